@@ -1,8 +1,18 @@
 include(CheckFunctionExists)
+include(CheckIncludeFile)
+include(CheckLibraryExists)
 
 set(PACKAGE ${PACKAGE_NAME})
 set(VERSION ${PACKAGE_VERSION})
 
 check_function_exists(ppoll HAVE_PPOLL)
 check_function_exists(pselect HAVE_PSELECT)
+check_function_exists(mlockall HAVE_MLOCKALL)
+check_function_exists(pthread_setaffinity_np HAVE_PTHREAD_SETAFFINITY_NP)
 check_function_exists(pthread_setname_np HAVE_PTHREAD_SETNAME_NP)
+check_include_file(linux/futex.h HAVE_LINUX_FUTEX_H)
+check_include_file(sys/epoll.h HAVE_SYS_EPOLL_H)
+check_include_file(zlib.h HAVE_ZLIB_H)
+if(HAVE_ZLIB_H)
+  check_library_exists(z deflateInit2_ "" HAVE_ZLIB)
+endif(HAVE_ZLIB_H)
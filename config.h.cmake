@@ -3,15 +3,30 @@
 /* Define for direct conversion from float to int (2 for swapped by order). */
 #undef HAVE_DIRECT_FLOAT_FORMAT
 
+/* Define to 1 if you have the <linux/futex.h> header file. */
+#cmakedefine HAVE_LINUX_FUTEX_H 1
+
+/* Define to 1 if mlockall() is available. */
+#cmakedefine HAVE_MLOCKALL 1
+
 /* Define to 1 if ppoll() is available. */
 #cmakedefine HAVE_PPOLL 1
 
 /* Define to 1 if pselect() is available. */
 #cmakedefine HAVE_PSELECT 1
 
+/* Define to 1 if pthread has pthread_setaffinity_np. */
+#cmakedefine HAVE_PTHREAD_SETAFFINITY_NP 1
+
 /* Define to 1 if pthread has pthread_setname_np. */
 #cmakedefine HAVE_PTHREAD_SETNAME_NP
 
+/* Define to 1 if you have the <sys/epoll.h> header file. */
+#cmakedefine HAVE_SYS_EPOLL_H 1
+
+/* Define to 1 if zlib is available for gzip encoding HTTP responses. */
+#cmakedefine HAVE_ZLIB 1
+
 /* Name of package */
 #cmakedefine PACKAGE "${PACKAGE_NAME}"
 
@@ -28,6 +28,7 @@
 #include <vector>
 #include <deque>
 #include <cstring>
+#include <algorithm>
 #include <time.h>
 #include <iomanip>
 #include <Address.h>
@@ -111,7 +112,7 @@ bool ScanRequest::notify(result_t result, SymbolString& slave)
 	unsigned char dstAddress = m_master[1];
 	if (result == RESULT_OK) {
 		if (m_message==m_messageMap->getScanMessage()) {
-			auto message = m_messageMap->getScanMessage(dstAddress);
+			auto message = m_busHandler->getDerivedScanMessage(m_messageMap.get(), dstAddress);
 			if (message!=NULL) {
 				m_message = message;
 				m_message->storeLastData(PartType::masterData, m_master, m_index); // expected to work since this is a clone
@@ -176,17 +177,161 @@ bool ActiveBusRequest::notify(result_t result, SymbolString& slave)
 }
 
 
+AnswerUpdater::~AnswerUpdater()
+{
+	stop();
+	join();
+}
+
+void AnswerUpdater::update(const shared_ptr<Message>& message)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool wasEmpty = m_pending.empty();
+	m_pending[message.get()] = message;
+	if (wasEmpty)
+		m_cond.notify_one();
+}
+
+void AnswerUpdater::updateAll()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pendingAll = true;
+	m_cond.notify_one();
+}
+
+void AnswerUpdater::reset()
+{
+	std::lock_guard<std::mutex> prepareLock(m_prepareMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending.clear();
+		m_pendingAll = false;
+	}
+	m_table.clear();
+}
+
+void AnswerUpdater::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cond.notify_one();
+	Thread::stop();
+}
+
+void AnswerUpdater::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stopping) {
+		if (m_pending.empty() && !m_pendingAll) {
+			m_cond.wait(lock);
+			continue;
+		}
+		// take all waiting messages and prepare them without blocking the bus thread
+		deque<shared_ptr<Message>> messages;
+		for (const auto& it : m_pending)
+			messages.push_back(it.second);
+		m_pending.clear();
+		bool all = m_pendingAll;
+		m_pendingAll = false;
+		lock.unlock();
+		{
+			std::lock_guard<std::mutex> prepareLock(m_prepareMutex);
+			auto messageMap = m_messages.get();
+			if (all) {
+				for (const auto& message : messageMap->findAll("", "", true, true, false, false)) {
+					if (message->getDstAddress() == m_ownSlaveAddress)
+						messages.push_back(message);
+				}
+				messages.push_back(messageMap->getScanMessage());
+			}
+			for (const auto& message : messages)
+				prepare(*messageMap, message);
+		}
+		lock.lock();
+	}
+}
+
+void AnswerUpdater::prepare(MessageMap& messages, const shared_ptr<Message>& message)
+{
+	shared_ptr<Message> read = message, write;
+	if (message->isWrite()) {
+		write = message;
+		read = messages.find(message->getCircuit(), message->getName(), false);
+		if (read == NULL || (read->getDstAddress() != m_ownSlaveAddress && read->getDstAddress() != SYN))
+			return;
+	} else {
+		write = messages.find(message->getCircuit(), message->getName(), true);
+	}
+	if (read->getCount() > 1)
+		return; // chained messages are not prepared
+	istringstream input;
+	if (read == messages.getScanMessage()) {
+		input.str(SCAN_ANSWER);
+	} else if (write != NULL && write->getLastUpdateTime() > 0) {
+		ostringstream output;
+		if (write->decodeLastData(PartType::masterData, output) == RESULT_OK)
+			input.str(output.str());
+	}
+	// encode without touching the message state, which is owned by the bus thread
+	SymbolString unescaped(false), slave; // escaped including the CRC
+	result_t result = read->encodeSlave(input, unescaped);
+	if (result == RESULT_OK)
+		slave.addAll(unescaped);
+	if (result == RESULT_OK && m_table.set(read->getId(), slave))
+		logDebug(lf_bus, "prepared answer for %s %s", read->getCircuit().c_str(), read->getName().c_str());
+	else
+		m_table.remove(read->getId());
+}
+
 void BusHandler::clear()
 {
 	memset(m_seenAddresses, 0, sizeof(m_seenAddresses));
+	memset(m_scanRetries, 0, sizeof(m_scanRetries));
 	m_masterCount = 1;
 	m_scanResults.clear();
+	if (m_answerUpdater)
+		m_answerUpdater->reset();
 }
 
-result_t BusHandler::sendAndWait(SymbolString& master, SymbolString& slave)
+result_t BusHandler::sendAndWait(SymbolString& master, SymbolString& slave, const unsigned long long coalesceSince)
 {
 	result_t result = RESULT_ERR_NO_SIGNAL;
 	slave.clear();
+	shared_ptr<CoalescedRead> read;
+	string key;
+	if (coalesceSince > 0 && master.size() > 1 && master[1] != BROADCAST && !libebus::Address(master[1]).isMaster()) {
+		key = master.getDataStr(true, false);
+		std::unique_lock<std::mutex> lock(m_coalesceMutex);
+		m_coalesceReadCount++;
+		auto it = m_coalescedReads.find(key);
+		if (it != m_coalescedReads.end() && (it->second->m_pending
+			|| (it->second->m_result == RESULT_OK && it->second->m_doneTime >= coalesceSince))) {
+			read = it->second;
+			m_coalesceCond.wait(lock, [&read]() { return !read->m_pending; });
+			if (read->m_result == RESULT_OK) {
+				slave = read->m_slave;
+				m_coalescedCount++;
+				logInfo(lf_bus, "coalesced message: %s", key.c_str());
+				return RESULT_OK;
+			}
+			// the identical read failed, try on our own
+		}
+		if (m_coalescedReads.size() >= COALESCE_MAX_READS) {
+			// drop the oldest completed read
+			auto oldest = m_coalescedReads.end();
+			for (auto check = m_coalescedReads.begin(); check != m_coalescedReads.end(); check++) {
+				if (!check->second->m_pending && (oldest == m_coalescedReads.end()
+					|| check->second->m_doneTime < oldest->second->m_doneTime))
+					oldest = check;
+			}
+			if (oldest != m_coalescedReads.end())
+				m_coalescedReads.erase(oldest);
+		}
+		read = make_shared<CoalescedRead>();
+		m_coalescedReads[key] = read;
+	}
 	auto request = make_shared<ActiveBusRequest>(master, slave);
 	logInfo(lf_bus, "send message: %s", master.getDataStr().c_str());
 
@@ -196,9 +341,10 @@ result_t BusHandler::sendAndWait(SymbolString& master, SymbolString& slave)
 		result = success ? request->m_result : RESULT_ERR_TIMEOUT;
 
 		if (result == RESULT_OK) {
-			auto message = m_messages->find(master);
+			auto messages = m_messageMaps.get();
+			auto message = messages->find(master);
 			if (message != NULL)
-				m_messages->invalidateCache(message);
+				messages->invalidateCache(message);
 			break;
 		}
 		if (!success || result == RESULT_ERR_NO_SIGNAL || result == RESULT_ERR_SEND || result == RESULT_ERR_DEVICE) {
@@ -208,8 +354,20 @@ result_t BusHandler::sendAndWait(SymbolString& master, SymbolString& slave)
 		logError(lf_bus, "send to %2.2x: %s%s", master[1], getResultCode(result), sendRetries>0 ? ", retry" : "");
 
 		request->m_busLostRetries = 0;
+		request->m_queueTime = clockGetMicros();
 	}
 
+	if (read) {
+		{
+			std::lock_guard<std::mutex> lock(m_coalesceMutex);
+			read->m_pending = false;
+			read->m_doneTime = clockGetMicros();
+			read->m_result = result;
+			if (result == RESULT_OK)
+				read->m_slave = slave;
+		}
+		m_coalesceCond.notify_all();
+	}
 	return result;
 }
 
@@ -218,6 +376,10 @@ void BusHandler::run()
 	unsigned int symCount = 0;
 	time_t lastTime;
 	time(&lastTime);
+	if (m_answerUpdater) {
+		m_answerUpdater->start("answer");
+		m_answerUpdater->updateAll();
+	}
 	do {
 		if (m_device->isValid()) {
 			result_t result = handleSymbol();
@@ -227,6 +389,8 @@ void BusHandler::run()
 			time(&now);
 			if (now > lastTime) {
 				m_symPerSec = symCount / (unsigned int)(now-lastTime);
+				m_busLoad = m_dataSymCount * SYMBOL_DURATION / 10000 / (unsigned int)(now-lastTime);
+				m_dataSymCount = 0;
 				if (m_symPerSec > m_maxSymPerSec) {
 					m_maxSymPerSec = m_symPerSec;
 					if (m_maxSymPerSec > 100)
@@ -249,6 +413,25 @@ void BusHandler::run()
 			symCount = 0;
 		}
 	} while (isRunning());
+	if (m_answerUpdater) {
+		m_answerUpdater->stop();
+		m_answerUpdater->join();
+	}
+}
+
+void BusHandler::refreshMessages()
+{
+	shared_ptr<MessageMap> previous = m_messages;
+	unsigned int generation = m_messagesGeneration.load(std::memory_order_relaxed);
+	if (!m_messageMaps.refresh(m_messages, generation))
+		return;
+	// the scan state and the prepared answers refer to the previous generation
+	clear();
+	size_t count = m_messages->takeLastData(*previous);
+	logNotice(lf_bus, "switched to configuration generation %d, took over data of %d messages", generation, count);
+	m_messagesGeneration.store(generation, std::memory_order_release);
+	if (m_answerUpdater)
+		m_answerUpdater->updateAll();
 }
 
 result_t BusHandler::handleSymbol()
@@ -258,6 +441,9 @@ result_t BusHandler::handleSymbol()
 	bool sending = false;
 	shared_ptr<BusRequest> startRequest;
 
+	if (m_state == BusState::ready || m_state == BusState::noSignal)
+		refreshMessages(); // only between telegrams
+
 	// check if another symbol has to be sent and determine timeout for receive
 	switch (m_state)
 	{
@@ -274,11 +460,11 @@ result_t BusHandler::handleSymbol()
 			setState(BusState::ready, RESULT_ERR_TIMEOUT); // just to be sure an old BusRequest is cleaned up
 		if (m_remainLockCount == 0 && m_currentRequest == NULL) {
 			startRequest = m_nextRequests.peek();
-			if (startRequest == NULL && m_pollInterval > 0) { // check for poll/scan
+			if (startRequest == NULL && m_pollInterval > 0) { // check for poll
 				time_t now;
 				time(&now);
-				if (m_lastPoll == 0 || difftime(now, m_lastPoll) > m_pollInterval) {
-					auto message = m_messages->getNextPoll();
+				if (m_busLoad <= POLL_MAX_BUS_LOAD && (m_lastPoll == 0 || difftime(now, m_lastPoll) > m_pollInterval)) {
+					auto message = m_messages->getNextPoll(now);
 					if (message != NULL) {
 						m_lastPoll = now;
 						auto request = make_shared<PollRequest>(message);
@@ -293,6 +479,22 @@ result_t BusHandler::handleSymbol()
 					}
 				}
 			}
+			if (startRequest == NULL && m_busLoad <= POLL_MAX_BUS_LOAD) { // check for background refresh
+				auto message = m_messages->getNextRefresh();
+				if (message != NULL) {
+					auto request = make_shared<PollRequest>(message);
+					result_t ret = request->prepare(m_ownMasterAddress);
+					if (ret != RESULT_OK) {
+						logError(lf_bus, "prepare refresh message: %s", getResultCode(ret));
+					}
+					else {
+						startRequest = request;
+						m_nextRequests.push(request);
+					}
+				}
+			}
+			if (startRequest == NULL) // check for scan
+				startRequest = getNextIdleRequest();
 			if (startRequest != NULL) { // initiate arbitration
 				sendSymbol = m_ownMasterAddress.binAddr();
 				sending = true;
@@ -388,6 +590,7 @@ result_t BusHandler::handleSymbol()
 			else if (recvSymbol != SYN) {
 				logError(lf_bus, "received %2.2x instead of AUTO-SYN symbol", recvSymbol);
 			} else {
+				synReceived();
 				if (m_generateSynInterval != SYN_TIMEOUT) {
 					// received own AUTO-SYN symbol back again: act as AUTO-SYN generator now
 					m_generateSynInterval = SYN_TIMEOUT;
@@ -413,6 +616,10 @@ result_t BusHandler::handleSymbol()
 	}
 
 	m_lastReceive = now;
+	if (recvSymbol != SYN)
+		m_dataSymCount++;
+	else
+		synReceived();
 	if ((recvSymbol == SYN) && (m_state != BusState::sendSyn)) {
 		if (!sending && m_remainLockCount > 0 && m_command.size() != 1)
 			m_remainLockCount--;
@@ -441,11 +648,14 @@ result_t BusHandler::handleSymbol()
 			m_currentRequest = startRequest;
 			// check arbitration
 			if (recvSymbol == sendSymbol) { // arbitration successful
+				m_arbitrationWait.add(clockGetMicros()-m_currentRequest->m_queueTime);
+				m_requestRepeats = 0;
 				m_nextSendPos = 1;
 				m_repeat = false;
 				return setState(BusState::sendCmd, RESULT_OK);
 			}
 			// arbitration lost. if same priority class found, try again after next AUTO-SYN
+			m_arbitrationLostCount.fetch_add(1, std::memory_order_relaxed);
 			m_remainLockCount = libebus::Address(recvSymbol).isMaster() ? 2 : 1; // number of SYN to wait for before next send try
 			if ((recvSymbol & 0x0f) != (sendSymbol & 0x0f) && m_lockCount > m_remainLockCount)
 				// if different priority class found, try again after N AUTO-SYN symbols (at least next AUTO-SYN)
@@ -499,6 +709,10 @@ result_t BusHandler::handleSymbol()
 			if (!m_commandCrcValid)
 				return setState(BusState::skip, RESULT_ERR_ACK);
 
+			if (m_currentRequest != NULL && m_commandSentTime != 0) {
+				m_commandAckTime.add(clockGetMicros()-m_commandSentTime);
+				m_commandSentTime = 0;
+			}
 			if (m_currentRequest != NULL) {
 				if (libebus::Address(m_currentRequest->m_master[1]).isMaster()) {
 					return setState(BusState::sendSyn, RESULT_OK);
@@ -529,6 +743,8 @@ result_t BusHandler::handleSymbol()
 		return setState(BusState::skip, RESULT_ERR_ACK);
 
 	case BusState::recvRes:
+		if (m_currentRequest != NULL && m_response.size() == 0)
+			m_responseStartTime = clockGetMicros();
 		headerLen = 0;
 		crcPos = m_response.size() > headerLen ? headerLen + 1 + m_response[headerLen] : 0xff;
 		result = m_response.push_back(recvSymbol, true, m_response.size() < crcPos);
@@ -584,6 +800,7 @@ result_t BusHandler::handleSymbol()
 					return setState(BusState::sendSyn, RESULT_OK);
 
 				m_commandCrcValid = true;
+				m_commandSentTime = clockGetMicros();
 				return setState(BusState::recvCmdAck, RESULT_OK);
 			}
 			return RESULT_OK;
@@ -601,6 +818,10 @@ result_t BusHandler::handleSymbol()
 				}
 				return setState(BusState::sendSyn, RESULT_ERR_ACK);
 			}
+			if (m_responseStartTime != 0) {
+				m_responseTime.add(clockGetMicros()-m_responseStartTime);
+				m_responseStartTime = 0;
+			}
 			return setState(BusState::sendSyn, RESULT_OK);
 		}
 		return setState(BusState::skip, RESULT_ERR_INVALID_ARG);
@@ -623,7 +844,12 @@ result_t BusHandler::handleSymbol()
 
 			m_nextSendPos = 0;
 			m_repeat = false;
-			istringstream input; // TODO create input from database of internal variables
+			m_response.clear(true); // escape while sending response
+			if (m_answerTable.find(m_command, m_response)) {
+				m_answeredPreparedCount.fetch_add(1, std::memory_order_relaxed);
+				return setState(BusState::sendRes, RESULT_OK);
+			}
+			istringstream input;
 			auto message = m_messages->find(m_command);
 			if (message == NULL) {
 				message = m_messages->find(m_command, true);
@@ -637,10 +863,11 @@ result_t BusHandler::handleSymbol()
 			}
 
 			// build response and store in m_response for sending back to requesting master
-			m_response.clear(true); // escape while sending response
 			result = message->prepareSlave(input, m_response);
 			if (result != RESULT_OK)
 				return setState(BusState::skip, result);
+			m_answeredBuiltCount.fetch_add(1, std::memory_order_relaxed);
+			m_answerUpdater->update(message); // prepare the answer for the next request
 			return setState(BusState::sendRes, RESULT_OK);
 		}
 		return setState(BusState::skip, RESULT_ERR_INVALID_ARG);
@@ -671,7 +898,11 @@ result_t BusHandler::handleSymbol()
 
 result_t BusHandler::setState(BusState state, result_t result, bool firstRepetition)
 {
+	if (result == RESULT_ERR_CRC)
+		m_crcErrorCount.fetch_add(1, std::memory_order_relaxed);
 	if (m_currentRequest != NULL) {
+		if (firstRepetition)
+			m_requestRepeats++;
 		if (result == RESULT_ERR_BUS_LOST && m_currentRequest->m_busLostRetries < m_busLostRetries) {
 			logDebug(lf_bus, "%s during %s, retry", getResultCode(result), getStateCode(m_state));
 			m_currentRequest->m_busLostRetries++;
@@ -680,16 +911,25 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
 		}
 		else if (state == BusState::sendSyn || (result != RESULT_OK && !firstRepetition)) {
 			logDebug(lf_bus, "notify request: %s", getResultCode(result));
+			m_requestRetries.add(m_currentRequest->m_busLostRetries+m_requestRepeats);
+			m_requestRepeats = 0;
 			unsigned char dstAddress = m_currentRequest->m_master[1];
-			if (result == RESULT_OK)
+			if (result == RESULT_OK) {
 				addSeenAddress(dstAddress);
+				m_sentCount.fetch_add(1, std::memory_order_relaxed);
+				m_receivedCount.fetch_add(1, std::memory_order_relaxed);
+			}
 
 			bool restart = m_currentRequest->notify(
 				result == RESULT_ERR_SYN && (m_state == BusState::recvCmdAck || m_state == BusState::recvRes) ? RESULT_ERR_TIMEOUT : result, m_response
 			);
 			if (restart) {
 				m_currentRequest->m_busLostRetries = 0;
-				m_nextRequests.push(m_currentRequest);
+				m_currentRequest->m_queueTime = clockGetMicros();
+				if (m_currentRequest->m_idle)
+					m_idleRequests.push(m_currentRequest); // continue in the next idle slot
+				else
+					m_nextRequests.push(m_currentRequest);
 			}
 			else if (m_currentRequest->m_deleteOnFinish) {
 				m_currentRequest.reset();
@@ -701,6 +941,7 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
 	}
 
 	if (state ==BusState:: noSignal) { // notify all requests
+		m_lastSynTime = 0;
 		m_response.clear(false); // notify with empty response
 		while ((m_currentRequest = m_nextRequests.pop()) != NULL) {
 			bool restart = m_currentRequest->notify(RESULT_ERR_NO_SIGNAL, m_response);
@@ -731,6 +972,7 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
 	m_state = state;
 
 	if (state == BusState::ready || state == BusState::skip) {
+		m_commandSentTime = m_responseStartTime = 0;
 		m_command.clear();
 		m_commandCrcValid = false;
 		m_response.clear(false); // unescape while receiving response
@@ -741,11 +983,110 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
 	return result;
 }
 
+void BusHandler::synReceived()
+{
+	unsigned long long now = clockGetMicros();
+	if (m_lastSynTime != 0)
+		m_synInterval.add(now-m_lastSynTime);
+	m_lastSynTime = now;
+}
+
+void BusHandler::formatStats(ostringstream& output)
+{
+	output << "arbitration wait: ";
+	m_arbitrationWait.format(output, "us");
+	output << "\ncommand ACK time: ";
+	m_commandAckTime.format(output, "us");
+	output << "\nresponse time: ";
+	m_responseTime.format(output, "us");
+	output << "\nrequest retries: ";
+	m_requestRetries.format(output, "");
+	output << "\nSYN interval: ";
+	m_synInterval.format(output, "us");
+	std::lock_guard<std::mutex> lock(m_coalesceMutex);
+	output << "\ncoalesced reads: " << m_coalescedCount << " of " << m_coalesceReadCount;
+	if (m_coalesceReadCount > 0)
+		output << " (" << (m_coalescedCount * 100 / m_coalesceReadCount) << "%)";
+}
+
+void BusHandler::resetStats()
+{
+	m_arbitrationWait.reset();
+	m_commandAckTime.reset();
+	m_responseTime.reset();
+	m_requestRetries.reset();
+	m_synInterval.reset();
+	std::lock_guard<std::mutex> lock(m_coalesceMutex);
+	m_coalesceReadCount = m_coalescedCount = 0;
+}
+
+shared_ptr<BusRequest> BusHandler::getNextIdleRequest()
+{
+	if (m_busLoad > SCAN_MAX_BUS_LOAD)
+		return NULL;
+	shared_ptr<BusRequest> request = m_idleRequests.pop();
+	if (request == NULL && m_scanListener != NULL) {
+		unsigned char address = getNextAutoScanAddress();
+		auto scanMessage = m_messages->getScanMessage();
+		if (address == SYN || scanMessage == NULL)
+			return NULL;
+		auto scanRequest = make_shared<ScanRequest>(m_messages, deque<shared_ptr<Message>>{scanMessage},
+			deque<unsigned char>{address}, this);
+		result_t result = scanRequest->prepare(m_ownMasterAddress);
+		if (result < RESULT_OK) {
+			logError(lf_bus, "prepare scan %2.2x message: %s", address, getResultCode(result));
+			m_seenAddresses[address] |= SCAN_INIT;
+			m_scanRetries[address] = SCAN_MAX_RETRIES; // do not try again
+			return NULL;
+		}
+		m_runningScans++;
+		request = scanRequest;
+	}
+	if (request != NULL) {
+		request->m_queueTime = clockGetMicros();
+		m_nextRequests.push(request);
+	}
+	return request;
+}
+
+unsigned char BusHandler::getNextAutoScanAddress()
+{
+	unsigned char derived = SYN, retry = SYN;
+	for (unsigned char address = 1; address != 0; address++) { // 0 is known to be a master
+		if ((m_seenAddresses[address]&SCAN_DONE) != 0 || address == m_ownSlaveAddress.binAddr())
+			continue;
+		libebus::Address slaveAddr(address);
+		if (not slaveAddr.isValid(false) || slaveAddr.isMaster())
+			continue;
+		bool seen = (m_seenAddresses[address]&SEEN) != 0;
+		if (!seen) {
+			unsigned char master = slaveAddr.getMasterAddress().binAddr();
+			if (master == SYN || (m_seenAddresses[master]&SEEN) == 0)
+				continue;
+		}
+		if ((m_seenAddresses[address]&SCAN_INIT) != 0) {
+			if (retry == SYN && m_scanRetries[address] < SCAN_MAX_RETRIES)
+				retry = address; // unanswered before
+		} else if (seen) {
+			return address; // seen on the bus itself
+		} else if (derived == SYN) {
+			derived = address; // only the corresponding master was seen
+		}
+	}
+	if (derived == SYN && retry != SYN) {
+		m_scanRetries[retry]++;
+		return retry;
+	}
+	return derived;
+}
+
 void BusHandler::addSeenAddress(libebus::Address address)
 {
 	if (not address.isValid(false))
 		return;
 	if (not address.isMaster()) {
+		if ((m_seenAddresses[address.binAddr()]&(SEEN|SCAN_INIT|SCAN_DONE)) == SCAN_INIT)
+			m_seenAddresses[address.binAddr()] &= (unsigned char)~SCAN_INIT; // scan again after an unanswered one
 		m_seenAddresses[address.binAddr()] |= SEEN;
 		address = address.getMasterAddress().binAddr();
 		if (address==SYN)
@@ -762,6 +1103,51 @@ void BusHandler::addSeenAddress(libebus::Address address)
 	}
 }
 
+/**
+ * Helper class for formatting the hex string of a @a SymbolString only when needed and only once.
+ */
+class LazyDataStr
+{
+public:
+	/**
+	 * Construct a new instance.
+	 * @param str the @a SymbolString to format.
+	 */
+	LazyDataStr(const SymbolString& str) : m_str(str) {}
+
+	/**
+	 * Get the hex string, formatting it on first use.
+	 * @return the null terminated hex string (see @a SymbolString::getDataStr()).
+	 */
+	const char* c_str()
+	{
+		if (!m_formatted) {
+			m_length = m_str.getDataStr(m_buffer, sizeof(m_buffer));
+			m_formatted = true;
+		}
+		return m_buffer;
+	}
+
+	/**
+	 * Get the length of the hex string, formatting it on first use.
+	 * @return the length of the hex string.
+	 */
+	size_t length() { c_str(); return m_length; }
+
+private:
+	/** the @a SymbolString to format. */
+	const SymbolString& m_str;
+
+	/** whether @a m_buffer was already formatted. */
+	bool m_formatted = false;
+
+	/** the length of the formatted hex string in @a m_buffer. */
+	size_t m_length = 0;
+
+	/** the buffer for the formatted hex string. */
+	char m_buffer[MAX_DATA_STR_SIZE];
+};
+
 void BusHandler::receiveCompleted()
 {
 	libebus::Address srcAddress = m_command[0];
@@ -774,24 +1160,25 @@ void BusHandler::receiveCompleted()
 
 	addSeenAddress(srcAddress.binAddr());
 	addSeenAddress(dstAddress.binAddr());
+	m_receivedCount.fetch_add(1, std::memory_order_relaxed);
 
+	// the hex strings are formatted at most once and only if needed for logging or grabbing
+	LazyDataStr command(m_command), response(m_response);
 	bool master = dstAddress.isMaster();
 	if (dstAddress == BROADCAST)
-		logInfo(lf_update, "update BC cmd: %s", m_command.getDataStr().c_str());
+		logInfo(lf_update, "update BC cmd: %s", command.c_str());
 	else if (master)
-		logInfo(lf_update, "update MM cmd: %s", m_command.getDataStr().c_str());
+		logInfo(lf_update, "update MM cmd: %s", command.c_str());
 	else
-		logInfo(lf_update, "update MS cmd: %s / %s", m_command.getDataStr().c_str(), m_response.getDataStr().c_str());
+		logInfo(lf_update, "update MS cmd: %s / %s", command.c_str(), response.c_str());
 
 	auto message = m_messages->find(m_command);
 	if (m_grabUnknownMessages==GrabRequest::all || (message==NULL && m_grabUnknownMessages==GrabRequest::unknown)) {
-		string data;
-		string key = data = m_command.getDataStr();
-		if (key.length() > 2*(1+1+2+1+4)) {
-			key = key.substr(0, 2*(1+1+2+1+4)); // QQZZPBSBNN + up to 4 DD bytes
-		}
+		string key(command.c_str(), std::min(command.length(), (size_t)2*(1+1+2+1+4))); // QQZZPBSBNN + up to 4 DD bytes
+		string data(command.c_str(), command.length());
 		if (dstAddress != BROADCAST && !master) {
-			data += " / " + m_response.getDataStr();
+			data += " / ";
+			data += response.c_str();
 		}
 		if (message) {
 			data += " = "+message->getCircuit()+" "+message->getName();
@@ -799,27 +1186,36 @@ void BusHandler::receiveCompleted()
 		m_grabbedUnknownMessages[key] = data;
 	}
 	if (message == NULL) {
+		m_unknownCount.fetch_add(1, std::memory_order_relaxed);
 		if (dstAddress == BROADCAST)
-			logNotice(lf_update, "unknown BC cmd: %s", m_command.getDataStr().c_str());
+			logNotice(lf_update, "unknown BC cmd: %s", command.c_str());
 		else if (master)
-			logNotice(lf_update, "unknown MM cmd: %s", m_command.getDataStr().c_str());
+			logNotice(lf_update, "unknown MM cmd: %s", command.c_str());
 		else
-			logNotice(lf_update, "unknown MS cmd: %s / %s", m_command.getDataStr().c_str(), m_response.getDataStr().c_str());
+			logNotice(lf_update, "unknown MS cmd: %s / %s", command.c_str(), response.c_str());
 	}
 	else {
 		m_messages->invalidateCache(message);
+		unsigned long long cursor = m_updateListener ? m_messages->getChangeJournal().getCursor() : 0;
+		result_t result = message->storeLastData(m_command, m_response);
+		if (m_updateListener && result == RESULT_OK && m_messages->getChangeJournal().getCursor() != cursor)
+			m_updateListener->notifyUpdate(message); // the data was changed
+		if (m_answerUpdater && result == RESULT_OK && message->isWrite()
+			&& dstAddress == (master ? m_ownMasterAddress : m_ownSlaveAddress))
+			m_answerUpdater->update(message); // internal value written: prepare the answer of the matching read message
+		if (!needsLog(lf_update, ll_error))
+			return; // decoding is only needed for logging
 		string circuit = message->getCircuit();
 		string name = message->getName();
-		result_t result = message->storeLastData(m_command, m_response);
 		ostringstream output;
 		if (result==RESULT_OK)
 			result = message->decodeLastData(output);
 		if (result < RESULT_OK)
-			logError(lf_update, "unable to parse %s %s from %s / %s: %s", circuit.c_str(), name.c_str(), m_command.getDataStr().c_str(), m_response.getDataStr().c_str(), getResultCode(result));
-		else {
+			logError(lf_update, "unable to parse %s %s from %s / %s: %s", circuit.c_str(), name.c_str(), command.c_str(), response.c_str(), getResultCode(result));
+		else if (needsLog(lf_update, ll_notice)) {
 			string data = output.str();
 			if (m_answer && dstAddress == (master ? m_ownMasterAddress : m_ownSlaveAddress)) {
-				logNotice(lf_update, "self-update %s %s QQ=%2.2x: %s", circuit.c_str(), name.c_str(), srcAddress, data.c_str()); // TODO store in database of internal variables
+				logNotice(lf_update, "self-update %s %s QQ=%2.2x: %s", circuit.c_str(), name.c_str(), srcAddress, data.c_str());
 			}
 			else if (message->getDstAddress() == SYN) { // any destination
 				if (message->getSrcAddress() == SYN) // any destination and any source
@@ -837,14 +1233,15 @@ void BusHandler::receiveCompleted()
 
 result_t BusHandler::startScan(bool full)
 {
-	auto messages = m_messages->findAll("scan", "");
+	auto messageMap = m_messageMaps.get();
+	auto messages = messageMap->findAll("scan", "");
 	for (auto it = messages.begin(); it < messages.end(); it++) {
 		auto message = *it;
 		if (message->getPrimaryCommand() == 0x07 && message->getSecondaryCommand() == 0x04)
 			messages.erase(it--); // query pb 0x07 / sb 0x04 only once
 	}
 
-	auto scanMessage = m_messages->getScanMessage();
+	auto scanMessage = messageMap->getScanMessage();
 	if (scanMessage==NULL)
 		return RESULT_ERR_NOTFOUND;
 
@@ -863,13 +1260,13 @@ result_t BusHandler::startScan(bool full)
 		slaves.push_back(slaveAddr.binAddr());
 	}
 	messages.push_front(scanMessage);
-	auto request = make_shared<ScanRequest>(m_messages, messages, slaves, this);
+	auto request = make_shared<ScanRequest>(messageMap, messages, slaves, this);
 	result_t result = request->prepare(m_ownMasterAddress);
 	if (result < RESULT_OK) {
 		return result==RESULT_ERR_EOF ? RESULT_EMPTY : result;
 	}
 	m_runningScans++;
-	m_nextRequests.push(request);
+	m_idleRequests.push(request);
 	return RESULT_OK;
 }
 
@@ -880,6 +1277,8 @@ void BusHandler::setScanResult(unsigned char dstAddress, string str)
 		m_seenAddresses[dstAddress] |= SCAN_DONE;
 		m_scanResults[dstAddress] = str;
 		logNotice(lf_bus, "scan %2.2x: %s", dstAddress, str.c_str());
+		if (m_scanListener != NULL && (m_seenAddresses[dstAddress]&LOAD_INIT) == 0)
+			m_scanListener->notifyScanned(dstAddress);
 	}
 }
 
@@ -889,8 +1288,44 @@ void BusHandler::setScanFinished()
 		m_runningScans--;
 }
 
+shared_ptr<Message> BusHandler::getDerivedScanMessage(MessageMap* messages, unsigned char dstAddress)
+{
+	auto message = messages->getScanMessage(dstAddress, false);
+	if (message!=NULL)
+		return message;
+	libebus::Address address(dstAddress);
+	if (!address.isValid(false) || address.isMaster())
+		return NULL;
+	std::lock_guard<std::mutex> lock(m_derivedScanMutex);
+	auto it = m_derivedScanMessages.find(dstAddress);
+	if (it != m_derivedScanMessages.end())
+		return it->second;
+	message = messages->getScanMessage()->derive(dstAddress, true);
+	m_derivedScanMessages[dstAddress] = message;
+	return message;
+}
+
+void BusHandler::adoptScanMessages(MessageMap* messages)
+{
+	map<unsigned char, shared_ptr<Message>> derived;
+	{
+		std::lock_guard<std::mutex> lock(m_derivedScanMutex);
+		if (m_derivedScanMessages.empty())
+			return;
+		derived.swap(m_derivedScanMessages);
+	}
+	for (const auto& it : derived) {
+		if (messages->getScanMessage(it.first, false) != NULL)
+			continue; // derived meanwhile by a writer
+		result_t result = messages->add(it.second);
+		if (result != RESULT_OK)
+			logError(lf_bus, "add scan %2.2x message: %s", it.first, getResultCode(result));
+	}
+}
+
 void BusHandler::formatScanResult(ostringstream& output)
 {
+	auto messages = m_messageMaps.get();
 	if (m_runningScans>0) {
 		output << static_cast<unsigned>(m_runningScans) << " scan(s) still running" << endl;
 	}
@@ -910,7 +1345,7 @@ void BusHandler::formatScanResult(ostringstream& output)
 		for (unsigned char slave = 1; slave != 0; slave++) { // 0 is known to be a master
 			libebus::Address slaveAddr(slave);
 			if (slaveAddr.isValid(false) && not slaveAddr.isMaster() && (m_seenAddresses[slave]&SCAN_DONE)!=0) {
-				auto message = m_messages->getScanMessage(slave);
+				auto message = messages->getScanMessage(slave, false);
 				if (message!=NULL && message->getLastUpdateTime()>0) {
 					if (first)
 						first = false;
@@ -926,6 +1361,7 @@ void BusHandler::formatScanResult(ostringstream& output)
 
 void BusHandler::formatSeenInfo(ostringstream& output)
 {
+	auto messages = m_messageMaps.get();
 	unsigned char rawAddress = 0;
 
 	for (int index=0; index<256; index++, rawAddress++) {
@@ -954,7 +1390,7 @@ void BusHandler::formatSeenInfo(ostringstream& output)
 			}
 			if ((m_seenAddresses[address.binAddr()]&SCAN_DONE)!=0) {
 				output << ", scanned";
-				auto message = m_messages->getScanMessage(address);
+				auto message = messages->getScanMessage(address, false);
 				if (message!=NULL && message->getLastUpdateTime()>0) {
 					// add detailed scan info: Manufacturer ID SW HW
 					output << " \"";
@@ -965,7 +1401,7 @@ void BusHandler::formatSeenInfo(ostringstream& output)
 						output << "\"";
 				}
 			}
-			string loadedFiles = m_messages->getLoadedFiles(address);
+			string loadedFiles = messages->getLoadedFiles(address);
 			if (!loadedFiles.empty())
 				output << ", loaded " << loadedFiles;
 		}
@@ -974,10 +1410,11 @@ void BusHandler::formatSeenInfo(ostringstream& output)
 
 result_t BusHandler::scanAndWait(const libebus::Address& dstAddress, SymbolString& slave)
 {
+	auto messages = m_messageMaps.get();
 	if (not dstAddress.isValid(false) || dstAddress.isMaster())
 		return RESULT_ERR_INVALID_ADDR;
 	m_seenAddresses[dstAddress.binAddr()] |= SCAN_INIT;
-	auto scanMessage = m_messages->getScanMessage();
+	auto scanMessage = messages->getScanMessage();
 	if (scanMessage==NULL) {
 		return RESULT_ERR_NOTFOUND;
 	}
@@ -987,7 +1424,7 @@ result_t BusHandler::scanAndWait(const libebus::Address& dstAddress, SymbolStrin
 	if (result==RESULT_OK) {
 		result = sendAndWait(master, slave);
 		if (result==RESULT_OK) {
-			auto message = m_messages->getScanMessage(dstAddress.binAddr());
+			auto message = messages->getScanMessage(dstAddress.binAddr());
 			if (message!=NULL && message!=scanMessage) {
 				scanMessage = message;
 				scanMessage->storeLastData(PartType::masterData, master, 0); // update the cache, expected to work since this is a clone
@@ -999,7 +1436,10 @@ result_t BusHandler::scanAndWait(const libebus::Address& dstAddress, SymbolStrin
 	if (result!=RESULT_OK)
 		return result;
 
-	return scanMessage->storeLastData(PartType::slaveData, slave, 0); // update the cache
+	result = scanMessage->storeLastData(PartType::slaveData, slave, 0); // update the cache
+	if (result==RESULT_OK && m_scanListener != NULL && (m_seenAddresses[dstAddress.binAddr()]&LOAD_INIT) == 0)
+		m_scanListener->notifyScanned(dstAddress.binAddr());
+	return result;
 }
 
 bool BusHandler::enableGrab(bool enable, bool all)
@@ -1029,31 +1469,11 @@ void BusHandler::formatGrabResult(ostringstream& output)
 	}
 }
 
-unsigned char BusHandler::getNextScanAddress(unsigned char lastAddress, bool& scanned) {
-	libebus::Address ebusAddr(lastAddress);
-
-	if (lastAddress==SYN)
-		return SYN;
-	while (++lastAddress!=0) { // 0 is known to be a master
-		if (not ebusAddr.isValid(false) || ebusAddr.isMaster())
-			continue;
-		if ((m_seenAddresses[lastAddress]&(SEEN|LOAD_INIT))==SEEN) {
-			scanned = (m_seenAddresses[lastAddress]&SCAN_INIT)!=0;
-			return lastAddress;
-		}
-		unsigned char master = ebusAddr.getMasterAddress().binAddr();
-		if (master!=SYN && (m_seenAddresses[master]&SEEN)!=0 && (m_seenAddresses[lastAddress]&LOAD_INIT)==0) {
-			scanned = (m_seenAddresses[lastAddress]&SCAN_INIT)!=0;
-			return lastAddress;
-		}
-	}
-	return SYN;
-}
-
 void BusHandler::setScanConfigLoaded(unsigned char address, string file) {
+	auto messages = m_messageMaps.get();
 	m_seenAddresses[address] |= LOAD_INIT;
 	if (!file.empty()) {
 		m_seenAddresses[address] |= LOAD_DONE;
-		m_messages->addLoadedFile(address, file);
+		messages->addLoadedFile(address, file);
 	}
 }
@@ -20,15 +20,23 @@
 #define BUSHANDLER_H_
 
 #include "message.h"
+#include "answertable.h"
 #include "data.h"
 #include "symbol.h"
 #include "result.h"
 #include "device.h"
 #include "queue.h"
 #include "thread.h"
+#include "clock.h"
+#include "histogram.h"
 #include <string>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <pthread.h>
 #include <Address.h>
 
@@ -56,6 +64,18 @@
 /** the maximum allowed time [us] for retrieving back a sent symbol (2x symbol duration). */
 #define SEND_TIMEOUT (2*SYMBOL_DURATION)
 
+/** the maximum bus load [%] of the last second at which a poll message may still be sent. */
+#define POLL_MAX_BUS_LOAD 50
+
+/** the maximum bus load [%] of the last second at which a scan message may still be sent in an idle bus slot. */
+#define SCAN_MAX_BUS_LOAD 30
+
+/** the number of times the automatic scan of an unanswered slave address is repeated after all others were scanned. */
+#define SCAN_MAX_RETRIES 2
+
+/** the maximum number of completed reads kept for attaching identical requests to. */
+#define COALESCE_MAX_READS 16
+
 /** the possible bus states. */
 enum class BusState {
 	noSignal,	//!< no signal on the bus
@@ -111,7 +131,7 @@ public:
 	 */
 	BusRequest(SymbolString& master, const bool deleteOnFinish)
 		: m_master(master), m_busLostRetries(0),
-		  m_deleteOnFinish(deleteOnFinish) {}
+		  m_deleteOnFinish(deleteOnFinish), m_idle(false), m_queueTime(clockGetMicros()) {}
 
 	/**
 	 * Destructor.
@@ -137,6 +157,12 @@ protected:
 	/** whether to automatically delete this @a BusRequest when finished. */
 	const bool m_deleteOnFinish;
 
+	/** whether to send this @a BusRequest only in idle bus slots (i.e. when no other request is waiting). */
+	bool m_idle;
+
+	/** the monotonic time in microseconds when the request was queued for sending. */
+	unsigned long long m_queueTime;
+
 };
 
 
@@ -194,16 +220,17 @@ public:
 
 	/**
 	 * Constructor.
-	 * @param messageMap the @a MessageMap instance.
+	 * @param messageMap the @a MessageMap generation.
 	 * @param messages the @a Message instances to query starting with the primary one.
 	 * @param slaves the slave addresses to scan.
 	 * @param busHandler the @a BusHandler instance to notify of final scan result.
 	 */
-	ScanRequest(MessageMap* messageMap, deque<shared_ptr<Message>> messages, deque<unsigned char> slaves, BusHandler* busHandler)
+	ScanRequest(shared_ptr<MessageMap> messageMap, deque<shared_ptr<Message>> messages, deque<unsigned char> slaves, BusHandler* busHandler)
 		: BusRequest(m_master, true), m_messageMap(messageMap), m_index(0), m_allMessages(messages), m_messages(messages), m_slaves(slaves), m_busHandler(busHandler)
 	{
 		m_message = m_messages.front();
 		m_messages.pop_front();
+		m_idle = true;
 	}
 
 	/**
@@ -223,8 +250,8 @@ public:
 
 private:
 
-	/** the @a MessageMap instance. */
-	MessageMap* m_messageMap;
+	/** the @a MessageMap generation. */
+	shared_ptr<MessageMap> m_messageMap;
 
 	/** the escaped master data @a SymbolString. */
 	SymbolString m_master;
@@ -288,6 +315,165 @@ private:
 };
 
 
+/**
+ * Interface for getting informed about messages changed by data received from the bus.
+ */
+class UpdateListener
+{
+public:
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~UpdateListener() {}
+
+	/**
+	 * Called from the @a BusHandler thread when a @a Message was changed by received data.
+	 * @param message the changed @a Message.
+	 */
+	virtual void notifyUpdate(const shared_ptr<Message>& message) = 0;
+
+};
+
+
+/**
+ * Interface for getting informed about completed scans of slave addresses.
+ */
+class ScanListener
+{
+public:
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~ScanListener() {}
+
+	/**
+	 * Called when the scan message of a slave address was answered and the configuration for it is not loaded yet.
+	 * @param address the scanned slave address.
+	 */
+	virtual void notifyScanned(unsigned char address) = 0;
+
+};
+
+
+/**
+ * Prepares the answers to requests for the own slave address in an @a AnswerTable from a dedicated thread.
+ *
+ * The answer of a read message is prepared from the data last written to the
+ * write message with the same circuit and name, so that the @a BusHandler
+ * thread only has to look up the answer when a request is received.
+ */
+class AnswerUpdater : public Thread
+{
+public:
+
+	/**
+	 * Construct a new instance.
+	 * @param messages the @a MessageMapHolder with the current generation of all known @a Message instances.
+	 * @param ownSlaveAddress the own slave address.
+	 * @param table the @a AnswerTable to fill.
+	 */
+	AnswerUpdater(MessageMapHolder& messages, const libebus::Address ownSlaveAddress, AnswerTable& table)
+		: m_messages(messages), m_ownSlaveAddress(ownSlaveAddress), m_table(table) {}
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~AnswerUpdater();
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	AnswerUpdater(const AnswerUpdater& src);
+
+public:
+
+	/**
+	 * Prepare the answer for a read message, or for the read message matching a written message.
+	 * @param message the read @a Message, or the write @a Message that received new data.
+	 */
+	void update(const shared_ptr<Message>& message);
+
+	/**
+	 * Prepare the answers for all read messages of the own slave address.
+	 */
+	void updateAll();
+
+	/**
+	 * Remove all prepared and waiting answers (e.g. before reloading the configuration).
+	 */
+	void reset();
+
+	// @copydoc
+	void stop() override;
+
+protected:
+
+	// @copydoc
+	void run() override;
+
+private:
+
+	/**
+	 * Prepare the answer for a single @a Message and store it in the @a AnswerTable.
+	 * @param messages the @a MessageMap generation to look up the corresponding @a Message in.
+	 * @param message the read @a Message, or the write @a Message that received new data.
+	 */
+	void prepare(MessageMap& messages, const shared_ptr<Message>& message);
+
+	/** the @a MessageMapHolder with the current generation of all known @a Message instances. */
+	MessageMapHolder& m_messages;
+
+	/** the own slave address. */
+	const libebus::Address m_ownSlaveAddress;
+
+	/** the @a AnswerTable to fill. */
+	AnswerTable& m_table;
+
+	/** the mutex for preparing answers and resetting the table. */
+	std::mutex m_prepareMutex;
+
+	/** the mutex for @a m_pending, @a m_pendingAll, and @a m_stopping. */
+	std::mutex m_mutex;
+
+	/** the condition for waking up the thread. */
+	std::condition_variable m_cond;
+
+	/** the messages waiting for having their answer prepared by @a Message pointer. */
+	unordered_map<Message*, shared_ptr<Message>> m_pending;
+
+	/** whether the answers for all read messages of the own slave address shall be prepared. */
+	bool m_pendingAll = false;
+
+	/** whether the thread shall stop. */
+	bool m_stopping = false;
+
+};
+
+
+/**
+ * A read of a master telegram that identical requests received before its completion attach to.
+ */
+struct CoalescedRead
+{
+	/** whether the read is still queued or in flight. */
+	bool m_pending = true;
+
+	/** the monotonic time in microseconds when the read was completed. */
+	unsigned long long m_doneTime = 0;
+
+	/** the result of the read. */
+	result_t m_result = RESULT_ERR_NO_SIGNAL;
+
+	/** the received slave data. */
+	SymbolString m_slave{false};
+};
+
+
 /**
  * Handles input from and output to the bus with respect to the eBUS protocol.
  */
@@ -298,7 +484,7 @@ public:
 	/**
 	 * Construct a new instance.
 	 * @param device the @a Device instance for accessing the bus.
-	 * @param messages the @a MessageMap instance with all known @a Message instances.
+	 * @param messages the @a MessageMapHolder with the current generation of all known @a Message instances.
 	 * @param ownAddress the own master address.
 	 * @param answer whether to answer queries for the own master/slave address.
 	 * @param busLostRetries the number of times a send is repeated due to lost arbitration.
@@ -308,15 +494,16 @@ public:
 	 * @param slaveRecvTimeout the maximum time in microseconds an addressed slave is expected to acknowledge.
 	 * @param lockCount the number of AUTO-SYN symbols before sending is allowed after lost arbitration, or 0 for auto detection.
 	 * @param generateSyn whether to enable AUTO-SYN symbol generation.
-	 * @param pollInterval the interval in seconds in which poll messages are cycled, or 0 if disabled.
+	 * @param pollInterval the minimum interval in seconds between two polls, or 0 if disabled.
 	 */
-	BusHandler(Device* device, MessageMap* messages,
+	BusHandler(Device* device, MessageMapHolder& messages,
 			const libebus::Address ownAddress, const bool answer,
 			const unsigned int busLostRetries, const unsigned int failedSendRetries,
 			const unsigned int transferLatency, const unsigned int busAcquireTimeout, const unsigned int slaveRecvTimeout,
 			const unsigned int lockCount, const bool generateSyn,
 			const unsigned int pollInterval)
-		: m_device(device), m_messages(messages),
+		: m_device(device), m_messageMaps(messages), m_messages(messages.get()),
+		  m_messagesGeneration(messages.getGeneration()),
 		  m_ownMasterAddress(ownAddress), m_ownSlaveAddress(ownAddress.binAddr()+5), m_answer(answer),
 		  m_busLostRetries(busLostRetries), m_failedSendRetries(failedSendRetries),
 		  m_transferLatency(transferLatency), m_busAcquireTimeout(busAcquireTimeout), m_slaveRecvTimeout(slaveRecvTimeout),
@@ -325,6 +512,9 @@ public:
 		  m_pollInterval(pollInterval), m_command(false), m_response(false)
     {
 		memset(m_seenAddresses, 0, sizeof(m_seenAddresses));
+		memset(m_scanRetries, 0, sizeof(m_scanRetries));
+		if (answer)
+			m_answerUpdater = std::make_unique<AnswerUpdater>(messages, m_ownSlaveAddress, m_answerTable);
 	}
 
 	/**
@@ -335,7 +525,8 @@ public:
 	}
 
 	/**
-	 * Clear stored values (e.g. scan results).
+	 * Clear stored values (e.g. scan results and prepared answers).
+	 * Note: this is done by the bus thread when switching to a new @a MessageMap generation.
 	 */
 	void clear();
 
@@ -343,9 +534,12 @@ public:
 	 * Send a message on the bus and wait for the answer.
 	 * @param master the escaped @a SymbolString with the master data to send.
 	 * @param slave the @a SymbolString that will be filled with retrieved slave data.
+	 * @param coalesceSince the monotonic time in microseconds when the caller received the request, or 0.
+	 * When non-zero and the identical master data to a slave is already queued or in flight, or was successfully
+	 * read after this time, the slave data of that read is returned instead of sending the message again.
 	 * @return the result code.
 	 */
-	result_t sendAndWait(SymbolString& master, SymbolString& slave);
+	result_t sendAndWait(SymbolString& master, SymbolString& slave, const unsigned long long coalesceSince=0);
 
 	/**
 	 * Main thread entry.
@@ -371,6 +565,23 @@ public:
 	 */
 	void setScanFinished();
 
+	/**
+	 * Get the scan @a Message for a slave address from the bus thread without changing the @a MessageMap.
+	 * A scan @a Message not yet available in the @a MessageMap is derived and kept until it is added by
+	 * @a adoptScanMessages().
+	 * @param messages the @a MessageMap in use by the bus thread.
+	 * @param dstAddress the scanned slave address.
+	 * @return the scan @a Message for the address, or NULL if the address is no slave.
+	 */
+	shared_ptr<Message> getDerivedScanMessage(MessageMap* messages, unsigned char dstAddress);
+
+	/**
+	 * Add the scan @a Message instances derived by the bus thread to the @a MessageMap.
+	 * The caller has to hold the lock for exclusive write access to the @a MessageMap.
+	 * @param messages the current @a MessageMap generation.
+	 */
+	void adoptScanMessages(MessageMap* messages);
+
 	/**
 	 * Format the scan result to the @a ostringstream.
 	 * @param output the @a ostringstream to format the scan result to.
@@ -423,6 +634,91 @@ public:
 	 */
 	unsigned int getMaxSymbolRate() { return m_maxSymPerSec; }
 
+	/**
+	 * Return the current bus load.
+	 * @return the percentage of the bus capacity used by symbols other than SYN in the last second.
+	 */
+	unsigned int getBusLoad() { return m_busLoad; }
+
+	/**
+	 * Return the number of telegrams received completely (including the own ones).
+	 * @return the number of telegrams received completely.
+	 */
+	unsigned long getReceivedCount() { return m_receivedCount.load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of own telegrams sent successfully.
+	 * @return the number of own telegrams sent successfully.
+	 */
+	unsigned long getSentCount() { return m_sentCount.load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of requests to the own slave address answered.
+	 * @param prepared true for the requests answered from the @a AnswerTable, false for the answers built on the fly.
+	 * @return the number of requests answered.
+	 */
+	unsigned long getAnsweredCount(const bool prepared) { return (prepared ? m_answeredPreparedCount : m_answeredBuiltCount).load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of received telegram parts with invalid CRC.
+	 * @return the number of received telegram parts with invalid CRC.
+	 */
+	unsigned long getCrcErrorCount() { return m_crcErrorCount.load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of lost arbitrations.
+	 * @return the number of lost arbitrations.
+	 */
+	unsigned long getArbitrationLostCount() { return m_arbitrationLostCount.load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of received telegrams without matching message definition.
+	 * @return the number of received telegrams without matching message definition.
+	 */
+	unsigned long getUnknownCount() { return m_unknownCount.load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of requests waiting to be sent.
+	 * @return the number of requests waiting to be sent.
+	 */
+	size_t getPendingRequestCount() { return m_nextRequests.size(); }
+
+	/**
+	 * Return the number of finished requests not yet collected.
+	 * @return the number of finished requests not yet collected.
+	 */
+	size_t getFinishedRequestCount() { return m_finishedRequests.size(); }
+
+	/**
+	 * Set the @a UpdateListener to inform about messages changed by received data (before starting the thread).
+	 * @param listener the @a UpdateListener, or NULL.
+	 */
+	void setUpdateListener(UpdateListener* listener) { m_updateListener = listener; }
+
+	/**
+	 * Set the @a ScanListener to inform about completed scans and enable scanning seen slaves automatically in idle
+	 * bus slots (before starting the thread).
+	 * @param listener the @a ScanListener, or NULL.
+	 */
+	void setScanListener(ScanListener* listener) { m_scanListener = listener; }
+
+	/**
+	 * Format the bus timing statistics to the @a ostringstream.
+	 * @param output the @a ostringstream to format the statistics to.
+	 */
+	void formatStats(ostringstream& output);
+
+	/**
+	 * Reset the bus timing statistics.
+	 */
+	void resetStats();
+
+	/**
+	 * Return the number of the @a MessageMap generation used by the bus thread.
+	 * @return the number of the @a MessageMap generation used by the bus thread.
+	 */
+	unsigned int getMessagesGeneration() { return m_messagesGeneration.load(std::memory_order_acquire); }
+
 	/**
 	 * Return the number of masters already seen.
 	 * @return the number of masters already seen (including ebusd itself).
@@ -430,12 +726,11 @@ public:
 	unsigned int getMasterCount() { return m_masterCount; }
 
 	/**
-	 * Get the next slave address that still needs to be scanned or loaded.
-	 * @param lastAddress the last returned slave address, or 0 for returning the first one.
-	 * @param scanned set to true when the slave is already scanned but not yet loaded, set to false when it still needs to be scanned and loaded.
-	 * @return the next slave address that still needs to be scanned or loaded, or @a SYN.
+	 * Return whether the slave address was scanned successfully and the configuration for it is not loaded yet.
+	 * @param address the slave address.
+	 * @return whether the configuration for the slave address still needs to be loaded.
 	 */
-	unsigned char getNextScanAddress(unsigned char lastAddress, bool& scanned);
+	bool isScanConfigPending(unsigned char address) { return (m_seenAddresses[address]&(SCAN_DONE|LOAD_INIT))==SCAN_DONE; }
 
 	/**
 	 * Set the state of the participant to configuration @a LOADED.
@@ -461,6 +756,24 @@ private:
 	 */
 	result_t setState(BusState state, result_t result, bool firstRepetition=false);
 
+	/**
+	 * Switch the bus thread to a newly published @a MessageMap generation (if any) and take over the last seen data.
+	 */
+	void refreshMessages();
+
+	/**
+	 * Get the next request to send in an idle bus slot and queue it for sending.
+	 * @return the queued @a BusRequest, or NULL if there is nothing to send (or the bus load is too high).
+	 */
+	shared_ptr<BusRequest> getNextIdleRequest();
+
+	/**
+	 * Get the next slave address to scan automatically.
+	 * @return the next slave address not yet scanned (preferring those seen on the bus over those of seen masters),
+	 * the next unanswered slave address to scan again, or @a SYN.
+	 */
+	unsigned char getNextAutoScanAddress();
+
 	/**
 	 * Add a seen bus address.
 	 * @param address the seen bus address.
@@ -472,11 +785,22 @@ private:
 	 */
 	void receiveCompleted();
 
+	/**
+	 * Called when a SYN symbol was received for updating the SYN interval statistics.
+	 */
+	void synReceived();
+
 	/** the @a Device instance for accessing the bus. */
 	Device* m_device;
 
-	/** the @a MessageMap instance with all known @a Message instances. */
-	MessageMap* m_messages;
+	/** the @a MessageMapHolder with the current generation of all known @a Message instances. */
+	MessageMapHolder& m_messageMaps;
+
+	/** the @a MessageMap generation used by the bus thread. */
+	shared_ptr<MessageMap> m_messages;
+
+	/** the number of the @a MessageMap generation in @a m_messages. */
+	std::atomic<unsigned int> m_messagesGeneration;
 
 	/** the own master address. */
 	const libebus::Address m_ownMasterAddress;
@@ -517,7 +841,7 @@ private:
 	/** the interval in microseconds after which to generate an AUTO-SYN symbol, or 0 if disabled. */
 	long m_generateSynInterval;
 
-	/** the interval in seconds in which poll messages are cycled, or 0 if disabled. */
+	/** the minimum interval in seconds between two polls, or 0 if disabled. */
 	const unsigned int m_pollInterval;
 
 	/** the time of the last received symbol, or 0 for never. */
@@ -532,6 +856,9 @@ private:
 	/** the currently handled BusRequest, or NULL. */
 	shared_ptr<BusRequest> m_currentRequest;
 
+	/** the queue of @a BusRequests that shall only be handled in idle bus slots. */
+	Queue<shared_ptr<BusRequest>> m_idleRequests;
+
 	/** the queue of @a BusRequests that are already finished. */
 	Queue<shared_ptr<BusRequest>> m_finishedRequests;
 
@@ -548,6 +875,93 @@ private:
 	/** the maximum number of received symbols per second ever seen. */
 	unsigned int m_maxSymPerSec = 0;
 
+	/** the number of received symbols other than SYN since the last calculation of @a m_busLoad. */
+	unsigned int m_dataSymCount = 0;
+
+	/** the percentage of the bus capacity used by symbols other than SYN in the last second. */
+	unsigned int m_busLoad = 0;
+
+	/** the number of telegrams received completely (including the own ones). */
+	std::atomic<unsigned long> m_receivedCount{0};
+
+	/** the number of own telegrams sent successfully. */
+	std::atomic<unsigned long> m_sentCount{0};
+
+	/** the number of received telegram parts with invalid CRC. */
+	std::atomic<unsigned long> m_crcErrorCount{0};
+
+	/** the number of lost arbitrations. */
+	std::atomic<unsigned long> m_arbitrationLostCount{0};
+
+	/** the number of received telegrams without matching message definition. */
+	std::atomic<unsigned long> m_unknownCount{0};
+
+	/** the @a UpdateListener to inform about messages changed by received data, or NULL. */
+	UpdateListener* m_updateListener = NULL;
+
+	/** the @a ScanListener to inform about completed scans, or NULL for no automatic scan. */
+	ScanListener* m_scanListener = NULL;
+
+	/** the mutex for exclusive access to @a m_derivedScanMessages. */
+	std::mutex m_derivedScanMutex;
+
+	/** the scan @a Message instances derived by the bus thread and not yet added to the @a MessageMap by slave address. */
+	map<unsigned char, shared_ptr<Message>> m_derivedScanMessages;
+
+	/** the number of requests answered from the @a AnswerTable. */
+	std::atomic<unsigned long> m_answeredPreparedCount{0};
+
+	/** the number of requests answered by building the answer on the fly. */
+	std::atomic<unsigned long> m_answeredBuiltCount{0};
+
+	/** the prepared answers for requests to the own slave address. */
+	AnswerTable m_answerTable;
+
+	/** the @a AnswerUpdater filling @a m_answerTable, or NULL if not answering. */
+	std::unique_ptr<AnswerUpdater> m_answerUpdater;
+
+	/** the mutex for exclusive access to @a m_coalescedReads and the coalescing counters. */
+	std::mutex m_coalesceMutex;
+
+	/** the condition variable signalled when a read in @a m_coalescedReads is completed. */
+	std::condition_variable m_coalesceCond;
+
+	/** the recent @a CoalescedRead instances by unescaped master data. */
+	map<string, shared_ptr<CoalescedRead>> m_coalescedReads;
+
+	/** the number of reads that were allowed to be coalesced. */
+	unsigned long m_coalesceReadCount = 0;
+
+	/** the number of reads answered from an identical read instead of sending them. */
+	unsigned long m_coalescedCount = 0;
+
+	/** the time in microseconds from queueing a request until winning the arbitration. */
+	Histogram m_arbitrationWait;
+
+	/** the time in microseconds from completely sending the own command until receiving the ACK. */
+	Histogram m_commandAckTime;
+
+	/** the time in microseconds from the first symbol of the slave response until completing the request. */
+	Histogram m_responseTime;
+
+	/** the number of retries (lost arbitration and repetitions after NAK) per bus transaction of a request. */
+	Histogram m_requestRetries;
+
+	/** the time in microseconds between two received SYN symbols. */
+	Histogram m_synInterval;
+
+	/** the monotonic time in microseconds of the last received SYN symbol, or 0. */
+	unsigned long long m_lastSynTime = 0;
+
+	/** the monotonic time in microseconds when the own command was completely sent, or 0. */
+	unsigned long long m_commandSentTime = 0;
+
+	/** the monotonic time in microseconds of the first symbol of the slave response to the own command, or 0. */
+	unsigned long long m_responseStartTime = 0;
+
+	/** the number of repetitions after NAK of the current request. */
+	unsigned int m_requestRepeats = 0;
+
 	/** the current @a BusState. */
 	BusState m_state = BusState::noSignal;
 
@@ -569,6 +983,9 @@ private:
 	/** the participating bus addresses seen so far (0 if not seen yet, or combination of @a SEEN bits). */
 	unsigned char m_seenAddresses[256];
 
+	/** the number of automatic scan retries by slave address. */
+	unsigned char m_scanRetries[256];
+
 	/** the scan results by slave address. */
 	map<unsigned char, string> m_scanResults;
 
@@ -23,6 +23,7 @@
 #include "main.h"
 #include "mainloop.h"
 #include "bushandler.h"
+#include "configcache.h"
 #include "log.h"
 #include <stdlib.h>
 #include <argp.h>
@@ -72,6 +73,8 @@ static struct options opt = {
 	false, // scanConfig
 	0, // checkConfig
 	5, // pollInterval
+	"", // configCache
+	0, // historySegments
 	0x31, // address
 	false, // answer
 	9400, // acquireTimeout
@@ -87,19 +90,34 @@ static struct options opt = {
 	false, // localOnly
 	0, // httpPort
 	"/var/ebusd/html", // htmlPath
+	false, // reactor
+	ThreadSettings(), // busThread
+	ThreadSettings(), // mainThread
+	ThreadSettings(), // netThread
+	-1, // memLock
 	PACKAGE_LOGFILE, // logFile
 	false, // logRaw
+	false, // logAsync
+	"", // mqttHost
+	MQTT_DEFAULT_PORT, // mqttPort
+	"ebusd", // mqttTopic
+	MQTT_DEFAULT_WINDOW, // mqttWindow
+	false, // mqttRetain
 	false, // dump
 	"/tmp/ebus_dump.bin", // dumpFile
-	100 // dumpSize
+	100, // dumpSize
+	false // dumpTimestamps
 };
 
 /** the @a MessageMap instance, or NULL. */
-static std::unique_ptr<MessageMap> s_messageMap;
+static shared_ptr<MessageMap> s_messageMap;
 
 /** the @a MainLoop instance, or NULL. */
 static std::unique_ptr<MainLoop> s_mainLoop;
 
+/** the names and devices of the additional buses. */
+static vector<std::pair<string, string>> s_additionalBuses;
+
 /** the version string of the program. */
 const char *argp_program_version = "" PACKAGE_STRING "." REVISION "";
 
@@ -112,10 +130,13 @@ static const char argpdoc[] =
 
 #define O_INISND 1
 #define O_DEVLAT (O_INISND+1)
-#define O_CHKCFG (O_DEVLAT+1)
+#define O_ADDBUS (O_DEVLAT+1)
+#define O_CHKCFG (O_ADDBUS+1)
 #define O_DMPCFG (O_CHKCFG+1)
-#define O_POLINT (O_DMPCFG+1)
-#define O_ANSWER (O_POLINT+1)
+#define O_CFGCAC (O_DMPCFG+1)
+#define O_POLINT (O_CFGCAC+1)
+#define O_HISTRY (O_POLINT+1)
+#define O_ANSWER (O_HISTRY+1)
 #define O_ACQTIM (O_ANSWER+1)
 #define O_ACQRET (O_ACQTIM+1)
 #define O_SNDRET (O_ACQRET+1)
@@ -127,11 +148,23 @@ static const char argpdoc[] =
 #define O_LOCAL  (O_PIDFIL+1)
 #define O_HTTPPT (O_LOCAL+1)
 #define O_HTMLPA (O_HTTPPT+1)
-#define O_LOGARE (O_HTMLPA+1)
+#define O_REACTR (O_HTMLPA+1)
+#define O_BUSTHR (O_REACTR+1)
+#define O_MAITHR (O_BUSTHR+1)
+#define O_NETTHR (O_MAITHR+1)
+#define O_MEMLCK (O_NETTHR+1)
+#define O_LOGARE (O_MEMLCK+1)
 #define O_LOGLEV (O_LOGARE+1)
 #define O_LOGRAW (O_LOGLEV+1)
-#define O_DMPFIL (O_LOGRAW+1)
+#define O_LOGASY (O_LOGRAW+1)
+#define O_MQHOST (O_LOGASY+1)
+#define O_MQPORT (O_MQHOST+1)
+#define O_MQTOPI (O_MQPORT+1)
+#define O_MQWIND (O_MQTOPI+1)
+#define O_MQRETA (O_MQWIND+1)
+#define O_DMPFIL (O_MQRETA+1)
 #define O_DMPSIZ (O_DMPFIL+1)
+#define O_DMPTIM (O_DMPSIZ+1)
 
 /** the definition of the known program arguments. */
 static const struct argp_option argpoptions[] = {
@@ -141,13 +174,16 @@ static const struct argp_option argpoptions[] = {
 	{"readonly",       'r',      NULL,    0, "Only read from device, never write to it", 0 },
 	{"initsend",       O_INISND, NULL,    0, "Send an initial escape symbol after connecting device", 0 },
 	{"latency",        O_DEVLAT, "USEC",  0, "Transfer latency in us [0 for USB, 10000 for IP]", 0 },
+	{"bus",            O_ADDBUS, "NAME:DEV", 0, "Also handle the bus on device DEV addressed by the \"@NAME\" prefix (may be repeated)", 0 },
 
 	{NULL,             0,        NULL,    0, "Message configuration options:", 2 },
 	{"configpath",     'c',      "PATH",  0, "Read CSV config files from PATH [" CONFIG_PATH "]", 0 },
 	{"scanconfig",     's',      NULL,    0, "Pick CSV config files matching initial scan. If combined with --checkconfig, you can add scan message data as arguments for checking a particular scan configuration, e.g. \"FF08070400/0AB5454850303003277201\".", 0 },
 	{"checkconfig",    O_CHKCFG, NULL,    0, "Check CSV config files, then stop", 0 },
 	{"dumpconfig",     O_DMPCFG, NULL,    0, "Check and dump CSV config files, then stop", 0 },
+	{"configcache",    O_CFGCAC, "FILE",  0, "Cache the split rows of the CSV config files in binary FILE (definitions are still built on each start) []", 0 },
 	{"pollinterval",   O_POLINT, "SEC",   0, "Poll for data every SEC seconds (0=disable) [5]", 0 },
+	{"history",        O_HISTRY, "COUNT", 0, "Keep COUNT segments of 256 bytes with the data changes of each message (0=disable) [0]", 0 },
 
 	{NULL,             0,        NULL,    0, "eBUS options:", 3 },
 	{"address",        'a',      "ADDR",  0, "Use ADDR as own bus address [31]", 0 },
@@ -167,17 +203,31 @@ static const struct argp_option argpoptions[] = {
 	{"localhost",      O_LOCAL,  NULL,    0, "Listen for command line connections on 127.0.0.1 interface only", 0 },
 	{"httpport",       O_HTTPPT, "PORT",  0, "Listen for HTTP connections on PORT, 0 to disable [0]", 0 },
 	{"htmlpath",       O_HTMLPA, "PATH",  0, "Path for HTML files served by HTTP port [/var/ebusd/html]", 0 },
+	{"reactor",        O_REACTR, NULL,    0, "Handle all client connections in a single event loop thread", 0 },
+	{"busthread",      O_BUSTHR, "SCHED", 0, "Schedule the bus threads with SCHED as [other|fifo|rr[:PRIO]][@CPU[-CPU][,CPU[-CPU]]*], e.g. \"fifo:50@1\" []", 0 },
+	{"mainthread",     O_MAITHR, "SCHED", 0, "Schedule the main loop thread with SCHED (see busthread) []", 0 },
+	{"netthread",      O_NETTHR, "SCHED", 0, "Schedule the network threads with SCHED (see busthread) []", 0 },
+	{"memlock",        O_MEMLCK, "KB",    OPTION_ARG_OPTIONAL, "Lock all memory and pre-fault KB of heap at startup [1024]", 0 },
 
 	{NULL,             0,        NULL,    0, "Log options:", 5 },
 	{"logfile",        'l',      "FILE",  0, "Write log to FILE (only for daemon) [" PACKAGE_LOGFILE "]", 0 },
 	{"logareas",       O_LOGARE, "AREAS", 0, "Only write log for matching AREA(S): main,network,bus,update,all [all]", 0 },
 	{"loglevel",       O_LOGLEV, "LEVEL", 0, "Only write log below or equal to LEVEL: error/notice/info/debug [notice]", 0 },
 	{"lograwdata",     O_LOGRAW, NULL,    0, "Log each received/sent byte on the bus", 0 },
+	{"logasync",       O_LOGASY, NULL,    0, "Write log from a background thread (dropping messages when it falls behind)", 0 },
+
+	{NULL,             0,        NULL,    0, "MQTT options:", 6 },
+	{"mqtthost",       O_MQHOST, "HOST",  0, "Publish updated values to the MQTT broker on HOST (name or IP) []", 0 },
+	{"mqttport",       O_MQPORT, "PORT",  0, "Connect to the MQTT broker on PORT [1883]", 0 },
+	{"mqtttopic",      O_MQTOPI, "TOPIC", 0, "Use TOPIC as prefix of the published topics TOPIC/CIRCUIT/NAME [ebusd]", 0 },
+	{"mqttwindow",     O_MQWIND, "MSEC",  0, "Collect updates for MSEC ms and only publish the latest value of each message [500]", 0 },
+	{"mqttretain",     O_MQRETA, NULL,    0, "Let the MQTT broker retain the published values", 0 },
 
-	{NULL,             0,        NULL,    0, "Dump options:", 6 },
+	{NULL,             0,        NULL,    0, "Dump options:", 7 },
 	{"dump",           'D',      NULL,    0, "Enable dump of received bytes", 0 },
 	{"dumpfile",       O_DMPFIL, "FILE",  0, "Dump received bytes to FILE [/tmp/ebus_dump.bin]", 0 },
 	{"dumpsize",       O_DMPSIZ, "SIZE",  0, "Make dump files no larger than SIZE kB [100]", 0 },
+	{"dumptimestamps", O_DMPTIM, NULL,    0, "Prefix each dumped byte with its receive time (64 bit microseconds, little endian)", 0 },
 
 	{NULL,             0,        NULL,    0, NULL, 0 },
 };
@@ -191,6 +241,9 @@ static DataFieldTemplates globalTemplates;
  */
 static map<string, DataFieldTemplates*> templatesByPath;
 
+/** the @a ConfigCache for the CSV config files (only used with @a options.configCache). */
+static ConfigCache configCache;
+
 /**
  * The program argument parsing function.
  * @param key the key from @a argpoptions.
@@ -231,6 +284,28 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 			return EINVAL;
 		}
 		break;
+	case O_ADDBUS: { // --bus=solar:/dev/ttyUSB1
+		const char* pos = arg == NULL ? NULL : strchr(arg, ':');
+		if (pos == NULL || pos == arg || pos[1] == 0) {
+			argp_error(state, "invalid bus");
+			return EINVAL;
+		}
+		string name(arg, pos-arg);
+		for (auto ch : name) {
+			if (!isalnum(ch)) {
+				argp_error(state, "invalid bus name");
+				return EINVAL;
+			}
+		}
+		for (auto& bus : s_additionalBuses) {
+			if (strcasecmp(bus.first.c_str(), name.c_str()) == 0) {
+				argp_error(state, "duplicate bus name");
+				return EINVAL;
+			}
+		}
+		s_additionalBuses.push_back(std::make_pair(name, string(pos+1)));
+		break;
+	}
 
 	// Message configuration options:
 	case 'c': // --configpath=/etc/ebusd
@@ -254,6 +329,13 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case O_DMPCFG: // --dumpconfig
 		opt->checkConfig = 2;
 		break;
+	case O_CFGCAC: // --configcache=/var/cache/ebusd/config.cache
+		if (arg == NULL) {
+			argp_error(state, "invalid configcache");
+			return EINVAL;
+		}
+		opt->configCache = arg;
+		break;
 	case O_POLINT: // --pollinterval=5
 		opt->pollInterval = parseInt(arg, 10, 0, 3600, result);
 		if (result != RESULT_OK) {
@@ -261,6 +343,13 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 			return EINVAL;
 		}
 		break;
+	case O_HISTRY: // --history=0
+		opt->historySegments = parseInt(arg, 10, 0, 1000, result);
+		if (result != RESULT_OK) {
+			argp_error(state, "invalid history");
+			return EINVAL;
+		}
+		break;
 
 	// eBUS options:
 	case 'a': // --address=31
@@ -358,6 +447,38 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 		}
 		opt->htmlPath = arg;
 		break;
+	case O_REACTR: // --reactor
+		opt->reactor = true;
+		break;
+	case O_BUSTHR: // --busthread=fifo:50@1
+		if (!opt->busThread.parse(arg)) {
+			argp_error(state, "invalid busthread");
+			return EINVAL;
+		}
+		break;
+	case O_MAITHR: // --mainthread=other@0
+		if (!opt->mainThread.parse(arg)) {
+			argp_error(state, "invalid mainthread");
+			return EINVAL;
+		}
+		break;
+	case O_NETTHR: // --netthread=other@0
+		if (!opt->netThread.parse(arg)) {
+			argp_error(state, "invalid netthread");
+			return EINVAL;
+		}
+		break;
+	case O_MEMLCK: // --memlock=1024
+		if (arg == NULL) {
+			opt->memLock = 1024;
+			break;
+		}
+		opt->memLock = parseInt(arg, 10, 0, 1024*1024, result);
+		if (result != RESULT_OK) {
+			argp_error(state, "invalid memlock");
+			return EINVAL;
+		}
+		break;
 
 	// Log options:
 	case 'l': // --logfile=/var/log/ebusd.log
@@ -382,6 +503,42 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case O_LOGRAW:  // --lograwdata
 		opt->logRaw = true;
 		break;
+	case O_LOGASY:  // --logasync
+		opt->logAsync = true;
+		break;
+
+	// MQTT options:
+	case O_MQHOST: // --mqtthost=localhost
+		if (arg == NULL || arg[0] == 0) {
+			argp_error(state, "invalid mqtthost");
+			return EINVAL;
+		}
+		opt->mqttHost = arg;
+		break;
+	case O_MQPORT: // --mqttport=1883
+		opt->mqttPort = (uint16_t)parseInt(arg, 10, 1, 65535, result);
+		if (result != RESULT_OK) {
+			argp_error(state, "invalid mqttport");
+			return EINVAL;
+		}
+		break;
+	case O_MQTOPI: // --mqtttopic=ebusd
+		if (arg == NULL || arg[0] == 0 || strchr(arg, '+') || strchr(arg, '#')) {
+			argp_error(state, "invalid mqtttopic");
+			return EINVAL;
+		}
+		opt->mqttTopic = arg;
+		break;
+	case O_MQWIND: // --mqttwindow=500
+		opt->mqttWindow = parseInt(arg, 10, 0, 60000, result);
+		if (result != RESULT_OK) {
+			argp_error(state, "invalid mqttwindow");
+			return EINVAL;
+		}
+		break;
+	case O_MQRETA: // --mqttretain
+		opt->mqttRetain = true;
+		break;
 
 	// Dump options:
 	case 'D':  // --dump
@@ -401,6 +558,9 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 			return EINVAL;
 		}
 		break;
+	case O_DMPTIM: // --dumptimestamps
+		opt->dumpTimestamps = true;
+		break;
 
 	default:
 		return ARGP_ERR_UNKNOWN;
@@ -512,7 +672,7 @@ void signalHandler(int sig)
 {
 	switch (sig) {
 	case SIGHUP:
-		logNotice(lf_main, "SIGHUP received");
+		reopenLogFile(); // only sets a flag, the file is reopened before writing the next message
 		break;
 	case SIGINT:
 		logNotice(lf_main, "SIGINT received");
@@ -610,6 +770,7 @@ static bool readTemplates(const string path, const string extension, bool availa
 		templates = &globalTemplates;
 	} else {
 		templates = new DataFieldTemplates(globalTemplates);
+		templates->setRowCache(globalTemplates.getRowCache());
 	}
 	templatesByPath[path] = templates;
 	if (!available) {
@@ -624,6 +785,15 @@ static bool readTemplates(const string path, const string extension, bool availa
 	return templates;
 }
 
+/**
+ * Helper method for logging reading of a configuration file.
+ * @param filename the name of the file being read.
+ */
+static void logReadingFile(const string& filename)
+{
+	logInfo(lf_main, "reading file %s", filename.c_str());
+}
+
 /**
  * Read the configuration files from the specified path.
  * @param path the path from which to read the files.
@@ -642,12 +812,9 @@ static result_t readConfigFiles(const string path, const string extension, Messa
 		return result;
 
 	readTemplates(path, extension, hasTemplates, verbose);
-	for (const auto& name : files) {
-		logInfo(lf_main, "reading file %s", name.c_str());
-		result_t result = messages->readFromFile(name, verbose);
-		if (result != RESULT_OK)
-			return result;
-	}
+	result = messages->readFromFiles(files, verbose, 0, logReadingFile);
+	if (result != RESULT_OK)
+		return result;
 	if (recursive) {
 		for (const auto& name : dirs) {
 			logInfo(lf_main, "reading dir  %s", name.c_str());
@@ -659,6 +826,20 @@ static result_t readConfigFiles(const string path, const string extension, Messa
 	return RESULT_OK;
 };
 
+/**
+ * Write the @a ConfigCache to the cache file if enabled and modified.
+ */
+static void writeConfigCache()
+{
+	if (!opt.configCache[0] || !configCache.isModified())
+		return;
+	result_t result = configCache.write(opt.configCache);
+	if (result == RESULT_OK)
+		logInfo(lf_main, "wrote config cache %s", opt.configCache);
+	else
+		logError(lf_main, "error writing config cache %s: %s", opt.configCache, getResultCode(result));
+}
+
 /**
  * Helper method for logging loading of a configuration file.
  * @param messages the @a MessageMap instance.
@@ -683,11 +864,25 @@ result_t loadConfigFiles(MessageMap* messages, bool verbose, bool denyRecursive)
 	}
 	templatesByPath.clear();
 
+	FileRowCache* rowCache = NULL;
+	if (opt.configCache[0]) {
+		result_t result = configCache.open(opt.configCache);
+		if (result != RESULT_OK && result != RESULT_ERR_NOTFOUND)
+			logError(lf_main, "ignoring config cache %s: %s", opt.configCache, getResultCode(result));
+		rowCache = &configCache;
+	}
+	messages->setRowCache(rowCache);
+	globalTemplates.setRowCache(rowCache);
+
 	result_t result = readConfigFiles(string(opt.configPath), ".csv", messages, (!opt.scanConfig || opt.checkConfig) && !denyRecursive, verbose);
 	if (result == RESULT_OK)
 		logInfo(lf_main, "read config files");
 	else
 		logError(lf_main, "error reading config files: %s, %s", getResultCode(result), messages->getLastError().c_str());
+	if (rowCache != NULL) {
+		logInfo(lf_main, "config cache: %lu files cached, %lu read from source", configCache.getHits(), configCache.getMisses());
+		writeConfigCache();
+	}
 
 	result = messages->resolveConditions(verbose);
 	if (result != RESULT_OK)
@@ -854,6 +1049,7 @@ result_t loadScanConfigFile(MessageMap* messages, libebus::Address address, Symb
 		return result;
 	}
 	logNotice(lf_main, "read scan config file %s for ID \"%s\", SW%4.4d, HW%4.4d", best.c_str(), ident.c_str(), sw, hw);
+	writeConfigCache();
 
 	result = messages->resolveConditions(verbose);
 	if (result != RESULT_OK)
@@ -899,7 +1095,8 @@ int main(int argc, char* argv[])
 	if (argp_parse(&argp, argc, argv, ARGP_IN_ORDER, &arg_index, &opt) != 0)
 		return EINVAL;
 
-	s_messageMap = std::make_unique<MessageMap>(opt.checkConfig && opt.scanConfig && arg_index >= argc);
+	s_messageMap = make_shared<MessageMap>(opt.checkConfig && opt.scanConfig && arg_index >= argc);
+	s_messageMap->setHistorySegments(opt.historySegments);
 	if (opt.checkConfig) {
 		logNotice(lf_main, PACKAGE_STRING "." REVISION " performing configuration check...");
 
@@ -949,11 +1146,30 @@ int main(int argc, char* argv[])
 		logError(lf_main, "unable to create device %s", opt.device);
 		return EINVAL;
 	}
+	vector<std::pair<string, shared_ptr<Device>>> buses;
+	for (auto& bus : s_additionalBuses) {
+		auto busDevice = Device::create(bus.second, !opt.noDeviceCheck, opt.readOnly, opt.initialSend, &logRawData);
+		if (not busDevice) {
+			logError(lf_main, "unable to create device %s", bus.second.c_str());
+			return EINVAL;
+		}
+		buses.push_back(std::make_pair(bus.first, busDevice));
+	}
 
 	if (!opt.foreground) {
 		setLogFile(opt.logFile);
 		daemonize(); // make me daemon
 	}
+	// lock after forking (locks are not inherited by the child) and before starting any thread
+	string memoryLock, memoryLockError;
+	if (opt.memLock >= 0) {
+		if (lockMemory((size_t)opt.memLock*1024, memoryLockError))
+			memoryLock = "locked, " + std::to_string(opt.memLock) + " kB pre-faulted";
+		else
+			memoryLock = "not locked (" + memoryLockError + ")";
+	}
+	if (opt.logAsync && !startLogThread())
+		logError(lf_main, "unable to start log thread");
 
 	// trap signals that we expect to receive
 	signal(SIGHUP, signalHandler);
@@ -961,6 +1177,10 @@ int main(int argc, char* argv[])
 	signal(SIGTERM, signalHandler);
 
 	logNotice(lf_main, PACKAGE_STRING "." REVISION " started");
+	if (!memoryLockError.empty())
+		logError(lf_main, "unable to lock memory: %s", memoryLockError.c_str());
+	else if (!memoryLock.empty())
+		logNotice(lf_main, "memory %s", memoryLock.c_str());
 
 	// load configuration files
 	loadConfigFiles(s_messageMap.get());
@@ -968,7 +1188,9 @@ int main(int argc, char* argv[])
 		logError(lf_main, "conditions require a poll interval > 0");
 
 	// create the MainLoop and run it
-	s_mainLoop = std::make_unique<MainLoop>(opt, device, s_messageMap.get());
+	s_mainLoop = std::make_unique<MainLoop>(opt, device, s_messageMap, buses, memoryLock);
+	s_messageMap.reset(); // the main loop owns the generations from now on
+	s_mainLoop->setSettings(opt.mainThread);
 	s_mainLoop->start("mainloop");
 	s_mainLoop->join();
 
@@ -22,6 +22,7 @@
 #include "result.h"
 #include "data.h"
 #include "message.h"
+#include "thread.h"
 #include <stdint.h>
 #include <Address.h>
 
@@ -40,6 +41,8 @@ struct options
 	bool scanConfig; //!< pick configuration files matching initial scan
 	int checkConfig; //!< check CSV config files (!=0) and optionally dump (2), then stop
 	int pollInterval; //!< poll interval in seconds, 0 to disable [5]
+	const char* configCache; //!< binary cache file for the split CSV config files, or empty to disable []
+	int historySegments; //!< number of 256 byte history segments kept per message, 0 to disable [0]
 
 	libebus::Address address; //!< own bus address [31]
 	bool answer; //!< answer to requests from other masters
@@ -57,13 +60,26 @@ struct options
 	bool localOnly; //!< listen on 127.0.0.1 interface only
 	uint16_t httpPort; //!< optional port to listen for HTTP connections, 0 to disable [0]
 	const char* htmlPath; //!< path for HTML files served by the HTTP port [/var/ebusd/html]
+	bool reactor; //!< handle all client connections in a single event loop thread
+	ThreadSettings busThread; //!< scheduling settings of the bus threads
+	ThreadSettings mainThread; //!< scheduling settings of the main loop thread
+	ThreadSettings netThread; //!< scheduling settings of the network threads
+	int memLock; //!< size of the heap in kB to pre-fault after locking all memory, or -1 to disable [-1]
 
 	const char* logFile; //!< log file name [/var/log/ebusd.log]
 	bool logRaw; //!< log each received/sent byte on the bus
+	bool logAsync; //!< write the log from a background thread
+
+	const char* mqttHost; //!< host name or IP address of the MQTT broker, or empty to disable []
+	uint16_t mqttPort; //!< port of the MQTT broker [1883]
+	const char* mqttTopic; //!< prefix of the MQTT topics [ebusd]
+	int mqttWindow; //!< time in milliseconds for collecting updates before publishing them [500]
+	bool mqttRetain; //!< whether the MQTT broker shall retain the published values
 
 	bool dump; //!< dump received bytes
 	const char* dumpFile; //!< dump file name [/tmp/ebus_dump.bin]
 	int dumpSize; //!< maximum size of dump file in kB [100]
+	bool dumpTimestamps; //!< prefix each dumped byte with its receive time
 };
 
 /**
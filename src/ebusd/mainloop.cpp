@@ -18,10 +18,15 @@
 
 #include "mainloop.h"
 #include <iomanip>
+#include <algorithm>
 #include "main.h"
 #include "log.h"
 #include "data.h"
 #include "config.h"
+#include "flatindex.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 using std::dec;
 
@@ -41,21 +46,162 @@ static const char* columnNames[] = {
 /** the number of known column names. */
 static const size_t columnCount = sizeof(columnNames) / sizeof(char*);
 
-MainLoop::MainLoop(const struct options& opt, shared_ptr<Device> device, MessageMap* messages)
-	: m_device(device), m_messages(messages), m_address(opt.address), m_scanConfig(opt.scanConfig), m_enableHex(opt.enableHex)
+/** the commands understood by @a MainLoop::decodeMessage(). */
+enum class Command {
+	read,    //!< read a value
+	write,   //!< write a value
+	hex,     //!< send arbitrary data
+	find,    //!< find messages
+	listen,  //!< listen for updates
+	state,   //!< report the bus state
+	grab,    //!< grab messages
+	scan,    //!< scan slaves
+	log,     //!< change the log settings
+	raw,     //!< toggle logging of raw data
+	dump,    //!< toggle dumping of raw data
+	reload,  //!< reload the configuration
+	stop,    //!< stop the daemon
+	quit,    //!< close the connection
+	info,    //!< report information about the daemon
+	stats,   //!< report statistics
+	help,    //!< print the help
+};
+
+/** the known command names (full and short length names) with the @a Command. */
+static const struct {
+	const char* name;
+	Command command;
+} commandNames[] = {
+	{"read", Command::read}, {"r", Command::read},
+	{"write", Command::write}, {"w", Command::write},
+	{"hex", Command::hex},
+	{"find", Command::find}, {"f", Command::find},
+	{"listen", Command::listen}, {"l", Command::listen},
+	{"state", Command::state}, {"s", Command::state},
+	{"grab", Command::grab}, {"g", Command::grab},
+	{"scan", Command::scan},
+	{"log", Command::log},
+	{"raw", Command::raw},
+	{"dump", Command::dump},
+	{"reload", Command::reload},
+	{"stop", Command::stop},
+	{"quit", Command::quit}, {"q", Command::quit},
+	{"info", Command::info}, {"i", Command::info},
+	{"stats", Command::stats},
+	{"help", Command::help}, {"h", Command::help},
+};
+
+/**
+ * Find the @a Command by name.
+ * @param name the command name (case insensitive).
+ * @param command set to the found @a Command.
+ * @return true when the command was found.
+ */
+static bool findCommand(const string& name, Command& command)
 {
-	// setup Device
-	m_device->setLogRaw(opt.logRaw);
-	m_device->setDumpRawFile(opt.dumpFile);
-	m_device->setDumpRawMaxSize(opt.dumpSize);
-	m_device->setDumpRaw(opt.dump);
+	static FlatIndex<Command> index;
+	if (index.empty()) {
+		// only ever called from the main loop thread
+		for (const auto& entry : commandNames)
+			index[packName(entry.name, strlen(entry.name))] = entry.command;
+	}
+	const Command* found = index.find(packName(name.c_str(), name.length()));
+	if (!found)
+		return false;
+	command = *found;
+	return true;
+}
 
+/**
+ * Return whether the argument requests the help of a command.
+ * @param arg the argument to check.
+ * @return whether the argument is one of "-h", "-?", or "--help".
+ */
+static bool isHelpArg(const string& arg)
+{
+	return strcasecmp(arg.c_str(), "-h") == 0 || strcasecmp(arg.c_str(), "-?") == 0
+		|| strcasecmp(arg.c_str(), "--help") == 0;
+}
+
+ScanConfigLoader::~ScanConfigLoader()
+{
+	stop();
+	join();
+}
+
+void ScanConfigLoader::add(unsigned char address)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (find(m_pending.begin(), m_pending.end(), address) != m_pending.end())
+		return;
+	m_pending.push_back(address);
+	m_cond.notify_one();
+}
+
+void ScanConfigLoader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cond.notify_one();
+	Thread::stop();
+}
+
+void ScanConfigLoader::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stopping) {
+		if (m_pending.empty()) {
+			m_cond.wait(lock);
+			continue;
+		}
+		unsigned char address = m_pending.front();
+		m_pending.pop_front();
+		lock.unlock();
+		load(address);
+		lock.lock();
+	}
+}
+
+void ScanConfigLoader::load(unsigned char address)
+{
+	std::lock_guard<std::mutex> lock(m_messagesMutex);
+	if (!m_busHandler->isScanConfigPending(address))
+		return; // already loaded or reset meanwhile
+	auto messages = m_messages.get();
+	m_busHandler->adoptScanMessages(messages.get());
+	auto message = messages->getScanMessage(address);
+	if (message==NULL || message->getLastUpdateTime()==0)
+		return;
+	SymbolString slave(false);
+	slave = message->getLastSlaveData();
+	string file;
+	result_t result = loadScanConfigFile(messages.get(), address, slave, file);
+	if (result==RESULT_OK) {
+		logInfo(lf_main, "scan config %2.2x: file %s loaded", address, file.c_str());
+		m_busHandler->setScanConfigLoaded(address, file);
+	} else {
+		m_busHandler->setScanConfigLoaded(address, "");
+	}
+}
+
+/**
+ * Open the @a Device and create the @a BusHandler for it.
+ * @param opt the program options.
+ * @param device the @a Device instance.
+ * @param messages the @a MessageMapHolder of the bus.
+ * @return the created @a BusHandler instance.
+ */
+static std::unique_ptr<BusHandler> createBusHandler(const struct options& opt, Device* device,
+	MessageMapHolder& messages)
+{
 	// open Device
-	result_t result = m_device->open();
+	result_t result = device->open();
 	if (result != RESULT_OK)
-		logError(lf_bus, "unable to open %s: %s", m_device->getName(), getResultCode(result));
-	else if (!m_device->isValid())
-		logError(lf_bus, "device %s not available", m_device->getName());
+		logError(lf_bus, "unable to open %s: %s", device->getName(), getResultCode(result));
+	else if (!device->isValid())
+		logError(lf_bus, "device %s not available", device->getName());
 
 	// create BusHandler
 	unsigned int latency;
@@ -64,209 +210,378 @@ MainLoop::MainLoop(const struct options& opt, shared_ptr<Device> device, Message
 	} else {
 		latency = (unsigned int)opt.latency;
 	}
-	m_busHandler = std::make_unique<BusHandler>(m_device.get(), m_messages,
-			m_address, opt.answer,
+	return std::make_unique<BusHandler>(device, messages,
+			opt.address, opt.answer,
 			opt.acquireRetries, opt.sendRetries,
 			latency, opt.acquireTimeout, opt.receiveTimeout,
 			opt.masterCount, opt.generateSyn,
 			opt.pollInterval);
+}
+
+MainLoop::MainLoop(const struct options& opt, shared_ptr<Device> device, shared_ptr<MessageMap> messages,
+	const vector<std::pair<string, shared_ptr<Device>>>& buses, const string& memoryLock)
+	: m_device(device), m_messageMaps(messages), m_messages(messages), m_address(opt.address), m_scanConfig(opt.scanConfig), m_enableHex(opt.enableHex),
+	  m_memoryLock(memoryLock)
+{
+	// setup Device
+	m_device->setLogRaw(opt.logRaw);
+	m_device->setDumpRawFile(opt.dumpFile);
+	m_device->setDumpRawMaxSize(opt.dumpSize);
+	m_device->setDumpRawTimestamps(opt.dumpTimestamps);
+	m_device->setDumpRaw(opt.dump);
+
+	m_busHandler = createBusHandler(opt, m_device.get(), m_messageMaps);
+	for (const auto& it : buses) {
+		// derive the bus specific messages before any bus thread starts using the primary ones
+		auto derived = make_shared<MessageMap>();
+		derived->setHistorySegments(messages->getHistorySegments());
+		size_t count = derived->deriveFrom(messages);
+		auto bus = std::make_unique<AdditionalBus>(it.first, it.second, derived);
+		bus->m_device->setLogRaw(opt.logRaw);
+		bus->m_busHandler = createBusHandler(opt, bus->m_device.get(), bus->m_messageMaps);
+		logNotice(lf_main, "bus %s on %s with %d messages", bus->m_name.c_str(), bus->m_device->getName(),
+			static_cast<int>(count));
+		m_additionalBuses.push_back(std::move(bus));
+	}
+	if (opt.mqttHost[0]) {
+		m_mqttHandler = std::make_unique<MqttHandler>(opt.mqttHost, opt.mqttPort, opt.mqttTopic,
+			(unsigned int)opt.mqttWindow, opt.mqttRetain);
+		m_mqttHandler->start("mqtt");
+	}
+	m_busHandler->setUpdateListener(this);
+	if (m_scanConfig) {
+		m_scanConfigLoader = std::make_unique<ScanConfigLoader>(m_messageMaps, m_busHandler.get(), m_messagesMutex);
+		m_scanConfigLoader->start("scanconfig");
+		m_busHandler->setScanListener(this);
+	}
+	m_busHandler->setSettings(opt.busThread);
 	m_busHandler->start("bushandler");
+	for (auto& bus : m_additionalBuses) {
+		bus->m_busHandler->setSettings(opt.busThread);
+		bus->m_busHandler->start("bushandler");
+	}
 
 	// create network
 	m_htmlPath = opt.htmlPath;
-	m_network = std::make_unique<Network>(opt.localOnly, opt.port, opt.httpPort, m_netQueue);
+	m_network = std::make_unique<Network>(opt.localOnly, opt.port, opt.httpPort, m_netQueue, opt.reactor);
+	m_network->setSettings(opt.netThread);
 	m_network->start("network");
 }
 
+MainLoop::~MainLoop()
+{
+	// stop the bus handler first as it may still inform about completed scans
+	for (auto& bus : m_additionalBuses)
+		bus->m_busHandler->stop();
+	m_busHandler->stop();
+	for (auto& bus : m_additionalBuses)
+		bus->m_busHandler->join();
+	m_busHandler->join();
+	if (m_scanConfigLoader) {
+		m_scanConfigLoader->stop();
+		m_scanConfigLoader->join();
+	}
+	// drain the queue and release the clients still waiting for a result (the messages belong to their connections)
+	NetMessage* message;
+	while ((message = m_netQueue.pop()) != NULL)
+		m_deferredMessages.push_back(message);
+	for (auto deferred : m_deferredMessages)
+		deferred->setResult("", false, 0, 0, true);
+	m_deferredMessages.clear();
+}
+
 void MainLoop::run()
 {
 	bool running = true;
-	time_t lastTaskRun, now;
-	int taskDelay = 5;
-	unsigned char lastScanAddress = 0; // 0 is known to be a master
-	time(&now);
-	lastTaskRun = now;
 
 	while (running) {
-		string result;
-
 		// pick the next message to handle
-		NetMessage* message = m_netQueue.pop(taskDelay);
-		time(&now);
-		if (now<lastTaskRun) {
-			// clock skew
-			lastTaskRun = now;
-		} else if (now > lastTaskRun+taskDelay) {
-			logDebug(lf_main, "performing regular tasks");
-			if (m_scanConfig) {
-				bool scanned = false;
-				lastScanAddress = m_busHandler->getNextScanAddress(lastScanAddress, scanned);
-				if (lastScanAddress==SYN) {
-					taskDelay = 5;
-					lastScanAddress = 0;
-				} else {
-					SymbolString slave(false);
-					if (scanned) {
-						auto message = m_messages->getScanMessage(lastScanAddress);
-						slave = message->getLastSlaveData();
-						scanned = message->getLastUpdateTime()>0;
-					} else {
-						result_t result = m_busHandler->scanAndWait(lastScanAddress, slave);
-						taskDelay = (result == RESULT_ERR_NO_SIGNAL) ? 10 : 1;
-						if (result!=RESULT_OK)
-							logError(lf_main, "scan config %2.2x message: %s", lastScanAddress, getResultCode(result));
-						else {
-							scanned = true;
-							logInfo(lf_main, "scan config %2.2x message received", lastScanAddress);
-						}
-					}
-					if (scanned) {
-						string file;
-						result_t result = loadScanConfigFile(m_messages, lastScanAddress, slave, file);
-						if (result==RESULT_OK) {
-							logInfo(lf_main, "scan config %2.2x: file %s loaded", lastScanAddress, file.c_str());
-							m_busHandler->setScanConfigLoaded(lastScanAddress, file);
-						} else {
-							m_busHandler->setScanConfigLoaded(lastScanAddress, "");
-						}
-					}
-				}
-			}
-			time(&lastTaskRun);
+		NetMessage* message;
+		if (m_deferredMessages.empty())
+			message = m_netQueue.pop(5);
+		else {
+			message = m_deferredMessages.front();
+			m_deferredMessages.pop_front();
 		}
+		if (!m_retiredMessages.empty())
+			releaseRetiredMessages();
 		if (message==NULL) {
 			continue;
 		}
-		string request = message->getRequest();
+		std::lock_guard<std::mutex> lock(m_messagesMutex);
+		m_messageMaps.refresh(m_messages, m_messagesGeneration);
+		// add the scan messages derived by the bus threads meanwhile
+		m_busHandler->adoptScanMessages(m_messages.get());
+		for (auto& bus : m_additionalBuses)
+			bus->m_busHandler->adoptScanMessages(bus->m_messageMaps.get().get());
+		if (handleMessage(message, true, running))
+			continue;
 
-		time_t since, until;
-		time(&until);
-		bool listening = message->isListening(&since);
-		if (!listening)
-			since = until;
+		// answer all waiting messages that can be answered from the cache before possibly blocking on the bus
+		NetMessage* other;
+		while ((other = m_netQueue.pop()) != NULL) {
+			if (!handleMessage(other, true, running))
+				m_deferredMessages.push_back(other);
+		}
+		handleMessage(message, false, running);
+	}
+}
 
-		bool connected = true;
-		if (request.length() > 0) {
-			logDebug(lf_main, ">>> %s", request.c_str());
-			result = decodeMessage(request, message->isHttp(), connected, listening, running);
+bool MainLoop::handleMessage(NetMessage* message, const bool cacheOnly, bool& running)
+{
+	string request = message->getRequest();
+
+	time_t since, until;
+	time(&until);
+	unsigned long long cursor;
+	bool listening = message->isListening(&since, &cursor);
+	shared_ptr<ListenSubscription> subscription = message->getSubscription();
+	if (!listening) {
+		since = until;
+		cursor = m_messages->getChangeJournal().getCursor();
+	}
 
-			if (result.length() == 0 && !message->isHttp())
-				result = getResultCode(RESULT_EMPTY);
+	bool connected = true;
+	string result;
+	m_requestTime = message->getReceiveTime();
+	if (message->isHttp())
+		m_httpHeaders = message->getHttpHeaders();
+	if (request.length() > 0) {
+		vector<string> lines;
+		if (message->isHttp())
+			lines.push_back(request);
+		else {
+			// handle all pipelined commands in order
+			istringstream stream(request);
+			string line;
+			while (getline(stream, line))
+				if (line.length() > 0)
+					lines.push_back(line);
+		}
+		// continue after the lines already answered from the cache
+		for (size_t index = message->getHandledLines(result); index < lines.size(); index++) {
+			const string& line = lines[index];
+			string lineResult;
+			if (cacheOnly) {
+				if (message->isHttp() || !decodeCached(line, lineResult)) {
+					message->setHandledLines(index, result);
+					return false;
+				}
+			} else if (!connected || !running) {
+				break;
+			}
+			logDebug(lf_main, ">>> %s", line.c_str());
+			if (!cacheOnly)
+				lineResult = decodeMessage(line, message->isHttp(), connected, listening, subscription, running);
 
-			if (result.length() > 100)
-				logDebug(lf_main, "<<< %s ...", result.substr(0, 100).c_str());
+			if (lineResult.length() == 0 && !message->isHttp())
+				lineResult = getResultCode(RESULT_EMPTY);
+
+			if (lineResult.length() > 100)
+				logDebug(lf_main, "<<< %s ...", lineResult.substr(0, 100).c_str());
 			else
-				logDebug(lf_main, "<<< %s", result.c_str());
+				logDebug(lf_main, "<<< %s", lineResult.c_str());
 
-			if (result.length() == 0)
-				result = "\n"; // only for HTTP
+			if (lineResult.length() == 0)
+				lineResult = "\n"; // only for HTTP
 			else if (!message->isHttp())
-				result += "\n\n";
-		}
-		if (listening) {
-			result += getUpdates(since, until);
+				lineResult += "\n\n";
+			result += lineResult;
 		}
+		message->setHandledLines(0, "");
+	}
+	if (listening) {
+		result += getUpdates(since, until, cursor, subscription);
+	}
 
-		// send result to client
-		message->setResult(result, listening, until, !connected);
+	// send result to client
+	message->setSubscription(subscription);
+	message->setResult(result, listening, until, cursor, !connected);
+	return true;
+}
+
+void MainLoop::splitArgs(const string& data, const bool isHttp, vector<string>& args)
+{
+	m_tokens.clear();
+	if (isHttp)
+		splitHttpRequest(data.data(), data.length(), m_tokens);
+	else
+		splitCommand(data.data(), data.length(), m_tokens);
+	args.reserve(m_tokens.size());
+	for (const auto& token : m_tokens)
+		args.push_back(token.str());
+}
+
+bool MainLoop::findBus(vector<string>& args, const bool isHttp, AdditionalBus*& bus)
+{
+	bus = NULL;
+	string name;
+	if (isHttp) {
+		// e.g. GET /@solar/data/bai
+		if (args.size() < 2 || args[1].length() < 2 || args[1][0] != '/' || args[1][1] != '@')
+			return true;
+		size_t pos = args[1].find('/', 2);
+		name = args[1].substr(2, pos == string::npos ? string::npos : pos-2);
+		args[1] = pos == string::npos ? "/" : args[1].substr(pos);
+	} else {
+		// e.g. @solar read outsidetemp
+		if (args.empty() || args[0].length() < 2 || args[0][0] != '@')
+			return true;
+		name = args[0].substr(1);
+		args.erase(args.begin());
 	}
+	for (auto& it : m_additionalBuses) {
+		if (strcasecmp(it->m_name.c_str(), name.c_str()) == 0) {
+			bus = it.get();
+			return true;
+		}
+	}
+	return false;
 }
 
-string MainLoop::decodeMessage(const string& data, const bool isHttp, bool& connected, bool& listening, bool& running)
+void MainLoop::swapBus(AdditionalBus& bus)
 {
-	ostringstream result;
+	std::swap(m_device, bus.m_device);
+	std::swap(m_messages, bus.m_messages);
+	std::swap(m_messagesGeneration, bus.m_messagesGeneration);
+	std::swap(m_busHandler, bus.m_busHandler);
+}
 
-	// prepare data
-	string token, previous;
-	istringstream stream(data);
+bool MainLoop::decodeCached(const string& data, string& result)
+{
 	vector<string> args;
-	bool escaped = false;
-
-	char delim = ' ';
-	while (getline(stream, token, delim)) {
-		if (!isHttp) {
-			if (escaped) {
-				args.pop_back();
-				if (token.length() > 0 && token[token.length()-1] == '"') {
-					token.erase(token.length() - 1, 1);
-					escaped = false;
-				}
-				token = previous + " " + token;
-			}
-			else if (token.length() == 0) // allow multiple space chars for a single delimiter
-				continue;
-			else if (token[0] == '"') {
-				token.erase(0, 1);
-				if (token.length() > 0 && token[token.length()-1] == '"')
-					token.erase(token.length() - 1, 1);
-				else
-					escaped = true;
-			}
+	splitArgs(data, false, args);
+	AdditionalBus* bus;
+	if (!findBus(args, false, bus))
+		return false;
+	if (args.size() < 2)
+		return false;
+
+	Command command;
+	if (!findCommand(args[0], command) || command != Command::read)
+		return false;
+
+	// leave "CMD -h" to the usual command help
+	if (args.size() == 2 && isHelpArg(args[1]))
+		return false;
+
+	bool busRequired = false;
+	if (bus) {
+		bus->m_messageMaps.refresh(bus->m_messages, bus->m_messagesGeneration);
+		swapBus(*bus);
+		result = executeRead(args, &busRequired);
+		swapBus(*bus);
+	} else {
+		result = executeRead(args, &busRequired);
+	}
+	return !busRequired;
+}
+
+string MainLoop::decodeMessage(const string& data, const bool isHttp, bool& connected, bool& listening,
+	shared_ptr<ListenSubscription>& subscription, bool& running)
+{
+	vector<string> args;
+	splitArgs(data, isHttp, args);
+	AdditionalBus* bus;
+	if (!findBus(args, isHttp, bus)) {
+		if (!isHttp)
+			return "ERR: bus not found";
+		connected = m_httpHeaders.m_keepAlive;
+		return string(m_httpHeaders.m_http11 ? "HTTP/1.1" : "HTTP/1.0")
+			+ " 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+	}
+	if (!bus)
+		return executeCommand(args, isHttp, connected, listening, subscription, running);
+
+	Command command;
+	if (!isHttp && !args.empty() && findCommand(args[0], command)) {
+		switch (command) {
+		case Command::listen:
+		case Command::log:
+		case Command::reload:
+		case Command::stop:
+		case Command::quit:
+			return "ERR: command not available for additional bus";
+		default:
+			break;
 		}
-		args.push_back(token);
-		previous = token;
-		if (isHttp)
-			delim = (args.size() == 1) ? '?' : '\n';
 	}
+	bus->m_messageMaps.refresh(bus->m_messages, bus->m_messagesGeneration);
+	swapBus(*bus);
+	string result = executeCommand(args, isHttp, connected, listening, subscription, running);
+	swapBus(*bus);
+	return result;
+}
 
+string MainLoop::executeCommand(vector<string>& args, const bool isHttp, bool& connected, bool& listening,
+	shared_ptr<ListenSubscription>& subscription, bool& running)
+{
 	if (isHttp) {
 		const char* str = args.size() > 0 ? args[0].c_str() : "";
 		if (strcmp(str, "GET") == 0)
 			return executeGet(args, connected);
 
 		connected = false;
-		return "HTTP/1.0 405 Method Not Allowed\r\n\r\n";
+		return string(m_httpHeaders.m_http11 ? "HTTP/1.1" : "HTTP/1.0")
+			+ " 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
 	}
 
 	if (args.size() == 0)
 		return executeHelp();
 
-	const char* str = args[0].c_str();
+	Command command;
+	if (!findCommand(args[0], command))
+		return "ERR: command not found";
+
 	if (args.size() == 2) {
 		// check for "CMD -h"
-		if (strcasecmp(args[1].c_str(), "-h") == 0 || strcasecmp(args[1].c_str(), "-?") == 0 || strcasecmp(args[1].c_str(), "--help") == 0)
+		if (isHelpArg(args[1]))
 			args.clear(); // empty args is used as command help indicator
-		else if (strcasecmp(args[0].c_str(), "H") == 0 || strcasecmp(args[0].c_str(), "HELP") == 0) { // check for "HELP CMD"
-			str = args[1].c_str();
+		else if (command == Command::help) { // check for "HELP CMD"
+			if (!findCommand(args[1], command))
+				return "ERR: command not found";
 			args.clear(); // empty args is used as command help indicator
 		}
 	}
-	if (strcasecmp(str, "R") == 0 || strcasecmp(str, "READ") == 0)
+	switch (command) {
+	case Command::read:
 		return executeRead(args);
-	if (strcasecmp(str, "W") == 0 || strcasecmp(str, "WRITE") == 0)
+	case Command::write:
 		return executeWrite(args);
-	if (strcasecmp(str, "HEX") == 0) {
+	case Command::hex:
 		if (m_enableHex)
 			return executeHex(args);
 		return "ERR: command not enabled";
-	}
-	if (strcasecmp(str, "F") == 0 || strcasecmp(str, "FIND") == 0)
+	case Command::find:
 		return executeFind(args);
-	if (strcasecmp(str, "L") == 0 || strcasecmp(str, "LISTEN") == 0)
-		return executeListen(args, listening);
-	if (strcasecmp(str, "S") == 0 || strcasecmp(str, "STATE") == 0)
+	case Command::listen:
+		return executeListen(args, listening, subscription);
+	case Command::state:
 		return executeState(args);
-	if (strcasecmp(str, "G") == 0 || strcasecmp(str, "GRAB") == 0)
+	case Command::grab:
 		return executeGrab(args);
-	if (strcasecmp(str, "SCAN") == 0)
+	case Command::scan:
 		return executeScan(args);
-	if (strcasecmp(str, "LOG") == 0)
+	case Command::log:
 		return executeLog(args);
-	if (strcasecmp(str, "RAW") == 0)
+	case Command::raw:
 		return executeRaw(args);
-	if (strcasecmp(str, "DUMP") == 0)
+	case Command::dump:
 		return executeDump(args);
-	if (strcasecmp(str, "RELOAD") == 0)
+	case Command::reload:
 		return executeReload(args);
-	if (strcasecmp(str, "STOP") == 0)
+	case Command::stop:
 		return executeStop(args, running);
-	if (strcasecmp(str, "Q") == 0 || strcasecmp(str, "QUIT") == 0)
+	case Command::quit:
 		return executeQuit(args, connected);
-	if (strcasecmp(str, "I") == 0 || strcasecmp(str, "INFO") == 0)
+	case Command::info:
 		return executeInfo(args);
-	if (strcasecmp(str, "H") == 0 || strcasecmp(str, "HELP") == 0)
+	case Command::stats:
+		return executeStats(args);
+	case Command::help:
+	default:
 		return executeHelp();
-	return "ERR: command not found";
+	}
 }
 
 result_t MainLoop::parseHexMaster(vector<string> &args, size_t argPos, SymbolString& master)
@@ -307,8 +622,8 @@ result_t MainLoop::readFromBus(shared_ptr<Message> message, string inputStr, con
 			logError(lf_main, "prepare message part %d: %s", index, getResultCode(ret));
 			break;
 		}
-		// send message
-		ret = m_busHandler->sendAndWait(master, slave);
+		// send message (or attach to an identical read requested meanwhile)
+		ret = m_busHandler->sendAndWait(master, slave, m_requestTime);
 		if (ret != RESULT_OK) {
 			logError(lf_main, "send message part %d: %s", index, getResultCode(ret));
 			break;
@@ -322,10 +637,10 @@ result_t MainLoop::readFromBus(shared_ptr<Message> message, string inputStr, con
 	return ret;
 }
 
-string MainLoop::executeRead(vector<string> &args)
+string MainLoop::executeRead(vector<string> &args, bool* busRequired)
 {
 	size_t argPos = 1;
-	bool hex = false, verbose = false, numeric = false;
+	bool hex = false, verbose = false, numeric = false, adaptive = false, stale = false;
 	time_t maxAge = 5*60;
 	string circuit, params;
 	unsigned char dstAddress = SYN, pollPriority = 0;
@@ -334,6 +649,10 @@ string MainLoop::executeRead(vector<string> &args)
 			hex = true;
 		} else if (args[argPos] == "-f") {
 			maxAge = 0;
+		} else if (args[argPos] == "-a") {
+			adaptive = true;
+		} else if (args[argPos] == "-s") {
+			stale = true;
 		} else if (args[argPos] == "-v") {
 			verbose = true;
 		} else if (args[argPos] == "-n") {
@@ -410,7 +729,8 @@ string MainLoop::executeRead(vector<string> &args)
 		if (address == BROADCAST || address.isMaster())
 			return getResultCode(RESULT_ERR_INVALID_ARG);
 
-		logNotice(lf_main, "read hex cmd: %s", cacheMaster.getDataStr(true, false).c_str());
+		if (busRequired == NULL)
+			logNotice(lf_main, "read hex cmd: %s", cacheMaster.getDataStr(true, false).c_str());
 
 		// find message
 		auto message = m_messages->find(cacheMaster, false, true, false, false);
@@ -421,17 +741,25 @@ string MainLoop::executeRead(vector<string> &args)
 			return getResultCode(RESULT_ERR_INVALID_ARG);
 		if (circuit.length() > 0 && circuit!=message->getCircuit())
 			return getResultCode(RESULT_ERR_INVALID_ARG); // non-matching circuit
-		if (message->getLastUpdateTime() + maxAge > now || (message->isPassive() && message->getLastUpdateTime() != 0)) {
+		time_t messageMaxAge = adaptive ? message->getAdaptiveMaxAge(maxAge) : maxAge;
+		bool fresh = message->getLastUpdateTime() + messageMaxAge > now || (message->isPassive() && message->getLastUpdateTime() != 0);
+		if (fresh || (stale && message->getLastUpdateTime() != 0)) {
+			if (!fresh && m_messages->addRefreshMessage(message))
+				logInfo(lf_main, "hex read %s %s outdated, refresh queued", message->getCircuit().c_str(), message->getName().c_str());
 			SymbolString& slave = message->getLastSlaveData();
 			logNotice(lf_main, "hex read %s %s from cache", message->getCircuit().c_str(), message->getName().c_str());
 			return slave.getDataStr();
 		}
+		if (busRequired) {
+			*busRequired = true;
+			return "";
+		}
 
 		// send message
 		SymbolString master(true);
 		master.addAll(cacheMaster);
 		SymbolString slave(false);
-		ret = m_busHandler->sendAndWait(master, slave);
+		ret = m_busHandler->sendAndWait(master, slave, m_requestTime);
 
 		if (ret == RESULT_OK) {
 			ret = message->storeLastData(cacheMaster, slave);
@@ -448,11 +776,13 @@ string MainLoop::executeRead(vector<string> &args)
 		return getResultCode(ret);
 	}
 	if (argPos == 0 || args.size() < argPos + 1 || args.size() > argPos + 2)
-		return "usage: read [-f] [-m SECONDS] [-c CIRCUIT] [-d ZZ] [-p PRIO] [-v] [-n] [-i VALUE[;VALUE]*] NAME [FIELD[.N]]\n"
-			   "  or:  read [-f] [-m SECONDS] [-c CIRCUIT] -h ZZPBSBNNDx\n"
+		return "usage: read [-f] [-m SECONDS] [-a] [-s] [-c CIRCUIT] [-d ZZ] [-p PRIO] [-v] [-n] [-i VALUE[;VALUE]*] NAME [FIELD[.N]]\n"
+			   "  or:  read [-f] [-m SECONDS] [-a] [-s] [-c CIRCUIT] -h ZZPBSBNNDx\n"
 			   " Read value(s) or hex message.\n"
 			   "  -f          force reading from the bus (same as '-m 0')\n"
 			   "  -m SECONDS  only return cached value if age is less than SECONDS [300]\n"
+			   "  -a          derive the maximum age from how often the value changed so far (SECONDS until known)\n"
+			   "  -s          return an outdated cached value immediately and refresh it in the background\n"
 			   "  -c CIRCUIT  limit to messages of CIRCUIT\n"
 			   "  -d ZZ       override destination address ZZ\n"
 			   "  -p PRIO     set the message poll priority (1-9)\n"
@@ -485,18 +815,33 @@ string MainLoop::executeRead(vector<string> &args)
 	ostringstream result;
 	auto message = m_messages->find(circuit, args[argPos], false);
 
-	// adjust poll priority
-	if (message != NULL && pollPriority > 0 && message->setPollPriority(pollPriority)) {
-		m_messages->addPollMessage(message);
-	}
+	// adjust poll priority (only once the command is executed, not when returning with busRequired)
+	auto adjustPollPriority = [&]() {
+		if (message != NULL && pollPriority > 0 && message->setPollPriority(pollPriority))
+			m_messages->addPollMessage(message);
+	};
+	if (!busRequired)
+		adjustPollPriority();
 
-	if (dstAddress==SYN && maxAge > 0) {
+	if (dstAddress==SYN && (maxAge > 0 || adaptive || stale)) {
 		auto cacheMessage = m_messages->find(circuit, args[argPos], false, true);
 		bool hasCache = cacheMessage != NULL;
 		if (!hasCache || (message != NULL && message->getLastUpdateTime() > cacheMessage->getLastUpdateTime()))
 			cacheMessage = message; // message is newer/better
 
-		if (cacheMessage != NULL && (cacheMessage->getLastUpdateTime() + maxAge > now || (cacheMessage->isPassive() && cacheMessage->getLastUpdateTime() != 0))) {
+		bool fresh = false;
+		if (cacheMessage != NULL) {
+			time_t cacheMaxAge = adaptive ? cacheMessage->getAdaptiveMaxAge(maxAge) : maxAge;
+			fresh = cacheMessage->getLastUpdateTime() + cacheMaxAge > now || (cacheMessage->isPassive() && cacheMessage->getLastUpdateTime() != 0);
+		}
+		if (cacheMessage != NULL && (fresh || (stale && params.empty() && cacheMessage->getLastUpdateTime() != 0))) {
+			if (busRequired)
+				adjustPollPriority();
+			if (!fresh) {
+				auto refreshMessage = cacheMessage->getDstAddress() == SYN ? message : cacheMessage;
+				if (m_messages->addRefreshMessage(refreshMessage))
+					logInfo(lf_main, "read %s %s outdated, refresh queued", cacheMessage->getCircuit().c_str(), cacheMessage->getName().c_str());
+			}
 			if (verbose)
 				result << cacheMessage->getCircuit() << " " << cacheMessage->getName() << " ";
 			result_t ret = cacheMessage->decodeLastData(result, (verbose?OF_VERBOSE:0)|(numeric?OF_NUMERIC:0), false, fieldIndex==-2 ? NULL : fieldName.c_str(), fieldIndex);
@@ -516,8 +861,16 @@ string MainLoop::executeRead(vector<string> &args)
 
 	if (message == NULL)
 		return getResultCode(RESULT_ERR_NOTFOUND);
-	if (message->getDstAddress()==SYN && dstAddress==SYN)
+	if (message->getDstAddress()==SYN && dstAddress==SYN) {
+		if (busRequired)
+			adjustPollPriority();
 		return getResultCode(RESULT_ERR_INVALID_ADDR);
+	}
+
+	if (busRequired) {
+		*busRequired = true;
+		return "";
+	}
 
 	// read directly from bus
 	result_t ret = readFromBus(message, params, dstAddress);
@@ -862,16 +1215,15 @@ string MainLoop::executeFind(vector<string> &args)
 			if (verbose) {
 				auto dstAddress = message->getDstAddress();
 				if (dstAddress != SYN)
-					sprintf(str, "%02x", dstAddress.binAddr());
+					snprintf(str, sizeof(str), "%02x", dstAddress.binAddr());
 				else if (lastup != 0 && message->getLastMasterData().size()>1)
-					sprintf(str, "%02x", message->getLastMasterData()[1]);
+					snprintf(str, sizeof(str), "%02x", message->getLastMasterData()[1]);
 				else
-					sprintf(str, "any");
+					snprintf(str, sizeof(str), "any");
 				if (lastup != 0) {
 					struct tm* td = localtime(&lastup);
-					sprintf(str+strlen(str), ", lastup=%04d-%02d-%02d %02d:%02d:%02d",
-						td->tm_year+1900, td->tm_mon+1, td->tm_mday,
-						td->tm_hour, td->tm_min, td->tm_sec);
+					size_t length = strlen(str);
+					strftime(str+length, sizeof(str)-length, ", lastup=%Y-%m-%d %H:%M:%S", td);
 				}
 				result << " [ZZ=" << str;
 				if (message->isPassive())
@@ -893,22 +1245,75 @@ string MainLoop::executeFind(vector<string> &args)
 	return result.str();
 }
 
-string MainLoop::executeListen(vector<string> &args, bool& listening)
+string MainLoop::executeListen(vector<string> &args, bool& listening, shared_ptr<ListenSubscription>& subscription)
 {
-	if (args.size() == 1) {
-		if (listening)
-			return "listen continued";
+	if (args.size() == 2 && args[1] == "stop") {
+		listening = false;
+		subscription.reset();
+		return "listen stopped";
+	}
 
-		listening = true;
-		return "listen started";
+	size_t argPos = 1;
+	string circuit, name;
+	while (args.size() > argPos && args[argPos][0] == '-') {
+		if (args[argPos] == "-c") {
+			argPos++;
+			if (argPos >= args.size()) {
+				argPos = 0; // print usage
+				break;
+			}
+			circuit = args[argPos];
+		} else {
+			argPos = 0; // print usage
+			break;
+		}
+		argPos++;
 	}
+	if (argPos > 0 && args.size() == argPos+1)
+		name = args[argPos++];
+	if (argPos == 0 || args.size() != argPos)
+		return "usage: listen [-c CIRCUIT] [NAME]\n"
+			   "  or:  listen stop\n"
+			   " Listen for updates (optionally only of matching messages) or stop it.\n"
+			   "  CIRCUIT  the circuit of the messages to listen for\n"
+			   "  NAME     the name of the messages to listen for";
+
+	FileReader::tolower(circuit);
+	FileReader::tolower(name);
+	bool continued = listening && subscription && subscription->getCircuit() == circuit && subscription->getName() == name;
+	if (!continued) {
+		subscription = make_shared<ListenSubscription>(circuit, name);
+		std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+		m_subscriptions.push_back(subscription);
+	}
+	if (listening)
+		return continued ? "listen continued" : "listen changed";
+
+	listening = true;
+	return "listen started";
+}
 
-	if (args.size() != 2 || args[1] != "stop")
-		return "usage: listen [stop]\n"
-			   " Listen for updates or stop it.";
+void MainLoop::notifyScanned(unsigned char address)
+{
+	m_scanConfigLoader->add(address);
+}
 
-	listening = false;
-	return "listen stopped";
+void MainLoop::notifyUpdate(const shared_ptr<Message>& message)
+{
+	if (m_mqttHandler)
+		m_mqttHandler->notifyUpdate(message);
+	std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+	for (size_t index = 0; index < m_subscriptions.size(); ) {
+		shared_ptr<ListenSubscription> subscription = m_subscriptions[index].lock();
+		if (!subscription) {
+			m_subscriptions[index] = m_subscriptions.back(); // expired
+			m_subscriptions.pop_back();
+			continue;
+		}
+		if (subscription->matches(message->getCircuit(), message->getName()))
+			subscription->publish();
+		index++;
+	}
 }
 
 string MainLoop::executeState(vector<string> &args)
@@ -1062,12 +1467,50 @@ string MainLoop::executeReload(vector<string> &args)
 		return "usage: reload\n"
 			   " Reload CSV config files.";
 
-	m_busHandler->clear();
-	result_t result = loadConfigFiles(m_messages);
+	// build the new generation while the bus and the other readers keep using the current one
+	auto messages = make_shared<MessageMap>();
+	messages->setHistorySegments(m_messages->getHistorySegments());
+	result_t result = loadConfigFiles(messages.get());
+	// derive the additional buses before the primary bus starts using the new generation
+	vector<shared_ptr<MessageMap>> derived;
+	for (size_t index = 0; index < m_additionalBuses.size(); index++) {
+		derived.push_back(make_shared<MessageMap>());
+		derived.back()->setHistorySegments(messages->getHistorySegments());
+		derived.back()->deriveFrom(messages);
+	}
+	switchMessages(m_messageMaps, m_messages, m_messagesGeneration, m_busHandler.get(), messages);
+	for (size_t index = 0; index < m_additionalBuses.size(); index++) {
+		AdditionalBus& bus = *m_additionalBuses[index];
+		bus.m_messageMaps.refresh(bus.m_messages, bus.m_messagesGeneration);
+		switchMessages(bus.m_messageMaps, bus.m_messages, bus.m_messagesGeneration, bus.m_busHandler.get(),
+			derived[index]);
+	}
 
 	return getResultCode(result);
 }
 
+void MainLoop::switchMessages(MessageMapHolder& holder, shared_ptr<MessageMap>& current, unsigned int& generation,
+	BusHandler* busHandler, shared_ptr<MessageMap> messages)
+{
+	messages->getChangeJournal().continueAfter(current->getChangeJournal());
+	generation = holder.publish(messages);
+	// the bus thread takes over the last seen data when switching, so keep the previous generation until then
+	// for freeing it here instead of in the bus thread
+	m_retiredMessages.push_back({busHandler, generation, current});
+	current = messages;
+	// the bus thread clears its scan state and prepares the answers when switching to the new generation
+}
+
+void MainLoop::releaseRetiredMessages()
+{
+	for (auto it = m_retiredMessages.begin(); it != m_retiredMessages.end(); ) {
+		if (static_cast<int>(it->m_busHandler->getMessagesGeneration() - it->m_generation) >= 0)
+			it = m_retiredMessages.erase(it);
+		else
+			it++;
+	}
+}
+
 string MainLoop::executeStop(vector<string> &args, bool& running)
 {
 	if (args.size() == 1) {
@@ -1090,15 +1533,53 @@ string MainLoop::executeInfo(vector<string> &args)
 	if (m_busHandler->hasSignal()) {
 		result << "signal: acquired\n";
 		result << "symbol rate: " << static_cast<unsigned>(m_busHandler->getSymbolRate()) << "\n";
+		result << "bus load: " << static_cast<unsigned>(m_busHandler->getBusLoad()) << "%\n";
 	} else {
 		result << "signal: no signal\n";
 	}
 	result << "masters: " << static_cast<unsigned>(m_busHandler->getMasterCount()) << "\n";
 	result << "messages: " << static_cast<unsigned>(m_messages->size());
+	if (!m_additionalBuses.empty()) {
+		result << "\nadditional buses: ";
+		for (size_t index = 0; index < m_additionalBuses.size(); index++)
+			result << (index == 0 ? "" : ", ") << m_additionalBuses[index]->m_name;
+	}
+	result << "\nunknown cache: " << m_messages->getUnknownCacheHits() << " hits, " << m_messages->getUnknownCacheMisses() << " misses";
+	StringPoolStats poolStats;
+	InternedString::getStats(poolStats);
+	result << "\nstring pool: " << poolStats.m_strings << " strings, " << poolStats.m_references << " references, "
+		<< poolStats.m_bytes << " bytes, " << poolStats.m_savedBytes << " bytes saved";
+	if (m_device->getDumpRawDropped() > 0)
+		result << "\ndump dropped: " << m_device->getDumpRawDropped() << " bytes";
+	if (!m_memoryLock.empty())
+		result << "\nmemory: " << m_memoryLock;
+	result << "\nthread " << getName() << ": " << getEffectiveSettings();
+	result << "\nthread " << m_busHandler->getName() << ": " << m_busHandler->getEffectiveSettings();
+	for (auto& bus : m_additionalBuses)
+		result << "\nthread " << bus->m_busHandler->getName() << "@" << bus->m_name << ": "
+			<< bus->m_busHandler->getEffectiveSettings();
+	result << "\nthread " << m_network->getName() << ": " << m_network->getEffectiveSettings();
 	m_busHandler->formatSeenInfo(result);
 	return result.str();
 }
 
+string MainLoop::executeStats(vector<string> &args)
+{
+	bool reset = false;
+	if (args.size() == 2 && strcasecmp(args[1].c_str(), "RESET") == 0)
+		reset = true;
+	else if (args.size() != 1)
+		return "usage: stats [reset]\n"
+			   " Report the bus timing statistics (times in microseconds) and the share of coalesced reads.\n"
+			   "  reset  reset the statistics after reporting them";
+
+	ostringstream result;
+	m_busHandler->formatStats(result);
+	if (reset)
+		m_busHandler->resetStats();
+	return result.str();
+}
+
 string MainLoop::executeQuit(vector<string> &args, bool& connected)
 {
 	if (args.size() == 1) {
@@ -1119,9 +1600,11 @@ string MainLoop::executeHelp()
 		   "          Write hex message:     write [-c CIRCUIT] -h ZZPBSBNNDx\n"
 		   " hex      Send hex data:         hex ZZPBSBNNDx\n"
 		   " find|f   Find message(s):       find [-v] [-r] [-w] [-p] [-d] [-i ID] [-f] [-F COL[,COL]*] [-e] [-c CIRCUIT] [NAME]\n"
-		   " listen|l Listen for updates:    listen [stop]\n"
+		   " listen|l Listen for updates:    listen [-c CIRCUIT] [NAME]\n"
+		   "          Stop listening:        listen stop\n"
 		   " state|s  Report bus state\n"
 		   " info|i   Report information about the daemon, the configuration, and seen devices.\n"
+		   " stats    Report bus timing:     stats [reset]\n"
 		   " grab|g   Grab messages:         grab [all|stop]\n"
 		   "          Report the messages:   grab result\n"
 		   " scan     Scan slaves:           scan [full|ZZ]\n"
@@ -1134,19 +1617,148 @@ string MainLoop::executeHelp()
 		   " reload   Reload CSV config files\n"
 		   " stop     Stop the daemon\n"
 		   " quit|q   Close connection\n"
-		   " help|h   Print help             help [COMMAND]";
+		   " help|h   Print help             help [COMMAND]\n"
+		   "Prefix a command with \"@NAME \" for sending it to the additional bus NAME.";
+}
+
+/**
+ * Format the header lines of a metric in the Prometheus text format.
+ * @param output the @a ostream to format to.
+ * @param name the name of the metric.
+ * @param type the type of the metric (counter or gauge).
+ * @param help the help text of the metric.
+ */
+static void formatMetricHeader(ostream& output, const char* name, const char* type, const char* help)
+{
+	output << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+void MainLoop::formatMetrics(ostream& output)
+{
+	output << dec << setw(0);
+	formatMetricHeader(output, "ebusd_signal", "gauge", "Whether a signal on the bus is available.");
+	output << "ebusd_signal " << (m_busHandler->hasSignal() ? 1 : 0) << "\n";
+	formatMetricHeader(output, "ebusd_symbol_rate", "gauge", "Number of received symbols in the last second.");
+	output << "ebusd_symbol_rate " << m_busHandler->getSymbolRate() << "\n";
+	formatMetricHeader(output, "ebusd_bus_load_percent", "gauge", "Bus capacity used by symbols other than SYN in the last second.");
+	output << "ebusd_bus_load_percent " << m_busHandler->getBusLoad() << "\n";
+	formatMetricHeader(output, "ebusd_masters", "gauge", "Number of masters seen on the bus.");
+	output << "ebusd_masters " << m_busHandler->getMasterCount() << "\n";
+	formatMetricHeader(output, "ebusd_telegrams_received_total", "counter", "Number of telegrams received completely.");
+	output << "ebusd_telegrams_received_total " << m_busHandler->getReceivedCount() << "\n";
+	formatMetricHeader(output, "ebusd_telegrams_sent_total", "counter", "Number of own telegrams sent successfully.");
+	output << "ebusd_telegrams_sent_total " << m_busHandler->getSentCount() << "\n";
+	formatMetricHeader(output, "ebusd_telegrams_unknown_total", "counter", "Number of received telegrams without matching message definition.");
+	output << "ebusd_telegrams_unknown_total " << m_busHandler->getUnknownCount() << "\n";
+	formatMetricHeader(output, "ebusd_crc_errors_total", "counter", "Number of received telegram parts with invalid CRC.");
+	output << "ebusd_crc_errors_total " << m_busHandler->getCrcErrorCount() << "\n";
+	formatMetricHeader(output, "ebusd_arbitration_lost_total", "counter", "Number of lost arbitrations.");
+	output << "ebusd_arbitration_lost_total " << m_busHandler->getArbitrationLostCount() << "\n";
+	formatMetricHeader(output, "ebusd_answers_total", "counter", "Number of requests to the own slave address answered.");
+	output << "ebusd_answers_total{source=\"prepared\"} " << m_busHandler->getAnsweredCount(true) << "\n"
+		<< "ebusd_answers_total{source=\"built\"} " << m_busHandler->getAnsweredCount(false) << "\n";
+	formatMetricHeader(output, "ebusd_queue_length", "gauge", "Number of items waiting in the internal queues.");
+	output << "ebusd_queue_length{queue=\"request\"} " << m_busHandler->getPendingRequestCount() << "\n"
+		<< "ebusd_queue_length{queue=\"finished\"} " << m_busHandler->getFinishedRequestCount() << "\n"
+		<< "ebusd_queue_length{queue=\"network\"} " << m_netQueue.size() << "\n"
+		<< "ebusd_queue_length{queue=\"poll\"} " << m_messages->sizePoll() << "\n"
+		<< "ebusd_queue_length{queue=\"refresh\"} " << m_messages->sizeRefresh() << "\n";
+	formatMetricHeader(output, "ebusd_connections", "gauge", "Number of currently open connections.");
+	output << "ebusd_connections{type=\"client\"} " << Connection::getOpenCount(false) << "\n"
+		<< "ebusd_connections{type=\"http\"} " << Connection::getOpenCount(true) << "\n";
+	formatMetricHeader(output, "ebusd_connections_opened_total", "counter", "Number of connections opened so far.");
+	output << "ebusd_connections_opened_total{type=\"client\"} " << Connection::getOpenedCount(false) << "\n"
+		<< "ebusd_connections_opened_total{type=\"http\"} " << Connection::getOpenedCount(true) << "\n";
+	if (m_mqttHandler) {
+		formatMetricHeader(output, "ebusd_mqtt_connected", "gauge", "Whether the connection to the MQTT broker is established.");
+		output << "ebusd_mqtt_connected " << (m_mqttHandler->isConnected() ? 1 : 0) << "\n";
+		formatMetricHeader(output, "ebusd_mqtt_published_total", "counter", "Number of values published to the MQTT broker.");
+		output << "ebusd_mqtt_published_total " << m_mqttHandler->getPublishedCount() << "\n";
+		formatMetricHeader(output, "ebusd_mqtt_dropped_total", "counter", "Number of updates dropped because too many were waiting for MQTT.");
+		output << "ebusd_mqtt_dropped_total " << m_mqttHandler->getDroppedCount() << "\n";
+	}
+	formatMetricHeader(output, "ebusd_log_dropped_total", "counter", "Number of log messages dropped by the background log thread.");
+	output << "ebusd_log_dropped_total " << getLogDroppedCount() << "\n";
+	formatMetricHeader(output, "ebusd_messages", "gauge", "Number of message definitions.");
+	output << "ebusd_messages{kind=\"all\"} " << m_messages->size() << "\n"
+		<< "ebusd_messages{kind=\"conditional\"} " << m_messages->sizeConditional() << "\n"
+		<< "ebusd_messages{kind=\"passive\"} " << m_messages->sizePassive() << "\n"
+		<< "ebusd_messages{kind=\"poll\"} " << m_messages->sizePoll() << "\n";
+	formatMetricHeader(output, "ebusd_definitions_arena_bytes", "gauge", "Memory used by the definitions of the current configuration.");
+	output << "ebusd_definitions_arena_bytes{kind=\"allocated\"} " << m_messages->sizeArena(false) << "\n"
+		<< "ebusd_definitions_arena_bytes{kind=\"reserved\"} " << m_messages->sizeArena(true) << "\n";
+}
+
+void MainLoop::formatHistory(OutputSink& output, const shared_ptr<Message>& message, const time_t since,
+	const OutputFormat outputFormat)
+{
+	output << ",\n   \"history\": [";
+	bool first = true;
+	message->getHistory()->get(since, [&output, &message, &first, outputFormat](time_t time, SymbolString& master,
+		SymbolString& slave) {
+		if (first)
+			first = false;
+		else
+			output << ",";
+		output << "\n    {\"time\": ";
+		writeUnsigned(output, static_cast<unsigned>(time));
+		size_t pos = output.size();
+		output << ", \"fields\": {";
+		result_t result = message->decodeData(master, slave, output, outputFormat);
+		if (result == RESULT_OK) {
+			output << "}}";
+		} else {
+			output.truncate(pos); // remove written fields
+			output.clear();
+			output << ", \"decodeerror\": \"" << getResultCode(result) << "\"}";
+		}
+		return true;
+	});
+	output << (first ? "]" : "\n   ]");
 }
 
+#ifdef HAVE_ZLIB
+/**
+ * Encode the data in gzip format.
+ * @param input the data to encode.
+ * @param output the @a string to store the encoded data in.
+ * @return true on success, false on error.
+ */
+static bool gzipEncode(const string& input, string& output)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// window bits plus 16 for writing a gzip header and trailer instead of the zlib ones
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	output.resize(deflateBound(&stream, static_cast<uLong>(input.length())));
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+	stream.avail_in = static_cast<uInt>(input.length());
+	stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+	stream.avail_out = static_cast<uInt>(output.length());
+	int ret = deflate(&stream, Z_FINISH);
+	output.resize(stream.total_out);
+	deflateEnd(&stream);
+	return ret == Z_STREAM_END;
+}
+#endif
+
 string MainLoop::executeGet(vector<string> &args, bool& connected)
 {
 	result_t ret = RESULT_OK;
 	bool verbose = false, numeric = false, required = false;
 	size_t argPos = 1;
 	string uri = args[argPos++];
-	ostringstream result;
+	OutputSink& result = m_output;
+	result.reset();
 	int type = -1;
+	string etag;
+	bool notModified = false;
 
-	if (strncmp(uri.c_str(), "/data/", 6) == 0) {
+	if (uri == "/metrics") {
+		formatMetrics(result);
+		type = 7;
+	} else if (strncmp(uri.c_str(), "/data/", 6) == 0) {
 		string circuit = "", name = "";
 		size_t pos = uri.find('/', 6);
 		if (pos == string::npos) {
@@ -1157,7 +1769,7 @@ string MainLoop::executeGet(vector<string> &args, bool& connected)
 		}
 		time_t since = 0;
 		unsigned char pollPriority = 0;
-		bool exact = false;
+		bool exact = false, history = false;
 		if (args.size() > argPos) {
 			string query = args[argPos++];
 			istringstream stream(query);
@@ -1183,6 +1795,8 @@ string MainLoop::executeGet(vector<string> &args, bool& connected)
 					numeric = value.length()==0 || strcmp(value.c_str(), "1") == 0;
 				} else if (strcmp(qname.c_str(), "required") == 0) {
 					required = value.length()==0 || strcmp(value.c_str(), "1") == 0;
+				} else if (strcmp(qname.c_str(), "history") == 0) {
+					history = value.length()==0 || strcmp(value.c_str(), "1") == 0;
 				}
 				if (ret != RESULT_OK)
 					break;
@@ -1190,11 +1804,34 @@ string MainLoop::executeGet(vector<string> &args, bool& connected)
 		}
 		auto messages = m_messages->findAll(circuit, name, exact, true, false, true);
 
+		if (ret == RESULT_OK && !required && pollPriority == 0) {
+			// weak entity tag valid as long as none of the selected messages changed
+			size_t count = 0;
+			time_t maxLastChange = 0;
+			unsigned long long changes = 0;
+			for (const auto& message : messages) {
+				if (message->getDstAddress() == SYN)
+					continue;
+				if (since > 0 && message->getLastUpdateTime() <= since)
+					continue;
+				count++;
+				changes += message->getChangeCount();
+				if (message->getLastChangeTime() > maxLastChange)
+					maxLastChange = message->getLastChangeTime();
+			}
+			ostringstream tag;
+			tag << "W/\"" << hex << m_messagesGeneration << "-" << static_cast<unsigned>(maxLastChange)
+				<< "-" << changes << "-" << count << (m_busHandler->hasSignal() ? "s" : "n") << "\"";
+			etag = tag.str();
+			const string& match = m_httpHeaders.m_ifNoneMatch;
+			notModified = match == "*" || match.find(etag) != string::npos;
+		}
+
 		bool first = true;
 		result << "{";
 		string lastCircuit = "";
 		time_t maxLastUp = 0;
-		for (auto it = messages.begin(); ret == RESULT_OK && it < messages.end();) {
+		for (auto it = messages.begin(); ret == RESULT_OK && !notModified && it < messages.end();) {
 			auto message = *it++;
 			auto dstAddress = message->getDstAddress();
 			if (dstAddress == SYN)
@@ -1227,27 +1864,31 @@ string MainLoop::executeGet(vector<string> &args, bool& connected)
 			else
 				result << ",";
 			result << "\n  \"" << message->getName() << "\": {";
-			result << "\n   \"lastup\": " << setw(0) << dec << static_cast<unsigned>(lastup);
+			result << "\n   \"lastup\": " << setw(0) << dec;
+			writeUnsigned(result, static_cast<unsigned>(lastup));
 			if (lastup != 0) {
 				result << ",\n   \"zz\": \"" << setfill('0') << setw(2) << hex << static_cast<unsigned>(dstAddress.binAddr()) << "\"";
-				size_t pos = (size_t)result.tellp();
+				size_t pos = result.size();
 				result << ",\n   \"fields\": {";
 				result_t dret = message->decodeLastData(result, (verbose?OF_VERBOSE:0)|(numeric?OF_NUMERIC:0)|OF_JSON);
 				if (dret==RESULT_OK) {
 					result << "\n   }";
 				} else {
-					string prefix = result.str().substr(0, pos);
-					result.str("");
-					result.clear(); // remove written fields
-					result << prefix << ",\n   \"decodeerror\": \"" << getResultCode(dret) << "\"";
+					result.truncate(pos); // remove written fields
+					result.clear();
+					result << ",\n   \"decodeerror\": \"" << getResultCode(dret) << "\"";
 				}
+				if (history && message->getHistory() != NULL)
+					formatHistory(result, message, since, (verbose?OF_VERBOSE:0)|(numeric?OF_NUMERIC:0)|OF_JSON);
 			}
 			result << ",\n   \"passive\": " << (message->isPassive() ? "true" : "false");
 			result << ",\n   \"write\": " << (message->isWrite() ? "true" : "false");
 			result << "\n  }";
 		}
 
-		if (ret == RESULT_OK) {
+		if (notModified) {
+			result.reset();
+		} else if (ret == RESULT_OK) {
 			if (lastCircuit.length() > 0)
 				result << "\n },";
 			result << "\n \"global\": {";
@@ -1299,60 +1940,113 @@ string MainLoop::executeGet(vector<string> &args, bool& connected)
 		}
 	}
 
-	string data = ret==RESULT_OK ? result.str() : "";
-	result.str("");
-	result.clear();
-	result << "HTTP/1.0 ";
-	switch (ret) {
+	size_t dataLength = ret==RESULT_OK ? result.size() : 0;
+	string encoded;
+#ifdef HAVE_ZLIB
+	if (dataLength >= HTTP_GZIP_MIN_SIZE && m_httpHeaders.m_acceptGzip && type != 3 && type != 4) {
+		string plain;
+		plain.reserve(dataLength);
+		result.appendTo(plain);
+		if (gzipEncode(plain, encoded))
+			dataLength = encoded.length();
+		else
+			encoded.clear();
+	}
+#endif
+	ostringstream header;
+	header << (m_httpHeaders.m_http11 ? "HTTP/1.1 " : "HTTP/1.0 ");
+	switch (notModified ? RESULT_EMPTY : ret) {
+	case RESULT_EMPTY:
+		header << "304 Not Modified\r\nETag: " << etag;
+		break;
 	case RESULT_OK:
-		result << "200 OK\r\nContent-Type: ";
+		if (!etag.empty())
+			header << "200 OK\r\nETag: " << etag << "\r\nContent-Type: ";
+		else
+			header << "200 OK\r\nContent-Type: ";
 		switch (type) {
 		case 1:
-			result << "text/css";
+			header << "text/css";
 			break;
 		case 2:
-			result << "application/javascript";
+			header << "application/javascript";
 			break;
 		case 3:
-			result << "image/png";
+			header << "image/png";
 			break;
 		case 4:
-			result << "image/jpeg";
+			header << "image/jpeg";
 			break;
 		case 5:
-			result << "image/svg+xml";
+			header << "image/svg+xml";
 			break;
 		case 6:
-			result << "application/json;charset=utf-8";
+			header << "application/json;charset=utf-8";
+			break;
+		case 7:
+			header << "text/plain; version=0.0.4; charset=utf-8";
 			break;
 		default:
-			result << "text/html";
+			header << "text/html";
 			break;
 		}
-		result << "\r\nContent-Length: " << setw(0) << dec << static_cast<unsigned>(data.length());
+		if (!encoded.empty())
+			header << "\r\nContent-Encoding: gzip";
+		if (type != 3 && type != 4)
+			header << "\r\nVary: Accept-Encoding";
+		header << "\r\nContent-Length: " << setw(0) << dec << static_cast<unsigned>(dataLength);
 		break;
 	case RESULT_ERR_NOTFOUND:
-		result << "404 Not Found";
+		header << "404 Not Found\r\nContent-Length: 0";
 		break;
 	case RESULT_ERR_INVALID_ARG:
 	case RESULT_ERR_INVALID_NUM:
 	case RESULT_ERR_OUT_OF_RANGE:
-		result << "400 Bad Request";
+		header << "400 Bad Request\r\nContent-Length: 0";
 		break;
 	default:
-		result << "500 Internal Server Error";
+		header << "500 Internal Server Error\r\nContent-Length: 0";
 		break;
 	}
-	result << "\r\nServer: ebusd/" PACKAGE_VERSION "\r\n\r\n";
-	result << data;
-	connected = false;
-	return result.str();
+	connected = m_httpHeaders.m_keepAlive;
+	if (!connected)
+		header << "\r\nConnection: close";
+	else if (!m_httpHeaders.m_http11)
+		header << "\r\nConnection: keep-alive";
+	if (connected)
+		header << "\r\nKeep-Alive: timeout=" << static_cast<unsigned>(HTTP_KEEPALIVE_TIMEOUT);
+	header << "\r\nServer: ebusd/" PACKAGE_VERSION "\r\n\r\n";
+	string response = header.str();
+	if (!encoded.empty()) {
+		response.append(encoded);
+	} else if (dataLength > 0) {
+		response.reserve(response.length() + dataLength);
+		result.appendTo(response);
+	}
+	return response;
 }
 
-string MainLoop::getUpdates(time_t since, time_t until)
+string MainLoop::getUpdates(time_t since, time_t until, unsigned long long& cursor,
+	const shared_ptr<ListenSubscription>& subscription)
 {
-	ostringstream result;
+	OutputSink& result = m_output;
+	result.reset();
+
+	vector<Message*> changed;
+	if (m_messages->getChangeJournal().getChanges(cursor, changed)) {
+		for (auto message : changed) {
+			if (message->getDstAddress() == SYN || !message->isAvailable())
+				continue;
+			if (subscription && !subscription->matches(message->getCircuit(), message->getName()))
+				continue;
+			result << message->getCircuit() << " " << message->getName() << " = ";
+			message->decodeLastData(result);
+			result << endl;
+		}
+		return result.str();
+	}
 
+	// changes were dropped from the journal: check all messages
 	auto messages = m_messages->findAll("", "", false, true, true, true);
 
 	for (auto it = messages.begin(); it < messages.end();) {
@@ -1363,6 +2057,8 @@ string MainLoop::getUpdates(time_t since, time_t until)
 		time_t lastchg = message->getLastChangeTime();
 		if (lastchg < since || lastchg >= until)
 			continue;
+		if (subscription && !subscription->matches(message->getCircuit(), message->getName()))
+			continue;
 		result << message->getCircuit() << " " << message->getName() << " = ";
 		message->decodeLastData(result);
 		result << endl;
@@ -22,15 +22,152 @@
 #include "message.h"
 #include "network.h"
 #include "bushandler.h"
+#include "mqtthandler.h"
+#include "outputsink.h"
+#include "tokenizer.h"
 
 #include <memory>
+#include <mutex>
+#include <condition_variable>
 
 /** \file mainloop.h */
 
+/** the minimum size in bytes of a textual HTTP response for being gzip encoded (if supported). */
+#define HTTP_GZIP_MIN_SIZE 1024
+
+/**
+ * Loads the configuration files matching the scan result of slave addresses from a dedicated thread.
+ */
+class ScanConfigLoader : public Thread
+{
+public:
+
+	/**
+	 * Constructor.
+	 * @param messages the @a MessageMapHolder with the current generation to load the configuration files into.
+	 * @param busHandler the @a BusHandler instance to inform about loaded configuration files.
+	 * @param messagesMutex the mutex for exclusive access to the current generation of @a messages.
+	 */
+	ScanConfigLoader(MessageMapHolder& messages, BusHandler* busHandler, std::mutex& messagesMutex)
+		: m_messages(messages), m_busHandler(busHandler), m_messagesMutex(messagesMutex) {}
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~ScanConfigLoader();
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	ScanConfigLoader(const ScanConfigLoader& src);
+
+public:
+
+	/**
+	 * Add a scanned slave address for loading its configuration file.
+	 * @param address the scanned slave address.
+	 */
+	void add(unsigned char address);
+
+	// @copydoc
+	void stop() override;
+
+protected:
+
+	// @copydoc
+	void run() override;
+
+private:
+
+	/**
+	 * Load the configuration file matching the scan result of a slave address.
+	 * @param address the scanned slave address.
+	 */
+	void load(unsigned char address);
+
+	/** the @a MessageMapHolder with the current generation to load the configuration files into. */
+	MessageMapHolder& m_messages;
+
+	/** the @a BusHandler instance to inform about loaded configuration files. */
+	BusHandler* m_busHandler;
+
+	/** the mutex for exclusive access to the current generation of @a m_messages. */
+	std::mutex& m_messagesMutex;
+
+	/** the mutex for @a m_pending and @a m_stopping. */
+	std::mutex m_mutex;
+
+	/** the condition for waking up the thread. */
+	std::condition_variable m_cond;
+
+	/** the scanned slave addresses waiting for having their configuration file loaded. */
+	deque<unsigned char> m_pending;
+
+	/** whether the thread shall stop. */
+	bool m_stopping = false;
+
+};
+
+
+/**
+ * An additional bus segment handled by the same daemon with an own @a Device and @a BusHandler thread.
+ *
+ * Its @a Message instances are derived from the definitions loaded for the primary bus, so that only the
+ * last seen data and the polling state are kept per bus. Client commands and HTTP requests address it by
+ * the "@NAME" prefix.
+ */
+struct AdditionalBus
+{
+	/**
+	 * Constructor.
+	 * @param name the name for addressing the bus.
+	 * @param device the @a Device instance.
+	 * @param messages the initial @a MessageMap generation with the derived @a Message instances.
+	 */
+	AdditionalBus(const string& name, shared_ptr<Device> device, shared_ptr<MessageMap> messages)
+		: m_name(name), m_device(device), m_messageMaps(messages), m_messages(messages) {}
+
+	/** the name for addressing the bus. */
+	const string m_name;
+
+	/** the @a Device instance. */
+	shared_ptr<Device> m_device;
+
+	/** the @a MessageMapHolder with the current generation of the derived @a Message instances. */
+	MessageMapHolder m_messageMaps;
+
+	/** the @a MessageMap generation used by the main loop thread (swapped with the primary while selected). */
+	shared_ptr<MessageMap> m_messages;
+
+	/** the number of the @a MessageMap generation in @a m_messages. */
+	unsigned int m_messagesGeneration = 0;
+
+	/** the created @a BusHandler instance (swapped with the primary while selected). */
+	std::unique_ptr<BusHandler> m_busHandler;
+};
+
+/**
+ * A previous @a MessageMap generation kept until the bus thread switched to a newer one.
+ */
+struct RetiredMessages
+{
+	/** the @a BusHandler of the bus. */
+	BusHandler* m_busHandler;
+
+	/** the number of the generation the bus thread has to switch to before releasing @a m_messages. */
+	unsigned int m_generation;
+
+	/** the previous @a MessageMap generation. */
+	shared_ptr<MessageMap> m_messages;
+};
+
 /**
  * The main loop handling requests from connected clients.
  */
-class MainLoop : public Thread
+class MainLoop : public Thread, public UpdateListener, public ScanListener
 {
 
 public:
@@ -38,9 +175,17 @@ public:
 	 * Construct the main loop and create network and bus handling components.
 	 * @param opt the program options.
 	 * @param device the @a Device instance.
-	 * @param messages the @a MessageMap instance.
+	 * @param messages the initial @a MessageMap generation.
+	 * @param buses the names and @a Device instances of additional buses.
+	 * @param memoryLock the result of locking the memory at startup, or empty if not requested.
 	 */
-	MainLoop(const struct options& opt, shared_ptr<Device> device, MessageMap* messages);
+	MainLoop(const struct options& opt, shared_ptr<Device> device, shared_ptr<MessageMap> messages,
+		const vector<std::pair<string, shared_ptr<Device>>>& buses, const string& memoryLock);
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~MainLoop();
 
 	/**
 	 * Run the main loop.
@@ -53,13 +198,34 @@ public:
 	 */
 	void addMessage(NetMessage* message) { m_netQueue.push(message); }
 
+	// @copydoc
+	void notifyUpdate(const shared_ptr<Message>& message) override;
+
+	// @copydoc
+	void notifyScanned(unsigned char address) override;
+
 private:
 
 	/** the @a Device instance. */
 	std::shared_ptr<Device> m_device;
 
-	/** the @a MessageMap instance. */
-	MessageMap* m_messages;
+	/** the @a MessageMapHolder with the current generation of all known @a Message instances. */
+	MessageMapHolder m_messageMaps;
+
+	/** the @a MessageMap generation used by the main loop thread. */
+	shared_ptr<MessageMap> m_messages;
+
+	/** the number of the @a MessageMap generation in @a m_messages. */
+	unsigned int m_messagesGeneration = 0;
+
+	/** the monotonic time in microseconds when the currently handled request was received, or 0. */
+	unsigned long long m_requestTime = 0;
+
+	/** the relevant headers of the currently handled HTTP request. */
+	HttpHeaders m_httpHeaders;
+
+	/** the tokens of the currently handled command (reused for avoiding allocations). */
+	vector<StringRef> m_tokens;
 
 	/** the own master address for sending on the bus. */
 	const libebus::Address m_address;
@@ -70,28 +236,133 @@ private:
 	/** whether to enable the hex command. */
 	const bool m_enableHex;
 
+	/** the result of locking the memory at startup, or empty if not requested. */
+	const string m_memoryLock;
+
+	/** the created @a MqttHandler instance, or NULL. */
+	std::unique_ptr<MqttHandler> m_mqttHandler;
+
+	/** the mutex for exclusive access to the current @a MessageMap generation between handling client messages
+	 * and loading scan configuration files. */
+	std::mutex m_messagesMutex;
+
+	/** the created @a ScanConfigLoader instance, or NULL if not picking configuration files matching the scan. */
+	std::unique_ptr<ScanConfigLoader> m_scanConfigLoader;
+
+	/** the mutex for @a m_subscriptions. */
+	std::mutex m_subscriptionsMutex;
+
+	/** the @a ListenSubscription instances of listening clients (removed when expired). */
+	vector<weak_ptr<ListenSubscription>> m_subscriptions;
+
 	/** the created @a BusHandler instance. */
 	std::unique_ptr<BusHandler> m_busHandler;
 
+	/** the @a AdditionalBus instances. */
+	vector<std::unique_ptr<AdditionalBus>> m_additionalBuses;
+
 	/** the created @a Network instance. */
 	std::unique_ptr<Network> m_network;
 
 	/** the @a NetMessage @a Queue. */
-	Queue<NetMessage*> m_netQueue;
+	RingQueue<NetMessage*> m_netQueue;
+
+	/** the @a NetMessage instances taken from @a m_netQueue that still need to be handled (in order). */
+	deque<NetMessage*> m_deferredMessages;
+
+	/** the previous @a MessageMap generations still possibly in use by a bus thread (freed from this thread). */
+	deque<RetiredMessages> m_retiredMessages;
 
 	/** the path for HTML files served by the HTTP port. */
 	string m_htmlPath;
 
+	/** the @a OutputSink reused for formatting the larger responses (HTTP data and listen updates). */
+	OutputSink m_output;
+
+	/**
+	 * Handle all commands of a client @a NetMessage and set its result.
+	 * @param message the client @a NetMessage to handle.
+	 * @param cacheOnly true to only handle the message if all of its commands can be answered from the cache
+	 * without accessing the bus.
+	 * @param running set to false when the server shall be stopped.
+	 * @return true if the message was handled, false if it was left untouched because of @a cacheOnly.
+	 */
+	bool handleMessage(NetMessage* message, const bool cacheOnly, bool& running);
+
+	/**
+	 * Publish a new @a MessageMap generation of a bus without waiting for the bus to switch to it.
+	 * The previous generation is kept in @a m_retiredMessages until the bus thread switched.
+	 * @param holder the @a MessageMapHolder of the bus.
+	 * @param current the @a MessageMap generation used by the main loop thread (updated).
+	 * @param generation the number of the generation in @a current (updated).
+	 * @param busHandler the @a BusHandler of the bus.
+	 * @param messages the new @a MessageMap generation.
+	 */
+	void switchMessages(MessageMapHolder& holder, shared_ptr<MessageMap>& current, unsigned int& generation,
+		BusHandler* busHandler, shared_ptr<MessageMap> messages);
+
+	/**
+	 * Release the previous @a MessageMap generations the bus threads no longer use.
+	 */
+	void releaseRetiredMessages();
+
+	/**
+	 * Find the @a AdditionalBus addressed by the "@NAME" prefix of a client command and remove the prefix.
+	 * @param args the arguments of the client command.
+	 * @param isHttp true for HTTP message.
+	 * @param bus set to the addressed @a AdditionalBus, or NULL for the primary bus.
+	 * @return false when an unknown bus was addressed.
+	 */
+	bool findBus(vector<string>& args, const bool isHttp, AdditionalBus*& bus);
+
+	/**
+	 * Swap the bus specific members with the ones of an @a AdditionalBus for selecting it (and back again).
+	 * @param bus the @a AdditionalBus.
+	 */
+	void swapBus(AdditionalBus& bus);
+
+	/**
+	 * Split a client command into its arguments.
+	 * @param data the data string to split.
+	 * @param isHttp true for HTTP message.
+	 * @param args the @a vector to add the arguments to.
+	 */
+	void splitArgs(const string& data, const bool isHttp, vector<string>& args);
+
+	/**
+	 * Execute a client command only if it is a read command that can be answered from the cache.
+	 * @param data the data string to decode.
+	 * @param result the string to store the result in.
+	 * @return true if the command was answered from the cache, false if it needs to be executed normally.
+	 */
+	bool decodeCached(const string& data, string& result);
+
 	/**
 	 * Decode and execute client message.
 	 * @param data the data string to decode (may be empty).
 	 * @param connected set to false when the client connection shall be closed.
 	 * @param isHttp true for HTTP message.
 	 * @param listening set to true when the client is in listening mode.
+	 * @param subscription the @a ListenSubscription of the client in listening mode (replaced by the listen command).
+	 * @param running set to false when the server shall be stopped.
+	 * @return result string to send back to the client.
+	 */
+	string decodeMessage(const string& data, const bool isHttp, bool& connected, bool& listening,
+		shared_ptr<ListenSubscription>& subscription, bool& running);
+
+	/**
+	 * Execute a split client command on the currently selected bus.
+	 * The command handlers still receive their arguments as strings and parse their own options.
+	 * @param args the arguments of the client command.
+	 * @param isHttp true for HTTP message.
+	 * @param connected set to false when the client connection shall be closed.
+	 * @param listening set to true when the client is in listening mode.
+	 * @param subscription the @a ListenSubscription of the client in listening mode (replaced by the listen command).
 	 * @param running set to false when the server shall be stopped.
 	 * @return result string to send back to the client.
 	 */
-	string decodeMessage(const string& data, const bool isHttp, bool& connected, bool& listening, bool& running);
+	string executeCommand(vector<string>& args, const bool isHttp, bool& connected, bool& listening,
+		shared_ptr<ListenSubscription>& subscription, bool& running);
 
 	/**
 	 * Parse the hex master message from the remaining arguments.
@@ -114,9 +385,10 @@ private:
 	/**
 	 * Execute the read command.
 	 * @param args the arguments passed to the command (starting with the command itself), or empty for help.
+	 * @param busRequired when not NULL, a read from the bus is not performed but signaled by setting this to true.
 	 * @return the result string.
 	 */
-	string executeRead(vector<string> &args);
+	string executeRead(vector<string> &args, bool* busRequired=NULL);
 
 	/**
 	 * Execute the write command.
@@ -143,9 +415,10 @@ private:
 	 * Execute the listen command.
 	 * @param args the arguments passed to the command (starting with the command itself), or empty for help.
 	 * @param listening set to true when the client is in listening mode.
+	 * @param subscription the @a ListenSubscription of the client, replaced when listening is started or stopped.
 	 * @return the result string.
 	 */
-	string executeListen(vector<string> &args, bool& listening);
+	string executeListen(vector<string> &args, bool& listening, shared_ptr<ListenSubscription>& subscription);
 
 	/**
 	 * Execute the state command.
@@ -211,6 +484,19 @@ private:
 	 */
 	string executeInfo(vector<string> &args);
 
+	/**
+	 * Format the counters and gauges for the HTTP /metrics endpoint in the Prometheus text format.
+	 * @param output the @a ostream to format to.
+	 */
+	void formatMetrics(ostream& output);
+
+	/**
+	 * Execute the stats command.
+	 * @param args the arguments passed to the command (starting with the command itself), or empty for help.
+	 * @return the result string.
+	 */
+	string executeStats(vector<string> &args);
+
 	/**
 	 * Execute the quit command.
 	 * @param args the arguments passed to the command (starting with the command itself), or empty for help.
@@ -225,6 +511,16 @@ private:
 	 */
 	string executeHelp();
 
+	/**
+	 * Format the JSON array of the @a DataHistory entries of a @a Message for the HTTP /data endpoint.
+	 * @param output the @a OutputSink to format to.
+	 * @param message the @a Message with a @a DataHistory.
+	 * @param since the system time after which to include the entries.
+	 * @param outputFormat the @a OutputFormat options for the fields.
+	 */
+	void formatHistory(OutputSink& output, const shared_ptr<Message>& message, const time_t since,
+		const OutputFormat outputFormat);
+
 	/**
 	 * Execute the HTTP GET command.
 	 * @param args the arguments passed to the command (starting with the command itself).
@@ -234,12 +530,15 @@ private:
 	string executeGet(vector<string> &args, bool& connected);
 
 	/**
-	 * Get the updates received since the specified time.
-	 * @param since the start time from which to add updates (inclusive).
-	 * @param until the end time to which to add updates (exclusive).
+	 * Get the updates recorded in the @a ChangeJournal since the cursor.
+	 * @param since the start time from which to add updates (inclusive) if the journal is incomplete.
+	 * @param until the end time to which to add updates (exclusive) if the journal is incomplete.
+	 * @param cursor the @a ChangeJournal cursor from which to add updates, updated to the cursor for the next call.
+	 * @param subscription the @a ListenSubscription for filtering the updates, or NULL for all.
 	 * @return result string to send back to client.
 	 */
-	string getUpdates(time_t since, time_t until);
+	string getUpdates(time_t since, time_t until, unsigned long long& cursor,
+		const shared_ptr<ListenSubscription>& subscription);
 
 };
 
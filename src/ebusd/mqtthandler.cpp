@@ -0,0 +1,254 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "mqtthandler.h"
+#include "log.h"
+#include <cerrno>
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/** the MQTT packet type CONNECT. */
+#define MQTT_CONNECT 0x10
+
+/** the MQTT packet type CONNACK. */
+#define MQTT_CONNACK 0x20
+
+/** the MQTT packet type PUBLISH (QoS 0). */
+#define MQTT_PUBLISH 0x30
+
+/** the MQTT packet type PINGREQ. */
+#define MQTT_PINGREQ 0xc0
+
+/** the MQTT packet type DISCONNECT. */
+#define MQTT_DISCONNECT 0xe0
+
+/** the timeout in seconds for sending to and receiving from the broker. */
+#define MQTT_IO_TIMEOUT 5
+
+MqttHandler::~MqttHandler()
+{
+	stop();
+	join();
+}
+
+void MqttHandler::notifyUpdate(const shared_ptr<Message>& message)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pending.size() >= MQTT_MAX_PENDING && m_pending.find(message.get()) == m_pending.end()) {
+		m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	bool wasEmpty = m_pending.empty();
+	m_pending[message.get()] = message;
+	if (wasEmpty)
+		m_cond.notify_one();
+}
+
+void MqttHandler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cond.notify_one();
+	Thread::stop();
+}
+
+void MqttHandler::wait(std::unique_lock<std::mutex>& lock, unsigned int milliseconds)
+{
+	if (!m_stopping)
+		m_cond.wait_for(lock, std::chrono::milliseconds(milliseconds));
+}
+
+void MqttHandler::run()
+{
+	time_t lastConnect = 0, lastSend = 0, now;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stopping) {
+		if (!m_socket) {
+			time(&now);
+			if (lastConnect == 0 || now < lastConnect || now >= lastConnect+MQTT_RECONNECT_DELAY) {
+				lastConnect = now;
+				lock.unlock();
+				bool connected = connect();
+				lock.lock();
+				if (connected)
+					lastSend = now;
+			}
+			if (!m_socket) {
+				wait(lock, MQTT_RECONNECT_DELAY*1000);
+				continue;
+			}
+		}
+		if (m_pending.empty())
+			wait(lock, MQTT_KEEPALIVE/2*1000);
+		if (!m_pending.empty() && m_window > 0) {
+			// collect further updates of the same messages
+			auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_window);
+			while (!m_stopping && m_cond.wait_until(lock, until) != std::cv_status::timeout) {}
+		}
+		if (m_stopping)
+			break;
+		unordered_map<Message*, shared_ptr<Message>> pending;
+		pending.swap(m_pending);
+		lock.unlock();
+		time(&now);
+		bool success = discardInput(), sent = !pending.empty();
+		for (auto it = pending.begin(); success && it != pending.end(); ) {
+			success = publish(it->first);
+			if (success)
+				it = pending.erase(it);
+		}
+		if (success && !sent && (now < lastSend || now >= lastSend+MQTT_KEEPALIVE/2))
+			sent = success = send(string(1, (char)MQTT_PINGREQ)+string(1, '\0'));
+		if (!success)
+			disconnect(false);
+		else if (sent)
+			lastSend = now;
+		lock.lock();
+		for (auto& entry : pending) // keep the updates not published for the next connection
+			m_pending.insert(entry);
+	}
+	lock.unlock();
+	disconnect(true);
+}
+
+bool MqttHandler::connect()
+{
+	TCPClient client;
+	TCPSocket* socket = client.connect(m_host, m_port);
+	if (socket == NULL) {
+		logError(lf_network, "unable to connect to MQTT broker %s:%d", m_host.c_str(), m_port);
+		return false;
+	}
+	m_socket.reset(socket);
+	struct timeval timeout;
+	timeout.tv_sec = MQTT_IO_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(socket->getFD(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	setsockopt(socket->getFD(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	string data;
+	appendString(data, "MQTT");
+	data += (char)0x04; // protocol level 3.1.1
+	data += (char)0x02; // clean session
+	data += (char)(MQTT_KEEPALIVE>>8);
+	data += (char)(MQTT_KEEPALIVE&0xff);
+	appendString(data, "ebusd-"+std::to_string(getpid()));
+	unsigned char ack[4];
+	size_t received = 0;
+	if (send(buildPacket(MQTT_CONNECT, data))) {
+		while (received < sizeof(ack)) {
+			ssize_t len = ::recv(socket->getFD(), ack+received, sizeof(ack)-received, 0);
+			if (len <= 0)
+				break;
+			received += (size_t)len;
+		}
+	}
+	if (received < sizeof(ack) || ack[0] != MQTT_CONNACK || ack[1] != 2 || ack[3] != 0) {
+		logError(lf_network, "MQTT broker %s:%d refused the connection", m_host.c_str(), m_port);
+		disconnect(false);
+		return false;
+	}
+	m_connected = true;
+	logNotice(lf_network, "connected to MQTT broker %s:%d", m_host.c_str(), m_port);
+	return true;
+}
+
+void MqttHandler::disconnect(bool graceful)
+{
+	if (!m_socket)
+		return;
+	if (graceful && m_connected)
+		send(string(1, (char)MQTT_DISCONNECT)+string(1, '\0'));
+	if (m_connected)
+		logNotice(lf_network, "disconnected from MQTT broker %s:%d", m_host.c_str(), m_port);
+	m_connected = false;
+	m_socket.reset();
+}
+
+bool MqttHandler::send(const string& packet)
+{
+	size_t pos = 0;
+	while (pos < packet.length()) {
+		ssize_t sent = m_socket->send(packet.c_str()+pos, packet.length()-pos);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		pos += (size_t)sent;
+	}
+	return true;
+}
+
+bool MqttHandler::discardInput()
+{
+	char buffer[256];
+	while (true) {
+		ssize_t len = ::recv(m_socket->getFD(), buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (len > 0)
+			continue;
+		return len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+	}
+}
+
+bool MqttHandler::publish(Message* message)
+{
+	ostringstream output;
+	result_t result = message->decodeLastData(output);
+	if (result != RESULT_OK) {
+		logDebug(lf_network, "unable to publish %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
+			getResultCode(result));
+		return true;
+	}
+	string data;
+	appendString(data, m_topicPrefix+"/"+message->getCircuit()+"/"+message->getName());
+	data += output.str();
+	if (!send(buildPacket((unsigned char)(MQTT_PUBLISH | (m_retain ? 0x01 : 0x00)), data)))
+		return false;
+	m_publishedCount.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+string MqttHandler::buildPacket(const unsigned char header, const string& remaining)
+{
+	string packet(1, (char)header);
+	size_t length = remaining.length();
+	do {
+		unsigned char digit = (unsigned char)(length & 0x7f);
+		length >>= 7;
+		if (length > 0)
+			digit |= 0x80;
+		packet += (char)digit;
+	} while (length > 0);
+	packet += remaining;
+	return packet;
+}
+
+void MqttHandler::appendString(string& data, const string& value)
+{
+	data += (char)((value.length()>>8) & 0xff);
+	data += (char)(value.length() & 0xff);
+	data += value;
+}
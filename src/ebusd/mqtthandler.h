@@ -0,0 +1,219 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTHANDLER_H_
+#define MQTTHANDLER_H_
+
+#include "bushandler.h"
+#include "message.h"
+#include "tcpsocket.h"
+#include "thread.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/** @file mqtthandler.h
+ * A publisher of updated messages to an MQTT broker.
+ *
+ * The @a MqttHandler is informed by the @a BusHandler thread about changed
+ * messages and only remembers them, so that the bus thread never waits for
+ * the broker. Several changes of the same message within the collection
+ * window are coalesced into a single publication of the latest value. The
+ * messages are decoded and published by the own thread using MQTT 3.1.1 with
+ * QoS 0 to the topic "PREFIX/CIRCUIT/NAME".
+ */
+
+/** the default port of the MQTT broker. */
+#define MQTT_DEFAULT_PORT 1883
+
+/** the default time in milliseconds for collecting updates before publishing them. */
+#define MQTT_DEFAULT_WINDOW 500
+
+/** the maximum number of different messages waiting for being published. */
+#define MQTT_MAX_PENDING 1024
+
+/** the keep alive interval in seconds announced to the broker. */
+#define MQTT_KEEPALIVE 60
+
+/** the delay in seconds before reconnecting to the broker. */
+#define MQTT_RECONNECT_DELAY 5
+
+/**
+ * Publishes updated messages to an MQTT broker from a dedicated thread.
+ */
+class MqttHandler : public Thread, public UpdateListener
+{
+public:
+
+	/**
+	 * Construct a new instance.
+	 * @param host the host name or IP address of the broker.
+	 * @param port the port of the broker.
+	 * @param topicPrefix the prefix of all topics.
+	 * @param window the time in milliseconds for collecting updates before publishing them.
+	 * @param retain whether the broker shall retain the published values.
+	 */
+	MqttHandler(const string& host, const uint16_t port, const string& topicPrefix,
+		const unsigned int window, const bool retain)
+		: m_host(host), m_port(port), m_topicPrefix(topicPrefix), m_window(window), m_retain(retain) {}
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~MqttHandler();
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	MqttHandler(const MqttHandler& src);
+
+public:
+
+	// @copydoc
+	void notifyUpdate(const shared_ptr<Message>& message) override;
+
+	// @copydoc
+	void stop() override;
+
+	/**
+	 * Return whether the connection to the broker is established.
+	 * @return whether the connection to the broker is established.
+	 */
+	bool isConnected() const { return m_connected.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the number of values published so far.
+	 * @return the number of values published so far.
+	 */
+	unsigned long getPublishedCount() const { return m_publishedCount.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the number of updates dropped because too many messages were waiting.
+	 * @return the number of dropped updates.
+	 */
+	unsigned long getDroppedCount() const { return m_droppedCount.load(std::memory_order_relaxed); }
+
+protected:
+
+	// @copydoc
+	void run() override;
+
+private:
+
+	/**
+	 * Connect to the broker and wait for the acknowledge.
+	 * @return true on success.
+	 */
+	bool connect();
+
+	/**
+	 * Close the connection to the broker.
+	 * @param graceful whether to announce the disconnect to the broker.
+	 */
+	void disconnect(bool graceful);
+
+	/**
+	 * Send a complete packet to the broker.
+	 * @param packet the packet to send.
+	 * @return true on success, false if the connection was closed.
+	 */
+	bool send(const string& packet);
+
+	/**
+	 * Read and discard everything sent by the broker (e.g. ping responses) without waiting.
+	 * @return true on success, false if the connection was closed.
+	 */
+	bool discardInput();
+
+	/**
+	 * Decode and publish the latest data of the @a Message.
+	 * @param message the @a Message to publish.
+	 * @return true on success, false if the connection was closed.
+	 */
+	bool publish(Message* message);
+
+	/**
+	 * Wait until there is something to do or the handler is stopped.
+	 * @param lock the @a unique_lock on @a m_mutex.
+	 * @param milliseconds the maximum time to wait in milliseconds.
+	 */
+	void wait(std::unique_lock<std::mutex>& lock, unsigned int milliseconds);
+
+	/**
+	 * Build a packet from the fixed header byte and the remaining data.
+	 * @param header the first byte of the fixed header.
+	 * @param remaining the variable header and the payload.
+	 * @return the packet.
+	 */
+	static string buildPacket(const unsigned char header, const string& remaining);
+
+	/**
+	 * Append a length prefixed string to the packet data.
+	 * @param data the packet data to append to.
+	 * @param value the string to append.
+	 */
+	static void appendString(string& data, const string& value);
+
+	/** the host name or IP address of the broker. */
+	const string m_host;
+
+	/** the port of the broker. */
+	const uint16_t m_port;
+
+	/** the prefix of all topics. */
+	const string m_topicPrefix;
+
+	/** the time in milliseconds for collecting updates before publishing them. */
+	const unsigned int m_window;
+
+	/** whether the broker shall retain the published values. */
+	const bool m_retain;
+
+	/** the mutex for @a m_pending and @a m_stopping. */
+	std::mutex m_mutex;
+
+	/** the condition for waking up the thread. */
+	std::condition_variable m_cond;
+
+	/** the changed messages waiting for being published by @a Message pointer. */
+	unordered_map<Message*, shared_ptr<Message>> m_pending;
+
+	/** whether the thread shall stop. */
+	bool m_stopping = false;
+
+	/** the connection to the broker, or NULL. */
+	std::unique_ptr<TCPSocket> m_socket;
+
+	/** whether the connection to the broker is established. */
+	std::atomic<bool> m_connected{false};
+
+	/** the number of values published so far. */
+	std::atomic<unsigned long> m_publishedCount{0};
+
+	/** the number of updates dropped because too many messages were waiting. */
+	std::atomic<unsigned long> m_droppedCount{0};
+
+};
+
+#endif // MQTTHANDLER_H_
@@ -22,7 +22,10 @@
 
 #include "network.h"
 #include "log.h"
+#include "poller.h"
 #include <cstring>
+#include <errno.h>
+#include <unordered_map>
 
 #ifdef HAVE_PPOLL
 #include <poll.h>
@@ -30,6 +33,10 @@
 
 int Connection::m_ids = 0;
 
+std::atomic<unsigned long> Connection::m_openedCount[2];
+
+std::atomic<unsigned long> Connection::m_openCount[2];
+
 void Connection::run()
 {
 	int ret;
@@ -43,7 +50,7 @@ void Connection::run()
 
 #ifdef HAVE_PPOLL
 	int nfds = 2;
-	struct pollfd fds[nfds];
+	struct pollfd fds[3];
 
 	memset(fds, 0, sizeof(fds));
 
@@ -69,17 +76,35 @@ void Connection::run()
 
 	bool closed = false;
 	NetMessage message(m_isHttp);
+	time_t lastActivity, now;
+	time(&lastActivity);
 
 	while (!closed) {
+		// also wake up for updates published to the subscription of a listening client
+		shared_ptr<ListenSubscription> subscription = message.getSubscription();
+		int listenFD = subscription ? subscription->getNotifyFD() : -1;
 #ifdef HAVE_PPOLL
+		nfds = 2;
+		if (listenFD >= 0) {
+			fds[2].fd = listenFD;
+			fds[2].events = POLLIN;
+			fds[2].revents = 0;
+			nfds = 3;
+		}
 		// wait for new fd event
 		ret = ppoll(fds, nfds, &tdiff, NULL);
 #else
 #ifdef HAVE_PSELECT
 		// set readfds to inital checkfds
 		fd_set readfds = checkfds;
+		int waitfd = maxfd;
+		if (listenFD >= 0) {
+			FD_SET(listenFD, &readfds);
+			if (listenFD > waitfd)
+				waitfd = listenFD;
+		}
 		// wait for new fd event
-		ret = pselect(maxfd + 1, &readfds, NULL, &exceptfds, &tdiff, NULL);
+		ret = pselect(waitfd + 1, &readfds, NULL, &exceptfds, &tdiff, NULL);
 #endif
 #endif
 		bool newData = false;
@@ -92,6 +117,8 @@ void Connection::run()
 			// new data from socket
 			newData = fds[1].revents & POLLIN;
 			closed = fds[1].revents & POLLRDHUP;
+			if (nfds > 2 && (fds[2].revents & POLLIN))
+				subscription->consume();
 #else
 #ifdef HAVE_PSELECT
 			// new data from notify
@@ -101,10 +128,20 @@ void Connection::run()
 			// new data from socket
 			newData = FD_ISSET(sockFD, &readfds);
 			closed = FD_ISSET(sockFD, &exceptfds);
+			if (listenFD >= 0 && FD_ISSET(listenFD, &readfds))
+				subscription->consume();
 #endif
 #endif
 		}
 
+		time(&now);
+		if (newData) {
+			lastActivity = now;
+		} else if (m_isHttp && (now < lastActivity || now >= lastActivity+HTTP_KEEPALIVE_TIMEOUT)) {
+			logDebug(lf_network, "[%05d] idle HTTP connection", getID());
+			break;
+		}
+
 		if (newData || message.isListening()) {
 			char data[256];
 
@@ -124,7 +161,8 @@ void Connection::run()
 			}
 
 			// decode client data
-			if (message.add(data)) {
+			bool complete = message.add(data);
+			while (complete) {
 				m_netQueue.push(&message);
 
 				// wait for result
@@ -135,6 +173,8 @@ void Connection::run()
 					break;
 
 				m_socket->send(result.c_str(), result.size());
+				// a pipelined HTTP request might already be complete
+				complete = m_isHttp && !message.isDisconnect() && message.add("");
 			}
 
 			if (message.isDisconnect() || !m_socket->isValid())
@@ -147,8 +187,102 @@ void Connection::run()
 }
 
 
-Network::Network(const bool local, const uint16_t port, const uint16_t httpPort, Queue<NetMessage*>& netQueue)
-	: m_netQueue(netQueue)
+bool ReactorConnection::handleEvents(const short events, RingQueue<NetMessage*>& netQueue)
+{
+	if (events & (POLLERR | POLLHUP)) {
+		// the message can only be released after the result was set
+		m_closing = true;
+		return m_pending;
+	}
+	if (events & POLLOUT)
+		return flush();
+
+	if (!(events & POLLIN) || m_pending)
+		return true;
+
+	char data[256];
+	ssize_t datalen = m_socket->recv(data, sizeof(data)-1);
+	if (datalen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return true;
+
+	// remove closed socket
+	if (datalen <= 0)
+		return false;
+
+	data[datalen] = '\0';
+	time(&m_lastActivity);
+	addRequest(data, netQueue);
+	return true;
+}
+
+bool ReactorConnection::handleResult()
+{
+	if (!m_pending || !m_message.hasResult())
+		return true;
+
+	m_pending = false;
+	string result = m_message.getResult();
+	if (m_closing)
+		return false;
+
+	m_output = result;
+	m_outputPos = 0;
+	if (m_message.isDisconnect())
+		m_closing = true;
+	return flush();
+}
+
+void ReactorConnection::checkListening(RingQueue<NetMessage*>& netQueue)
+{
+	if (!m_pending && m_output.empty() && m_message.isListening()) {
+		m_listenUpdate = false;
+		addRequest("", netQueue);
+	}
+}
+
+void ReactorConnection::checkPipelined(RingQueue<NetMessage*>& netQueue)
+{
+	if (m_message.isHttp() && !m_pending && !m_closing && m_output.empty())
+		addRequest("", netQueue);
+}
+
+bool ReactorConnection::isIdle(const time_t now) const
+{
+	return m_message.isHttp() && !m_pending && m_output.empty()
+		&& (now < m_lastActivity || now >= m_lastActivity+HTTP_KEEPALIVE_TIMEOUT);
+}
+
+void ReactorConnection::addRequest(const char* data, RingQueue<NetMessage*>& netQueue)
+{
+	// decode client data
+	if (m_message.add(data)) {
+		m_pending = true;
+		logDebug(lf_network, "[%05d] wait for result", getID());
+		netQueue.push(&m_message);
+	}
+}
+
+bool ReactorConnection::flush()
+{
+	while (m_outputPos < m_output.size()) {
+		ssize_t sent = m_socket->send(m_output.c_str() + m_outputPos, m_output.size() - m_outputPos);
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return true;
+
+		if (sent <= 0)
+			return false;
+
+		m_outputPos += (size_t)sent;
+	}
+	m_output.clear();
+	m_outputPos = 0;
+	return !m_closing;
+}
+
+
+Network::Network(const bool local, const uint16_t port, const uint16_t httpPort, RingQueue<NetMessage*>& netQueue,
+	const bool reactor)
+	: m_netQueue(netQueue), m_reactor(reactor)
 {
 	if (local)
 		m_tcpServer = std::make_unique<TCPServer>(port, "127.0.0.1");
@@ -172,6 +306,7 @@ Network::~Network()
     m_connections.clear();
 
 	join();
+	m_pendingConnections.clear();
 }
 
 void Network::run()
@@ -179,6 +314,11 @@ void Network::run()
 	if (!m_listening)
 		return;
 
+	if (m_reactor) {
+		runReactor();
+		return;
+	}
+
 	int ret;
 	struct timespec tdiff;
 
@@ -295,3 +435,171 @@ void Network::cleanConnections()
 	}
 }
 
+/**
+ * Close a @a ReactorConnection and stop watching its socket.
+ * @param poller the @a Poller watching the socket.
+ * @param connections the open @a ReactorConnection instances by socket file descriptor.
+ * @param listening the @a ReactorConnection instances by file descriptor of the watched @a ListenSubscription.
+ * @param connection the @a ReactorConnection to close.
+ */
+static void closeConnection(Poller& poller, std::unordered_map<int, shared_ptr<ReactorConnection>>& connections,
+	std::unordered_map<int, shared_ptr<ReactorConnection>>& listening, shared_ptr<ReactorConnection> connection)
+{
+	if (connection->getWatchedEvents() >= 0)
+		poller.remove(connection->getFD());
+	auto subscription = connection->getWatchedSubscription();
+	if (subscription) {
+		poller.remove(subscription->getNotifyFD());
+		listening.erase(subscription->getNotifyFD());
+		connection->setWatchedSubscription(NULL);
+	}
+	connections.erase(connection->getFD());
+	logInfo(lf_network, "[%05d] connection closed", connection->getID());
+}
+
+void Network::runReactor()
+{
+	Poller poller;
+	if (!poller.isValid()) {
+		logError(lf_network, "unable to create poller");
+		return;
+	}
+	int notifyFD = m_notify.notifyFD();
+	int resultFD = m_resultNotify.notifyFD();
+	int tcpFD = m_tcpServer->getFD();
+	int httpFD = m_httpServer ? m_httpServer->getFD() : -1;
+	poller.add(notifyFD, POLLIN);
+	poller.add(resultFD, POLLIN);
+	poller.add(tcpFD, POLLIN);
+	if (m_httpServer)
+		poller.add(httpFD, POLLIN);
+
+	std::unordered_map<int, shared_ptr<ReactorConnection>> connections, listening;
+	vector<Poller::Event> events;
+	vector<shared_ptr<ReactorConnection>> touched;
+	time_t lastListenCheck, now;
+	time(&lastListenCheck);
+
+	bool running = true;
+	while (running) {
+		int ret = poller.wait(1000, events);
+		if (ret < 0 && errno != EINTR) {
+			logError(lf_network, "unable to wait for network events: %s", strerror(errno));
+			break;
+		}
+		touched.clear();
+		for (auto& event : events) {
+			int fd = event.m_fd;
+			if (fd == notifyFD) {
+				running = false;
+				break;
+			}
+
+			if (fd == resultFD) {
+				char buffer[256];
+				if (read(resultFD, buffer, sizeof(buffer)) > 0) {
+					for (auto& it : connections) {
+						if (it.second->isPending())
+							touched.push_back(it.second);
+					}
+				}
+				continue;
+			}
+			if (fd == tcpFD || fd == httpFD) {
+				bool isHttp = fd == httpFD;
+				auto socket = (isHttp ? m_httpServer : m_tcpServer)->newSocket();
+				if (socket == NULL)
+					continue;
+
+				if (!socket->setNonBlocking())
+					continue;
+
+				auto connection = make_shared<ReactorConnection>(socket, isHttp, &m_resultNotify);
+				connections[connection->getFD()] = connection;
+				touched.push_back(connection);
+				logInfo(lf_network, "[%05d] %s connection opened %s", connection->getID(), isHttp ? "HTTP" : "client", socket->getIP().c_str());
+				continue;
+			}
+			auto listenIt = listening.find(fd);
+			if (listenIt != listening.end()) {
+				listenIt->second->handleListenEvent();
+				touched.push_back(listenIt->second);
+				continue;
+			}
+			auto it = connections.find(fd);
+			if (it == connections.end())
+				continue;
+
+			auto connection = it->second;
+			if (connection->handleEvents(event.m_events, m_netQueue))
+				touched.push_back(connection);
+			else
+				closeConnection(poller, connections, listening, connection);
+		}
+		if (!running)
+			break;
+
+		// regularly pass listening connections to the main loop for adding updates
+		time(&now);
+		if (now < lastListenCheck || now >= lastListenCheck+2) {
+			vector<shared_ptr<ReactorConnection>> idle;
+			for (auto& it : connections) {
+				if (it.second->isIdle(now)) {
+					idle.push_back(it.second);
+					continue;
+				}
+				it.second->checkListening(m_netQueue);
+				touched.push_back(it.second);
+			}
+			for (auto& connection : idle) {
+				logDebug(lf_network, "[%05d] idle HTTP connection", connection->getID());
+				closeConnection(poller, connections, listening, connection);
+			}
+			lastListenCheck = now;
+		}
+
+		for (auto& connection : touched) {
+			int fd = connection->getFD();
+			auto it = connections.find(fd);
+			if (it == connections.end() || it->second != connection)
+				continue; // already closed
+
+			if (!connection->handleResult()) {
+				closeConnection(poller, connections, listening, connection);
+				continue;
+			}
+			connection->checkPipelined(m_netQueue);
+			if (connection->hasListenUpdate())
+				connection->checkListening(m_netQueue);
+			auto subscription = connection->getSubscription();
+			auto watchedSubscription = connection->getWatchedSubscription();
+			if (subscription != watchedSubscription) {
+				if (watchedSubscription) {
+					poller.remove(watchedSubscription->getNotifyFD());
+					listening.erase(watchedSubscription->getNotifyFD());
+				}
+				if (subscription) {
+					poller.add(subscription->getNotifyFD(), POLLIN);
+					listening[subscription->getNotifyFD()] = connection;
+				}
+				connection->setWatchedSubscription(subscription);
+			}
+			short watched = connection->getWatchedEvents();
+			short wanted = connection->getEvents();
+			if (wanted == watched)
+				continue;
+			if (wanted < 0)
+				poller.remove(fd);
+			else if (watched < 0)
+				poller.add(fd, wanted);
+			else
+				poller.modify(fd, wanted);
+			connection->setWatchedEvents(wanted);
+		}
+	}
+	// the MainLoop might still reference the NetMessage of pending connections, so keep them until destruction
+	for (auto& it : connections) {
+		if (it.second->isPending())
+			m_pendingConnections.push_back(it.second);
+	}
+}
@@ -20,18 +20,142 @@
 #define NETWORK_H_
 
 #include "tcpsocket.h"
-#include "queue.h"
+#include "ringqueue.h"
 #include "notify.h"
 #include "thread.h"
+#include "clock.h"
 #include <string>
+#include <sstream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
 #include <algorithm>
+#include <atomic>
+#include <vector>
+#include <poll.h>
 
 /** \file network.h */
 
 /** Forward declaration for @a Connection. */
 class Connection;
 
+/**
+ * The subscription of a listening client for updated messages.
+ *
+ * Updates are published by the bus handling thread and only wake up the
+ * connection through the own @a Notify object if circuit and name match the
+ * filter. Several updates published before the connection woke up are
+ * collected into a single wakeup.
+ */
+class ListenSubscription
+{
+
+public:
+	/**
+	 * Constructor.
+	 * @param circuit the circuit name to match (lower case), or empty for any.
+	 * @param name the message name to match (lower case), or empty for any.
+	 */
+	ListenSubscription(const string& circuit, const string& name)
+		: m_circuit(circuit), m_name(name) {}
+
+private:
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	ListenSubscription(const ListenSubscription& src);
+
+public:
+
+	/**
+	 * Return whether an update of the message with the circuit and name matches the filter.
+	 * @param circuit the circuit name of the updated message.
+	 * @param name the name of the updated message.
+	 * @return whether the update matches the filter.
+	 */
+	bool matches(const string& circuit, const string& name) const
+	{
+		return (m_circuit.empty() || strcasecmp(m_circuit.c_str(), circuit.c_str()) == 0)
+			&& (m_name.empty() || strcasecmp(m_name.c_str(), name.c_str()) == 0);
+	}
+
+	/**
+	 * Return the circuit name to match.
+	 * @return the circuit name to match, or empty for any.
+	 */
+	const string& getCircuit() const { return m_circuit; }
+
+	/**
+	 * Return the message name to match.
+	 * @return the message name to match, or empty for any.
+	 */
+	const string& getName() const { return m_name; }
+
+	/**
+	 * Publish a matching update and wake up the connection if not done already.
+	 */
+	void publish()
+	{
+		if (!m_pending.exchange(true))
+			m_notify.notify();
+	}
+
+	/**
+	 * Return the file descriptor that becomes readable when an update was published.
+	 * @return the file descriptor to watch.
+	 */
+	int getNotifyFD() { return m_notify.notifyFD(); }
+
+	/**
+	 * Consume the wakeup after the file descriptor became readable (before collecting the updates).
+	 */
+	void consume()
+	{
+		char buffer[32];
+		if (read(m_notify.notifyFD(), buffer, sizeof(buffer)) < 0) {
+			// nothing to consume
+		}
+		m_pending = false;
+	}
+
+private:
+	/** the circuit name to match, or empty for any. */
+	const string m_circuit;
+
+	/** the message name to match, or empty for any. */
+	const string m_name;
+
+	/** the @a Notify object for waking up the connection. */
+	Notify m_notify;
+
+	/** whether an update was published since the last @a consume(). */
+	std::atomic<bool> m_pending{false};
+
+};
+
+/** the number of seconds after which an idle persistent HTTP connection is closed. */
+#define HTTP_KEEPALIVE_TIMEOUT 15
+
+/**
+ * The HTTP request headers relevant for preparing the response.
+ */
+struct HttpHeaders
+{
+	/** whether the request was sent with HTTP/1.1 (or later). */
+	bool m_http11 = false;
+
+	/** whether the client wants to keep the connection open for further requests. */
+	bool m_keepAlive = false;
+
+	/** whether the client accepts gzip encoded content. */
+	bool m_acceptGzip = false;
+
+	/** the entity tag(s) of the "If-None-Match" header, or empty. */
+	string m_ifNoneMatch;
+};
+
 /**
  * Class for data/message transfer between @a Connection and @a MainLoop.
  */
@@ -70,6 +194,10 @@ public:
 
 	/**
 	 * Add request data received from the client.
+	 * For non-HTTP messages, the request consists of all complete lines received so far (without the last
+	 * line separator), while an incomplete last line is kept for the next request.
+	 * For HTTP messages, the request consists of the first line without the "HTTP/x.x" suffix, while the relevant
+	 * headers are available via @a getHttpHeaders() and anything after the empty line is kept for the next request.
 	 * @param request the request data from the client.
 	 * @return true when the request is complete and the response shall be prepared.
 	 */
@@ -81,11 +209,17 @@ public:
 		}
 		size_t pos = m_request.find(m_isHttp ? "\n\n" : "\n");
 		if (pos!=string::npos) {
+			m_receiveTime = clockGetMicros();
 			if (m_isHttp) {
+				m_remainder = m_request.substr(pos+2); // pipelined request
+				m_request.resize(pos);
 				pos = m_request.find("\n");
-				m_request.resize(pos); // reduce to first line
+				string headers = pos == string::npos ? "" : m_request.substr(pos+1);
+				if (pos != string::npos)
+					m_request.resize(pos); // reduce to first line
 				// typical first line: GET /ehp/outsidetemp HTTP/1.1
 				pos = m_request.rfind(" HTTP/");
+				parseHttpHeaders(pos != string::npos && m_request.compare(pos+6, string::npos, "1.0") != 0, headers);
 				if (pos!=string::npos) {
 					m_request.resize(pos); // remove "HTTP/x.x" suffix
 				}
@@ -97,7 +231,9 @@ public:
 					m_request[pos] = (char)(((value1&0x0f)<<4)|(value2&0x0f));
 					m_request.erase(pos+1, 2);
 				}
-			} else if (pos+1==m_request.length()) {
+			} else {
+				pos = m_request.rfind('\n');
+				m_remainder = m_request.substr(pos+1);
 				m_request.resize(pos); // reduce to complete lines
 			}
 			return true;
@@ -112,11 +248,41 @@ public:
 	bool isHttp() const { return m_isHttp; }
 
 	/**
-	 * Return the request string.
+	 * Return the request string (for non-HTTP messages possibly several lines separated by newline).
 	 * @return the request string.
 	 */
 	string getRequest() const { return m_request; }
 
+	/**
+	 * Return the relevant headers of the last complete HTTP request.
+	 * @return the @a HttpHeaders of the last complete HTTP request.
+	 */
+	const HttpHeaders& getHttpHeaders() const { return m_httpHeaders; }
+
+	/**
+	 * Return the monotonic time in microseconds when the request was completely received.
+	 * @return the monotonic time in microseconds when the request was completely received, or 0.
+	 */
+	unsigned long long getReceiveTime() const { return m_receiveTime; }
+
+	/**
+	 * Set the @a Notify object to signal when the result was set instead of only waking up @a getResult().
+	 * @param notify the @a Notify object, or NULL.
+	 */
+	void setResultNotify(const Notify* notify) { m_resultNotify = notify; }
+
+	/**
+	 * Return whether the result was already set, i.e. @a getResult() does not block.
+	 * @return whether the result was already set.
+	 */
+	bool hasResult()
+	{
+		pthread_mutex_lock(&m_mutex);
+		bool ret = m_resultSet;
+		pthread_mutex_unlock(&m_mutex);
+		return ret;
+	}
+
 	/**
 	 * Wait for the result being set and return the result string.
 	 * @return the result string.
@@ -128,7 +294,8 @@ public:
 		while (!m_resultSet)
 			pthread_cond_wait(&m_cond, &m_mutex);
 
-		m_request.clear();
+		m_request = m_remainder;
+		m_remainder.clear();
 		string result = m_result;
 		m_result.clear();
 		m_resultSet = false;
@@ -142,26 +309,40 @@ public:
 	 * @param result the result string.
 	 * @param listening whether the client is in listening mode.
 	 * @param listenUntil the end time to which to updates were added (exclusive).
+	 * @param listenCursor the @a ChangeJournal cursor up to which updates were added.
 	 * @param disconnect true when the client shall be disconnected.
 	 */
-	void setResult(const string result, const bool listening, const time_t listenUntil, const bool disconnect)
+	void setResult(const string result, const bool listening, const time_t listenUntil,
+		const unsigned long long listenCursor, const bool disconnect)
 	{
 		pthread_mutex_lock(&m_mutex);
 		m_result = result;
 		m_disconnect = disconnect;
 		m_listening = listening;
 		m_listenSince = listenUntil;
+		m_listenCursor = listenCursor;
 		m_resultSet = true;
 		pthread_cond_signal(&m_cond);
+		const Notify* notify = m_resultNotify; // this might be gone right after unlocking
 		pthread_mutex_unlock(&m_mutex);
+		if (notify)
+			notify->notify();
 	}
 
 	/**
 	 * Return whether the client is in listening mode.
 	 * @param listenSince set to the start time from which to add updates (inclusive).
+	 * @param listenCursor set to the @a ChangeJournal cursor from which to add updates.
 	 * @return whether the client is in listening mode.
 	 */
-	bool isListening(time_t* listenSince=NULL) { if (listenSince) *listenSince = m_listenSince; return m_listening; }
+	bool isListening(time_t* listenSince=NULL, unsigned long long* listenCursor=NULL)
+	{
+		if (listenSince)
+			*listenSince = m_listenSince;
+		if (listenCursor)
+			*listenCursor = m_listenCursor;
+		return m_listening;
+	}
 
 	/**
 	 * Return whether the client shall be disconnected.
@@ -169,13 +350,101 @@ public:
 	 */
 	bool isDisconnect() { return m_disconnect; }
 
+	/**
+	 * Set the @a ListenSubscription of the client in listening mode (before setting the result).
+	 * @param subscription the @a ListenSubscription, or NULL.
+	 */
+	void setSubscription(shared_ptr<ListenSubscription> subscription) { m_subscription = subscription; }
+
+	/**
+	 * Return the @a ListenSubscription of the client in listening mode.
+	 * @return the @a ListenSubscription, or NULL.
+	 */
+	shared_ptr<ListenSubscription> getSubscription() const { return m_subscription; }
+
+	/**
+	 * Remember the leading request lines already handled (only used by the thread handling the request).
+	 * @param lines the number of leading request lines already handled.
+	 * @param results the concatenated results of these lines.
+	 */
+	void setHandledLines(const size_t lines, const string& results)
+	{
+		m_handledLines = lines;
+		m_handledResults = results;
+	}
+
+	/**
+	 * Return the leading request lines already handled (only used by the thread handling the request).
+	 * @param results set to the concatenated results of these lines.
+	 * @return the number of leading request lines already handled.
+	 */
+	size_t getHandledLines(string& results) const
+	{
+		results = m_handledResults;
+		return m_handledLines;
+	}
+
 private:
+	/**
+	 * Parse the relevant HTTP request headers into @a m_httpHeaders.
+	 * @param http11 whether the request was sent with HTTP/1.1 (or later).
+	 * @param headers the header lines following the first request line (without carriage returns).
+	 */
+	void parseHttpHeaders(const bool http11, const string& headers)
+	{
+		m_httpHeaders = HttpHeaders();
+		m_httpHeaders.m_http11 = http11;
+		m_httpHeaders.m_keepAlive = http11; // persistent by default since HTTP/1.1
+		istringstream stream(headers);
+		string line;
+		while (getline(stream, line)) {
+			size_t pos = line.find(':');
+			if (pos == string::npos)
+				continue;
+			string name = line.substr(0, pos);
+			pos = line.find_first_not_of(" \t", pos+1);
+			string value = pos == string::npos ? "" : line.substr(pos);
+			if (strcasecmp(name.c_str(), "Connection") == 0) {
+				transform(value.begin(), value.end(), value.begin(), ::tolower);
+				if (value.find("close") != string::npos)
+					m_httpHeaders.m_keepAlive = false;
+				else if (value.find("keep-alive") != string::npos)
+					m_httpHeaders.m_keepAlive = true;
+			} else if (strcasecmp(name.c_str(), "If-None-Match") == 0) {
+				m_httpHeaders.m_ifNoneMatch = value;
+			} else if (strcasecmp(name.c_str(), "Accept-Encoding") == 0) {
+				transform(value.begin(), value.end(), value.begin(), ::tolower);
+				pos = value.find("gzip");
+				if (pos != string::npos) {
+					// a quality value of zero explicitly refuses the encoding
+					size_t qpos = value.find(";q=", pos+4);
+					m_httpHeaders.m_acceptGzip = qpos != pos+4 || strtod(value.c_str()+qpos+3, NULL) > 0;
+				}
+			}
+		}
+	}
+
 	/** whether this is a HTTP message. */
 	const bool m_isHttp;
 
+	/** the relevant headers of the last complete HTTP request. */
+	HttpHeaders m_httpHeaders;
+
 	/** the request string. */
 	string m_request;
 
+	/** the incomplete last line received after the complete request lines, or the following HTTP request. */
+	string m_remainder;
+
+	/** the monotonic time in microseconds when the request was completely received, or 0. */
+	unsigned long long m_receiveTime = 0;
+
+	/** the number of leading request lines already handled. */
+	size_t m_handledLines = 0;
+
+	/** the concatenated results of the leading request lines already handled. */
+	string m_handledResults;
+
 	/** whether the result was already set. */
 	bool m_resultSet = false;
 
@@ -197,6 +466,15 @@ private:
 	/** start timestamp of listening update. */
 	time_t m_listenSince = 0;
 
+	/** the @a ChangeJournal cursor of listening update. */
+	unsigned long long m_listenCursor = 0;
+
+	/** the @a Notify object to signal when the result was set, or NULL. */
+	const Notify* m_resultNotify = NULL;
+
+	/** the @a ListenSubscription of the client in listening mode, or NULL. */
+	shared_ptr<ListenSubscription> m_subscription;
+
 };
 
 /**
@@ -210,16 +488,17 @@ public:
 	 * Constructor.
 	 * @param socket the @a TCPSocket for communication.
 	 * @param isHttp whether this is a HTTP message.
-	 * @param netQueue the reference to the @a NetMessage @a Queue.
+	 * @param netQueue the reference to the @a NetMessage @a RingQueue.
 	 */
-	Connection(shared_ptr<TCPSocket> socket, const bool isHttp, Queue<NetMessage*>& netQueue)
+	Connection(shared_ptr<TCPSocket> socket, const bool isHttp, RingQueue<NetMessage*>& netQueue)
 		: m_isHttp(isHttp), m_socket(socket), m_netQueue(netQueue)
-		{ m_id = ++m_ids; }
+		{ m_id = newID(); opened(isHttp); }
 
 	virtual ~Connection()
     {
         stop();
         join();
+        closed(m_isHttp);
     }
 	/**
 	 * endless loop for connection instance.
@@ -237,6 +516,42 @@ public:
 	 */
 	int getID() { return m_id; }
 
+	/**
+	 * Return a new ID for a connection.
+	 * @return the new ID for a connection.
+	 */
+	static int newID() { return ++m_ids; }
+
+	/**
+	 * Count a newly opened connection.
+	 * @param isHttp whether this is a HTTP connection.
+	 */
+	static void opened(const bool isHttp)
+	{
+		m_openedCount[isHttp ? 1 : 0].fetch_add(1, std::memory_order_relaxed);
+		m_openCount[isHttp ? 1 : 0].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Count a closed connection.
+	 * @param isHttp whether this is a HTTP connection.
+	 */
+	static void closed(const bool isHttp) { m_openCount[isHttp ? 1 : 0].fetch_sub(1, std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of connections opened so far.
+	 * @param isHttp whether to count HTTP connections instead of client connections.
+	 * @return the number of connections opened so far.
+	 */
+	static unsigned long getOpenedCount(const bool isHttp) { return m_openedCount[isHttp ? 1 : 0].load(std::memory_order_relaxed); }
+
+	/**
+	 * Return the number of currently open connections.
+	 * @param isHttp whether to count HTTP connections instead of client connections.
+	 * @return the number of currently open connections.
+	 */
+	static unsigned long getOpenCount(const bool isHttp) { return m_openCount[isHttp ? 1 : 0].load(std::memory_order_relaxed); }
+
 private:
 	/** whether this is a HTTP connection. */
 	const bool m_isHttp;
@@ -244,8 +559,8 @@ private:
 	/** the @a TCPSocket for communication. */
 	std::shared_ptr<TCPSocket> m_socket;
 
-	/** the reference to the @a NetMessage @a Queue. */
-	Queue<NetMessage*>& m_netQueue;
+	/** the reference to the @a NetMessage @a RingQueue. */
+	RingQueue<NetMessage*>& m_netQueue;
 
 	/** notification object for shutdown procedure. */
 	Notify m_notify;
@@ -256,6 +571,198 @@ private:
 	/** the IF of the last opened connection. */
 	static int m_ids;
 
+	/** the number of client and HTTP connections opened so far. */
+	static std::atomic<unsigned long> m_openedCount[2];
+
+	/** the number of currently open client and HTTP connections. */
+	static std::atomic<unsigned long> m_openCount[2];
+
+};
+
+/**
+ * A client connection handled by the single event loop of @a Network in reactor mode.
+ *
+ * Behaves like @a Connection on the wire, but never blocks: received data is
+ * handed over to the @a MainLoop, and the connection is not read from again
+ * until the result was completely written to the non-blocking socket.
+ */
+class ReactorConnection
+{
+
+public:
+	/**
+	 * Constructor.
+	 * @param socket the @a TCPSocket for communication (switched to non-blocking mode).
+	 * @param isHttp whether this is a HTTP connection.
+	 * @param resultNotify the @a Notify object to signal when the result of the @a MainLoop was set.
+	 */
+	ReactorConnection(shared_ptr<TCPSocket> socket, const bool isHttp, const Notify* resultNotify)
+		: m_socket(socket), m_message(isHttp), m_id(Connection::newID())
+		{ m_message.setResultNotify(resultNotify); Connection::opened(isHttp); time(&m_lastActivity); }
+
+	/**
+	 * Destructor.
+	 */
+	~ReactorConnection() { Connection::closed(m_message.isHttp()); }
+
+	/**
+	 * Return the ID of this connection.
+	 * @return the ID of this connection.
+	 */
+	int getID() const { return m_id; }
+
+	/**
+	 * Return the socket file descriptor.
+	 * @return the socket file descriptor.
+	 */
+	int getFD() const { return m_socket->getFD(); }
+
+	/**
+	 * Return the poll flags to wait for in the current state.
+	 * @return the poll flags to wait for, or -1 if the socket shall not be watched at all.
+	 */
+	short getEvents() const
+	{
+		if (m_pending)
+			return m_closing ? -1 : 0;
+		return m_output.empty() ? POLLIN : POLLOUT;
+	}
+
+	/**
+	 * Return the poll flags currently watched for.
+	 * @return the poll flags currently watched for, or -1 if the socket is not watched.
+	 */
+	short getWatchedEvents() const { return m_watchedEvents; }
+
+	/**
+	 * Set the poll flags currently watched for.
+	 * @param events the poll flags currently watched for, or -1 if the socket is not watched.
+	 */
+	void setWatchedEvents(const short events) { m_watchedEvents = events; }
+
+	/**
+	 * Return whether the @a NetMessage was handed over to the @a MainLoop and the result is not yet collected.
+	 * @return whether the @a NetMessage is in use by the @a MainLoop.
+	 */
+	bool isPending() const { return m_pending; }
+
+	/**
+	 * Handle poll flags reported for the socket.
+	 * @param events the occurred poll flags.
+	 * @param netQueue the @a RingQueue for passing the @a NetMessage to the @a MainLoop.
+	 * @return false when the connection shall be closed.
+	 */
+	bool handleEvents(const short events, RingQueue<NetMessage*>& netQueue);
+
+	/**
+	 * Collect the result from the @a MainLoop if available and start sending it.
+	 * @return false when the connection shall be closed.
+	 */
+	bool handleResult();
+
+	/**
+	 * Hand over the @a NetMessage to the @a MainLoop for adding updates if the client is in listening mode.
+	 * @param netQueue the @a RingQueue for passing the @a NetMessage to the @a MainLoop.
+	 */
+	void checkListening(RingQueue<NetMessage*>& netQueue);
+
+	/**
+	 * Hand over the @a NetMessage to the @a MainLoop if a pipelined HTTP request was already received completely.
+	 * @param netQueue the @a RingQueue for passing the @a NetMessage to the @a MainLoop.
+	 */
+	void checkPipelined(RingQueue<NetMessage*>& netQueue);
+
+	/**
+	 * Return whether this is a persistent HTTP connection that was idle for too long.
+	 * @param now the current system time.
+	 * @return whether the connection shall be closed because of being idle.
+	 */
+	bool isIdle(const time_t now) const;
+
+	/**
+	 * Return the @a ListenSubscription whose file descriptor shall be watched in the current state.
+	 * @return the @a ListenSubscription to watch, or NULL.
+	 */
+	shared_ptr<ListenSubscription> getSubscription() const
+	{
+		return m_pending ? m_watchedSubscription : m_message.getSubscription();
+	}
+
+	/**
+	 * Return the @a ListenSubscription whose file descriptor is currently watched.
+	 * @return the watched @a ListenSubscription, or NULL.
+	 */
+	shared_ptr<ListenSubscription> getWatchedSubscription() const { return m_watchedSubscription; }
+
+	/**
+	 * Set the @a ListenSubscription whose file descriptor is currently watched.
+	 * @param subscription the watched @a ListenSubscription, or NULL.
+	 */
+	void setWatchedSubscription(shared_ptr<ListenSubscription> subscription) { m_watchedSubscription = subscription; }
+
+	/**
+	 * Handle the file descriptor of the watched @a ListenSubscription having become readable.
+	 */
+	void handleListenEvent()
+	{
+		if (m_watchedSubscription)
+			m_watchedSubscription->consume();
+		m_listenUpdate = true;
+	}
+
+	/**
+	 * Return whether an update was published to the @a ListenSubscription and not yet handed over.
+	 * @return whether an update is waiting to be handed over.
+	 */
+	bool hasListenUpdate() const { return m_listenUpdate; }
+
+private:
+	/**
+	 * Pass the received data to the @a NetMessage and hand it over to the @a MainLoop when complete.
+	 * @param data the received data.
+	 * @param netQueue the @a RingQueue for passing the @a NetMessage to the @a MainLoop.
+	 */
+	void addRequest(const char* data, RingQueue<NetMessage*>& netQueue);
+
+	/**
+	 * Write as much of the pending output as possible.
+	 * @return false when the connection shall be closed.
+	 */
+	bool flush();
+
+	/** the @a TCPSocket for communication. */
+	std::shared_ptr<TCPSocket> m_socket;
+
+	/** the @a NetMessage for the request and result. */
+	NetMessage m_message;
+
+	/** the ID of this connection. */
+	const int m_id;
+
+	/** whether the @a NetMessage was handed over to the @a MainLoop. */
+	bool m_pending = false;
+
+	/** whether the connection shall be closed after the pending result or output. */
+	bool m_closing = false;
+
+	/** the output not yet written to the socket. */
+	string m_output;
+
+	/** the position in @a m_output of the next byte to write. */
+	size_t m_outputPos = 0;
+
+	/** the poll flags currently watched for, or -1 if the socket is not watched. */
+	short m_watchedEvents = -1;
+
+	/** the @a ListenSubscription whose file descriptor is currently watched (kept for keeping the descriptor open), or NULL. */
+	shared_ptr<ListenSubscription> m_watchedSubscription;
+
+	/** whether an update was published to the @a ListenSubscription and not yet handed over. */
+	bool m_listenUpdate = false;
+
+	/** the system time when data was last received. */
+	time_t m_lastActivity;
+
 };
 
 /**
@@ -270,9 +777,11 @@ public:
 	 * @param local true to accept connections only for local host.
 	 * @param port the port to listen for command line connections.
 	 * @param httpPort the port to listen for HTTP connections, or 0.
-	 * @param netQueue the reference to the @a NetMessage @a Queue.
+	 * @param netQueue the reference to the @a NetMessage @a RingQueue.
+	 * @param reactor true to handle all connections in the single network thread instead of one thread per connection.
 	 */
-	Network(const bool local, const uint16_t port, const uint16_t httpPort, Queue<NetMessage*>& netQueue);
+	Network(const bool local, const uint16_t port, const uint16_t httpPort, RingQueue<NetMessage*>& netQueue,
+		const bool reactor=false);
 
 	/**
 	 * destructor.
@@ -293,8 +802,8 @@ private:
 	/** the list of active @a Connection instances. */
 	list<shared_ptr<Connection>> m_connections;
 
-	/** the reference to the @a NetMessage @a Queue. */
-	Queue<NetMessage*>& m_netQueue;
+	/** the reference to the @a NetMessage @a RingQueue. */
+	RingQueue<NetMessage*>& m_netQueue;
 
 	/** the command line @a TCPServer instance. */
 	std::unique_ptr<TCPServer> m_tcpServer;
@@ -308,11 +817,25 @@ private:
 	/** true if this instance is listening */
 	bool m_listening = false;
 
+	/** whether to handle all connections in this thread. */
+	const bool m_reactor;
+
+	/** @a Notify object for results set by the @a MainLoop in reactor mode. */
+	Notify m_resultNotify;
+
+	/** the @a ReactorConnection instances whose @a NetMessage was still in use by the @a MainLoop on shutdown. */
+	vector<shared_ptr<ReactorConnection>> m_pendingConnections;
+
 	/**
 	 * clean inactive connections from container.
 	 */
 	void cleanConnections();
 
+	/**
+	 * endless loop handling all connections in reactor mode.
+	 */
+	void runReactor();
+
 };
 
 #endif // NETWORK_H_
@@ -0,0 +1,119 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "answertable.h"
+
+bool AnswerTable::find(SymbolString& master, SymbolString& slave) const
+{
+	if (master.size() < 5)
+		return false;
+	shared_ptr<const Table> table = getTable();
+	const unsigned char* lengths = table->m_idLengthsByCommand.find((unsigned long long)master[2] << 8 | master[3]);
+	if (lengths == NULL)
+		return false;
+	size_t maxIdLength = master[4];
+	if (maxIdLength > ANSWERTABLE_MAX_ID_LENGTH)
+		maxIdLength = ANSWERTABLE_MAX_ID_LENGTH;
+	if (master.size() < 5+maxIdLength)
+		return false;
+	unsigned char id[2+ANSWERTABLE_MAX_ID_LENGTH];
+	for (size_t pos = 0; pos < 2+maxIdLength; pos++)
+		id[pos] = master[pos == 0 ? 2 : pos == 1 ? 3 : pos+3];
+	for (size_t idLength = maxIdLength+1; idLength-- > 0; ) {
+		if ((*lengths & (1 << idLength)) == 0)
+			continue;
+		const Entry* const* entry = table->m_entriesByKey.find(getKey(id, idLength));
+		if (entry) {
+			slave = (*entry)->m_slave;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AnswerTable::set(const vector<unsigned char>& id, const SymbolString& slave)
+{
+	if (id.size() < 2 || id.size() > 2+ANSWERTABLE_MAX_ID_LENGTH)
+		return false;
+	auto entry = make_shared<Entry>();
+	entry->m_id = id;
+	entry->m_slave = slave;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	vector<shared_ptr<const Entry>> entries = getTable()->m_entries;
+	bool replaced = false;
+	for (auto& existing : entries) {
+		if (existing->m_id == id) {
+			existing = entry;
+			replaced = true;
+			break;
+		}
+	}
+	if (!replaced)
+		entries.push_back(entry);
+	publish(entries);
+	return true;
+}
+
+bool AnswerTable::remove(const vector<unsigned char>& id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	vector<shared_ptr<const Entry>> entries = getTable()->m_entries;
+	for (auto it = entries.begin(); it != entries.end(); it++) {
+		if ((*it)->m_id == id) {
+			entries.erase(it);
+			publish(entries);
+			return true;
+		}
+	}
+	return false;
+}
+
+void AnswerTable::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::atomic_store(&m_table, make_shared<const Table>());
+}
+
+size_t AnswerTable::size() const
+{
+	return getTable()->m_entries.size();
+}
+
+unsigned long long AnswerTable::getKey(const unsigned char* id, const size_t idLength)
+{
+	unsigned long long key = (unsigned long long)idLength << (8 * 7);
+	for (size_t pos = 0; pos < 2+idLength; pos++)
+		key |= (unsigned long long)id[pos] << (8 * (6-pos)); // exact for up to ANSWERTABLE_MAX_ID_LENGTH bytes
+	return key;
+}
+
+void AnswerTable::publish(vector<shared_ptr<const Entry>>& entries)
+{
+	auto table = make_shared<Table>();
+	table->m_entries.swap(entries);
+	for (const auto& entry : table->m_entries) {
+		size_t idLength = entry->m_id.size()-2;
+		table->m_entriesByKey[getKey(entry->m_id.data(), idLength)] = entry.get();
+		table->m_idLengthsByCommand[(unsigned long long)entry->m_id[0] << 8 | entry->m_id[1]] |= (unsigned char)(1 << idLength);
+	}
+	std::atomic_store(&m_table, shared_ptr<const Table>(table));
+}
@@ -0,0 +1,156 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBEBUS_ANSWERTABLE_H_
+#define LIBEBUS_ANSWERTABLE_H_
+
+#include "symbol.h"
+#include "flatindex.h"
+#include "cppconfig.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** @file answertable.h
+ * A table of prepared answers for requests to the own slave address.
+ *
+ * The @a AnswerTable maps the primary and secondary command byte and the ID
+ * of a request to the complete escaped slave part of the answer including
+ * the CRC, so that answering a request on the bus only needs a lookup and a
+ * copy of the symbols. The answers are prepared and replaced by another
+ * thread. Each modification publishes a new immutable snapshot of the table,
+ * so that a lookup never waits for a modification.
+ */
+
+/** the maximum length of an ID (excluding primary and secondary command byte) supported by the @a AnswerTable. */
+#define ANSWERTABLE_MAX_ID_LENGTH 5
+
+/**
+ * A table of prepared answers by primary/secondary command byte and ID.
+ */
+class AnswerTable
+{
+public:
+
+	/**
+	 * Construct a new empty instance.
+	 */
+	AnswerTable() : m_table(make_shared<const Table>()) {}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	AnswerTable(const AnswerTable& src);
+
+public:
+
+	/**
+	 * Find the prepared answer for a request.
+	 * @param master the unescaped master @a SymbolString of the request (starting with the source address).
+	 * @param slave the @a SymbolString to copy the escaped slave data including the CRC to.
+	 * @return true when an answer was found, false otherwise.
+	 */
+	bool find(SymbolString& master, SymbolString& slave) const;
+
+	/**
+	 * Set or replace the prepared answer for requests with the ID.
+	 * @param id the primary and secondary command byte followed by the ID.
+	 * @param slave the escaped slave @a SymbolString including the CRC.
+	 * @return true on success, false if the ID is invalid or too long.
+	 */
+	bool set(const vector<unsigned char>& id, const SymbolString& slave);
+
+	/**
+	 * Remove the prepared answer for requests with the ID.
+	 * @param id the primary and secondary command byte followed by the ID.
+	 * @return true if an answer was removed.
+	 */
+	bool remove(const vector<unsigned char>& id);
+
+	/**
+	 * Remove all prepared answers.
+	 */
+	void clear();
+
+	/**
+	 * Get the number of prepared answers.
+	 * @return the number of prepared answers.
+	 */
+	size_t size() const;
+
+private:
+
+	/**
+	 * A single prepared answer.
+	 */
+	struct Entry
+	{
+		/** the primary and secondary command byte followed by the ID. */
+		vector<unsigned char> m_id;
+
+		/** the escaped slave @a SymbolString including the CRC. */
+		SymbolString m_slave;
+	};
+
+	/**
+	 * An immutable snapshot of all prepared answers.
+	 */
+	struct Table
+	{
+		/** the prepared answers. */
+		vector<shared_ptr<const Entry>> m_entries;
+
+		/** the prepared answers by key (see @a getKey()). */
+		FlatIndex<const Entry*> m_entriesByKey;
+
+		/** the bit mask of the available ID lengths by primary and secondary command byte. */
+		FlatIndex<unsigned char> m_idLengthsByCommand;
+	};
+
+	/**
+	 * Calculate the key for the primary and secondary command byte and ID.
+	 * @param id the primary and secondary command byte followed by the ID.
+	 * @param idLength the length of the ID (at most @a ANSWERTABLE_MAX_ID_LENGTH).
+	 * @return the key.
+	 */
+	static unsigned long long getKey(const unsigned char* id, const size_t idLength);
+
+	/**
+	 * Build the indexes of a new snapshot and publish it.
+	 * @param entries the prepared answers of the new snapshot.
+	 */
+	void publish(vector<shared_ptr<const Entry>>& entries);
+
+	/**
+	 * Get the current snapshot.
+	 * @return the current snapshot.
+	 */
+	shared_ptr<const Table> getTable() const { return std::atomic_load(&m_table); }
+
+	/** the mutex for serializing modifications. */
+	std::mutex m_mutex;
+
+	/** the current snapshot (only accessed atomically). */
+	shared_ptr<const Table> m_table;
+
+};
+
+#endif // LIBEBUS_ANSWERTABLE_H_
@@ -0,0 +1,523 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "data.h"
+#include "filereader.h"
+#include "flatindex.h"
+#include "message.h"
+#include "outputsink.h"
+#include "queue.h"
+#include "ringqueue.h"
+#include "symbol.h"
+#include "tokenizer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** the number of allocations done so far. */
+static atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, memory_order_relaxed);
+	void* ptr = malloc(size);
+	if (!ptr)
+		throw bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+/** the @a DataFieldTemplates for the messages of the benchmarks. */
+static DataFieldTemplates templates;
+
+DataFieldTemplates* getTemplates(const string filename)
+{
+	return &templates;
+}
+
+/** whether any benchmark produced a different result for the previous and the current implementation. */
+static bool s_mismatch = false;
+
+/**
+ * Measure the wall clock time of a function.
+ * @param function the function to run.
+ * @return the duration in microseconds.
+ */
+template <typename F>
+static long long measure(F function)
+{
+	auto start = chrono::steady_clock::now();
+	function();
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Report the result of comparing a previous implementation with the current one.
+ * @param name the name of the benchmark.
+ * @param operations the number of operations done by each implementation.
+ * @param previous the name of the previous implementation.
+ * @param previousTime the duration of the previous implementation in microseconds.
+ * @param current the name of the current implementation.
+ * @param currentTime the duration of the current implementation in microseconds.
+ * @param same whether both implementations produced the same result.
+ */
+static void report(const char* name, const size_t operations, const char* previous, const long long previousTime,
+	const char* current, const long long currentTime, const bool same)
+{
+	cout << name << ": " << operations << " operations, "
+		<< previous << " " << previousTime << " us, "
+		<< current << " " << currentTime << " us";
+	if (currentTime > 0)
+		cout << " (" << static_cast<double>(previousTime) / static_cast<double>(currentTime) << "x)";
+	if (!same) {
+		cout << ", RESULT MISMATCH";
+		s_mismatch = true;
+	}
+	cout << endl;
+}
+
+/**
+ * Compare lookups of message keys in a @a map with the @a FlatIndex.
+ */
+static void benchFlatIndex()
+{
+	// keys shaped like message keys: ID length, source, ZZ, PB, SB, ID bytes
+	map<unsigned long long, int> keyMap;
+	FlatIndex<int> index;
+	vector<unsigned long long> keys;
+	for (unsigned long long i = 0; i < 4000; i++) {
+		unsigned long long key = ((i % 5) << 61) | (0x1fULL << 56) | ((0x08 + (i % 3)) << 48) | (0xb509ULL << 32)
+			| ((i * 7919) & 0xffffff) << 8;
+		keyMap[key] = (int)i;
+		index[key] = (int)i;
+		keys.push_back(key);
+		keys.push_back(key ^ 0x0100); // miss
+	}
+	const int rounds = 100;
+	long long mapSum = 0, indexSum = 0;
+	long long mapTime = measure([&]() {
+		for (int round = 0; round < rounds; round++) {
+			for (auto key : keys) {
+				auto it = keyMap.find(key);
+				if (it != keyMap.end())
+					mapSum += it->second;
+			}
+		}
+	});
+	long long indexTime = measure([&]() {
+		for (int round = 0; round < rounds; round++) {
+			for (auto key : keys) {
+				auto value = index.find(key);
+				if (value)
+					indexSum += *value;
+			}
+		}
+	});
+	report("flatindex", keys.size()*rounds, "map", mapTime, "flat index", indexTime, mapSum == indexSum);
+}
+
+/**
+ * Compare storing telegrams in a vector per symbol string with the inline storage of @a SymbolString.
+ */
+static void benchSymbolString()
+{
+	static const unsigned char master[] = {0x10, 0x08, 0xb5, 0x09, 0x03, 0x0d, 0x29, 0x00, 0xaa, 0x07};
+	static const unsigned char slave[] = {0x04, 0x12, 0x34, 0xa9, 0x78};
+	const unsigned long telegrams = 1000000;
+	vector<unsigned char> lastVectorMaster, lastVectorSlave;
+	unsigned long start = allocations;
+	long long vectorTime = measure([&]() {
+		for (unsigned long i = 0; i < telegrams; i++) {
+			vector<unsigned char> masterData, slaveData;
+			for (auto value : master)
+				masterData.push_back(value);
+			for (auto value : slave)
+				slaveData.push_back(value);
+			lastVectorMaster = masterData;
+			lastVectorSlave = slaveData;
+		}
+	});
+	unsigned long vectorAllocations = allocations - start;
+
+	SymbolString lastMaster(false), lastSlave(false);
+	start = allocations;
+	long long inlineTime = measure([&]() {
+		for (unsigned long i = 0; i < telegrams; i++) {
+			SymbolString masterData(true), slaveData(true);
+			for (auto value : master)
+				masterData.push_back(value, false);
+			masterData.push_back(masterData.getCRC(), false, false);
+			for (auto value : slave)
+				slaveData.push_back(value, false);
+			slaveData.push_back(slaveData.getCRC(), false, false);
+			lastMaster = masterData;
+			lastSlave = slaveData;
+		}
+	});
+	unsigned long inlineAllocations = allocations - start;
+	// both kept the last telegram (the symbol strings additionally contain the CRC and escape sequences)
+	bool same = lastMaster.size() > lastVectorMaster.size() && lastSlave.size() > lastVectorSlave.size();
+	report("symbolstring", telegrams, "vector", vectorTime, "inline", inlineTime, same);
+	cout << "symbolstring: allocations per telegram: vector " << static_cast<double>(vectorAllocations) / telegrams
+		<< ", inline " << static_cast<double>(inlineAllocations) / telegrams << endl;
+}
+
+/**
+ * Pass values from several producer threads through a queue to the calling thread.
+ * @param queue the queue to use.
+ * @param producers the number of producer threads.
+ * @param count the total number of values.
+ * @return the sum of all received values.
+ */
+template <class Q>
+static long long runContention(Q& queue, const int producers, const int count)
+{
+	vector<int> values((size_t)count);
+	for (int i = 0; i < count; i++)
+		values[(size_t)i] = i;
+	vector<thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&queue, &values, p, producers, count]{
+			for (int i = p; i < count; i += producers)
+				queue.push(&values[(size_t)i]);
+		});
+	}
+	long long sum = 0;
+	for (int received = 0; received < count; received++) {
+		int* value = queue.pop(5);
+		if (value == nullptr)
+			break;
+		sum += *value;
+	}
+	for (auto& producer : threads)
+		producer.join();
+	return sum;
+}
+
+/**
+ * Compare the mutex based @a Queue with the @a RingQueue for several producers.
+ */
+static void benchQueue()
+{
+	const int producers = 4, count = 200000;
+	Queue<int*> queue;
+	RingQueue<int*> ring;
+	long long queueSum = 0, ringSum = 0;
+	long long queueTime = measure([&]() { queueSum = runContention(queue, producers, count); });
+	long long ringTime = measure([&]() { ringSum = runContention(ring, producers, count); });
+	report("queue", count, "queue", queueTime, "ring queue", ringTime,
+		queueSum == ringSum && ringSum == (long long)count * (count - 1) / 2);
+}
+
+/**
+ * Compare decoding the ident fields field by field with the compiled decode plan.
+ */
+static void benchDecodePlan()
+{
+	auto set = DataFieldSet::getIdentFields();
+	SymbolString slave(false);
+	slave.parseHex("0ab5454243443101020304");
+	const int rounds = 100000;
+	size_t fieldLength = 0, planLength = 0;
+	ostringstream output;
+	long long fieldTime = measure([&]() {
+		for (int round = 0; round < rounds; round++) {
+			output.str("");
+			set->readFields(PartType::slaveData, slave, 0, output, 0);
+			fieldLength += (size_t)output.tellp();
+		}
+	});
+	long long planTime = measure([&]() {
+		for (int round = 0; round < rounds; round++) {
+			output.str("");
+			set->read(PartType::slaveData, slave, 0, output, 0);
+			planLength += (size_t)output.tellp();
+		}
+	});
+	report("decodeplan", rounds, "fields", fieldTime, "plan", planTime, fieldLength == planLength);
+}
+
+/**
+ * Compare decoding into a new @a ostringstream with decoding into a reused @a OutputSink.
+ */
+static void benchOutputSink()
+{
+	auto set = DataFieldSet::getIdentFields();
+	SymbolString slave(false);
+	slave.parseHex("0ab5454243443101020304");
+	const int rounds = 100000;
+	size_t streamLength = 0, sinkLength = 0;
+	long long streamTime = measure([&]() {
+		for (int round = 0; round < rounds; round++) {
+			ostringstream output;
+			set->read(PartType::slaveData, slave, 0, output, OF_JSON);
+			streamLength += output.str().length();
+		}
+	});
+	OutputSink sink;
+	long long sinkTime = measure([&]() {
+		for (int round = 0; round < rounds; round++) {
+			sink.reset();
+			set->read(PartType::slaveData, slave, 0, sink, OF_JSON);
+			sinkLength += sink.size();
+		}
+	});
+	report("outputsink", rounds, "ostringstream", streamTime, "reused sink", sinkTime, streamLength == sinkLength);
+}
+
+/**
+ * Split a command line with the previous stream based implementation.
+ * @param data the command line.
+ * @param args the @a vector to which to add the arguments.
+ */
+static void splitStream(const string& data, vector<string>& args)
+{
+	string token, previous;
+	istringstream stream(data);
+	bool escaped = false;
+	while (getline(stream, token, ' ')) {
+		if (escaped) {
+			args.pop_back();
+			if (token.length() > 0 && token[token.length()-1] == '"') {
+				token.erase(token.length() - 1, 1);
+				escaped = false;
+			}
+			token = previous + " " + token;
+		} else if (token.length() == 0) {
+			continue;
+		} else if (token[0] == '"') {
+			token.erase(0, 1);
+			if (token.length() > 0 && token[token.length()-1] == '"')
+				token.erase(token.length() - 1, 1);
+			else
+				escaped = true;
+		}
+		args.push_back(token);
+		previous = token;
+	}
+}
+
+/**
+ * Compare splitting command lines with a stream and looking up the command by name with the tokenizer and a
+ * @a FlatIndex of packed names.
+ */
+static void benchTokenizer()
+{
+	static const char* commands[] = {
+		"read -c bai -m 60 outsidetemp", "r -f \"flow temp\"", "write -c 430 z1desiredtemp 21.5",
+		"find -d", "state", "info", "hex -n 1508b509030d2800", "listen stop",
+	};
+	static const char* names[] = {"read", "r", "write", "w", "hex", "find", "f", "listen", "l", "state", "s",
+		"grab", "g", "scan", "log", "raw", "dump", "reload", "stop", "quit", "q", "info", "i", "stats", "help", "h"};
+	const size_t commandCount = sizeof(commands) / sizeof(char*);
+	const size_t nameCount = sizeof(names) / sizeof(char*);
+	const size_t count = 200000;
+	FlatIndex<size_t> index;
+	for (size_t pos = 0; pos < nameCount; pos++)
+		index[packName(names[pos], strlen(names[pos]))] = pos;
+	size_t streamFound = 0, tokenFound = 0;
+	long long streamTime = measure([&]() {
+		for (size_t run = 0; run < count; run++) {
+			vector<string> args;
+			splitStream(commands[run % commandCount], args);
+			for (size_t pos = 0; pos < nameCount; pos++) {
+				if (strcasecmp(args[0].c_str(), names[pos]) == 0) {
+					streamFound += pos;
+					break;
+				}
+			}
+		}
+	});
+	vector<StringRef> tokens;
+	long long tokenTime = measure([&]() {
+		for (size_t run = 0; run < count; run++) {
+			const char* command = commands[run % commandCount];
+			tokens.clear();
+			splitCommand(command, strlen(command), tokens);
+			const size_t* found = index.find(packName(tokens[0].data(), tokens[0].length()));
+			if (found)
+				tokenFound += *found;
+		}
+	});
+	report("tokenizer", count, "stream", streamTime, "tokenizer", tokenTime, streamFound == tokenFound);
+}
+
+/**
+ * Compare splitting CSV rows with @a FileReader::splitFields() on a stream against the @a CsvTokenizer.
+ */
+static void benchCsv()
+{
+	string data = "# type,circuit,name,comment,QQ,ZZ,PBSB,ID,field,part,type,divider/values,unit,comment\n"
+		"*r,,,,,,\"B509\",\"0D\",,,,,,\n";
+	const size_t rows = 20000;
+	for (size_t index = 0; index < rows; index++) {
+		data += "r,bai,FlowTemp" + std::to_string(index) + ",\"flow, temperature\",,08,,2800,temp,s,D2C,,°C,\n";
+		data += "w,,HeatingCurve,heating curve,,,\"B509\",0E2000,,,EXP,,\"0.1,1,2,3\",\n";
+	}
+	const size_t count = 5;
+	size_t streamFields = 0, tokenFields = 0;
+	long long streamTime = measure([&]() {
+		for (size_t run = 0; run < count; run++) {
+			istringstream ifs(data);
+			vector<string> row;
+			unsigned int lineNo = 0;
+			while (FileReader::splitFields(ifs, row, lineNo))
+				streamFields += row.size();
+		}
+	});
+	long long tokenTime = measure([&]() {
+		for (size_t run = 0; run < count; run++) {
+			CsvTokenizer tokenizer(data.data(), data.length());
+			vector<StringRef> row;
+			unsigned int lineNo = 0;
+			while (tokenizer.next(row, lineNo))
+				tokenFields += row.size();
+		}
+	});
+	report("csv", count*(2*rows+1), "stream", streamTime, "tokenizer", tokenTime, streamFields == tokenFields);
+}
+
+/**
+ * Compare looking up known and unknown master data in a @a MessageMap without and with the cache of unknown
+ * master data.
+ */
+static void benchUnknownCache()
+{
+	string content;
+	for (unsigned int index = 0; index < 64; index++) {
+		ostringstream row;
+		row << "r,bai,name" << index << ",,,08,b509," << hex << setw(2) << setfill('0') << index
+			<< (index % 2 == 0 ? "" : "01") << (index % 4 == 3 ? "02" : "") << ",,,UCH,\n";
+		content += row.str();
+	}
+	MessageMap messages;
+	if (messages.readFromContent(StringRef(content.data(), content.length()), "08.csv") != RESULT_OK) {
+		cerr << "unknowncache: " << messages.getLastError() << endl;
+		s_mismatch = true;
+		return;
+	}
+	vector<SymbolString> known, unknown;
+	for (unsigned int index = 0; index < 64; index++) {
+		ostringstream master;
+		master << "1008b50904" << hex << setw(2) << setfill('0') << index << "010203";
+		known.emplace_back(false);
+		known.back().parseHex(master.str());
+		master.str("");
+		master << "1008b50904" << hex << setw(2) << setfill('0') << (index+128) << "010203";
+		unknown.emplace_back(false);
+		unknown.back().parseHex(master.str());
+	}
+	vector<SymbolString*> masters[3];
+	for (size_t index = 0; index < known.size(); index++) {
+		masters[0].push_back(&known[index]);
+		masters[1].push_back(&unknown[index]);
+		masters[2].push_back(&known[index]);
+		masters[2].push_back(&unknown[index]);
+	}
+	const size_t count = 1000000;
+	static const char* names[] = {"unknowncache known", "unknowncache unknown", "unknowncache mixed"};
+	for (int pass = 0; pass < 3; pass++) {
+		const vector<SymbolString*>& passMasters = masters[pass];
+		size_t uncachedFound = 0, cachedFound = 0;
+		long long uncachedTime = measure([&]() {
+			for (size_t run = 0; run < count; run++)
+				if (messages.findUncached(*passMasters[run % passMasters.size()]))
+					uncachedFound++;
+		});
+		long long cachedTime = measure([&]() {
+			for (size_t run = 0; run < count; run++)
+				if (messages.find(*passMasters[run % passMasters.size()]))
+					cachedFound++;
+		});
+		report(names[pass], count, "uncached", uncachedTime, "cached", cachedTime,
+			uncachedFound == cachedFound && uncachedFound == (pass == 0 ? count : pass == 1 ? 0 : count/2));
+	}
+}
+
+/** a named benchmark. */
+struct Benchmark
+{
+	/** the name of the benchmark. */
+	const char* m_name;
+
+	/** the function running the benchmark. */
+	void (*m_run)();
+};
+
+/** the known benchmarks. */
+static const Benchmark benchmarks[] = {
+	{"flatindex", benchFlatIndex},
+	{"symbolstring", benchSymbolString},
+	{"queue", benchQueue},
+	{"decodeplan", benchDecodePlan},
+	{"outputsink", benchOutputSink},
+	{"tokenizer", benchTokenizer},
+	{"csv", benchCsv},
+	{"unknowncache", benchUnknownCache},
+};
+
+/**
+ * Main function.
+ * @param argc the number of command line arguments.
+ * @param argv the command line arguments: the names of the benchmarks to run, or none for all.
+ * @return the exit code.
+ */
+int main(int argc, char* argv[])
+{
+	bool found = argc <= 1;
+	for (const auto& benchmark : benchmarks) {
+		bool run = argc <= 1;
+		for (int arg = 1; arg < argc && !run; arg++)
+			run = strcmp(argv[arg], benchmark.m_name) == 0;
+		if (run) {
+			benchmark.m_run();
+			found = true;
+		}
+	}
+	if (!found) {
+		cerr << "usage: " << argv[0] << " [NAME]*, with NAME being one of:";
+		for (const auto& benchmark : benchmarks)
+			cerr << " " << benchmark.m_name;
+		cerr << endl;
+		return EXIT_FAILURE;
+	}
+	return s_mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,376 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "bushandler.h"
+#include "message.h"
+#include "data.h"
+#include "device.h"
+#include "dumpwriter.h"
+#include "outputsink.h"
+#include "clock.h"
+#include "log.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/** the number of allocations done so far. */
+static atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, memory_order_relaxed);
+	void* ptr = malloc(size);
+	if (!ptr)
+		throw bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+/** the global @a DataFieldTemplates. */
+static DataFieldTemplates globalTemplates;
+
+/** the @a DataFieldTemplates by path (may also carry a reference to @a globalTemplates). */
+static map<string, DataFieldTemplates*> templatesByPath;
+
+DataFieldTemplates* getTemplates(const string filename)
+{
+	string path;
+	size_t pos = filename.find_last_of('/');
+	if (pos != string::npos)
+		path = filename.substr(0, pos);
+	auto it = templatesByPath.find(path);
+	if (it != templatesByPath.end())
+		return it->second;
+	return &globalTemplates;
+}
+
+/**
+ * Read all configuration files in the path and its sub directories.
+ * @param path the path to read the files from.
+ * @param root whether this is the root path (using the global templates).
+ * @param messages the @a MessageMap to add the messages to.
+ * @return @a RESULT_OK on success, or an error code.
+ */
+static result_t readConfigFiles(const string& path, const bool root, MessageMap& messages)
+{
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL)
+		return RESULT_ERR_NOTFOUND;
+	vector<string> files, dirs;
+	bool hasTemplates = false;
+	dirent* d;
+	while ((d = readdir(dir)) != NULL) {
+		string name = d->d_name;
+		if (name == "." || name == "..")
+			continue;
+		const string file = path + "/" + name;
+		struct stat st;
+		if (stat(file.c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			dirs.push_back(file);
+		else if (S_ISREG(st.st_mode) && name.length() > 4 && name.substr(name.length()-4) == ".csv") {
+			if (name == "_templates.csv")
+				hasTemplates = true;
+			else
+				files.push_back(file);
+		}
+	}
+	closedir(dir);
+	DataFieldTemplates* templates = &globalTemplates;
+	if (!root && hasTemplates)
+		templates = new DataFieldTemplates(globalTemplates);
+	templatesByPath[path] = templates;
+	if (hasTemplates && templates->readFromFile(path + "/_templates.csv") != RESULT_OK)
+		cerr << "error reading templates in " << path << ": " << templates->getLastError() << endl;
+	result_t result = messages.readFromFiles(files, false);
+	if (result != RESULT_OK)
+		return result;
+	for (const auto& sub : dirs) {
+		result = readConfigFiles(sub, false, messages);
+		if (result != RESULT_OK)
+			return result;
+	}
+	return RESULT_OK;
+}
+
+/**
+ * A @a Device replaying a recorded dump from memory at maximum speed.
+ */
+class ReplayDevice : public Device
+{
+public:
+	/**
+	 * Construct a new instance.
+	 * @param data the bytes to replay.
+	 * @param rounds the number of times to replay the bytes.
+	 */
+	ReplayDevice(const vector<unsigned char>& data, const unsigned int rounds)
+		: Device("replay", false, true, false, NULL), m_data(data), m_rounds(rounds) {}
+
+	// @copydoc
+	virtual result_t open() override
+	{
+		close();
+		m_fd = ::open("/dev/null", O_RDONLY); // always readable, only used for waiting in recv()
+		return m_fd < 0 ? RESULT_ERR_NOTFOUND : RESULT_OK;
+	}
+
+	/**
+	 * Return whether all rounds were replayed.
+	 * @return whether all rounds were replayed.
+	 */
+	bool isDone() const { return m_done; }
+
+	/**
+	 * Return the monotonic time in microseconds of the first replayed byte.
+	 * @return the monotonic time in microseconds of the first replayed byte.
+	 */
+	unsigned long long getStartTime() const { return m_startTime; }
+
+	/**
+	 * Return the monotonic time in microseconds when the replay was completed.
+	 * @return the monotonic time in microseconds when the replay was completed.
+	 */
+	unsigned long long getEndTime() const { return m_endTime; }
+
+protected:
+	// @copydoc
+	virtual void checkDevice() override {}
+
+	// @copydoc
+	virtual ssize_t read(unsigned char* buffer, const size_t maxLength) override
+	{
+		if (m_startTime == 0)
+			m_startTime = clockGetMicros();
+		if (m_pos >= m_data.size()) {
+			m_pos = 0;
+			m_round++;
+		}
+		if (m_round >= m_rounds || m_data.empty()) {
+			if (!m_done) {
+				m_endTime = clockGetMicros();
+				m_done = true;
+			}
+			return 0;
+		}
+		size_t length = min(maxLength, m_data.size()-m_pos);
+		memcpy(buffer, m_data.data()+m_pos, length);
+		m_pos += length;
+		return (ssize_t)length;
+	}
+
+private:
+	/** the bytes to replay. */
+	const vector<unsigned char>& m_data;
+
+	/** the number of times to replay the bytes. */
+	const unsigned int m_rounds;
+
+	/** the current round. */
+	unsigned int m_round = 0;
+
+	/** the position of the next byte to replay in @a m_data. */
+	size_t m_pos = 0;
+
+	/** the monotonic time in microseconds of the first replayed byte, or 0. */
+	unsigned long long m_startTime = 0;
+
+	/** the monotonic time in microseconds when the replay was completed, or 0. */
+	unsigned long long m_endTime = 0;
+
+	/** whether all rounds were replayed. */
+	atomic<bool> m_done{false};
+};
+
+/**
+ * A telegram extracted from the dump.
+ */
+struct Telegram
+{
+	/** the unescaped master data. */
+	SymbolString m_master{false};
+
+	/** the unescaped slave data (empty for broadcast and master-master telegrams). */
+	SymbolString m_slave{false};
+};
+
+/**
+ * Receive a master or slave part of a telegram.
+ * @param data the raw bytes.
+ * @param pos the position of the next byte in @a data (updated).
+ * @param end the end position of the telegram in @a data.
+ * @param part the unescaped @a SymbolString to fill (including the CRC).
+ * @param headerLen the number of header bytes before the length byte.
+ * @param acknowledge whether the part has to be followed by an @a ACK.
+ * @return true when the part was completely received with valid CRC and positive acknowledge.
+ */
+static bool receivePart(const vector<unsigned char>& data, size_t& pos, const size_t end, SymbolString& part,
+	const size_t headerLen, const bool acknowledge)
+{
+	while (pos < end) {
+		size_t crcPos = part.size() > headerLen ? headerLen + 1 + part[headerLen] : 0xff;
+		if (part.push_back(data[pos++], true, part.size() < crcPos) < RESULT_OK)
+			return false;
+		if (crcPos != 0xff && part.size() == crcPos + 1) {
+			if (part[crcPos] != part.getCRC())
+				return false;
+			return !acknowledge || (pos < end && data[pos++] == ACK);
+		}
+	}
+	return false;
+}
+
+/**
+ * Split the raw bytes into telegrams (skipping all incomplete, repeated, or erroneous ones).
+ * @param data the raw bytes.
+ * @param telegrams the vector to add the @a Telegram instances to.
+ */
+static void splitTelegrams(const vector<unsigned char>& data, vector<Telegram>& telegrams)
+{
+	size_t pos = 0;
+	while (pos < data.size()) {
+		while (pos < data.size() && data[pos] == SYN)
+			pos++;
+		size_t end = pos;
+		while (end < data.size() && data[end] != SYN)
+			end++;
+		Telegram telegram;
+		unsigned char dstAddress = pos+1 < end ? data[pos+1] : SYN;
+		bool broadcast = dstAddress == BROADCAST;
+		bool master = libebus::Address(dstAddress).isMaster();
+		if (receivePart(data, pos, end, telegram.m_master, 4, !broadcast)
+		&& (broadcast || master || receivePart(data, pos, end, telegram.m_slave, 0, true)))
+			telegrams.push_back(move(telegram));
+		pos = end;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool timestamps = false;
+	unsigned int rounds = 10;
+	int argPos = 1;
+	for (; argPos < argc && argv[argPos][0] == '-'; argPos++) {
+		if (strcmp(argv[argPos], "-t") == 0)
+			timestamps = true;
+		else if (strcmp(argv[argPos], "-n") == 0 && argPos+1 < argc)
+			rounds = (unsigned int)atoi(argv[++argPos]);
+		else
+			break;
+	}
+	if (argc-argPos != 2 || rounds == 0) {
+		cerr << "usage: bench_replay [-t] [-n ROUNDS] CONFIGPATH DUMPFILE" << endl
+			<< " Replay a raw dump written with --dumpfile (-t for a dump with timestamps)" << endl
+			<< " through BusHandler and MessageMap ROUNDS times (default 10) at maximum speed." << endl;
+		return 1;
+	}
+	setLogLevel("error");
+	setLogFile("/dev/null");
+
+	auto messages = make_shared<MessageMap>();
+	result_t result = readConfigFiles(argv[argPos], true, *messages);
+	if (result != RESULT_OK) {
+		cerr << "error reading config files: " << getResultCode(result) << ", " << messages->getLastError() << endl;
+		return 1;
+	}
+
+	ifstream stream(argv[argPos+1], ios::in | ios::binary);
+	if (!stream.is_open()) {
+		cerr << "unable to open " << argv[argPos+1] << endl;
+		return 1;
+	}
+	vector<unsigned char> data;
+	char record[DUMP_RECORD_SIZE];
+	size_t recordSize = timestamps ? DUMP_RECORD_SIZE : 1;
+	while (stream.read(record, recordSize))
+		data.push_back((unsigned char)record[recordSize-1]);
+	stream.close();
+
+	vector<Telegram> telegrams;
+	splitTelegrams(data, telegrams);
+	cout << "messages: " << messages->size() << endl
+		<< "dump: " << data.size() << " bytes, " << telegrams.size() << " telegrams" << endl;
+	if (telegrams.empty())
+		return 1;
+
+	// full replay through the BusHandler
+	ReplayDevice device(data, rounds);
+	device.open();
+	MessageMapHolder messageMaps(messages);
+	BusHandler busHandler(&device, messageMaps, 0x31, false, 0, 0, 0, 0, 0, 0, false, 0);
+	unsigned long startAllocations = allocations.load();
+	busHandler.start("bushandler");
+	while (!device.isDone())
+		usleep(1000);
+	unsigned long replayAllocations = allocations.load()-startAllocations;
+	busHandler.stop();
+	busHandler.join();
+	unsigned long received = busHandler.getReceivedCount();
+	unsigned long long micros = device.getEndTime()-device.getStartTime();
+	cout << "replay: " << received << " telegrams in " << micros << " us, "
+		<< (micros > 0 ? received*1000000ULL/micros : 0) << " telegrams/s, "
+		<< (received > 0 ? (double)replayAllocations/(double)received : 0.0) << " allocations/telegram" << endl;
+
+	// find + storeLastData + decodeLastData only
+	OutputSink output;
+	unsigned long known = 0;
+	startAllocations = allocations.load();
+	unsigned long long start = clockGetMicros();
+	for (unsigned int round = 0; round < rounds; round++) {
+		for (auto& telegram : telegrams) {
+			auto message = messages->find(telegram.m_master);
+			if (message == NULL)
+				continue;
+			known++;
+			output.reset();
+			if (message->storeLastData(telegram.m_master, telegram.m_slave) == RESULT_OK)
+				message->decodeLastData(output);
+		}
+	}
+	micros = clockGetMicros()-start;
+	unsigned long decodeAllocations = allocations.load()-startAllocations;
+	unsigned long total = (unsigned long)telegrams.size()*rounds;
+	cout << "decode: " << total << " telegrams (" << known << " known) in " << micros << " us, "
+		<< micros*1000ULL/total << " ns/telegram, "
+		<< (double)decodeAllocations/(double)total << " allocations/telegram" << endl;
+	return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "configcache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::ios;
+
+/** the length of the magic bytes. */
+#define MAGIC_LENGTH 8
+
+/** the length of the header (magic, version, number of files, hash). */
+#define HEADER_LENGTH (MAGIC_LENGTH+4+4+8)
+
+/**
+ * Calculate the FNV-1a hash of the data.
+ * @param data the data.
+ * @param length the length of the data.
+ * @return the hash value.
+ */
+static unsigned long long hashData(const char* data, size_t length)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for (size_t pos = 0; pos < length; pos++) {
+		hash ^= (unsigned char)data[pos];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ * Append a number to the serialized data.
+ * @param output the @a string to append to.
+ * @param value the value to append.
+ */
+template<typename T>
+static void appendValue(string& output, const T value)
+{
+	output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * Read a number from the serialized data.
+ * @param data the current position in the serialized data (updated on success).
+ * @param end the end of the serialized data.
+ * @param value the variable in which to store the value.
+ * @return true on success, false if not enough data is left.
+ */
+template<typename T>
+static bool readValue(const char*& data, const char* end, T& value)
+{
+	if ((size_t)(end-data) < sizeof(value))
+		return false;
+	memcpy(&value, data, sizeof(value));
+	data += sizeof(value);
+	return true;
+}
+
+result_t ConfigCache::open(const string& file)
+{
+	close();
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return RESULT_ERR_NOTFOUND;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < HEADER_LENGTH) {
+		::close(fd);
+		return RESULT_ERR_INVALID_ARG;
+	}
+	void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return RESULT_ERR_INVALID_ARG;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_map = static_cast<char*>(mapped);
+	m_mapSize = (size_t)st.st_size;
+	const char* data = m_map;
+	const char* end = m_map+m_mapSize;
+	unsigned int version = 0, count = 0;
+	unsigned long long hash = 0;
+	bool valid = memcmp(data, CONFIGCACHE_MAGIC, MAGIC_LENGTH) == 0;
+	data += MAGIC_LENGTH;
+	valid = valid && readValue(data, end, version) && version == CONFIGCACHE_VERSION
+		&& readValue(data, end, count) && readValue(data, end, hash)
+		&& hash == hashData(data, (size_t)(end-data));
+	for (unsigned int index = 0; valid && index < count; index++) {
+		unsigned int nameLength = 0;
+		Entry entry;
+		unsigned long long length = 0;
+		valid = readValue(data, end, nameLength) && (size_t)(end-data) >= nameLength;
+		if (!valid)
+			break;
+		string name(data, nameLength);
+		data += nameLength;
+		valid = readValue(data, end, entry.m_mtime) && readValue(data, end, entry.m_size)
+			&& readValue(data, end, length) && (unsigned long long)(end-data) >= length;
+		if (!valid)
+			break;
+		entry.m_data = data;
+		entry.m_length = (size_t)length;
+		data += length;
+		m_entries[name] = entry;
+	}
+	if (!valid || data != end) {
+		m_entries.clear();
+		munmap(m_map, m_mapSize);
+		m_map = NULL;
+		m_mapSize = 0;
+		return RESULT_ERR_INVALID_ARG;
+	}
+	return RESULT_OK;
+}
+
+void ConfigCache::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	if (m_map != NULL) {
+		munmap(m_map, m_mapSize);
+		m_map = NULL;
+		m_mapSize = 0;
+	}
+	m_modified = false;
+	m_hits = m_misses = 0;
+}
+
+bool ConfigCache::getRows(const string& filename, vector<FileRow>& rows)
+{
+	unsigned long long mtime = 0, size = 0;
+	bool exists = getFileState(filename, mtime, size);
+	const char* data;
+	size_t length;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_entries.find(filename);
+		if (it == m_entries.end()) {
+			m_misses++;
+			return false;
+		}
+		Entry& entry = it->second;
+		if (!exists || entry.m_mtime != mtime || entry.m_size != size) {
+			m_entries.erase(it);
+			m_modified = true;
+			m_misses++;
+			return false;
+		}
+		data = entry.m_data == NULL ? entry.m_rows.data() : entry.m_data;
+		length = entry.m_length;
+		m_hits++;
+	}
+	if (readRows(data, length, rows))
+		return true;
+	rows.clear();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.erase(filename);
+	m_modified = true;
+	m_hits--;
+	m_misses++;
+	return false;
+}
+
+void ConfigCache::addRows(const string& filename, const vector<FileRow>& rows)
+{
+	Entry entry;
+	if (!getFileState(filename, entry.m_mtime, entry.m_size))
+		return;
+	for (const auto& row : rows) {
+		appendValue(entry.m_rows, (unsigned int)row.m_lineNo);
+		appendValue(entry.m_rows, (unsigned int)row.m_fields.size());
+		for (const auto& field : row.m_fields) {
+			appendValue(entry.m_rows, (unsigned int)field.length());
+			entry.m_rows.append(field);
+		}
+	}
+	entry.m_data = NULL;
+	entry.m_length = entry.m_rows.length();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries[filename] = entry;
+	m_modified = true;
+}
+
+bool ConfigCache::isModified()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_modified;
+}
+
+result_t ConfigCache::write(const string& file)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	string body;
+	unsigned int count = 0;
+	for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+		Entry& entry = it->second;
+		unsigned long long mtime = 0, size = 0;
+		if (!getFileState(it->first, mtime, size) || entry.m_mtime != mtime || entry.m_size != size) {
+			it = m_entries.erase(it); // drop removed or modified files
+			continue;
+		}
+		appendValue(body, (unsigned int)it->first.length());
+		body.append(it->first);
+		appendValue(body, entry.m_mtime);
+		appendValue(body, entry.m_size);
+		appendValue(body, (unsigned long long)entry.m_length);
+		body.append(entry.m_data == NULL ? entry.m_rows.data() : entry.m_data, entry.m_length);
+		count++;
+		it++;
+	}
+	string header(CONFIGCACHE_MAGIC, MAGIC_LENGTH);
+	appendValue(header, (unsigned int)CONFIGCACHE_VERSION);
+	appendValue(header, count);
+	appendValue(header, hashData(body.data(), body.length()));
+	string tmpFile = file+".tmp";
+	ofstream stream(tmpFile.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!stream.is_open())
+		return RESULT_ERR_NOTFOUND;
+	stream.write(header.data(), header.length());
+	stream.write(body.data(), body.length());
+	stream.close();
+	if (stream.fail() || rename(tmpFile.c_str(), file.c_str()) != 0) {
+		remove(tmpFile.c_str());
+		return RESULT_ERR_GENERIC_IO;
+	}
+	m_modified = false;
+	return RESULT_OK;
+}
+
+bool ConfigCache::getFileState(const string& filename, unsigned long long& mtime, unsigned long long& size)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0)
+		return false;
+	mtime = (unsigned long long)st.st_mtim.tv_sec*1000000000ULL + (unsigned long long)st.st_mtim.tv_nsec;
+	size = (unsigned long long)st.st_size;
+	return true;
+}
+
+bool ConfigCache::readRows(const char* data, size_t length, vector<FileRow>& rows)
+{
+	const char* end = data+length;
+	while (data < end) {
+		FileRow row;
+		unsigned int count = 0;
+		if (!readValue(data, end, row.m_lineNo) || !readValue(data, end, count))
+			return false;
+		row.m_fields.reserve(std::min((size_t)count, (size_t)(end-data)/sizeof(unsigned int)));
+		for (unsigned int index = 0; index < count; index++) {
+			unsigned int fieldLength = 0;
+			if (!readValue(data, end, fieldLength) || (size_t)(end-data) < fieldLength)
+				return false;
+			row.m_fields.emplace_back(data, fieldLength);
+			data += fieldLength;
+		}
+		rows.push_back(std::move(row));
+	}
+	return true;
+}
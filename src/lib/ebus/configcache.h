@@ -0,0 +1,192 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBEBUS_CONFIGCACHE_H_
+#define LIBEBUS_CONFIGCACHE_H_
+
+#include "filereader.h"
+#include "result.h"
+#include "cppconfig.h"
+#include <mutex>
+
+/** @file configcache.h
+ * Classes for caching the split rows of the configuration files in a binary
+ * file.
+ *
+ * The @a ConfigCache maps a previously written cache file into memory and
+ * hands out the rows of each configuration file already split into fields,
+ * as long as the modification time and size of the file still match the
+ * values stored in the cache. Files read from CSV are added to the cache and
+ * the cache file is rewritten when anything changed.
+ *
+ * Only reading and splitting the files is skipped: the templates, field
+ * sets, conditions, instructions, and messages are still created from the
+ * cached rows on each start, exactly as from the CSV files. Since the
+ * @a CsvTokenizer already splits a file in a single pass, the cache mainly
+ * saves opening and reading each file (only its state is queried).
+ *
+ * A cache file starts with the @a CONFIGCACHE_MAGIC bytes, the version, the
+ * number of files, and a hash of all following bytes. Each file is stored
+ * with its name, modification time, size, and the length of its rows,
+ * followed by the rows. Each row consists of the line number, the number of
+ * fields, and each field with its length. All numbers are stored in host
+ * byte order.
+ */
+
+/** the magic bytes at the start of a cache file. */
+#define CONFIGCACHE_MAGIC "ebusdcfg"
+
+/** the version of the cache file format. */
+#define CONFIGCACHE_VERSION 1
+
+/**
+ * A cache for the split rows of configuration files stored in a binary file.
+ */
+class ConfigCache : public FileRowCache
+{
+public:
+
+	/**
+	 * Construct a new instance.
+	 */
+	ConfigCache() {}
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~ConfigCache() { close(); }
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	ConfigCache(const ConfigCache& src);
+
+public:
+
+	/**
+	 * Map the cache file into memory (after closing a previously mapped one).
+	 * @param file the name of the cache file.
+	 * @return @a RESULT_OK on success, @a RESULT_ERR_NOTFOUND if the file does not exist,
+	 * or @a RESULT_ERR_INVALID_ARG if the file is not a valid cache file.
+	 */
+	result_t open(const string& file);
+
+	/**
+	 * Forget all cached rows and unmap the cache file.
+	 */
+	void close();
+
+	// @copydoc
+	virtual bool getRows(const string& filename, vector<FileRow>& rows);
+
+	// @copydoc
+	virtual void addRows(const string& filename, const vector<FileRow>& rows);
+
+	/**
+	 * Return whether the cached rows differ from the mapped cache file.
+	 * @return whether the cached rows differ from the mapped cache file.
+	 */
+	bool isModified();
+
+	/**
+	 * Write all cached rows of files that were not modified to the cache file.
+	 * @param file the name of the cache file.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	result_t write(const string& file);
+
+	/**
+	 * Get the number of files read from the cache.
+	 * @return the number of files read from the cache.
+	 */
+	unsigned long getHits() { return m_hits; }
+
+	/**
+	 * Get the number of files requested but not available in the cache.
+	 * @return the number of files requested but not available in the cache.
+	 */
+	unsigned long getMisses() { return m_misses; }
+
+private:
+
+	/**
+	 * A cached file.
+	 */
+	struct Entry
+	{
+		/** the modification time of the file in nanoseconds. */
+		unsigned long long m_mtime;
+
+		/** the size of the file. */
+		unsigned long long m_size;
+
+		/** the serialized rows pointing into the mapped file, or NULL when stored in @a m_rows. */
+		const char* m_data;
+
+		/** the length of the serialized rows. */
+		size_t m_length;
+
+		/** the serialized rows of a file added by @a addRows(). */
+		string m_rows;
+	};
+
+	/**
+	 * Get the modification time and size of a file.
+	 * @param filename the name of the file.
+	 * @param mtime the variable in which to store the modification time in nanoseconds.
+	 * @param size the variable in which to store the size.
+	 * @return true on success, false if the file does not exist.
+	 */
+	static bool getFileState(const string& filename, unsigned long long& mtime, unsigned long long& size);
+
+	/**
+	 * Deserialize the rows of an @a Entry.
+	 * @param data the serialized rows.
+	 * @param length the length of the serialized rows.
+	 * @param rows the vector to add the rows to.
+	 * @return true on success, false if the data is invalid.
+	 */
+	static bool readRows(const char* data, size_t length, vector<FileRow>& rows);
+
+	/** the mutex for all members. */
+	std::mutex m_mutex;
+
+	/** the mapped cache file, or NULL. */
+	char* m_map = NULL;
+
+	/** the size of @a m_map. */
+	size_t m_mapSize = 0;
+
+	/** the cached files by name. */
+	map<string, Entry> m_entries;
+
+	/** whether @a m_entries differ from the mapped cache file. */
+	bool m_modified = false;
+
+	/** the number of files read from the cache. */
+	unsigned long m_hits = 0;
+
+	/** the number of files requested but not available in the cache. */
+	unsigned long m_misses = 0;
+
+};
+
+#endif // LIBEBUS_CONFIGCACHE_H_
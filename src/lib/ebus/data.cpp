@@ -28,6 +28,7 @@
 #include <cstring>
 #include <math.h>
 #include "cppconfig.h"
+#include "outputsink.h"
 
 using std::dec;
 using std::setprecision;
@@ -153,7 +154,7 @@ int parseSignedInt(const char* str, int base, const int minValue, const int maxV
 	return (int)ret;
 }
 
-void printErrorPos(ostream& out, vector<string>::iterator begin, const vector<string>::iterator end, vector<string>::iterator pos, string filename, size_t lineNo, result_t result)
+void printErrorPos(ostream& out, vector<string>::iterator begin, const vector<string>::iterator end, vector<string>::iterator pos, const string& filename, size_t lineNo, result_t result)
 {
 	if (pos > begin)
 		pos--;
@@ -368,7 +369,7 @@ result_t DataField::create(vector<string>::iterator &it,
 	if (fields.size() == 1)
 		returnField = fields[0];
 	else {
-		returnField = make_shared<DataFieldSet>(firstName, firstComment, fields);
+		returnField = allocateShared<DataFieldSet>(firstName, firstComment, fields);
 	}
 	return RESULT_OK;
 }
@@ -424,7 +425,7 @@ result_t SingleDataField::create(const char *typeNameStr, const unsigned char le
 		case BaseType::tim:
 			if (divisor != 0 || !values.empty())
 				return RESULT_ERR_INVALID_ARG; // cannot set divisor or values for string field
-			returnField = make_shared<StringDataField>(name, comment, unit, dataType, partType, byteCount);
+			returnField = allocateShared<StringDataField>(name, comment, unit, dataType, partType, byteCount);
 			return RESULT_OK;
 		case BaseType::num:
 			if (values.empty() && dataType.flags & DAY) {
@@ -455,7 +456,7 @@ result_t SingleDataField::create(const char *typeNameStr, const unsigned char le
 						return RESULT_ERR_OUT_OF_RANGE;
 				}
 
-				returnField = make_shared<NumberDataField>(name, comment, unit, dataType, partType, byteCount, bitCount, divisor);
+				returnField = allocateShared<NumberDataField>(name, comment, unit, dataType, partType, byteCount, bitCount, divisor);
 				return RESULT_OK;
 			}
 			if (values.begin()->first < dataType.minValue || values.rbegin()->first > dataType.maxValue)
@@ -464,7 +465,7 @@ result_t SingleDataField::create(const char *typeNameStr, const unsigned char le
 			if (divisor != 0)
 				return RESULT_ERR_INVALID_ARG; // cannot use divisor != 1 for value list field
 			//TODO add special field for fixed values (exactly one value in the list of values)
-			returnField = make_shared<ValueListDataField>(name, comment, unit, dataType, partType, byteCount, bitCount, values);
+			returnField = allocateShared<ValueListDataField>(name, comment, unit, dataType, partType, byteCount, bitCount, values);
 			return RESULT_OK;
 		}
 	}
@@ -514,7 +515,7 @@ result_t SingleDataField::read(const PartType partType,
 
 result_t SingleDataField::read(const PartType partType,
 		SymbolString& data, unsigned char offset,
-		ostringstream& output, OutputFormat outputFormat, signed char outputIndex,
+		ostream& output, OutputFormat outputFormat, signed char outputIndex,
 		bool leadingSeparator, const char* fieldName, signed char fieldIndex)
 {
 	if (partType != m_partType)
@@ -539,6 +540,18 @@ result_t SingleDataField::read(const PartType partType,
 		return RESULT_EMPTY;
 	}
 
+	writePrefix(output, outputFormat, outputIndex, leadingSeparator);
+	result_t result = readSymbols(data, offset, output, outputFormat);
+	if (result != RESULT_OK)
+		return result;
+
+	writeSuffix(output, outputFormat);
+	return RESULT_OK;
+}
+
+void SingleDataField::writePrefix(ostream& output, OutputFormat outputFormat,
+		signed char outputIndex, bool leadingSeparator)
+{
 	if (outputFormat & OF_JSON) {
 		if (leadingSeparator)
 			output << ",";
@@ -552,11 +565,10 @@ result_t SingleDataField::read(const PartType partType,
 		if (outputFormat & OF_VERBOSE)
 			output << m_name << "=";
 	}
+}
 
-	result_t result = readSymbols(data, offset, output, outputFormat);
-	if (result != RESULT_OK)
-		return result;
-
+void SingleDataField::writeSuffix(ostream& output, OutputFormat outputFormat)
+{
 	if (outputFormat & OF_VERBOSE) {
 		if (m_unit.length() > 0) {
 			if (outputFormat & OF_JSON)
@@ -573,7 +585,23 @@ result_t SingleDataField::read(const PartType partType,
 	}
 	if (outputFormat & OF_JSON)
 		output << "}";
-	return RESULT_OK;
+}
+
+void SingleDataField::compile(DecodeStep& step)
+{
+	step.m_field = this;
+	step.m_partType = m_partType;
+	step.m_kind = isIgnored() ? DecodeKind::ignored : DecodeKind::field;
+	step.m_type = m_dataType.type;
+	step.m_flags = m_dataType.flags;
+	step.m_offset = 0;
+	step.m_length = m_length;
+	step.m_bitCount = 0;
+	step.m_bitOffset = 0;
+	step.m_replacement = m_dataType.replacement;
+	step.m_divisor = 1;
+	step.m_precision = 0;
+	step.m_values = NULL;
 }
 
 result_t SingleDataField::write(istringstream& input,
@@ -618,7 +646,7 @@ result_t StringDataField::derive(string name, string comment,
 	if (unit.empty())
 		unit = m_unit;
 
-	fields.push_back(make_shared<StringDataField>(name, comment, unit, m_dataType, partType, m_length));
+	fields.push_back(allocateShared<StringDataField>(name, comment, unit, m_dataType, partType, m_length));
 
 	return RESULT_OK;
 }
@@ -648,7 +676,7 @@ result_t StringDataField::readRawValue(SymbolString& input, const unsigned char
 }
 
 result_t StringDataField::readSymbols(SymbolString& input, const unsigned char baseOffset,
-		ostringstream& output, OutputFormat outputFormat)
+		ostream& output, OutputFormat outputFormat)
 {
 	size_t start = 0, count = m_length;
 	int incr = 1;
@@ -926,6 +954,13 @@ void NumericDataField::dump(ostream& output)
 	output << FIELD_SEPARATOR;
 }
 
+void NumericDataField::compile(DecodeStep& step)
+{
+	SingleDataField::compile(step);
+	step.m_bitCount = m_bitCount;
+	step.m_bitOffset = m_bitOffset;
+}
+
 result_t NumericDataField::readRawValue(SymbolString& input,
 		unsigned char baseOffset, unsigned int& value)
 {
@@ -1017,8 +1052,8 @@ result_t NumericDataField::writeRawValue(unsigned int value,
 }
 
 
-NumberDataField::NumberDataField(const string name, const string comment,
-		const string unit, const dataType_t dataType, const PartType partType,
+NumberDataField::NumberDataField(const InternedString& name, const InternedString& comment,
+		const InternedString& unit, const dataType_t dataType, const PartType partType,
 		const unsigned char length, const unsigned char bitCount,
 		const int divisor)
 	: NumericDataField(name, comment, unit, dataType, partType, length, bitCount,
@@ -1053,7 +1088,7 @@ result_t NumberDataField::derive(string name, string comment,
 		if (divisor != 0 || m_divisor != 1)
 			return RESULT_ERR_INVALID_ARG; // cannot use divisor != 1 for value list field
 
-		fields.push_back(make_shared<ValueListDataField>(name, comment, unit, m_dataType, partType, m_length, m_bitCount, values));
+		fields.push_back(allocateShared<ValueListDataField>(name, comment, unit, m_dataType, partType, m_length, m_bitCount, values));
 	}
 	else {
 		if (divisor == 0)
@@ -1078,7 +1113,7 @@ result_t NumberDataField::derive(string name, string comment,
 				return RESULT_ERR_OUT_OF_RANGE;
 			}
 		}
-		fields.push_back(make_shared<NumberDataField>(name, comment, unit, m_dataType, partType, m_length, m_bitCount, divisor));
+		fields.push_back(allocateShared<NumberDataField>(name, comment, unit, m_dataType, partType, m_length, m_bitCount, divisor));
 	}
 	return RESULT_OK;
 }
@@ -1092,8 +1127,17 @@ void NumberDataField::dump(ostream& output)
 	dumpString(output, m_comment);
 }
 
+void NumberDataField::compile(DecodeStep& step)
+{
+	NumericDataField::compile(step);
+	step.m_divisor = m_divisor;
+	step.m_precision = m_precision;
+	if (step.m_kind == DecodeKind::field && (m_dataType.flags & EXP) == 0)
+		step.m_kind = DecodeKind::number;
+}
+
 result_t NumberDataField::readSymbols(SymbolString& input, const unsigned char baseOffset,
-		ostringstream& output, OutputFormat outputFormat)
+		ostream& output, OutputFormat outputFormat)
 {
 	unsigned int value = 0;
 	int signedValue;
@@ -1316,7 +1360,7 @@ result_t ValueListDataField::derive(string name, string comment,
 	else
 		values = m_values;
 
-	fields.push_back(make_shared<ValueListDataField>(name, comment, unit, m_dataType, partType, m_length, m_bitCount, values));
+	fields.push_back(allocateShared<ValueListDataField>(name, comment, unit, m_dataType, partType, m_length, m_bitCount, values));
 
 	return RESULT_OK;
 }
@@ -1336,8 +1380,16 @@ void ValueListDataField::dump(ostream& output)
 	dumpString(output, m_comment);
 }
 
+void ValueListDataField::compile(DecodeStep& step)
+{
+	NumericDataField::compile(step);
+	step.m_values = &m_values;
+	if (step.m_kind == DecodeKind::field)
+		step.m_kind = DecodeKind::valueList;
+}
+
 result_t ValueListDataField::readSymbols(SymbolString& input, const unsigned char baseOffset,
-		ostringstream& output, OutputFormat outputFormat)
+		ostream& output, OutputFormat outputFormat)
 {
 	unsigned int value = 0;
 
@@ -1560,7 +1612,18 @@ result_t DataFieldSet::read(const PartType partType,
 
 result_t DataFieldSet::read(const PartType partType,
 		SymbolString& data, unsigned char offset,
-		ostringstream& output, OutputFormat outputFormat, signed char outputIndex,
+		ostream& output, OutputFormat outputFormat, signed char outputIndex,
+		bool leadingSeparator, const char* fieldName, signed char fieldIndex)
+{
+	if (fieldName == NULL && !m_plan.empty() && partType != PartType::any)
+		return readPlan(partType, data, offset, output, outputFormat, outputIndex, leadingSeparator);
+
+	return readFields(partType, data, offset, output, outputFormat, outputIndex, leadingSeparator, fieldName, fieldIndex);
+}
+
+result_t DataFieldSet::readFields(const PartType partType,
+		SymbolString& data, unsigned char offset,
+		ostream& output, OutputFormat outputFormat, signed char outputIndex,
 		bool leadingSeparator, const char* fieldName, signed char fieldIndex)
 {
 	bool previousFullByteOffset = true;
@@ -1614,6 +1677,245 @@ result_t DataFieldSet::read(const PartType partType,
 	return RESULT_OK;
 }
 
+void DataFieldSet::compilePlan()
+{
+	m_plan.clear();
+	unsigned char offsets[] = { 0, 0 };
+	bool previousFullByteOffset[] = { true, true };
+	m_planLength[0] = m_planLength[1] = 0;
+	for (auto& field : m_fields) {
+		PartType partType = field->getPartType();
+		if (partType == PartType::any)
+			break;
+		unsigned char length = field->getLength(partType, MAX_LEN);
+		if (length != field->getLength(partType, 0))
+			break; // remainder of input
+		int index = partType == PartType::masterData ? 0 : 1;
+		if (!previousFullByteOffset[index] && !field->hasFullByteOffset(false))
+			offsets[index]--;
+
+		DecodeStep step;
+		field->compile(step);
+		step.m_offset = offsets[index];
+		m_plan.push_back(step);
+
+		offsets[index] = (unsigned char)(offsets[index] + length);
+		if (offsets[index] > m_planLength[index])
+			m_planLength[index] = offsets[index];
+		previousFullByteOffset[index] = field->hasFullByteOffset(true);
+	}
+	if (m_plan.size() != m_fields.size())
+		m_plan.clear(); // layout not fixed
+}
+
+/**
+ * Read the numeric raw value of a compiled @a DecodeStep (all positions already checked).
+ * @param step the @a DecodeStep to read.
+ * @param input the unescaped @a SymbolString to read the binary value from.
+ * @param baseOffset the offset of the field in the @a SymbolString.
+ * @param value the variable in which to store the numeric raw value.
+ * @return @a RESULT_OK on success, or an error code.
+ */
+static result_t readPlanRawValue(const DecodeStep& step, SymbolString& input,
+		const size_t baseOffset, unsigned int& value)
+{
+	value = 0;
+	if ((step.m_flags & BCD) == 0) {
+		if ((step.m_flags & REV) == 0) {
+			for (size_t i = step.m_length; i-- > 0; )
+				value = (value << 8) | input[baseOffset + i];
+		} else {
+			for (size_t i = 0; i < step.m_length; i++)
+				value = (value << 8) | input[baseOffset + i];
+		}
+		value >>= step.m_bitOffset;
+		if ((step.m_bitCount % 8) != 0)
+			value &= (1 << step.m_bitCount) - 1;
+		return RESULT_OK;
+	}
+	size_t start = 0;
+	int incr = 1;
+	if ((step.m_flags & REV) != 0) {
+		start = step.m_length - 1;
+		incr = -1;
+	}
+	unsigned int exp = 1;
+	for (size_t offset = start, i = 0; i < step.m_length; offset += incr, i++) {
+		unsigned char ch = input[baseOffset + offset];
+		if ((step.m_flags & REQ) == 0 && ch == (step.m_replacement & 0xff)) {
+			value = step.m_replacement;
+			return RESULT_OK;
+		}
+		if ((step.m_flags & HCD) == 0) {
+			if ((ch & 0xf0) > 0x90 || (ch & 0x0f) > 0x09)
+				return RESULT_ERR_OUT_OF_RANGE; // invalid BCD
+
+			ch = (unsigned char)((ch >> 4) * 10 + (ch & 0x0f));
+		} else if (ch > 0x63)
+			return RESULT_ERR_OUT_OF_RANGE; // invalid HCD
+		value += ch * exp;
+		exp *= 100;
+	}
+	return RESULT_OK;
+}
+
+/**
+ * Format the raw value of a compiled @a DecodeStep of kind @a DecodeKind::number.
+ * @param step the @a DecodeStep to format.
+ * @param value the numeric raw value.
+ * @param output the @a ostream to append the formatted value to.
+ * @param outputFormat the @a OutputFormat options to use.
+ */
+static void formatPlanNumber(const DecodeStep& step, const unsigned int value,
+		ostream& output, OutputFormat outputFormat)
+{
+	output << setw(0) << dec; // initialize output
+
+	if ((step.m_flags & REQ) == 0 && value == step.m_replacement) {
+		if (outputFormat & OF_JSON)
+			output << "null";
+		else
+			output << NULL_VALUE;
+		return;
+	}
+
+	int signedValue;
+	bool negative = (step.m_flags & SIG) != 0 && (value & (1 << (step.m_bitCount - 1))) != 0;
+	if (step.m_bitCount == 32) {
+		if (!negative) {
+			if (step.m_divisor < 0) {
+				output << static_cast<float>((float)value * (float)(-step.m_divisor));
+			} else if (step.m_divisor <= 1) {
+				writeUnsigned(output, value);
+			} else {
+				output << setprecision(step.m_precision)
+				       << fixed << static_cast<float>((float)value / (float)step.m_divisor);
+			}
+			return;
+		}
+		signedValue = (int) value; // negative signed value
+	}
+	else if (negative) // negative signed value
+		signedValue = (int) value - (1 << step.m_bitCount);
+	else
+		signedValue = (int) value;
+
+	if (step.m_divisor < 0)
+		output << static_cast<float>((float)signedValue * (float)(-step.m_divisor));
+	else if (step.m_divisor <= 1) {
+		if ((step.m_flags & (FIX|BCD)) == (FIX|BCD)) {
+			if (outputFormat & OF_JSON) {
+				output << '"';
+				output << setw(step.m_length * 2) << setfill('0');
+				output << static_cast<int>(signedValue) << setw(0);
+				output << '"';
+				return;
+			}
+			output << setw(step.m_length * 2) << setfill('0');
+			output << static_cast<int>(signedValue) << setw(0);
+		} else
+			writeSigned(output, signedValue);
+	}
+	else
+		output << setprecision(step.m_precision)
+		       << fixed << static_cast<float>((float)signedValue / (float)step.m_divisor);
+}
+
+/**
+ * Format the raw value of a compiled @a DecodeStep of kind @a DecodeKind::valueList.
+ * @param step the @a DecodeStep to format.
+ * @param value the numeric raw value.
+ * @param output the @a ostream to append the formatted value to.
+ * @param outputFormat the @a OutputFormat options to use.
+ */
+static void formatPlanValueList(const DecodeStep& step, const unsigned int value,
+		ostream& output, OutputFormat outputFormat)
+{
+	auto it = step.m_values->find(value);
+	if (it == step.m_values->end()) {
+		if (value != step.m_replacement) {
+			output << setw(0) << dec; // fall back to raw value in input
+			writeSigned(output, static_cast<int>(value));
+		}
+		else if (outputFormat & OF_JSON)
+			output << "null";
+		else
+			output << NULL_VALUE;
+	} else if (outputFormat & OF_NUMERIC) {
+		output << setw(0) << dec;
+		writeSigned(output, static_cast<int>(value));
+	} else if (outputFormat & OF_JSON)
+		output << '"' << it->second << '"';
+	else
+		output << it->second;
+}
+
+result_t DataFieldSet::readPlan(const PartType partType,
+		SymbolString& data, unsigned char offset,
+		ostream& output, OutputFormat outputFormat, signed char outputIndex,
+		bool leadingSeparator)
+{
+	size_t baseOffset = offset;
+	if (partType == PartType::masterData)
+		baseOffset += 5; // skip QQ ZZ PB SB NN
+	else
+		baseOffset++; // skip NN
+	if (baseOffset + m_planLength[partType == PartType::masterData ? 0 : 1] > data.size()) {
+		// let the fields produce the same partial output and error
+		return readFields(partType, data, offset, output, outputFormat, outputIndex, leadingSeparator);
+	}
+	bool found = false;
+
+	if (!m_uniqueNames && outputIndex<0)
+		outputIndex = 0;
+	for (auto& step : m_plan) {
+		if (step.m_kind == DecodeKind::ignored)
+			continue;
+		if (step.m_partType != partType) {
+			if (outputIndex>=0)
+				outputIndex++;
+			continue;
+		}
+		if (step.m_kind == DecodeKind::field) {
+			result_t result = step.m_field->read(partType, data, (unsigned char)(offset + step.m_offset), output, outputFormat, outputIndex, leadingSeparator);
+			if (result < RESULT_OK)
+				return result;
+			if (result == RESULT_EMPTY) {
+				if (outputIndex>=0)
+					outputIndex++;
+				continue;
+			}
+		} else {
+			unsigned int value;
+			step.m_field->writePrefix(output, outputFormat, outputIndex, leadingSeparator);
+			result_t result = readPlanRawValue(step, data, baseOffset + step.m_offset, value);
+			if (result != RESULT_OK)
+				return result;
+			if (step.m_kind == DecodeKind::number)
+				formatPlanNumber(step, value, output, outputFormat);
+			else
+				formatPlanValueList(step, value, output, outputFormat);
+			step.m_field->writeSuffix(output, outputFormat);
+		}
+		found = true;
+		leadingSeparator = true;
+		if (outputIndex>=0)
+			outputIndex++;
+	}
+
+	if (!found) {
+		return RESULT_EMPTY;
+	}
+	if (m_comment.length() > 0 && (outputFormat & OF_VERBOSE)) {
+		if (outputFormat & OF_JSON)
+			output << ",\"comment\": \"" << m_comment << '"';
+		else
+			output << " [" << m_comment << "]";
+	}
+
+	return RESULT_OK;
+}
+
 result_t DataFieldSet::write(istringstream& input,
 		const PartType partType, SymbolString& data,
 		unsigned char offset, char separator, unsigned char* length)
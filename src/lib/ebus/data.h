@@ -22,6 +22,8 @@
 #include "symbol.h"
 #include "result.h"
 #include "filereader.h"
+#include "arena.h"
+#include "stringpool.h"
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -49,7 +51,7 @@
  * structures and can easily be extended if necessary.
  *
  * Each @a DataField can be converted from a @a SymbolString to an
- * @a ostringstream (see @a DataField#read() methods) or vice versa from an
+ * @a ostream (see @a DataField#read() methods) or vice versa from an
  * @a istringstream to a @a SymbolString (see @a DataField#write()).
  *
  * The @a DataFieldTemplates allow definition of derived types as well as
@@ -159,16 +161,69 @@ int parseSignedInt(const char* str, int base, const int minValue, const int maxV
  * @param lineNo the current line number in the file being read.
  * @param result the result code.
  */
-void printErrorPos(ostream& out, vector<string>::iterator begin, const vector<string>::iterator end, vector<string>::iterator pos, string filename, size_t lineNo, result_t result);
+void printErrorPos(ostream& out, vector<string>::iterator begin, const vector<string>::iterator end, vector<string>::iterator pos, const string& filename, size_t lineNo, result_t result);
 
 
 class DataFieldTemplates;
 class SingleDataField;
 
+/** the kind of decoding performed by a @a DecodeStep. */
+enum class DecodeKind {
+	field,     //!< delegate to the virtual read of the @a SingleDataField
+	ignored,   //!< ignored field (only covered by the position check)
+	number,    //!< number with optional divisor decoded by the plan interpreter
+	valueList, //!< number with value list decoded by the plan interpreter
+};
+
+/**
+ * A single step of a compiled decode plan of a @a DataFieldSet.
+ */
+struct DecodeStep
+{
+	/** the @a SingleDataField this step was compiled from. */
+	SingleDataField* m_field;
+
+	/** the message part in which the field is stored. */
+	PartType m_partType;
+
+	/** the kind of decoding to perform. */
+	DecodeKind m_kind;
+
+	/** the base data type. */
+	BaseType m_type;
+
+	/** the data type flags (like #BCD). */
+	unsigned short m_flags;
+
+	/** the offset of the field relative to the start of the message part data. */
+	unsigned char m_offset;
+
+	/** the number of symbols of the field. */
+	unsigned char m_length;
+
+	/** the number of bits in the binary value (numeric only). */
+	unsigned char m_bitCount;
+
+	/** the offset to the first bit in the binary value (numeric only). */
+	unsigned char m_bitOffset;
+
+	/** the replacement value. */
+	unsigned int m_replacement;
+
+	/** the divisor (negative for reciprocal) to apply on the value, or 1 for none. */
+	int m_divisor;
+
+	/** the precision for formatting the value. */
+	unsigned char m_precision;
+
+	/** the value=text assignments, or NULL. */
+	const map<unsigned int, string>* m_values;
+};
+
 /**
  * Base class for all kinds of data fields.
  */
-class DataField
+class DataField : public ArenaObject
 {
 public:
 
@@ -177,7 +232,7 @@ public:
 	 * @param name the field name.
 	 * @param comment the field comment.
 	 */
-	DataField(const string name, const string comment)
+	DataField(const InternedString& name, const InternedString& comment)
 		: m_name(name), m_comment(comment) {}
 
 	/**
@@ -246,13 +301,13 @@ public:
 	 * Get the field name.
 	 * @return the field name.
 	 */
-	string getName() const { return m_name; }
+	const string& getName() const { return m_name; }
 
 	/**
 	 * Get the field comment.
 	 * @return the field comment.
 	 */
-	string getComment() const { return m_comment; }
+	const string& getComment() const { return m_comment; }
 
 	/**
 	 * Dump the field settings to the output.
@@ -290,7 +345,7 @@ public:
 	 * @param partType the @a PartType of the data.
 	 * @param data the unescaped data @a SymbolString for reading binary data.
 	 * @param offset the additional offset to add for reading binary data.
-	 * @param output the @a ostringstream to append the formatted value to.
+	 * @param output the @a ostream to append the formatted value to.
 	 * @param outputFormat the @a OutputFormat options to use.
 	 * @param outputIndex the optional index of the field when using an indexed output format, or -1.
 	 * @param leadingSeparator whether to prepend a separator before the formatted value.
@@ -302,7 +357,7 @@ public:
 	 */
 	virtual result_t read(const PartType partType,
 			SymbolString& data, unsigned char offset,
-			ostringstream& output, OutputFormat outputFormat, signed char outputIndex=-1,
+			ostream& output, OutputFormat outputFormat, signed char outputIndex=-1,
 			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1) = 0;
 
 	/**
@@ -322,10 +377,10 @@ public:
 protected:
 
 	/** the field name. */
-	const string m_name;
+	const InternedString m_name;
 
 	/** the field comment. */
-	const string m_comment;
+	const InternedString m_comment;
 
 };
 
@@ -346,8 +401,8 @@ public:
 	 * @param partType the message part in which the field is stored.
 	 * @param length the number of symbols in the message part in which the field is stored.
 	 */
-	SingleDataField(const string& name, const string& comment,
-			const string& unit, const dataType_t dataType, const PartType partType,
+	SingleDataField(const InternedString& name, const InternedString& comment,
+			const InternedString& unit, const dataType_t dataType, const PartType partType,
 			const unsigned char length)
 		: DataField(name, comment),
 		  m_unit(unit), m_dataType(dataType), m_partType(partType),
@@ -384,7 +439,7 @@ public:
 	 * Get the value unit.
 	 * @return the value unit.
 	 */
-	string getUnit() const { return m_unit; }
+	const string& getUnit() const { return m_unit; }
 
 	/**
 	 * Get whether this field is ignored.
@@ -426,7 +481,7 @@ public:
 	// @copydoc
 	virtual result_t read(const PartType partType,
 			SymbolString& data, unsigned char offset,
-			ostringstream& output, OutputFormat outputFormat, signed char outputIndex=-1,
+			ostream& output, OutputFormat outputFormat, signed char outputIndex=-1,
 			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1);
 
 	// @copydoc
@@ -434,6 +489,29 @@ public:
 			const PartType partType, SymbolString& data,
 			unsigned char offset, char separator=UI_FIELD_SEPARATOR, unsigned char* length=NULL);
 
+	/**
+	 * Write the formatted output preceding the value.
+	 * @param output the @a ostream to append to.
+	 * @param outputFormat the @a OutputFormat options to use.
+	 * @param outputIndex the optional index of the field when using an indexed output format, or -1.
+	 * @param leadingSeparator whether to prepend a separator before the formatted value.
+	 */
+	void writePrefix(ostream& output, OutputFormat outputFormat,
+			signed char outputIndex, bool leadingSeparator);
+
+	/**
+	 * Write the formatted output following the value.
+	 * @param output the @a ostream to append to.
+	 * @param outputFormat the @a OutputFormat options to use.
+	 */
+	void writeSuffix(ostream& output, OutputFormat outputFormat);
+
+	/**
+	 * Compile this field into a @a DecodeStep (all except the offset).
+	 * @param step the @a DecodeStep to fill.
+	 */
+	virtual void compile(DecodeStep& step);
+
 protected:
 
 	/**
@@ -449,12 +527,12 @@ protected:
 	 * Internal method for reading the field from a @a SymbolString.
 	 * @param input the unescaped @a SymbolString to read the binary value from.
 	 * @param baseOffset the base offset in the @a SymbolString.
-	 * @param output the ostringstream to append the formatted value to.
+	 * @param output the @a ostream to append the formatted value to.
 	 * @param outputFormat the @a OutputFormat options to use.
 	 * @return @a RESULT_OK on success, or an error code.
 	 */
 	virtual result_t readSymbols(SymbolString& input, const unsigned char baseOffset,
-			ostringstream& output, OutputFormat outputFormat) = 0;
+			ostream& output, OutputFormat outputFormat) = 0;
 
 	/**
 	 * Internal method for writing the field to a @a SymbolString.
@@ -469,7 +547,7 @@ protected:
 protected:
 
 	/** the value unit. */
-	const string m_unit;
+	const InternedString m_unit;
 
 	/** the data type definition. */
 	const dataType_t m_dataType;
@@ -499,8 +577,8 @@ public:
 	 * @param partType the message part in which the field is stored.
 	 * @param length the number of symbols in the message part in which the field is stored, or @a REMAIN_LEN for remainder within same message part.
 	 */
-	StringDataField(const string name, const string comment,
-			const string unit, const dataType_t dataType, const PartType partType,
+	StringDataField(const InternedString& name, const InternedString& comment,
+			const InternedString& unit, const dataType_t dataType, const PartType partType,
 			const unsigned char length)
 		: SingleDataField(name, comment, unit, dataType, partType, length) {}
 
@@ -531,7 +609,7 @@ protected:
 
 	// @copydoc
 	virtual result_t readSymbols(SymbolString& input, const unsigned char baseOffset,
-			ostringstream& output, OutputFormat outputFormat);
+			ostream& output, OutputFormat outputFormat);
 
 	// @copydoc
 	virtual result_t writeSymbols(istringstream& input, const unsigned char offset, SymbolString& output, unsigned char* length);
@@ -557,8 +635,8 @@ public:
 	 * @param bitCount the number of bits in the binary value (may be less than @a length * 8).
 	 * @param bitOffset the offset to the first bit in the binary value.
 	 */
-	NumericDataField(const string name, const string comment,
-			const string unit, const dataType_t dataType, const PartType partType,
+	NumericDataField(const InternedString& name, const InternedString& comment,
+			const InternedString& unit, const dataType_t dataType, const PartType partType,
 			const unsigned char length, const unsigned char bitCount, const unsigned char bitOffset)
 		: SingleDataField(name, comment, unit, dataType, partType, length),
 		  m_bitCount(bitCount), m_bitOffset(bitOffset) {}
@@ -580,6 +658,9 @@ public:
 	// @copydoc
 	virtual void dump(ostream& output);
 
+	// @copydoc
+	virtual void compile(DecodeStep& step);
+
 protected:
 
 	// @copydoc
@@ -622,8 +703,8 @@ public:
 	 * @param bitCount the number of bits in the binary value (may be less than @a length * 8).
 	 * @param divisor the extra divisor (negative for reciprocal) to apply on the value, or 1 for none.
 	 */
-	NumberDataField(const string name, const string comment,
-			const string unit, const dataType_t dataType, const PartType partType,
+	NumberDataField(const InternedString& name, const InternedString& comment,
+			const InternedString& unit, const dataType_t dataType, const PartType partType,
 			const unsigned char length, const unsigned char bitCount,
 			const int divisor);
 
@@ -644,11 +725,14 @@ public:
 	// @copydoc
 	virtual void dump(ostream& output);
 
+	// @copydoc
+	virtual void compile(DecodeStep& step);
+
 protected:
 
 	// @copydoc
 	virtual result_t readSymbols(SymbolString& input, const unsigned char baseOffset,
-			ostringstream& output, OutputFormat outputFormat);
+			ostream& output, OutputFormat outputFormat);
 
 	// @copydoc
 	virtual result_t writeSymbols(istringstream& input, const unsigned char offset, SymbolString& output, unsigned char* length);
@@ -682,8 +766,8 @@ public:
 	 * @param bitCount the number of bits in the binary value (may be less than @a length * 8).
 	 * @param values the value=text assignments.
 	 */
-	ValueListDataField(const string name, const string comment,
-			const string unit, const dataType_t dataType, const PartType partType,
+	ValueListDataField(const InternedString& name, const InternedString& comment,
+			const InternedString& unit, const dataType_t dataType, const PartType partType,
 			const unsigned char length, const unsigned char bitCount,
 			const map<unsigned int, string> values)
 		: NumericDataField(name, comment, unit, dataType, partType, length, bitCount,
@@ -707,11 +791,14 @@ public:
 	// @copydoc
 	virtual void dump(ostream& output);
 
+	// @copydoc
+	virtual void compile(DecodeStep& step);
+
 protected:
 
 	// @copydoc
 	virtual result_t readSymbols(SymbolString& input, const unsigned char baseOffset,
-			ostringstream& output, OutputFormat outputFormat);
+			ostream& output, OutputFormat outputFormat);
 
 	// @copydoc
 	virtual result_t writeSymbols(istringstream& input, const unsigned char offset, SymbolString& output, unsigned char* length);
@@ -749,7 +836,7 @@ public:
 	 * @param comment the field comment.
 	 * @param fields the @a vector of @a SingleDataField instances part of this set.
 	 */
-	DataFieldSet(const string name, const string comment,
+	DataFieldSet(const InternedString& name, const InternedString& comment,
 				 const vector<shared_ptr<SingleDataField>> fields)
 		: DataField(name, comment),
 		  m_fields(fields)
@@ -767,6 +854,7 @@ public:
 			names[name] = name;
 		}
 		m_uniqueNames = uniqueNames;
+		compilePlan();
 	}
 
 	/**
@@ -820,7 +908,28 @@ public:
 	// @copydoc
 	virtual result_t read(const PartType partType,
 			SymbolString& data, unsigned char offset,
-			ostringstream& output, OutputFormat outputFormat, signed char outputIndex=-1,
+			ostream& output, OutputFormat outputFormat, signed char outputIndex=-1,
+			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1);
+
+	/**
+	 * Reads the value from the @a SymbolString by calling each @a SingleDataField (bypassing the compiled decode plan).
+	 * This is the reference for the decode plan and takes the same arguments as @a read().
+	 * @param partType the @a PartType of the data.
+	 * @param data the unescaped data @a SymbolString for reading binary data.
+	 * @param offset the additional offset to add for reading binary data.
+	 * @param output the @a ostream to append the formatted value to.
+	 * @param outputFormat the @a OutputFormat options to use.
+	 * @param outputIndex the optional index of the field when using an indexed output format, or -1.
+	 * @param leadingSeparator whether to prepend a separator before the formatted value.
+	 * @param fieldName the optional name of a field to limit the output to.
+	 * @param fieldIndex the optional index of the named field to limit the output to, or -1.
+	 * @return @a RESULT_OK on success (or if the partType does not match),
+	 * or @a RESULT_EMPTY if the field was skipped (either ignored or due to @a fieldName or @a fieldIndex),
+	 * or an error code.
+	 */
+	result_t readFields(const PartType partType,
+			SymbolString& data, unsigned char offset,
+			ostream& output, OutputFormat outputFormat, signed char outputIndex=-1,
 			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1);
 
 	// @copydoc
@@ -828,8 +937,35 @@ public:
 			const PartType partType, SymbolString& data,
 			unsigned char offset, char separator=UI_FIELD_SEPARATOR, unsigned char* length=NULL);
 
+	/**
+	 * Return whether the fields were compiled into a decode plan.
+	 * @return whether the fields were compiled into a decode plan.
+	 */
+	bool hasPlan() const { return !m_plan.empty(); }
+
 private:
 
+	/**
+	 * Compile the fields into the decode plan (left empty if the layout is not fixed).
+	 */
+	void compilePlan();
+
+	/**
+	 * Reads the value of all fields of the part from the @a SymbolString using the decode plan.
+	 * @param partType the @a PartType of the data.
+	 * @param data the unescaped data @a SymbolString for reading binary data.
+	 * @param offset the additional offset to add for reading binary data.
+	 * @param output the @a ostream to append the formatted value to.
+	 * @param outputFormat the @a OutputFormat options to use.
+	 * @param outputIndex the optional index of the field when using an indexed output format, or -1.
+	 * @param leadingSeparator whether to prepend a separator before the formatted value.
+	 * @return @a RESULT_OK on success, or @a RESULT_EMPTY if no field was read, or an error code.
+	 */
+	result_t readPlan(const PartType partType,
+			SymbolString& data, unsigned char offset,
+			ostream& output, OutputFormat outputFormat, signed char outputIndex,
+			bool leadingSeparator);
+
 	/** the @a DataFieldSet containing the ident message @a SingleDataField instances, or NULL. */
 	static shared_ptr<DataFieldSet> s_identFields;
 
@@ -839,6 +975,12 @@ private:
 	/** whether all fields have a unique name. */
 	bool m_uniqueNames;
 
+	/** the compiled decode plan with one @a DecodeStep per field, or empty. */
+	vector<DecodeStep> m_plan;
+
+	/** the number of symbols covered by the decode plan in master data (index 0) and slave data (index 1). */
+	unsigned char m_planLength[2];
+
 };
 
 
@@ -22,7 +22,6 @@
 
 #include "device.h"
 #include "data.h"
-#include <array>
 #include <regex>
 #include <cstdlib>
 #include <cstring>
@@ -39,12 +38,11 @@
 #include <poll.h>
 #endif
 
-using std::ios;
 
 Device::~Device()
 {
 	close();
-	m_dumpRawStream.close();
+	m_dumpRawWriter.stop();
 }
 
 shared_ptr<Device> Device::create(const string& name, const bool checkDevice, const bool readOnly, const bool initialSend,
@@ -97,6 +95,7 @@ void Device::close()
 		::close(m_fd);
 		m_fd = -1;
 	}
+	m_bufferPos = m_bufferLen = 0;
 }
 
 bool Device::isValid()
@@ -124,11 +123,37 @@ result_t Device::send(const unsigned char value)
 	return RESULT_OK;
 }
 
-result_t Device::recv(const long timeout, unsigned char& value)
+result_t Device::send(const unsigned char* data, const size_t length)
 {
 	if (!isValid())
 		return RESULT_ERR_DEVICE;
 
+	if (m_readOnly)
+		return RESULT_ERR_SEND;
+
+	for (size_t pos = 0; pos < length; ) {
+		ssize_t written = write(data + pos, length - pos);
+		if (written <= 0) {
+			if (written < 0 && errno == EINTR)
+				continue;
+			return RESULT_ERR_SEND;
+		}
+		pos += written;
+	}
+
+	if (m_logRaw && m_logRawFunc != NULL) {
+		for (size_t pos = 0; pos < length; pos++)
+			(*m_logRawFunc)(data[pos], false);
+	}
+
+	return RESULT_OK;
+}
+
+result_t Device::recv(const long timeout, unsigned char& value)
+{
+	if (!available() && !isValid()) // buffered bytes are served without checking the device again
+		return RESULT_ERR_DEVICE;
+
 	if (!available() && timeout > 0) {
 		int ret;
 		struct timespec tdiff;
@@ -163,31 +188,23 @@ result_t Device::recv(const long timeout, unsigned char& value)
 		if (ret == 0) return RESULT_ERR_TIMEOUT;
 	}
 
-	// directly read byte from device
-	ssize_t nbytes = read(value);
-	if (nbytes == 0)
-		return RESULT_ERR_EOF;
-	if (nbytes < 0)
-		return RESULT_ERR_DEVICE;
+	if (!available()) {
+		// read all bytes available from device at once
+		ssize_t nbytes = read(m_buffer, sizeof(m_buffer));
+		if (nbytes == 0)
+			return RESULT_ERR_EOF;
+		if (nbytes < 0)
+			return RESULT_ERR_DEVICE;
+		m_bufferPos = 0;
+		m_bufferLen = (size_t)nbytes;
+	}
+	value = m_buffer[m_bufferPos++];
 
 	if (m_logRaw && m_logRawFunc != NULL)
 		(*m_logRawFunc)(value, true);
 
-	if (m_dumpRaw && m_dumpRawStream.is_open()) {
-		m_dumpRawStream.write((char*)&value, 1);
-		m_dumpRawFileSize++;
-		if ((m_dumpRawFileSize % 1024) == 0)
-			m_dumpRawStream.flush();
-
-		if (m_dumpRawFileSize >= m_dumpRawMaxSize * 1024) {
-			string oldfile = string(m_dumpRawFile) + ".old";
-			if (rename(m_dumpRawFile, oldfile.c_str()) == 0) {
-				m_dumpRawStream.close();
-				m_dumpRawStream.open(m_dumpRawFile, ios::out | ios::binary | ios::app);
-				m_dumpRawFileSize = 0;
-			}
-		}
-	}
+	if (m_dumpRaw && m_dumpRawWriter.isRunning())
+		m_dumpRawWriter.push(value);
 
 	return RESULT_OK;
 }
@@ -200,24 +217,32 @@ void Device::setDumpRaw(bool dumpRaw)
 	m_dumpRaw = dumpRaw;
 
 	if (!dumpRaw || m_dumpRawFile == NULL)
-		m_dumpRawStream.close();
-	else {
-		m_dumpRawStream.open(m_dumpRawFile, ios::out | ios::binary | ios::app);
-		m_dumpRawFileSize = 0;
-	}
+		m_dumpRawWriter.stop();
+	else
+		m_dumpRawWriter.start();
 }
 
 void Device::setDumpRawFile(const char* dumpFile) {
 	if ((dumpFile == NULL) ? (m_dumpRawFile == NULL) : (m_dumpRawFile != NULL && (m_dumpRawFile == dumpFile || strcmp(dumpFile, m_dumpRawFile) == 0)))
 		return;
 
-	m_dumpRawStream.close();
+	m_dumpRawWriter.stop();
 	m_dumpRawFile = dumpFile;
+	m_dumpRawWriter.setFile(dumpFile == NULL ? "" : dumpFile);
 
-	if (m_dumpRaw && m_dumpRawFile != NULL) {
-		m_dumpRawStream.open(m_dumpRawFile, ios::out | ios::binary | ios::app);
-		m_dumpRawFileSize = 0;
-	}
+	if (m_dumpRaw && m_dumpRawFile != NULL)
+		m_dumpRawWriter.start();
+}
+
+void Device::setDumpRawTimestamps(bool timestamps) {
+	if (timestamps == m_dumpRawWriter.getTimestamps())
+		return;
+
+	bool running = m_dumpRawWriter.isRunning();
+	m_dumpRawWriter.stop();
+	m_dumpRawWriter.setTimestamps(timestamps);
+	if (running)
+		m_dumpRawWriter.start();
 }
 
 
@@ -338,40 +363,6 @@ void NetworkDevice::checkDevice()
 	unsigned char value;
 	ssize_t c = ::recv(m_fd, &value, 1, MSG_PEEK | MSG_DONTWAIT);
 	if (c == 0 || (c < 0 && errno != EAGAIN)) {
-		m_buffer.clear();
 		close();
 	}
 }
-
-bool NetworkDevice::available() const
-{
-	return not m_buffer.empty();
-}
-
-ssize_t NetworkDevice::write(const unsigned char value)
-{
-	m_buffer.clear();
-	return Device::write(value);
-}
-
-ssize_t NetworkDevice::read(unsigned char& value)
-{
-	if (available()) {
-		value = m_buffer.front();
-		m_buffer.pop_front();
-		return 1;
-	}
-
-	if (m_buffer.size() > 0) {
-		std::array<unsigned char, 32> buffer;
-		ssize_t size = ::read(m_fd, &buffer[0], buffer.size());
-		if (size<=0) {
-			return size;
-		}
-		m_buffer.insert(m_buffer.end(), buffer.begin(), buffer.end());
-		value = m_buffer.front();
-		m_buffer.pop_front();
-		return size;
-	}
-	return Device::read(value);
-}
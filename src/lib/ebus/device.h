@@ -23,10 +23,10 @@
 #include <termios.h>
 #include <iostream>
 #include <fstream>
-#include <deque>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include "result.h"
+#include "dumpwriter.h"
 #include "cppconfig.h"
 
 /** @file device.h
@@ -38,6 +38,9 @@
  * to a file and/or forwarding it to a logging function.
  */
 
+/** the maximum number of bytes read from the device at once. */
+#define DEVICE_BUFFER_SIZE 256
+
 /**
  * The base class for accessing an eBUS.
  */
@@ -104,6 +107,14 @@ public:
 	 */
 	result_t send(const unsigned char value);
 
+	/**
+	 * Write a batch of bytes to the device (with as few system calls as possible).
+	 * @param data the bytes to write.
+	 * @param length the number of bytes to write.
+	 * @return the @a result_t code.
+	 */
+	result_t send(const unsigned char* data, const size_t length);
+
 	/**
 	 * Read a single byte from the device.
 	 * @param timeout maximum time to wait for the byte in microseconds, or 0 for infinite.
@@ -146,7 +157,19 @@ public:
 	 * Set the maximum size of a file to dump raw data to.
 	 * @param maxSize the maximum size of a file to dump raw data to.
 	 */
-	void setDumpRawMaxSize(const long maxSize) { m_dumpRawMaxSize = maxSize; }
+	void setDumpRawMaxSize(const long maxSize) { m_dumpRawWriter.setMaxSize(maxSize); }
+
+	/**
+	 * Enable or disable writing the receive time for each byte dumped to a file (see @a DumpWriter).
+	 * @param timestamps true to write the receive time for each dumped byte.
+	 */
+	void setDumpRawTimestamps(bool timestamps=true);
+
+	/**
+	 * Get the number of dumped bytes dropped because the dump file could not be written fast enough.
+	 * @return the number of dropped bytes.
+	 */
+	unsigned long getDumpRawDropped() const { return m_dumpRawWriter.getDropped(); }
 
 	/**
 	 * Return the device name.
@@ -170,7 +193,7 @@ protected:
 	 * Check whether a byte is available immediately (without waiting).
 	 * @return true when a a byte is available immediately.
 	 */
-	virtual bool available() const { return false; }
+	bool available() const { return m_bufferPos < m_bufferLen; }
 
 	/**
 	 * Write a single byte.
@@ -180,11 +203,20 @@ protected:
 	virtual ssize_t write(const unsigned char value) { return ::write(m_fd, &value, 1); }
 
 	/**
-	 * Read a single byte.
-	 * @param value the reference in which the read byte value is stored.
+	 * Write a batch of bytes (possibly only partially).
+	 * @param buffer the bytes to write.
+	 * @param length the number of bytes to write.
+	 * @return the number of bytes written, or -1 on error.
+	 */
+	virtual ssize_t write(const unsigned char* buffer, const size_t length) { return ::write(m_fd, buffer, length); }
+
+	/**
+	 * Read all immediately available bytes (at least one, waiting if necessary).
+	 * @param buffer the buffer in which the read bytes are stored.
+	 * @param maxLength the maximum number of bytes to read.
 	 * @return the number of bytes read, or -1 on error.
 	 */
-	virtual ssize_t read(unsigned char& value) { return ::read(m_fd, &value, 1); }
+	virtual ssize_t read(unsigned char* buffer, const size_t maxLength) { return ::read(m_fd, buffer, maxLength); }
 
 protected:
 	/** the device name (e.g. "/dev/ttyUSB0" for serial, "127.0.0.1:1234" for network). */
@@ -203,6 +235,15 @@ protected:
 	int m_fd = -1;
 
 private:
+	/** the bytes read from the device but not yet returned by @a recv(). */
+	unsigned char m_buffer[DEVICE_BUFFER_SIZE];
+
+	/** the position of the next byte to return from @a m_buffer. */
+	size_t m_bufferPos = 0;
+
+	/** the number of bytes available in @a m_buffer. */
+	size_t m_bufferLen = 0;
+
 	/** whether logging of raw data is enabled. */
 	bool m_logRaw = false;
 
@@ -215,14 +256,8 @@ private:
 	/** the name of the file to dump raw data to. */
 	const char* m_dumpRawFile = nullptr;
 
-	/** the maximum size of @a m_dumpFile, or 0 for infinite. */
-	long m_dumpRawMaxSize = 0;
-
-	/** the @a ofstream for dumping raw data to. */
-	ofstream m_dumpRawStream;
-
-	/** the number of bytes already written to the @a m_dumpFile. */
-	long m_dumpRawFileSize = 0;
+	/** the @a DumpWriter for dumping raw data to @a m_dumpRawFile. */
+	DumpWriter m_dumpRawWriter;
 
 };
 
@@ -290,24 +325,12 @@ protected:
 	// @copydoc
 	virtual void checkDevice() override;
 
-	// @copydoc
-	virtual bool available() const override;
-
-	// @copydoc
-	virtual ssize_t write(const unsigned char value) override;
-
-	// @copydoc
-	virtual ssize_t read(unsigned char& value) override;
-
 private:
 	/** the socket address of the device. */
 	const struct sockaddr_in m_address;
 
 	/** true for UDP, false to TCP. */
 	const bool m_udp = false;
-
-	/** the buffer memory, or NULL. */
-	std::deque<unsigned char> m_buffer;
 };
 
 #endif // LIBEBUS_DEVICE_H_
@@ -0,0 +1,122 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "dumpwriter.h"
+#include <chrono>
+#include <cstdio>
+
+using std::ios;
+
+bool DumpWriter::start()
+{
+	if (m_active)
+		return true;
+	if (m_file.empty())
+		return false;
+	m_stream.open(m_file.c_str(), ios::out | ios::binary | ios::app);
+	if (!m_stream.is_open())
+		return false;
+	if (!m_ring)
+		m_ring.reset(new Entry[DUMP_RING_SIZE]);
+	m_fileSize = 0;
+	m_active = true;
+	if (!Thread::start("dumpwriter")) {
+		m_active = false;
+		m_stream.close();
+		return false;
+	}
+	return true;
+}
+
+void DumpWriter::stop()
+{
+	if (!m_active)
+		return;
+	m_active = false;
+	WaitThread::join();
+	m_stream.close();
+}
+
+bool DumpWriter::push(const unsigned char value)
+{
+	if (!m_active)
+		return false;
+	size_t head = m_head.load(std::memory_order_relaxed);
+	size_t next = (head + 1) & (DUMP_RING_SIZE - 1);
+	size_t tail = m_tail.load(std::memory_order_acquire);
+	if (next == tail) {
+		m_dropped++;
+		return false;
+	}
+	Entry& entry = m_ring[head];
+	if (m_timestamps)
+		entry.m_time = (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	entry.m_value = value;
+	m_head.store(next, std::memory_order_release);
+	if (((next - tail) & (DUMP_RING_SIZE - 1)) == DUMP_RING_SIZE/2)
+		wakeUp(); // drain before the interval elapses
+	return true;
+}
+
+void DumpWriter::run()
+{
+	while (m_active) {
+		drain();
+		Wait(0, DUMP_WRITE_INTERVAL);
+	}
+	drain();
+}
+
+void DumpWriter::drain()
+{
+	char buffer[256*DUMP_RECORD_SIZE];
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+	size_t head = m_head.load(std::memory_order_acquire);
+	if (tail == head)
+		return;
+	while (tail != head) {
+		size_t pos = 0;
+		for (; tail != head && pos+DUMP_RECORD_SIZE <= sizeof(buffer); tail = (tail + 1) & (DUMP_RING_SIZE - 1)) {
+			const Entry& entry = m_ring[tail];
+			if (m_timestamps) {
+				for (int i = 0; i < 8; i++)
+					buffer[pos++] = (char)((entry.m_time >> (8 * i)) & 0xff);
+			}
+			buffer[pos++] = (char)entry.m_value;
+		}
+		m_tail.store(tail, std::memory_order_release);
+		m_stream.write(buffer, pos);
+		m_fileSize += (long)pos;
+		long maxSize = m_maxSize.load(std::memory_order_relaxed);
+		if (maxSize > 0 && m_fileSize >= maxSize * 1024) {
+			string oldfile = m_file + ".old";
+			if (rename(m_file.c_str(), oldfile.c_str()) == 0) {
+				m_stream.close();
+				m_stream.open(m_file.c_str(), ios::out | ios::binary | ios::app);
+				m_fileSize = 0;
+			}
+		}
+		head = m_head.load(std::memory_order_acquire);
+	}
+	m_stream.flush();
+}
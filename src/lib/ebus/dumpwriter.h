@@ -0,0 +1,187 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBEBUS_DUMPWRITER_H_
+#define LIBEBUS_DUMPWRITER_H_
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include "cppconfig.h"
+#include "thread.h"
+
+/** @file dumpwriter.h
+ * Classes for writing raw bus data to a dump file.
+ *
+ * The @a DumpWriter decouples the thread receiving the bytes from the file
+ * system: received bytes are put into a lock-free single producer single
+ * consumer ring and written to the file (including rotation) by a dedicated
+ * writer thread. The ring is only allocated when dumping is started.
+ *
+ * A dump file either contains the plain received bytes or, with timestamps
+ * enabled, one record of @a DUMP_RECORD_SIZE bytes for each received byte:
+ * the receive time in microseconds since the epoch as 64 bit little endian
+ * value followed by the byte itself.
+ */
+
+/** the number of bytes the ring of a @a DumpWriter can hold (power of 2). */
+#define DUMP_RING_SIZE 16384
+
+/** the size of a single record in a timestamped dump file. */
+#define DUMP_RECORD_SIZE 9
+
+/** the maximum interval in milliseconds in which the writer thread drains the ring (earlier when half full). */
+#define DUMP_WRITE_INTERVAL 100
+
+/**
+ * Writer for raw bus data running in its own thread.
+ */
+class DumpWriter : public WaitThread
+{
+public:
+	/**
+	 * Construct a new instance.
+	 */
+	DumpWriter() : m_maxSize(0), m_head(0), m_tail(0), m_active(false), m_dropped(0) {}
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~DumpWriter() { stop(); }
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	DumpWriter(const DumpWriter& src);
+
+public:
+
+	/**
+	 * Set the name of the file to dump to (only effective on next @a start()).
+	 * @param file the name of the file to dump to.
+	 */
+	void setFile(const string& file) { m_file = file; }
+
+	/**
+	 * Set the maximum size of a file to dump to.
+	 * @param maxSize the maximum size of a file in kB, or 0 for infinite.
+	 */
+	void setMaxSize(const long maxSize) { m_maxSize.store(maxSize, std::memory_order_relaxed); }
+
+	/**
+	 * Set whether to write a timestamp for each byte (only effective on next @a start()).
+	 * @param timestamps true to write a timestamp for each byte.
+	 */
+	void setTimestamps(const bool timestamps) { m_timestamps = timestamps; }
+
+	/**
+	 * Get whether a timestamp is written for each byte.
+	 * @return whether a timestamp is written for each byte.
+	 */
+	bool getTimestamps() const { return m_timestamps; }
+
+	/**
+	 * Open the file and start the writer thread.
+	 * @return true on success, false if the file could not be opened.
+	 */
+	bool start();
+
+	/**
+	 * Write all pending bytes, stop the writer thread, and close the file.
+	 */
+	virtual void stop() override;
+
+	/**
+	 * Return whether the writer was started and not yet stopped.
+	 * @return whether the writer was started and not yet stopped.
+	 */
+	virtual bool isRunning() override { return m_active; }
+
+	/**
+	 * Add a received byte to the ring (only to be called from a single thread).
+	 * @param value the received byte.
+	 * @return true if the byte was added, false if it was dropped because the ring is full.
+	 */
+	bool push(const unsigned char value);
+
+	/**
+	 * Get the number of bytes dropped because the ring was full.
+	 * @return the number of dropped bytes.
+	 */
+	unsigned long getDropped() const { return m_dropped; }
+
+protected:
+
+	// @copydoc
+	virtual void run() override;
+
+private:
+
+	/**
+	 * Write all bytes currently available in the ring to the file.
+	 */
+	void drain();
+
+	/**
+	 * A single entry of the ring.
+	 */
+	struct Entry
+	{
+		/** the receive time in microseconds since the epoch (only with timestamps). */
+		unsigned long long m_time;
+
+		/** the received byte. */
+		unsigned char m_value;
+	};
+
+	/** the name of the file to dump to. */
+	string m_file;
+
+	/** the maximum size of a file in kB, or 0 for infinite. */
+	std::atomic<long> m_maxSize;
+
+	/** whether to write a timestamp for each byte. */
+	bool m_timestamps = false;
+
+	/** the ring entries (allocated on first @a start()). */
+	std::unique_ptr<Entry[]> m_ring;
+
+	/** the index of the next entry to write by @a push() (only modified by the producer). */
+	std::atomic<size_t> m_head;
+
+	/** the index of the next entry to read by @a drain() (only modified by the writer thread). */
+	std::atomic<size_t> m_tail;
+
+	/** whether the writer was started and not yet stopped. */
+	std::atomic<bool> m_active;
+
+	/** the number of bytes dropped because the ring was full. */
+	std::atomic<unsigned long> m_dropped;
+
+	/** the @a ofstream for writing to the file (only used by the writer thread while running). */
+	ofstream m_stream;
+
+	/** the number of bytes already written to the current file. */
+	long m_fileSize = 0;
+
+};
+
+#endif // LIBEBUS_DUMPWRITER_H_
@@ -23,6 +23,7 @@
 #include "result.h"
 #include "cppconfig.h"
 #include "Address.h"
+#include "tokenizer.h"
 #include <climits>
 #include <string>
 #include <iostream>
@@ -55,10 +56,272 @@
 /** the separator character used between multiple values (in CSV only). */
 #define VALUE_SEPARATOR ';'
 
-extern void printErrorPos(ostream& out, vector<string>::iterator begin, const vector<string>::iterator end, vector<string>::iterator pos, string filename, size_t lineNo, result_t result);
+extern void printErrorPos(ostream& out, vector<string>::iterator begin, const vector<string>::iterator end, vector<string>::iterator pos, const string& filename, size_t lineNo, result_t result);
 
 extern unsigned int parseInt(const char* str, int base, const unsigned int minValue, const unsigned int maxValue, result_t& result, unsigned int* length);
 
+/**
+ * A row of a file split into fields.
+ */
+struct FileRow
+{
+	/** the line number of the row in the file. */
+	unsigned int m_lineNo;
+
+	/** the fields of the row. */
+	vector<string> m_fields;
+};
+
+/**
+ * A tokenizer splitting the rows of CSV content held in memory into fields in a single pass, with the
+ * same rules as @a FileReader::splitFields(). Fields are referenced in the content directly and only
+ * those needing unquoting or joining of continued lines are collected in a scratch buffer per row.
+ * As the tree is built as C++14, @a StringRef stands in for std::string_view.
+ */
+class CsvTokenizer
+{
+public:
+
+	/**
+	 * Construct a new instance.
+	 * @param data the pointer to the content (has to stay valid while using this instance).
+	 * @param length the length of the content.
+	 */
+	CsvTokenizer(const char* data, const size_t length)
+		: m_pos(data), m_end(data+length) {}
+
+	/**
+	 * Split the next line(s) into fields.
+	 * @param row the @a vector to which to add the fields referencing either the content or the scratch buffer
+	 * (valid until the next call). This will be empty for completely empty and comment lines.
+	 * @param lineNo the current line number (incremented with each line read).
+	 * @return true if there are more lines to read, false when there are no more lines left.
+	 */
+	bool next(vector<StringRef>& row, unsigned int& lineNo)
+	{
+		row.clear();
+		m_fields.clear();
+		m_scratch.clear();
+		bool quotedText = false, wasQuoted = false;
+		char prev = FIELD_SEPARATOR;
+		bool empty = true, read = false;
+		startField();
+		while (m_pos < m_end) {
+			read = true;
+			lineNo++;
+			const char* lineEnd = static_cast<const char*>(memchr(m_pos, '\n', m_end-m_pos));
+			const char* begin = m_pos;
+			const char* end = lineEnd == NULL ? m_end : lineEnd;
+			m_pos = lineEnd == NULL ? m_end : lineEnd+1;
+			trim(begin, end);
+
+			if (!quotedText && (begin == end || *begin == '#' || (end-begin > 1 && begin[0] == '/' && begin[1] == '/')))
+				continue; // skip empty lines and comments
+
+			for (const char* pos = begin; pos < end; pos++) {
+				char ch = *pos;
+				switch (ch)
+				{
+				case FIELD_SEPARATOR:
+					if (quotedText) {
+						append(pos);
+					} else {
+						empty &= endField();
+						startField();
+						wasQuoted = false;
+					}
+					break;
+				case TEXT_SEPARATOR:
+					if (prev == TEXT_SEPARATOR && !quotedText) { // double dquote
+						append(pos);
+						quotedText = true;
+					} else if (quotedText) {
+						quotedText = false;
+					} else if (prev == FIELD_SEPARATOR) {
+						quotedText = wasQuoted = true;
+					} else {
+						append(pos);
+					}
+					break;
+				case '\r':
+					break;
+				default:
+					if (prev == TEXT_SEPARATOR && !quotedText && wasQuoted) {
+						// single dquote in the middle of formerly quoted text
+						append(pos > begin ? pos-1 : NULL, TEXT_SEPARATOR);
+						quotedText = true;
+					} else if (quotedText && pos == begin && m_field.m_length > 0 && lastFieldChar() != VALUE_SEPARATOR) {
+						append(NULL, VALUE_SEPARATOR);
+					}
+					append(pos);
+					break;
+				}
+				prev = ch;
+			}
+			if (!quotedText)
+				break;
+		}
+		if (endField() && empty) {
+			m_fields.clear();
+			return read;
+		}
+		for (const auto& field : m_fields)
+			row.push_back(StringRef(field.m_data == NULL ? m_scratch.data()+field.m_offset : field.m_data, field.m_length));
+		return true;
+	}
+
+	/**
+	 * Left and right trim the referenced part like @a FileReader::trim().
+	 * @param begin the pointer to the first character (updated).
+	 * @param end the pointer after the last character (updated).
+	 */
+	static void trim(const char*& begin, const char*& end)
+	{
+		const char* first = begin;
+		while (first < end && (*first == ' ' || *first == '\t'))
+			first++;
+		if (first == end)
+			return; // keep blank only parts unchanged
+		while (end[-1] == ' ' || end[-1] == '\t')
+			end--;
+		begin = first;
+	}
+
+private:
+
+	/**
+	 * A field of the current row.
+	 */
+	struct Field
+	{
+		/** the pointer to the first character in the content, or NULL when collected in the scratch buffer. */
+		const char* m_data;
+
+		/** the offset of the first character in the scratch buffer. */
+		size_t m_offset;
+
+		/** the number of characters. */
+		size_t m_length;
+	};
+
+	/**
+	 * Start collecting the next field.
+	 */
+	void startField()
+	{
+		m_field.m_data = NULL;
+		m_field.m_offset = m_scratch.length();
+		m_field.m_length = 0;
+		m_direct = true;
+	}
+
+	/**
+	 * Append a character to the current field.
+	 * @param pos the pointer to the character in the content, or NULL if not part of the content.
+	 * @param ch the character to append if not part of the content.
+	 */
+	void append(const char* pos, const char ch=0)
+	{
+		if (m_direct && pos != NULL) {
+			if (m_field.m_length == 0) {
+				m_field.m_data = pos;
+				m_field.m_length = 1;
+				return;
+			}
+			if (pos == m_field.m_data+m_field.m_length) {
+				m_field.m_length++;
+				return;
+			}
+		}
+		if (m_direct) {
+			// no longer contiguous in the content: continue in the scratch buffer
+			if (m_field.m_length > 0)
+				m_scratch.append(m_field.m_data, m_field.m_length);
+			m_field.m_data = NULL;
+			m_direct = false;
+		}
+		m_scratch.push_back(pos == NULL ? ch : *pos);
+		m_field.m_length++;
+	}
+
+	/**
+	 * Return the last character of the current field.
+	 * @return the last character of the current field.
+	 */
+	char lastFieldChar() const
+	{
+		return m_direct ? m_field.m_data[m_field.m_length-1] : m_scratch[m_field.m_offset+m_field.m_length-1];
+	}
+
+	/**
+	 * Finish the current field by trimming it and adding it to the row fields.
+	 * @return whether the trimmed field is empty.
+	 */
+	bool endField()
+	{
+		const char* base = m_direct ? m_field.m_data : m_scratch.data()+m_field.m_offset;
+		const char* begin = base;
+		const char* end = base == NULL ? NULL : base+m_field.m_length;
+		trim(begin, end);
+		Field field = m_field;
+		field.m_length = end-begin;
+		if (m_direct)
+			field.m_data = begin;
+		else
+			field.m_offset += begin-base;
+		m_fields.push_back(field);
+		return field.m_length == 0;
+	}
+
+	/** the pointer to the next character to read. */
+	const char* m_pos;
+
+	/** the pointer after the last character of the content. */
+	const char* m_end;
+
+	/** the scratch buffer for the fields of the current row not contiguous in the content. */
+	string m_scratch;
+
+	/** the fields of the current row. */
+	vector<Field> m_fields;
+
+	/** the field currently being collected. */
+	Field m_field;
+
+	/** whether the current field is still contiguous in the content. */
+	bool m_direct;
+};
+
+/**
+ * An interface for caching the split rows of files read by a @a FileReader.
+ * Note: the methods may be called from several threads concurrently.
+ */
+class FileRowCache
+{
+public:
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~FileRowCache() {}
+
+	/**
+	 * Get the cached rows of a file.
+	 * @param filename the name of the file.
+	 * @param rows the vector to add the rows to.
+	 * @return true when the rows are cached and the file was not modified since then.
+	 */
+	virtual bool getRows(const string& filename, vector<FileRow>& rows) = 0;
+
+	/**
+	 * Add the rows of a completely read file to the cache.
+	 * @param filename the name of the file.
+	 * @param rows the rows of the file.
+	 */
+	virtual void addRows(const string& filename, const vector<FileRow>& rows) = 0;
+
+};
+
 /**
  * An abstract class that support reading definitions from a file.
  */
@@ -77,6 +340,18 @@ public:
 	 */
 	virtual ~FileReader() {}
 
+	/**
+	 * Set the @a FileRowCache to use for reading files.
+	 * @param rowCache the @a FileRowCache to use, or NULL.
+	 */
+	void setRowCache(FileRowCache* rowCache) { m_rowCache = rowCache; }
+
+	/**
+	 * Get the @a FileRowCache used for reading files.
+	 * @return the @a FileRowCache used, or NULL.
+	 */
+	FileRowCache* getRowCache() { return m_rowCache; }
+
 	/**
 	 * Read the definitions from a file.
 	 * @param filename the name of the file being read.
@@ -89,72 +364,62 @@ public:
 	virtual result_t readFromFile(const string filename, bool verbose=false,
 		string defaultDest = "", string defaultCircuit = "", string defaultSuffix = "")
 	{
-		ifstream ifs;
-		ifs.open(filename.c_str(), ifstream::in);
-		if (!ifs.is_open()) {
+		vector<FileRow> cachedRows;
+		if (m_rowCache != NULL && m_rowCache->getRows(filename, cachedRows))
+			return readRows(NULL, &cachedRows, filename, verbose, defaultDest, defaultCircuit, defaultSuffix, false);
+		string content;
+		if (!readContent(filename, content)) {
 			m_lastError = filename;
 			return RESULT_ERR_NOTFOUND;
 		}
-		size_t lastSep = filename.find_last_of('/');
-		if (lastSep!=string::npos) { // potential destination address, matches "^ZZ."
-			// extract defaultDest, defaultCircuit, defaultSuffix from filename:
-			// ZZ.IDENT[.CIRCUIT][.SUFFIX].*csv
-			libebus::Address checkDest;
-			string checkIdent, useCircuit, useSuffix;
-			unsigned int checkSw, checkHw;
-			if (extractDefaultsFromFilename(filename.substr(lastSep+1), checkDest, checkIdent, useCircuit, useSuffix, checkSw, checkHw)) {
-				defaultDest = filename.substr(lastSep+1, 2);
-				if (!useCircuit.empty()) {
-					defaultCircuit = useCircuit;
-				}
-				if (!useSuffix.empty()) {
-					defaultSuffix = useSuffix;
-				}
-			}
-		}
-		unsigned int lineNo = 0;
-		vector<string> row;
-		vector< vector<string> > defaults;
-		while (splitFields(ifs, row, lineNo)) {
-			if (row.empty())
-				continue;
+		CsvTokenizer tokenizer(content.data(), content.length());
+		return readRows(&tokenizer, NULL, filename, verbose, defaultDest, defaultCircuit, defaultSuffix, m_rowCache != NULL);
+	}
 
-			result_t result;
-			vector<string>::iterator it = row.begin();
-			const vector<string>::iterator end = row.end();
-			if (m_supportsDefaults) {
-				if (row[0][0] == '*') {
-					row[0] = row[0].substr(1);
-					result = addDefaultFromFile(defaults, row, it, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
-					if (result == RESULT_OK)
-						continue;
-				} else
-					result = addFromFile(it, end, &defaults, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
-			}
-			else
-				result = addFromFile(it, end, NULL, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
+	/**
+	 * Read the definitions from the content of a file already held in memory (bypassing the @a FileRowCache).
+	 * @param content the @a StringRef to the content of the file.
+	 * @param filename the name of the file the content was read from (for the defaults and error reporting).
+	 * @param verbose whether to verbosely log problems.
+	 * @param defaultDest the default destination address (may be overwritten by file name), or empty.
+	 * @param defaultCircuit the default circuit name (may be overwritten by file name), or empty.
+	 * @param defaultSuffix the default circuit name suffix (starting with a ".", may be overwritten by file name, or empty.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	result_t readFromContent(const StringRef& content, const string& filename, bool verbose=false,
+		string defaultDest = "", string defaultCircuit = "", string defaultSuffix = "")
+	{
+		CsvTokenizer tokenizer(content.data(), content.length());
+		return readRows(&tokenizer, NULL, filename, verbose, defaultDest, defaultCircuit, defaultSuffix, false);
+	}
 
-			if (result != RESULT_OK) {
-				if (!verbose) {
-					ifs.close();
-					ostringstream error;
-					error << filename << ":" << static_cast<unsigned>(lineNo);
-					if (m_lastError.length()>0) {
-						error << ": " << m_lastError;
-					}
-					m_lastError = error.str();
-					return result;
-				}
-				if (m_lastError.length()>0) {
-					cout << m_lastError << endl;
-				}
-				printErrorPos(cout, row.begin(), end, it, filename, lineNo, result);
-			} else if (!verbose)
-				m_lastError = "";
+	/**
+	 * Read the whole content of a file in a single block.
+	 * @param filename the name of the file to read.
+	 * @param content the @a string to store the content in.
+	 * @return true on success, false if the file could not be opened.
+	 */
+	static bool readContent(const string& filename, string& content)
+	{
+		ifstream ifs(filename.c_str(), ifstream::in | ifstream::binary);
+		if (!ifs.is_open())
+			return false;
+		content.clear();
+		ifs.seekg(0, ifstream::end);
+		std::streamoff size = ifs.tellg();
+		if (size < 0) {
+			// not seekable: read in blocks of the stream buffer
+			ifs.clear();
+			ostringstream stream;
+			stream << ifs.rdbuf();
+			content = stream.str();
+			return true;
 		}
-
-		ifs.close();
-		return RESULT_OK;
+		ifs.seekg(0, ifstream::beg);
+		content.resize(static_cast<size_t>(size));
+		if (size > 0 && !ifs.read(&content[0], size))
+			content.resize(static_cast<size_t>(ifs.gcount()));
+		return true;
 	}
 
 	/**
@@ -163,11 +428,17 @@ public:
 	 */
 	virtual string getLastError() { return m_lastError; }
 
+	/**
+	 * Get the @a ostream to verbosely report problems to while reading a file.
+	 * @return the @a ostream to verbosely report problems to.
+	 */
+	virtual ostream& getVerboseOutput() { return cout; }
+
 	/**
 	 * Add a default row that was read from a file.
 	 * @param defaults the list to add the default row to.
-	 * @param row the default row (initial star char removed).
-	 * @param begin an iterator to the first column of the default row to read (for error reporting).
+	 * @param row the @a StringRef fields of the default row (initial star char removed), only valid during this call.
+	 * @param column the variable in which to store the index of the column reached (for error reporting).
 	 * @param defaultDest the valid destination address extracted from the file name (from ZZ part), or empty.
 	 * @param defaultCircuit the valid circuit name extracted from the file name (from IDENT part), or empty.
 	 * @param defaultSuffix the valid circuit name suffix (starting with a ".") extracted from the file name (number after after IDENT part and "."), or empty.
@@ -175,17 +446,23 @@ public:
 	 * @param lineNo the current line number in the file being read.
 	 * @return @a RESULT_OK on success, or an error code.
 	 */
-	virtual result_t addDefaultFromFile(vector< vector<string> >& defaults, vector<string>& row,
-			vector<string>::iterator& begin, string defaultDest, string defaultCircuit, string defaultSuffix,
+	virtual result_t addDefaultFromFile(vector< vector<string> >& defaults, const vector<StringRef>& row,
+			size_t& column, string defaultDest, string defaultCircuit, string defaultSuffix,
 			const string& filename, unsigned int lineNo)
 	{
-		defaults.push_back(row);
-		begin = row.end();
+		defaults.emplace_back();
+		vector<string>& values = defaults.back();
+		values.reserve(row.size());
+		for (const auto& field : row)
+			values.push_back(field.str());
+		column = row.size();
 		return RESULT_OK;
 	}
 
 	/**
 	 * Add a definition that was read from a file.
+	 * Unlike default rows, definition rows are still passed as strings (reused from row to row), as the
+	 * definition parsers modify and keep most of the fields.
 	 * @param begin an iterator to the first column of the definition row to read.
 	 * @param end the end iterator of the definition row to read.
 	 * @param defaults all previously read default rows (initial star char removed), or NULL if not supported.
@@ -375,11 +652,125 @@ public:
 
 private:
 
+	/**
+	 * Read the definitions from the rows of a file.
+	 * @param tokenizer the @a CsvTokenizer for the content of the file, or NULL when reading @a cachedRows.
+	 * @param cachedRows the rows taken from the @a FileRowCache (may be swapped out), or NULL.
+	 * @param filename the name of the file being read.
+	 * @param verbose whether to verbosely log problems.
+	 * @param defaultDest the default destination address (may be overwritten by file name), or empty.
+	 * @param defaultCircuit the default circuit name (may be overwritten by file name), or empty.
+	 * @param defaultSuffix the default circuit name suffix (starting with a ".", may be overwritten by file name, or empty.
+	 * @param addToCache whether to add the completely read rows to the @a FileRowCache.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	result_t readRows(CsvTokenizer* tokenizer, vector<FileRow>* cachedRows, const string& filename, bool verbose,
+		string defaultDest, string defaultCircuit, string defaultSuffix, bool addToCache)
+	{
+		size_t lastSep = filename.find_last_of('/');
+		if (lastSep!=string::npos) { // potential destination address, matches "^ZZ."
+			// extract defaultDest, defaultCircuit, defaultSuffix from filename:
+			// ZZ.IDENT[.CIRCUIT][.SUFFIX].*csv
+			libebus::Address checkDest;
+			string checkIdent, useCircuit, useSuffix;
+			unsigned int checkSw, checkHw;
+			if (extractDefaultsFromFilename(filename.substr(lastSep+1), checkDest, checkIdent, useCircuit, useSuffix, checkSw, checkHw)) {
+				defaultDest = filename.substr(lastSep+1, 2);
+				if (!useCircuit.empty()) {
+					defaultCircuit = useCircuit;
+				}
+				if (!useSuffix.empty()) {
+					defaultSuffix = useSuffix;
+				}
+			}
+		}
+		unsigned int lineNo = 0;
+		vector<StringRef> fields;
+		vector<string> row;
+		vector<FileRow> newRows;
+		vector< vector<string> > defaults;
+		size_t cachedIndex = 0;
+		while (cachedRows != NULL ? cachedIndex < cachedRows->size() : tokenizer->next(fields, lineNo)) {
+			if (cachedRows != NULL) {
+				FileRow& cachedRow = (*cachedRows)[cachedIndex++];
+				lineNo = cachedRow.m_lineNo;
+				row.swap(cachedRow.m_fields);
+				fields.clear();
+				for (const auto& field : row)
+					fields.emplace_back(field.data(), field.length());
+			}
+			if (fields.empty())
+				continue;
+			const bool isDefault = m_supportsDefaults && !fields[0].empty() && fields[0].data()[0] == '*';
+			if (cachedRows == NULL && (addToCache || !isDefault))
+				copyFields(fields, row);
+			if (addToCache)
+				newRows.push_back({lineNo, row});
+
+			result_t result;
+			vector<string>::iterator it;
+			if (isDefault) {
+				fields[0] = StringRef(fields[0].data()+1, fields[0].length()-1);
+				size_t column = 0;
+				result = addDefaultFromFile(defaults, fields, column, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
+				if (result == RESULT_OK)
+					continue;
+				// the strings are only needed for reporting the error position
+				if (cachedRows == NULL)
+					copyFields(fields, row);
+				else
+					row[0].erase(0, 1);
+				it = row.begin()+std::min(column, row.size());
+			} else {
+				it = row.begin();
+				result = addFromFile(it, row.end(), m_supportsDefaults ? &defaults : NULL, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
+			}
+			const vector<string>::iterator end = row.end();
+
+			if (result != RESULT_OK) {
+				if (!verbose) {
+					ostringstream error;
+					error << filename << ":" << static_cast<unsigned>(lineNo);
+					if (m_lastError.length()>0) {
+						error << ": " << m_lastError;
+					}
+					m_lastError = error.str();
+					return result;
+				}
+				ostream& out = getVerboseOutput();
+				if (m_lastError.length()>0) {
+					out << m_lastError << endl;
+				}
+				printErrorPos(out, row.begin(), end, it, filename, lineNo, result);
+			} else if (!verbose)
+				m_lastError = "";
+		}
+
+		if (addToCache)
+			m_rowCache->addRows(filename, newRows);
+		return RESULT_OK;
+	}
+
+	/**
+	 * Copy the fields of a row into the strings kept from the previous row.
+	 * @param fields the @a StringRef fields of the row.
+	 * @param row the @a vector of strings to fill.
+	 */
+	static void copyFields(const vector<StringRef>& fields, vector<string>& row)
+	{
+		row.resize(fields.size());
+		for (size_t index = 0; index < fields.size(); index++)
+			row[index].assign(fields[index].data(), fields[index].length());
+	}
+
 	/** whether this instance supports rows with defaults (starting with a star). */
 	bool m_supportsDefaults;
 
 protected:
 
+	/** the @a FileRowCache to use for reading files, or NULL. */
+	FileRowCache* m_rowCache = NULL;
+
 	/** a @a string describing the last error position. */
 	string m_lastError;
 
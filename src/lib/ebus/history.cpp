@@ -0,0 +1,194 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "history.h"
+
+/**
+ * Append an unsigned value in as many 7 bit groups as needed.
+ * @param value the value to append.
+ * @param output the vector to append to.
+ */
+static void writeVarint(unsigned long long value, vector<unsigned char>& output)
+{
+	while (value >= 0x80) {
+		output.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	output.push_back((unsigned char)value);
+}
+
+/**
+ * Read an unsigned value written by @a writeVarint().
+ * @param input the vector to read from.
+ * @param pos the position to read from, updated to the position after the value.
+ * @param value set to the read value.
+ * @return true on success, false if the input ended prematurely.
+ */
+static bool readVarint(const vector<unsigned char>& input, size_t& pos, unsigned long long& value)
+{
+	value = 0;
+	for (unsigned int shift = 0; pos < input.size() && shift < 64; shift += 7) {
+		unsigned char symbol = input[pos++];
+		value |= (unsigned long long)(symbol & 0x7f) << shift;
+		if ((symbol & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+void DataHistory::encode(const time_t delta, const size_t masterLength, const vector<unsigned char>& values,
+	const vector<unsigned char>& previous, vector<unsigned char>& output)
+{
+	writeVarint((unsigned long long)delta, output);
+	output.push_back((unsigned char)masterLength);
+	output.push_back((unsigned char)(values.size() - masterLength));
+	size_t maskPos = output.size();
+	output.resize(maskPos + (values.size() + 7) / 8, 0);
+	for (size_t pos = 0; pos < values.size(); pos++) {
+		unsigned char last = pos < previous.size() ? previous[pos] : 0;
+		if (values[pos] == last)
+			continue;
+		output[maskPos + pos / 8] = (unsigned char)(output[maskPos + pos / 8] | (1 << (pos % 8)));
+		output.push_back((unsigned char)(values[pos] - last));
+	}
+}
+
+void DataHistory::add(const time_t time, SymbolString& master, SymbolString& slave)
+{
+	vector<unsigned char> values;
+	values.reserve(master.size() + slave.size());
+	for (size_t pos = 0; pos < master.size(); pos++)
+		values.push_back(master[pos]);
+	for (size_t pos = 0; pos < slave.size(); pos++)
+		values.push_back(slave[pos]);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_maxSegments == 0)
+		return;
+	vector<unsigned char> entry;
+	Segment* segment = NULL;
+	if (!m_segments.empty()) {
+		segment = &m_segments.back();
+		encode(time > segment->m_lastTime ? time - segment->m_lastTime : 0, master.size(), values, m_lastValues, entry);
+		if (segment->m_data.size() + entry.size() > HISTORY_SEGMENT_SIZE)
+			segment = NULL; // start a new segment
+	}
+	if (segment == NULL) {
+		if (m_segments.size() >= m_maxSegments)
+			m_segments.pop_front();
+		m_segments.emplace_back();
+		segment = &m_segments.back();
+		segment->m_firstTime = segment->m_lastTime = time;
+		segment->m_data.reserve(HISTORY_SEGMENT_SIZE);
+		entry.clear();
+		encode(0, master.size(), values, vector<unsigned char>(), entry);
+	}
+	segment->m_data.insert(segment->m_data.end(), entry.begin(), entry.end());
+	if (time > segment->m_lastTime)
+		segment->m_lastTime = time;
+	segment->m_count++;
+	m_lastValues.swap(values);
+}
+
+size_t DataHistory::get(const time_t since, const std::function<bool(time_t, SymbolString&, SymbolString&)>& handler) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t count = 0;
+	vector<unsigned char> values;
+	for (auto& segment : m_segments) {
+		if (segment.m_lastTime <= since)
+			continue;
+		const vector<unsigned char>& data = segment.m_data;
+		values.clear();
+		time_t time = segment.m_firstTime;
+		size_t pos = 0;
+		for (size_t index = 0; index < segment.m_count; index++) {
+			unsigned long long delta;
+			if (!readVarint(data, pos, delta) || pos + 2 > data.size())
+				break;
+			size_t masterLength = data[pos++];
+			size_t length = masterLength + data[pos++];
+			size_t maskPos = pos;
+			pos += (length + 7) / 8;
+			if (pos > data.size())
+				break;
+			values.resize(length, 0);
+			for (size_t valuePos = 0; valuePos < length && pos < data.size(); valuePos++) {
+				if ((data[maskPos + valuePos / 8] & (1 << (valuePos % 8))) != 0)
+					values[valuePos] = (unsigned char)(values[valuePos] + data[pos++]);
+			}
+			time += (time_t)delta;
+			if (time <= since)
+				continue;
+			SymbolString master(false), slave(false);
+			for (size_t valuePos = 0; valuePos < length; valuePos++)
+				(valuePos < masterLength ? master : slave).push_back(values[valuePos], false, false);
+			count++;
+			if (!handler(time, master, slave))
+				return count;
+		}
+	}
+	return count;
+}
+
+void DataHistory::assign(const DataHistory& other)
+{
+	if (&other == this)
+		return;
+	deque<Segment> segments;
+	vector<unsigned char> lastValues;
+	{
+		std::lock_guard<std::mutex> lock(other.m_mutex);
+		segments = other.m_segments;
+		lastValues = other.m_lastValues;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	while (segments.size() > m_maxSegments)
+		segments.pop_front();
+	m_segments.swap(segments);
+	m_lastValues.swap(lastValues);
+}
+
+void DataHistory::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_segments.clear();
+	m_lastValues.clear();
+}
+
+size_t DataHistory::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t count = 0;
+	for (auto& segment : m_segments)
+		count += segment.m_count;
+	return count;
+}
+
+size_t DataHistory::getEncodedSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t size = 0;
+	for (auto& segment : m_segments)
+		size += segment.m_data.size();
+	return size;
+}
@@ -0,0 +1,153 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBEBUS_HISTORY_H_
+#define LIBEBUS_HISTORY_H_
+
+#include "symbol.h"
+#include "cppconfig.h"
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/** @file history.h
+ * A compact history of the data changes of a single message.
+ *
+ * The @a DataHistory keeps the master and slave data of each change in a
+ * bounded ring of fixed size segments. An entry consists of the seconds since
+ * the previous entry, the lengths, a bit mask of the bytes that differ from
+ * the previous entry, and the difference of each of these bytes only. The
+ * first entry of a segment is encoded against empty data, so that a segment
+ * can be decoded on its own and the oldest segment can be dropped when the
+ * ring is full.
+ */
+
+/** the size in bytes of a single segment of a @a DataHistory. */
+#define HISTORY_SEGMENT_SIZE 256
+
+/**
+ * A bounded history of the master and slave data of a message.
+ */
+class DataHistory
+{
+public:
+
+	/**
+	 * Construct a new empty instance.
+	 * @param maxSegments the maximum number of segments to keep.
+	 */
+	explicit DataHistory(const size_t maxSegments) : m_maxSegments(maxSegments) {}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	DataHistory(const DataHistory& src);
+
+public:
+
+	/**
+	 * Add an entry, dropping the oldest segment if necessary.
+	 * @param time the system time of the entry (not before the previous entry).
+	 * @param master the unescaped master @a SymbolString.
+	 * @param slave the unescaped slave @a SymbolString.
+	 */
+	void add(const time_t time, SymbolString& master, SymbolString& slave);
+
+	/**
+	 * Decode the entries after a certain time in chronological order.
+	 * @param since the system time after which to return the entries.
+	 * @param handler the function to call with the time and the unescaped master and slave data of each entry,
+	 * returning false to stop.
+	 * @return the number of entries passed to the handler.
+	 */
+	size_t get(const time_t since, const std::function<bool(time_t, SymbolString&, SymbolString&)>& handler) const;
+
+	/**
+	 * Replace all entries with the ones of another instance (e.g. when reloading the configuration).
+	 * @param other the @a DataHistory to copy the entries from.
+	 */
+	void assign(const DataHistory& other);
+
+	/**
+	 * Remove all entries.
+	 */
+	void clear();
+
+	/**
+	 * Get the number of stored entries.
+	 * @return the number of stored entries.
+	 */
+	size_t size() const;
+
+	/**
+	 * Get the number of bytes used by the encoded entries.
+	 * @return the number of bytes used by the encoded entries.
+	 */
+	size_t getEncodedSize() const;
+
+private:
+
+	/**
+	 * A segment of consecutive encoded entries.
+	 */
+	struct Segment
+	{
+		/** the system time of the first entry. */
+		time_t m_firstTime = 0;
+
+		/** the system time of the last entry. */
+		time_t m_lastTime = 0;
+
+		/** the number of entries. */
+		size_t m_count = 0;
+
+		/** the encoded entries. */
+		vector<unsigned char> m_data;
+	};
+
+	/**
+	 * Encode an entry.
+	 * @param delta the seconds since the previous entry.
+	 * @param masterLength the length of the master data at the start of @a values.
+	 * @param values the master data followed by the slave data.
+	 * @param previous the values of the previous entry, or empty.
+	 * @param output the vector to append the encoded entry to.
+	 */
+	static void encode(const time_t delta, const size_t masterLength, const vector<unsigned char>& values,
+		const vector<unsigned char>& previous, vector<unsigned char>& output);
+
+	/** the mutex for exclusive access to all members. */
+	mutable std::mutex m_mutex;
+
+	/** the maximum number of segments to keep. */
+	const size_t m_maxSegments;
+
+	/** the segments from the oldest to the newest. */
+	deque<Segment> m_segments;
+
+	/** the master data followed by the slave data of the last entry. */
+	vector<unsigned char> m_lastValues;
+
+};
+
+#endif // LIBEBUS_HISTORY_H_
@@ -27,6 +27,10 @@
 #include <locale>
 #include <iomanip>
 #include <climits>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
 
 using std::dec;
 
@@ -42,52 +46,46 @@ using std::dec;
 /** the bits in the @a ID_SOURCE_MASK for arbitrary source and active write message. */
 #define ID_SOURCE_ACTIVE_READ (0x1eLL << (8 * 7))
 
+/** the bit position of the ID length in the message key. */
+#define ID_LENGTH_SHIFT (8 * 7 + 5)
+
+/** get the key prefix (source, ZZ, PB, SB without the ID length) of the message key. */
+#define ID_KEY_PREFIX(key) (((key) >> (8 * 4)) & 0x1fffffffLL)
+
+/** get the bit for the ID length of the message key in the ID lengths bit mask. */
+#define ID_LENGTH_BIT(key) (unsigned char)(1 << ((key) >> ID_LENGTH_SHIFT))
+
 /** the maximum poll priority for a @a Message referred to by a @a Condition. */
 #define POLL_PRIORITY_CONDITION 5
 
 extern DataFieldTemplates* getTemplates(const string filename);
 
-Message::Message(const string& circuit, const string& name,
-		const bool isWrite, const bool isPassive, const string comment,
+Message::Message(const InternedString& circuit, const InternedString& name,
+		const bool isWrite, const bool isPassive, const InternedString& comment,
 		const libebus::Address& srcAddress, const libebus::Address& dstAddress,
 		const vector<unsigned char> id,
 		shared_ptr<DataField> data,
 		const unsigned char pollPriority,
 		Condition* condition)
-		: m_circuit(circuit), m_name(name), m_isWrite(isWrite),
-		  m_isPassive(isPassive), m_comment(comment),
+		: m_definition(allocateShared<MessageDefinition>(name, isWrite, isPassive, comment, id, data, condition)),
+		  m_circuit(circuit),
 		  m_srcAddress(srcAddress), m_dstAddress(dstAddress),
-		  m_id(id), m_data(data),
+		  m_key(calcKey(*m_definition, srcAddress, dstAddress)),
 		  m_pollPriority(pollPriority),
-		  m_usedByCondition(false), m_condition(condition),
+		  m_usedByCondition(false),
 		  m_lastUpdateTime(0), m_lastChangeTime(0), m_pollCount(0), m_lastPollTime(0)
 {
-	auto key = static_cast<unsigned long long>(id.size()-2) << (8 * 7 + 5);
-	if (isPassive)
-		key |= static_cast<unsigned long long>(srcAddress.getMasterNumber()) << (8 * 7); // 0..25
-	else
-		key |= (isWrite ? 0x1fLL : 0x1eLL) << (8 * 7); // special values for active
-	key |= (unsigned long long)dstAddress.binAddr() << (8 * 6);
-	int exp = 5;
-	for (vector<unsigned char>::const_iterator it = id.begin(); it < id.end(); it++) {
-		key ^= (unsigned long long)*it << (8 * exp--);
-		if (exp == 0)
-			exp = 3;
-	}
-	m_key = key;
 }
 
-Message::Message(const string& circuit, const string& name,
+Message::Message(const InternedString& circuit, const InternedString& name,
 		const bool isWrite, const bool isPassive,
 		const unsigned char pb, const unsigned char sb,
 		shared_ptr<DataField> data)
-		: m_circuit(circuit), m_name(name), m_isWrite(isWrite),
-		  m_isPassive(isPassive), m_comment(),
-		  m_srcAddress(SYN), m_dstAddress(SYN),
-		  m_data(data)
+		: m_definition(allocateShared<MessageDefinition>(name, isWrite, isPassive, InternedString(),
+		  vector<unsigned char>{pb, sb}, data, nullptr)),
+		  m_circuit(circuit),
+		  m_srcAddress(SYN), m_dstAddress(SYN)
 {
-	m_id.push_back(pb);
-	m_id.push_back(sb);
 	unsigned long long key = 0;
 	if (!isPassive)
 		key |= (isWrite ? 0x1fLL : 0x1eLL) << (8 * 7); // special values for active
@@ -113,6 +111,37 @@ string getDefault(const string value, vector<string>* defaults, size_t pos)
 	return defaults->at(pos);
 }
 
+Message::Message(const shared_ptr<const MessageDefinition>& definition, const InternedString& circuit,
+		const libebus::Address& srcAddress, const libebus::Address& dstAddress,
+		const unsigned char pollPriority)
+		: m_definition(definition), m_circuit(circuit),
+		  m_srcAddress(srcAddress), m_dstAddress(dstAddress),
+		  m_key(calcKey(*definition, srcAddress, dstAddress)),
+		  m_pollPriority(pollPriority),
+		  m_usedByCondition(false),
+		  m_lastUpdateTime(0), m_lastChangeTime(0), m_pollCount(0), m_lastPollTime(0)
+{
+}
+
+unsigned long long Message::calcKey(const MessageDefinition& definition,
+		const libebus::Address& srcAddress, const libebus::Address& dstAddress)
+{
+	const vector<unsigned char>& id = definition.m_id;
+	auto key = static_cast<unsigned long long>(id.size()-2) << (8 * 7 + 5);
+	if (definition.m_isPassive)
+		key |= static_cast<unsigned long long>(srcAddress.getMasterNumber()) << (8 * 7); // 0..25
+	else
+		key |= (definition.m_isWrite ? 0x1fLL : 0x1eLL) << (8 * 7); // special values for active
+	key |= (unsigned long long)dstAddress.binAddr() << (8 * 6);
+	int exp = 5;
+	for (vector<unsigned char>::const_iterator it = id.begin(); it < id.end(); it++) {
+		key ^= (unsigned long long)*it << (8 * exp--);
+		if (exp == 0)
+			exp = 3;
+	}
+	return key;
+}
+
 result_t Message::parseId(string input, vector<unsigned char>& id)
 {
 	istringstream in(input);
@@ -344,7 +373,7 @@ result_t Message::create(vector<string>::iterator& it, const vector<string>::ite
 	shared_ptr<DataField> data;
 	if (it==realEnd) {
 		vector<shared_ptr<SingleDataField>> fields;
-		data = make_shared<DataFieldSet>("", "", fields);
+		data = allocateShared<DataFieldSet>("", "", fields);
 	} else {
 		result = DataField::create(it, realEnd, templates, data, isWrite, false, isBroadcastOrMasterDestination, (unsigned char)maxLength);
 		if (result != RESULT_OK) {
@@ -367,9 +396,9 @@ result_t Message::create(vector<string>::iterator& it, const vector<string>::ite
 		}
 		shared_ptr<Message> message;
 		if (chainIds.size()>1) {
-			message = make_shared<ChainedMessage>(useCircuit, name, isWrite, comment, srcAddress, dstAddress, id, chainIds, chainLengths, data, pollPriority, condition);
+			message = allocateShared<ChainedMessage>(useCircuit, name, isWrite, comment, srcAddress, dstAddress, id, chainIds, chainLengths, data, pollPriority, condition);
 		} else
-			message = make_shared<Message>(useCircuit, name, isWrite, isPassive, comment, srcAddress, dstAddress, id, data, pollPriority, condition);
+			message = allocateShared<Message>(useCircuit, name, isWrite, isPassive, comment, srcAddress, dstAddress, id, data, pollPriority, condition);
 		messages.push_back(message);
 	}
 	return RESULT_OK;
@@ -378,10 +407,8 @@ result_t Message::create(vector<string>::iterator& it, const vector<string>::ite
 shared_ptr<Message> Message::derive(const libebus::Address &dstAddress, const libebus::Address &srcAddress,
 									const string circuit)
 {
-	return make_shared<Message>(circuit.length()==0 ? m_circuit : circuit, m_name,
-		m_isWrite, m_isPassive, m_comment,
-		srcAddress==SYN ? m_srcAddress : srcAddress, dstAddress,
-		m_id, m_data, m_pollPriority, m_condition);
+	return allocateShared<Message>(m_definition, circuit.length()==0 ? m_circuit : InternedString(circuit),
+		srcAddress==SYN ? m_srcAddress : srcAddress, dstAddress, m_pollPriority);
 }
 
 shared_ptr<Message> Message::derive(const unsigned char dstAddress, const bool extendCircuit)
@@ -394,12 +421,12 @@ shared_ptr<Message> Message::derive(const unsigned char dstAddress, const bool e
 	return derive(dstAddress);
 }
 
-bool Message::checkIdPrefix(vector<unsigned char>& id)
+bool Message::checkIdPrefix(const vector<unsigned char>& id)
 {
-	if (id.size() > m_id.size())
+	if (id.size() > m_definition->m_id.size())
 		return false;
 	for (size_t pos = 0; pos < id.size(); pos++) {
-		if (id[pos] != m_id[pos]) {
+		if (id[pos] != m_definition->m_id[pos]) {
 			return false;
 		}
 	}
@@ -413,7 +440,7 @@ bool Message::checkId(SymbolString& master, unsigned char* index)
 		return false;
 
 	for (unsigned char pos = 0; pos < idLen; pos++) {
-		if (m_id[2+pos] != master[5 + pos])
+		if (m_definition->m_id[2+pos] != master[5 + pos])
 			return false;
 	}
 	if (index)
@@ -426,7 +453,7 @@ bool Message::checkId(Message& other)
 	unsigned char idLen = getIdLength();
 	if (idLen != other.getIdLength() || getCount() > 1) // only equal for non-chained messages
 		return false;
-	return other.checkIdPrefix(m_id);
+	return other.checkIdPrefix(m_definition->m_id);
 }
 
 unsigned long long Message::getDerivedKey(const libebus::Address &dstAddress)
@@ -436,7 +463,7 @@ unsigned long long Message::getDerivedKey(const libebus::Address &dstAddress)
 
 bool Message::setPollPriority(unsigned char priority)
 {
-	if (priority == m_pollPriority || m_isPassive)
+	if (priority == m_pollPriority || m_definition->m_isPassive)
 		return false;
 
 	if (m_usedByCondition && (priority==0 || priority>POLL_PRIORITY_CONDITION))
@@ -457,51 +484,140 @@ void Message::setUsedByCondition() {
 
 bool Message::isAvailable()
 {
-	return (m_condition==NULL) || m_condition->isTrue();
+	return (m_definition->m_condition==NULL) || m_definition->m_condition->isTrue();
+}
+
+/** the mutex for the dependent @a Condition instances of all @a Message instances. */
+static std::mutex dependentConditionsMutex;
+
+void Message::addDependentCondition(Condition* condition)
+{
+	std::lock_guard<std::mutex> lock(dependentConditionsMutex);
+	if (std::find(m_dependentConditions.begin(), m_dependentConditions.end(), condition) == m_dependentConditions.end())
+		m_dependentConditions.push_back(condition);
+}
+
+void Message::removeDependentCondition(Condition* condition)
+{
+	std::lock_guard<std::mutex> lock(dependentConditionsMutex);
+	auto it = std::find(m_dependentConditions.begin(), m_dependentConditions.end(), condition);
+	if (it != m_dependentConditions.end())
+		m_dependentConditions.erase(it);
+}
+
+void Message::updateDependentConditions()
+{
+	if (!m_usedByCondition)
+		return;
+	std::lock_guard<std::mutex> lock(dependentConditionsMutex);
+	for (auto condition : m_dependentConditions)
+		condition->update();
 }
 
 bool Message::hasField(const char* fieldName, bool numeric)
 {
-	return m_data->hasField(fieldName, numeric);
+	return m_definition->m_data->hasField(fieldName, numeric);
 }
 
 result_t Message::prepareMaster(const libebus::Address srcAddress, SymbolString& masterData,
 		istringstream& input, char separator,
 		const libebus::Address dstAddress, unsigned char index)
 {
-	if (m_isPassive)
+	if (m_definition->m_isPassive)
 		return RESULT_ERR_INVALID_ARG; // prepare not possible
 
+	if (dstAddress == SYN && m_dstAddress == SYN)
+		return RESULT_ERR_INVALID_ADDR;
+	const unsigned char dst = dstAddress == SYN ? m_dstAddress.binAddr() : dstAddress.binAddr();
+	std::streampos inputPos = input.tellg();
+	bool cacheable = inputPos == std::streampos(0);
+	string inputStr;
+	size_t inputHash = 0;
+	if (cacheable) {
+		inputStr = input.str();
+		inputHash = std::hash<string>()(inputStr);
+		PreparedMasters* cache = getPreparedMasters();
+		std::lock_guard<std::mutex> lock(cache->m_mutex);
+		for (auto& prepared : cache->m_entries) {
+			if (prepared.m_srcAddress != srcAddress.binAddr() || prepared.m_dstAddress != dst
+			|| prepared.m_index != index || prepared.m_separator != separator
+			|| prepared.m_inputHash != inputHash || prepared.m_input != inputStr)
+				continue;
+			cache->m_hits++;
+			preparedMasterPart(index);
+			result_t result = storeLastData(PartType::masterData, prepared.m_master, index);
+			if (result < RESULT_OK)
+				return result;
+			masterData = masterData.isEscaped() ? prepared.m_escaped : prepared.m_master;
+			return RESULT_OK;
+		}
+	}
+
 	SymbolString master(false);
 	result_t result = master.push_back(srcAddress.binAddr(), false, false);
 	if (result != RESULT_OK)
 		return result;
-	if (dstAddress == SYN) {
-		if (m_dstAddress == SYN)
-			return RESULT_ERR_INVALID_ADDR;
-		result = master.push_back(m_dstAddress.binAddr(), false, false);
-	}
-	else
-		result = master.push_back(dstAddress.binAddr(), false, false);
+	result = master.push_back(dst, false, false);
 	if (result != RESULT_OK)
 		return result;
-	result = master.push_back(m_id[0], false, false);
+	result = master.push_back(m_definition->m_id[0], false, false);
 	if (result != RESULT_OK)
 		return result;
-	result = master.push_back(m_id[1], false, false);
+	result = master.push_back(m_definition->m_id[1], false, false);
 	if (result != RESULT_OK)
 		return result;
 	result = prepareMasterPart(master, input, separator, index);
 	if (result != RESULT_OK)
 		return result;
+	preparedMasterPart(index);
 	result = storeLastData(PartType::masterData, master, index);
 	if (result < RESULT_OK)
 		return result;
 	masterData.clear();
 	masterData.addAll(master);
+	if (cacheable) {
+		PreparedMaster prepared;
+		prepared.m_srcAddress = srcAddress.binAddr();
+		prepared.m_dstAddress = dst;
+		prepared.m_index = index;
+		prepared.m_separator = separator;
+		prepared.m_inputHash = inputHash;
+		prepared.m_input = inputStr;
+		prepared.m_master = master;
+		prepared.m_escaped.addAll(master);
+		PreparedMasters* cache = getPreparedMasters();
+		std::lock_guard<std::mutex> lock(cache->m_mutex);
+		if (cache->m_entries.size() < PREPARED_MASTER_CACHE_SIZE)
+			cache->m_entries.push_back(std::move(prepared));
+		else {
+			cache->m_entries[cache->m_next] = std::move(prepared);
+			cache->m_next = (cache->m_next + 1) % PREPARED_MASTER_CACHE_SIZE;
+		}
+	}
 	return RESULT_OK;
 }
 
+PreparedMasters* Message::getPreparedMasters()
+{
+	PreparedMasters* cache = m_preparedMasters.load(std::memory_order_acquire);
+	if (cache != NULL)
+		return cache;
+	PreparedMasters* created = new PreparedMasters();
+	if (m_preparedMasters.compare_exchange_strong(cache, created, std::memory_order_acq_rel))
+		return created;
+	delete created; // allocated by another thread meanwhile
+	return cache;
+}
+
+unsigned int Message::getPreparedHits() const
+{
+	PreparedMasters* cache = m_preparedMasters.load(std::memory_order_acquire);
+	if (cache == NULL)
+		return 0;
+	std::lock_guard<std::mutex> lock(cache->m_mutex);
+	return cache->m_hits;
+}
+
 result_t Message::prepareMasterPart(SymbolString& master, istringstream& input, char separator, unsigned char index)
 {
 	if (index!=0)
@@ -510,36 +626,45 @@ result_t Message::prepareMasterPart(SymbolString& master, istringstream& input,
 	result_t result = master.push_back(0, false, false); // length, will be set later
 	if (result != RESULT_OK)
 		return result;
-	for (size_t i = 2; i < m_id.size(); i++) {
-		result = master.push_back(m_id[i], false, false);
+	for (size_t i = 2; i < m_definition->m_id.size(); i++) {
+		result = master.push_back(m_definition->m_id[i], false, false);
 		if (result != RESULT_OK)
 			return result;
 	}
-	result = m_data->write(input, PartType::masterData, master, getIdLength(), separator);
+	result = m_definition->m_data->write(input, PartType::masterData, master, getIdLength(), separator);
 	if (result != RESULT_OK)
 		return result;
 	master[pos] = (unsigned char)(master.size()-pos-1);
 	return result;
 }
 
-result_t Message::prepareSlave(istringstream& input, SymbolString& slaveData)
+result_t Message::encodeSlave(istringstream& input, SymbolString& slave) const
 {
-	if (m_isWrite)
+	if (m_definition->m_isWrite)
 		return RESULT_ERR_INVALID_ARG; // prepare not possible
 
-	SymbolString slave(false);
 	result_t result = slave.push_back(0, false, false); // length, will be set later
 	if (result != RESULT_OK)
 		return result;
-	result = m_data->write(input, PartType::slaveData, slave, 0);
+	result = m_definition->m_data->write(input, PartType::slaveData, slave, 0);
 	if (result != RESULT_OK)
 		return result;
 	slave[0] = (unsigned char)(slave.size()-1);
+	return result;
+}
+
+result_t Message::prepareSlave(istringstream& input, SymbolString& slaveData)
+{
+	SymbolString slave(false);
+	result_t result = encodeSlave(input, slave);
+	if (result != RESULT_OK)
+		return result;
 	time(&m_lastUpdateTime);
 	if (slave != m_lastSlaveData) {
-		m_lastChangeTime = m_lastUpdateTime;
 		m_lastSlaveData = slave;
+		markChanged();
 	}
+	recordHistory();
 	slaveData.clear();
 	slaveData.addAll(slave);
 	return result;
@@ -559,8 +684,8 @@ result_t Message::storeLastData(const PartType partType, SymbolString& data, uns
 	if (partType == PartType::masterData) {
 		switch (data.compareMaster(m_lastMasterData)) {
 		case 1: // completely different
-			m_lastChangeTime = m_lastUpdateTime;
 			m_lastMasterData = data;
+			markChanged();
 			break;
 		case 2: // only master address is different
 			m_lastMasterData = data;
@@ -568,23 +693,88 @@ result_t Message::storeLastData(const PartType partType, SymbolString& data, uns
 		}
 	} else if (partType == PartType::slaveData) {
 		if (data != m_lastSlaveData) {
-			m_lastChangeTime = m_lastUpdateTime;
 			m_lastSlaveData = data;
+			markChanged();
 		}
+		recordHistory(); // the slave data completes the message
 	}
 	return RESULT_OK;
 }
 
+void Message::markChanged()
+{
+	if (m_lastChangeTime > 0 && m_lastUpdateTime > m_lastChangeTime) {
+		time_t interval = m_lastUpdateTime - m_lastChangeTime;
+		if (m_changeInterval == 0)
+			m_changeInterval = interval;
+		else
+			m_changeInterval = (m_changeInterval * (CHANGE_INTERVAL_WEIGHT - 1) + interval) / CHANGE_INTERVAL_WEIGHT;
+	}
+	m_lastChangeTime = m_lastUpdateTime;
+	m_changeCount++;
+	m_historyPending = true;
+	if (m_changeJournal)
+		m_changeJournal->add(this);
+	updateDependentConditions();
+}
+
+void Message::recordHistory()
+{
+	if (!m_history || !m_historyPending)
+		return;
+	m_historyPending = false;
+	m_history->add(m_lastUpdateTime, m_lastMasterData, m_lastSlaveData);
+}
+
+void Message::enableHistory(const size_t maxSegments)
+{
+	if (maxSegments > 0 && !m_history)
+		m_history = std::make_unique<DataHistory>(maxSegments);
+}
+
+time_t Message::getAdaptiveMaxAge(const time_t defaultMaxAge) const
+{
+	// the data did not change for at least the time since the last change
+	time_t interval = m_lastUpdateTime - m_lastChangeTime;
+	if (m_changeInterval > interval)
+		interval = m_changeInterval;
+	if (interval == 0)
+		return defaultMaxAge;
+	interval /= ADAPTIVE_MAX_AGE_DIVISOR;
+	if (interval < ADAPTIVE_MAX_AGE_MIN)
+		return ADAPTIVE_MAX_AGE_MIN;
+	if (interval > ADAPTIVE_MAX_AGE_MAX)
+		return ADAPTIVE_MAX_AGE_MAX;
+	return interval;
+}
+
+bool Message::takeLastData(Message& previous)
+{
+	if (previous.m_lastUpdateTime == 0 || previous.getCount() != getCount())
+		return false;
+	m_lastMasterData = previous.m_lastMasterData;
+	m_lastSlaveData = previous.m_lastSlaveData;
+	m_lastUpdateTime = previous.m_lastUpdateTime;
+	m_lastChangeTime = previous.m_lastChangeTime;
+	m_changeCount = previous.m_changeCount;
+	m_changeInterval = previous.m_changeInterval;
+	if (m_history && previous.m_history)
+		m_history->assign(*previous.m_history);
+	m_lastPollTime = previous.m_lastPollTime;
+	updateDependentConditions();
+	return true;
+}
+
 result_t Message::decodeLastData(const PartType partType,
-		ostringstream& output, OutputFormat outputFormat,
+		ostream& output, OutputFormat outputFormat,
 		bool leadingSeparator, const char* fieldName, signed char fieldIndex)
 {
 	unsigned char offset;
 	if (partType == PartType::masterData)
-		offset = (unsigned char)(m_id.size() - 2);
+		offset = (unsigned char)(m_definition->m_id.size() - 2);
 	else
 		offset = 0;
-	result_t result = m_data->read(partType, partType==PartType::masterData ? m_lastMasterData : m_lastSlaveData, offset, output, outputFormat, -1, leadingSeparator, fieldName, fieldIndex);
+	result_t result = m_definition->m_data->read(partType, partType==PartType::masterData ? m_lastMasterData : m_lastSlaveData, offset, output, outputFormat, -1, leadingSeparator, fieldName, fieldIndex);
 	if (result < RESULT_OK)
 		return result;
 	if (result == RESULT_EMPTY && fieldName != NULL)
@@ -592,16 +782,22 @@ result_t Message::decodeLastData(const PartType partType,
 	return result;
 }
 
-result_t Message::decodeLastData(ostringstream& output, OutputFormat outputFormat,
+result_t Message::decodeLastData(ostream& output, OutputFormat outputFormat,
+		bool leadingSeparator, const char* fieldName, signed char fieldIndex)
+{
+	return decodeData(m_lastMasterData, m_lastSlaveData, output, outputFormat, leadingSeparator, fieldName, fieldIndex);
+}
+
+result_t Message::decodeData(SymbolString& master, SymbolString& slave, ostream& output, OutputFormat outputFormat,
 		bool leadingSeparator, const char* fieldName, signed char fieldIndex)
 {
-	size_t startPos = output.str().length();
-	result_t result = m_data->read(PartType::masterData, m_lastMasterData, getIdLength(), output, outputFormat, -1, leadingSeparator, fieldName, fieldIndex);
+	std::streampos startPos = output.tellp();
+	result_t result = m_definition->m_data->read(PartType::masterData, master, getIdLength(), output, outputFormat, -1, leadingSeparator, fieldName, fieldIndex);
 	if (result < RESULT_OK)
 		return result;
 	bool empty = result == RESULT_EMPTY;
-	leadingSeparator |= output.str().length() > startPos;
-	result = m_data->read(PartType::slaveData, m_lastSlaveData, 0, output, outputFormat, -1, leadingSeparator, fieldName, fieldIndex);
+	leadingSeparator |= output.tellp() > startPos;
+	result = m_definition->m_data->read(PartType::slaveData, slave, 0, output, outputFormat, -1, leadingSeparator, fieldName, fieldIndex);
 	if (result < RESULT_OK)
 		return result;
 	if (result == RESULT_EMPTY && !empty)
@@ -613,11 +809,11 @@ result_t Message::decodeLastData(ostringstream& output, OutputFormat outputForma
 
 result_t Message::decodeLastDataNumField(unsigned int& output, const char* fieldName, signed char fieldIndex)
 {
-	result_t result = m_data->read(PartType::masterData, m_lastMasterData, getIdLength(), output, fieldName, fieldIndex);
+	result_t result = m_definition->m_data->read(PartType::masterData, m_lastMasterData, getIdLength(), output, fieldName, fieldIndex);
 	if (result < RESULT_OK)
 		return result;
 	if (result == RESULT_EMPTY)
-		result = m_data->read(PartType::slaveData, m_lastSlaveData, 0, output, fieldName, fieldIndex);
+		result = m_definition->m_data->read(PartType::slaveData, m_lastSlaveData, 0, output, fieldName, fieldIndex);
 	if (result < RESULT_OK)
 		return result;
 	if (result == RESULT_EMPTY)
@@ -625,26 +821,6 @@ result_t Message::decodeLastDataNumField(unsigned int& output, const char* field
 	return result;
 }
 
-bool Message::isLessPollWeight(const Message* other)
-{
-	unsigned char tprio = m_pollPriority;
-	unsigned char oprio = other->m_pollPriority;
-	unsigned int tw = tprio * m_pollCount;
-	unsigned int ow = oprio * other->m_pollCount;
-	if (tw > ow)
-		return true;
-	if (tw < ow)
-		return false;
-	if (tprio > oprio)
-		return true;
-	if (tprio < oprio)
-		return false;
-	if (m_lastPollTime > other->m_lastPollTime)
-		return true;
-
-	return false;
-}
-
 void Message::dump(ostream& output, vector<size_t>* columns, bool withConditions)
 {
 	bool first = true, all = columns==NULL;
@@ -664,14 +840,14 @@ void Message::dumpColumn(ostream& output, size_t column, bool withConditions)
 {
 	switch (column) {
 	case 0: // type
-		if (withConditions && m_condition!=NULL) {
-			m_condition->dump(output);
+		if (withConditions && m_definition->m_condition!=NULL) {
+			m_definition->m_condition->dump(output);
 		}
-		if (m_isPassive) {
+		if (m_definition->m_isPassive) {
 			output << "u";
-			if (m_isWrite)
+			if (m_definition->m_isWrite)
 				output << "w";
-		} else if (m_isWrite)
+		} else if (m_definition->m_isWrite)
 			output << "w";
 		else {
 			output << "r";
@@ -683,10 +859,10 @@ void Message::dumpColumn(ostream& output, size_t column, bool withConditions)
 		DataField::dumpString(output, m_circuit, false);
 		break;
 	case 2: // name
-		DataField::dumpString(output, m_name, false);
+		DataField::dumpString(output, m_definition->m_name, false);
 		break;
 	case 3: // comment
-		DataField::dumpString(output, m_comment, false);
+		DataField::dumpString(output, m_definition->m_comment, false);
 		break;
 	case 4: // QQ
 		if (m_srcAddress != SYN)
@@ -697,37 +873,47 @@ void Message::dumpColumn(ostream& output, size_t column, bool withConditions)
 			output << hex << setw(2) << setfill('0') << static_cast<unsigned>(m_dstAddress.binAddr());
 		break;
 	case 6: // PBSB
-		for (vector<unsigned char>::const_iterator it = m_id.begin(); it < m_id.begin()+2 && it < m_id.end(); it++) {
+		for (vector<unsigned char>::const_iterator it = m_definition->m_id.begin(); it < m_definition->m_id.begin()+2 && it < m_definition->m_id.end(); it++) {
 			output << hex << setw(2) << setfill('0') << static_cast<unsigned>(*it);
 		}
 		break;
 	case 7: // ID
-		for (vector<unsigned char>::const_iterator it = m_id.begin()+2; it < m_id.end(); it++) {
+		for (vector<unsigned char>::const_iterator it = m_definition->m_id.begin()+2; it < m_definition->m_id.end(); it++) {
 			output << hex << setw(2) << setfill('0') << static_cast<unsigned>(*it);
 		}
 		break;
 	case 8: // fields
-		m_data->dump(output);
+		m_definition->m_data->dump(output);
 		break;
 	}
 }
 
 
-ChainedMessage::ChainedMessage(const string &circuit, const string &name,
-							   const bool isWrite, const string comment,
+ChainedMessage::ChainedMessage(const InternedString& circuit, const InternedString& name,
+							   const bool isWrite, const InternedString& comment,
 							   const libebus::Address& srcAddress, const libebus::Address& dstAddress,
 							   const vector<unsigned char> &id,
 							   const vector<vector<unsigned char>> &ids, const vector<unsigned char> &lengths,
 							   shared_ptr<DataField> data,
 							   const unsigned char pollPriority,
 							   Condition *condition)
-		: Message(circuit, name, isWrite, false, comment,
-		  srcAddress, dstAddress, id,
-		  data, pollPriority, condition),
-		  m_ids(ids), m_lengths(lengths),
-		  m_maxTimeDiff(m_ids.size()*15) // 15 seconds per message
+		: Message(allocateShared<ChainedMessageDefinition>(name, isWrite, comment, id, ids, lengths, data, condition),
+		  circuit, srcAddress, dstAddress, pollPriority)
+{
+	initParts();
+}
+
+ChainedMessage::ChainedMessage(const shared_ptr<const ChainedMessageDefinition>& definition, const InternedString& circuit,
+							   const libebus::Address& srcAddress, const libebus::Address& dstAddress,
+							   const unsigned char pollPriority)
+		: Message(definition, circuit, srcAddress, dstAddress, pollPriority)
 {
-	size_t cnt = ids.size();
+	initParts();
+}
+
+void ChainedMessage::initParts()
+{
+	size_t cnt = chain().m_ids.size();
 
 	m_lastMasterDatas.resize(cnt);
 	m_lastSlaveDatas.resize(cnt);
@@ -736,8 +922,8 @@ ChainedMessage::ChainedMessage(const string &circuit, const string &name,
 	m_lastSlaveUpdateTimes.resize(cnt);
 
 	for (size_t index=0; index<cnt; index++) {
-		m_lastMasterDatas[index] = make_shared<SymbolString>();
-		m_lastSlaveDatas[index] = make_shared<SymbolString>();
+		m_lastMasterDatas[index] = allocateShared<SymbolString>();
+		m_lastSlaveDatas[index] = allocateShared<SymbolString>();
 	}
 }
 
@@ -748,27 +934,25 @@ ChainedMessage::~ChainedMessage()
 shared_ptr<Message> ChainedMessage::derive(const libebus::Address &dstAddress, const libebus::Address &srcAddress,
 										   const string circuit)
 {
-	return make_shared<ChainedMessage>(circuit.length()==0 ? m_circuit : circuit, m_name,
-		m_isWrite, m_comment,
-		srcAddress==SYN ? m_srcAddress : srcAddress, dstAddress,
-		m_id, m_ids, m_lengths, m_data,
-		m_pollPriority, m_condition);
+	return allocateShared<ChainedMessage>(std::static_pointer_cast<const ChainedMessageDefinition>(m_definition),
+		circuit.length()==0 ? m_circuit : InternedString(circuit),
+		srcAddress==SYN ? m_srcAddress : srcAddress, dstAddress, m_pollPriority);
 }
 
 bool ChainedMessage::checkId(SymbolString& master, unsigned char* index)
 {
 	unsigned char idLen = getIdLength();
-	unsigned char chainPrefixLength = (unsigned char)(m_id.size()-2); // minimum is 2
+	unsigned char chainPrefixLength = (unsigned char)(m_definition->m_id.size()-2); // minimum is 2
 	if (master.size() < 5 + idLen) // QQ, ZZ, PB, SB, NN
 		return false;
 
 	for (unsigned char pos=0; pos<chainPrefixLength; pos++) {
-		if (m_id[2+pos] != master[5 + pos])
+		if (m_definition->m_id[2+pos] != master[5 + pos])
 			return false; // chain prefix mismatch
 	}
 
-	for (unsigned char checkIndex=0; checkIndex<m_ids.size(); checkIndex++) { // check suffix for each part
-		vector<unsigned char> id = m_ids[checkIndex];
+	for (unsigned char checkIndex=0; checkIndex<chain().m_ids.size(); checkIndex++) { // check suffix for each part
+		vector<unsigned char> id = chain().m_ids[checkIndex];
 		bool found = false;
 		for (unsigned char pos=chainPrefixLength; pos<idLen; pos++) {
 			if (id[2+pos] != master[5 + pos]) {
@@ -791,7 +975,7 @@ bool ChainedMessage::checkId(Message& other)
 	unsigned char idLen = getIdLength();
 	if (idLen != other.getIdLength() || other.getCount() == 1) // only equal for chained messages
 		return false;
-	return other.checkIdPrefix(m_id);
+	return other.checkIdPrefix(m_definition->m_id);
 }
 
 result_t ChainedMessage::prepareMasterPart(SymbolString& master, istringstream& input, char separator, unsigned char index)
@@ -801,22 +985,22 @@ result_t ChainedMessage::prepareMasterPart(SymbolString& master, istringstream&
 		return RESULT_ERR_NOTFOUND;
 
 	SymbolString allData(false);
-	result_t result = m_data->write(input, PartType::masterData, allData, 0, separator);
+	result_t result = m_definition->m_data->write(input, PartType::masterData, allData, 0, separator);
 	if (result != RESULT_OK)
 		return result;
 	size_t pos = 0, addData = 0;
-	if (m_isWrite) {
-		addData = m_lengths[0];
+	if (m_definition->m_isWrite) {
+		addData = chain().m_lengths[0];
 		for (size_t i=0; i<index; i++) {
 			pos += addData;
-			addData = m_lengths[i+1];
+			addData = chain().m_lengths[i+1];
 		}
 	}
 	if (pos+addData>allData.size()) {
 		return RESULT_ERR_INVALID_POS;
 	}
 
-	vector<unsigned char> id = m_ids[index];
+	vector<unsigned char> id = chain().m_ids[index];
 	result = master.push_back((unsigned char)(id.size()-2+addData), false, false); // NN
 	if (result != RESULT_OK)
 		return result;
@@ -830,12 +1014,30 @@ result_t ChainedMessage::prepareMasterPart(SymbolString& master, istringstream&
 		if (result != RESULT_OK)
 			return result;
 	}
+	return result;
+}
+
+void ChainedMessage::preparedMasterPart(unsigned char index)
+{
 	if (index==0) {
-		for (size_t i=0; i<cnt; i++) {
-			m_lastMasterUpdateTimes[index] = m_lastSlaveUpdateTimes[index] = 0;
+		for (size_t i=0; i<getCount(); i++) {
+			m_lastMasterUpdateTimes[i] = m_lastSlaveUpdateTimes[i] = 0;
 		}
 	}
-	return result;
+}
+
+bool ChainedMessage::takeLastData(Message& previous)
+{
+	if (!Message::takeLastData(previous))
+		return false;
+	ChainedMessage& other = static_cast<ChainedMessage&>(previous); // same count > 1 means chained as well
+	for (size_t index = 0; index < m_lastMasterDatas.size(); index++) {
+		*m_lastMasterDatas[index] = *other.m_lastMasterDatas[index];
+		*m_lastSlaveDatas[index] = *other.m_lastSlaveDatas[index];
+		m_lastMasterUpdateTimes[index] = other.m_lastMasterUpdateTimes[index];
+		m_lastSlaveUpdateTimes[index] = other.m_lastSlaveUpdateTimes[index];
+	}
+	return true;
 }
 
 result_t ChainedMessage::storeLastData(SymbolString& master, SymbolString& slave)
@@ -853,7 +1055,7 @@ result_t ChainedMessage::storeLastData(SymbolString& master, SymbolString& slave
 
 result_t ChainedMessage::storeLastData(const PartType partType, SymbolString& data, unsigned char index)
 {
-	if (index>=m_ids.size())
+	if (index>=chain().m_ids.size())
 		return RESULT_ERR_INVALID_ARG;
 	if (partType == PartType::masterData) {
 		switch (data.compareMaster(*m_lastMasterDatas[index])) {
@@ -873,7 +1075,7 @@ result_t ChainedMessage::storeLastData(const PartType partType, SymbolString& da
 	}
 	// check arrival time of all parts
 	time_t minTime=0, maxTime=0;
-	for (index=0; index<m_ids.size(); index++) {
+	for (index=0; index<chain().m_ids.size(); index++) {
 		if (index==0) {
 			minTime = maxTime = m_lastMasterUpdateTimes[index];
 		} else {
@@ -890,15 +1092,15 @@ result_t ChainedMessage::storeLastData(const PartType partType, SymbolString& da
 		if (m_lastSlaveUpdateTimes[index]>maxTime) {
 			maxTime = m_lastSlaveUpdateTimes[index];
 		}
-		if (minTime==0 || maxTime==0 || maxTime-minTime>m_maxTimeDiff) {
+		if (minTime==0 || maxTime==0 || maxTime-minTime>chain().m_maxTimeDiff) {
 			return RESULT_CONTINUE;
 		}
 	}
 	// everything was completely retrieved in short time
 	SymbolString master(false);
 	SymbolString slave(false);
-	size_t offset = 5+(m_ids[0].size()-2); // skip QQ, ZZ, PB, SB, NN
-	for (index=0; index<m_ids.size(); index++) {
+	size_t offset = 5+(chain().m_ids[0].size()-2); // skip QQ, ZZ, PB, SB, NN
+	for (index=0; index<chain().m_ids.size(); index++) {
 		auto add = m_lastMasterDatas[index];
 		size_t end = 5+(*add)[4];
 		for (size_t pos=index==0?0:offset; pos<end; pos++) {
@@ -928,8 +1130,8 @@ void ChainedMessage::dumpColumn(ostream& output, size_t column, bool withConditi
 		return;
 	}
 	bool first = true;
-	for (size_t index = 0; index<m_ids.size(); index++) {
-		vector<unsigned char> id = m_ids[index];
+	for (size_t index = 0; index<chain().m_ids.size(); index++) {
+		vector<unsigned char> id = chain().m_ids[index];
 		for (vector<unsigned char>::const_iterator it = id.begin()+2; it < id.end(); it++) {
 			if (first) {
 				first = false;
@@ -938,11 +1140,54 @@ void ChainedMessage::dumpColumn(ostream& output, size_t column, bool withConditi
 			}
 			output << hex << setw(2) << setfill('0') << static_cast<unsigned>(*it);
 		}
-		output << LENGTH_SEPARATOR << dec << setw(0) << static_cast<unsigned>(m_lengths[index]);
+		output << LENGTH_SEPARATOR << dec << setw(0) << static_cast<unsigned>(chain().m_lengths[index]);
 	}
 }
 
 
+void ChangeJournal::add(Message* message)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries[m_nextSequence & (CHANGE_JOURNAL_SIZE-1)] = message;
+	m_nextSequence++;
+	if (m_nextSequence - m_firstSequence > CHANGE_JOURNAL_SIZE)
+		m_firstSequence = m_nextSequence - CHANGE_JOURNAL_SIZE;
+}
+
+unsigned long long ChangeJournal::getCursor()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_nextSequence;
+}
+
+bool ChangeJournal::getChanges(unsigned long long& cursor, vector<Message*>& messages)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool complete = cursor >= m_firstSequence;
+	unordered_set<Message*> seen;
+	for (unsigned long long sequence = complete ? cursor : m_firstSequence; sequence < m_nextSequence; sequence++) {
+		Message* message = m_entries[sequence & (CHANGE_JOURNAL_SIZE-1)];
+		if (seen.insert(message).second)
+			messages.push_back(message);
+	}
+	cursor = m_nextSequence;
+	return complete;
+}
+
+void ChangeJournal::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_firstSequence = m_nextSequence;
+}
+
+void ChangeJournal::continueAfter(ChangeJournal& previous)
+{
+	unsigned long long sequence = previous.getCursor() + 1;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_firstSequence = m_nextSequence = sequence;
+}
+
+
 shared_ptr<Message> getFirstAvailable(vector<shared_ptr<Message>> &messages, unsigned char idLength=0, SymbolString* master=NULL) {
     for (auto& message : messages) {
         if (master && !message->checkId(*master))
@@ -954,6 +1199,20 @@ shared_ptr<Message> getFirstAvailable(vector<shared_ptr<Message>> &messages, uns
 	return NULL;
 }
 
+/**
+ * Get the first available @a Message matching the master data without copying the reference.
+ * @param messages the @a Message instances to check.
+ * @param master the master @a SymbolString to check the ID against.
+ * @return the entry of the first available @a Message, or NULL.
+ */
+static shared_ptr<Message>* getFirstAvailableEntry(vector<shared_ptr<Message>> &messages, SymbolString& master) {
+	for (auto& message : messages) {
+		if (message->checkId(master) && message->isAvailable())
+			return &message;
+	}
+	return NULL;
+}
+
 shared_ptr<Message> getFirstAvailable(vector<shared_ptr<Message>> &messages, Message& sameIdExtAs) {
 	for (auto& message : messages) {
 		if (!message->checkId(sameIdExtAs))
@@ -1113,6 +1372,12 @@ void SimpleCondition::dump(ostream& output)
 	//output << "{name="<<m_name<<",field="<<m_field<<",dst="<<static_cast<unsigned>(m_dstAddress)<<",valuessize="<<static_cast<unsigned>(m_valueRanges.size())<<"}";
 }
 
+SimpleCondition::~SimpleCondition()
+{
+	if (m_message)
+		m_message->removeDependentCondition(this);
+}
+
 CombinedCondition* SimpleCondition::combineAnd(Condition* other)
 {
 	CombinedCondition* ret = new CombinedCondition();
@@ -1150,7 +1415,7 @@ result_t SimpleCondition::resolve(MessageMap* messages, ostringstream& errorMess
 		unsigned long long key = message->getDerivedKey(m_dstAddress);
 		auto derived = messages->getByKey(key);
 		if (derived==NULL) {
-			message = message->derive(m_dstAddress, true);
+			message = message->derive(m_dstAddress.binAddr(), true);
 			messages->add(message);
 		} else {
 			message = getFirstAvailable(*derived, *message);
@@ -1169,24 +1434,29 @@ result_t SimpleCondition::resolve(MessageMap* messages, ostringstream& errorMess
 	}
 	m_message = message;
 	message->setUsedByCondition();
+	message->addDependentCondition(this);
+	update(); // the message might already contain data
 	if (m_name.length()>0)
 		messages->addPollMessage(message, true);
 	return RESULT_OK;
 }
 
-bool SimpleCondition::isTrue()
+void SimpleCondition::update()
 {
 	if (!m_message)
-		return false;
-	if (m_message->getLastChangeTime()>m_lastCheckTime) {
-		bool isTrue = !m_hasValues; // for message seen check
-		if (!isTrue) {
-			isTrue = checkValue(m_message.get(), m_field);
-		}
-		m_isTrue = isTrue;
-		m_lastCheckTime = m_message->getLastChangeTime();
-	}
-	return m_isTrue;
+		return;
+	bool isTrue;
+	if (m_hasValues)
+		isTrue = m_message->getLastChangeTime()>0 && checkValue(m_message.get(), m_field);
+	else
+		isTrue = m_message->getLastChangeTime()>0; // for message seen check
+	m_isTrue.store(isTrue, std::memory_order_relaxed);
+}
+
+void SimpleCondition::addMessages(vector<shared_ptr<Message>>& messages)
+{
+	if (m_message && std::find(messages.begin(), messages.end(), m_message) == messages.end())
+		messages.push_back(m_message);
 }
 
 
@@ -1219,6 +1489,12 @@ bool SimpleStringCondition::checkValue(Message* message, string field) {
 }
 
 
+CombinedCondition::~CombinedCondition()
+{
+	for (auto& message : m_messages)
+		message->removeDependentCondition(this);
+}
+
 void CombinedCondition::dump(ostream& output)
 {
 	for (vector<Condition*>::iterator it = m_conditions.begin(); it!=m_conditions.end(); it++) {
@@ -1238,16 +1514,28 @@ result_t CombinedCondition::resolve(MessageMap* messages, ostringstream& errorMe
 			return ret;
 		}
 	}
+	if (m_messages.empty()) {
+		// added after the resolved conditions so that these are updated first
+		addMessages(m_messages);
+		for (auto& message : m_messages)
+			message->addDependentCondition(this);
+	}
+	update();
 	return RESULT_OK;
 }
 
-bool CombinedCondition::isTrue()
+void CombinedCondition::update()
 {
-	for (vector<Condition*>::iterator it = m_conditions.begin(); it!=m_conditions.end(); it++) {
-		if (!(*it)->isTrue())
-			return false;
-	}
-	return true;
+	bool isTrue = true;
+	for (vector<Condition*>::iterator it = m_conditions.begin(); isTrue && it!=m_conditions.end(); it++)
+		isTrue = (*it)->isTrue();
+	m_isTrue.store(isTrue, std::memory_order_relaxed);
+}
+
+void CombinedCondition::addMessages(vector<shared_ptr<Message>>& messages)
+{
+	for (auto condition : m_conditions)
+		condition->addMessages(messages);
 }
 
 
@@ -1340,11 +1628,9 @@ result_t MessageMap::add(shared_ptr<Message> message, bool storeByName)
 	bool isPassive = message->isPassive();
 	if (storeByName) {
 		bool isWrite = message->isWrite();
-		string circuit = message->getCircuit();
-		FileReader::tolower(circuit);
-		string name = message->getName();
-		FileReader::tolower(name);
-		string nameKey = string(isPassive ? "P" : (isWrite ? "W" : "R")) + circuit + FIELD_SEPARATOR + name;
+		InternedString circuit = message->m_circuit.lower();
+		InternedString name = message->m_definition->m_name.lower();
+		string nameKey = string(isPassive ? "P" : (isWrite ? "W" : "R")) + circuit.str() + FIELD_SEPARATOR + name.str();
 		if (!m_addAll) {
 			auto nameIt = m_messagesByName.find(nameKey);
 			if (nameIt != m_messagesByName.end()) {
@@ -1355,14 +1641,14 @@ result_t MessageMap::add(shared_ptr<Message> message, bool storeByName)
 		}
 		m_messagesByName[nameKey].push_back(message);
 
-		nameKey = string(isPassive ? "-P" : (isWrite ? "-W" : "-R")) + name; // also store without circuit
+		nameKey = string(isPassive ? "-P" : (isWrite ? "-W" : "-R")) + name.str(); // also store without circuit
 		auto nameIt = m_messagesByName.find(nameKey);
 		if (nameIt == m_messagesByName.end())
 			m_messagesByName[nameKey].push_back(message); // always store first message without circuit (in order of circuit name)
 		else {
 			auto messages = &nameIt->second;
 			auto first = messages->front();
-			if (circuit < first->getCircuit())
+			if (circuit.str() < first->getCircuit())
 				m_messagesByName[nameKey].at(0) = message; // always store first message without circuit (in order of circuit name)
 			else if (m_addAll || (conditional && first->isConditional()))
 				m_messagesByName[nameKey].push_back(message); // store further messages only if both are conditional or if storing everything
@@ -1373,55 +1659,79 @@ result_t MessageMap::add(shared_ptr<Message> message, bool storeByName)
 		if (isPassive)
 			m_passiveMessageCount++;
 		addPollMessage(message);
+		message->m_changeJournal = &m_changeJournal;
+		message->enableHistory(m_historySegments);
+		std::lock_guard<std::mutex> lock(m_nameIndexMutex);
+		m_nameIndexValid = false;
 	}
 	unsigned char idLength = message->getIdLength();
 	if (idLength > m_maxIdLength)
 		m_maxIdLength = idLength;
-	m_messagesByKey[key].push_back(message);
+	auto& keyMessages = m_messagesByKey[key];
+	keyMessages.push_back(message);
+	invalidateUnknownCache();
+	m_messagesByKeyIndex[key] = &keyMessages;
+	m_idLengthsByKeyPrefix[ID_KEY_PREFIX(key)] |= ID_LENGTH_BIT(key);
 
 	return RESULT_OK;
 }
 
-result_t MessageMap::addDefaultFromFile(vector< vector<string> >& defaults, vector<string>& row,
-	vector<string>::iterator& begin, string defaultDest, string defaultCircuit, string defaultSuffix,
+result_t MessageMap::addDefaultFromFile(vector< vector<string> >& defaults, const vector<StringRef>& row,
+	size_t& column, string defaultDest, string defaultCircuit, string defaultSuffix,
 	const string& filename, unsigned int lineNo)
 {
+	if (m_staging) {
+		flushStagedOutput();
+		m_stagedLineNo = lineNo;
+	}
 	// check for condition in defaults
-	string type = row[0];
-	if (type.length()>0 && type[0]=='[' && type[type.length()-1]==']') {
+	const StringRef& type = row[0];
+	if (type.length()>1 && type.data()[0]=='[' && type.data()[type.length()-1]==']') {
 		// condition
-		type = type.substr(1, type.length()-2);
-		string key = filename+":"+type;
+		string name(type.data()+1, type.length()-2);
+		string key = filename+":"+name;
 		map<string, Condition*>::iterator it = m_conditions.find(key);
 		if (it != m_conditions.end()) {
-			m_lastError = "condition "+type+" already defined";
+			m_lastError = "condition "+name+" already defined";
 			return RESULT_ERR_DUPLICATE_NAME;
 		}
+		vector<string> values;
+		values.reserve(row.size());
+		for (const auto& field : row)
+			values.push_back(field.str());
+		vector<string>::iterator begin = values.begin();
 		SimpleCondition* condition = NULL;
-		result_t result = Condition::create(type, ++begin, row.end(), defaultDest, defaultCircuit+defaultSuffix, condition);
+		result_t result = Condition::create(name, ++begin, values.end(), defaultDest, defaultCircuit+defaultSuffix, condition);
+		column = begin-values.begin();
 		if (condition==NULL || result!=RESULT_OK) {
 			m_lastError = "invalid condition";
 			return result;
 		}
 		m_conditions[key] = condition;
+		if (m_staging)
+			stage().m_condition = key;
 		return RESULT_OK;
 	}
-	if (row.size()>1 && defaultCircuit.length()>0) {
-		if (row[1].length()==0)
-			row[1] = defaultCircuit+defaultSuffix; // set default circuit and suffix: "circuit[.suffix]"
-		else if (row[1][0]=='#')
-			row[1] = defaultCircuit+defaultSuffix+row[1]; // move security suffix behind default circuit and suffix: "circuit[.suffix]#security"
-		else if (defaultSuffix.length()>0 && row[1].find_last_of('.')==string::npos) { // circuit suffix not yet present
-			size_t pos = row[1].find_first_of('#');
+	result_t result = FileReader::addDefaultFromFile(defaults, row, column, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
+	if (result != RESULT_OK)
+		return result;
+	vector<string>& values = defaults.back();
+	if (values.size()>1 && defaultCircuit.length()>0) {
+		if (values[1].length()==0)
+			values[1] = defaultCircuit+defaultSuffix; // set default circuit and suffix: "circuit[.suffix]"
+		else if (values[1][0]=='#')
+			values[1] = defaultCircuit+defaultSuffix+values[1]; // move security suffix behind default circuit and suffix: "circuit[.suffix]#security"
+		else if (defaultSuffix.length()>0 && values[1].find_last_of('.')==string::npos) { // circuit suffix not yet present
+			size_t pos = values[1].find_first_of('#');
 			if (pos==string::npos)
-				row[1] += defaultSuffix; // append default suffix: "circuit.suffix"
+				values[1] += defaultSuffix; // append default suffix: "circuit.suffix"
 			else
-				row[1] = row[1].substr(0, pos)+defaultSuffix+row[1].substr(pos); // insert default suffix: "circuit.suffix#security"
+				values[1] = values[1].substr(0, pos)+defaultSuffix+values[1].substr(pos); // insert default suffix: "circuit.suffix#security"
 		}
 	}
-	if (row.size()>5 && defaultDest.length()>0 && row[5].length()==0)
-		row[5] = defaultDest; // set default destination
-	return FileReader::addDefaultFromFile(defaults, row, begin, defaultDest, defaultCircuit, defaultSuffix, filename, lineNo);
+	if (values.size()>5 && defaultDest.length()>0 && values[5].length()==0)
+		values[5] = defaultDest; // set default destination
+	return RESULT_OK;
 }
 
 result_t MessageMap::readConditions(string& types, const string& filename, Condition*& condition)
@@ -1455,6 +1765,8 @@ result_t MessageMap::readConditions(string& types, const string& filename, Condi
 								return RESULT_ERR_INVALID_ARG;
 							}
 							m_conditions[key] = add; // store derived condition
+							if (m_staging)
+								stage().m_condition = key;
 						}
 					}
 					if (add==NULL) {
@@ -1477,6 +1789,8 @@ result_t MessageMap::readConditions(string& types, const string& filename, Condi
 			}
 			if (store) {
 				m_conditions[combinedkey] = condition; // store combined condition
+				if (m_staging)
+					stage().m_condition = combinedkey;
 			}
 		}
 	}
@@ -1487,6 +1801,10 @@ result_t MessageMap::addFromFile(vector<string>::iterator& begin, const vector<s
 	vector< vector<string> >* defaults, const string& defaultDest, const string& defaultCircuit, const string& defaultSuffix,
 	const string& filename, unsigned int lineNo)
 {
+	if (m_staging) {
+		flushStagedOutput();
+		m_stagedLineNo = lineNo;
+	}
 	vector<string>::iterator restart = begin;
 	string types = *restart;
 	Condition* condition = NULL;
@@ -1510,6 +1828,8 @@ result_t MessageMap::addFromFile(vector<string>::iterator& begin, const vector<s
 		} else {
 			it->second.push_back(instruction);
 		}
+		if (m_staging)
+			stage().m_instruction = true;
 		return RESULT_OK;
 	}
 	if (types.length() == 0)
@@ -1528,6 +1848,15 @@ result_t MessageMap::addFromFile(vector<string>::iterator& begin, const vector<s
 		begin = restart;
 		messages.clear();
 		result = Message::create(begin, end, defaults, condition, filename, templates, messages);
+		if (m_staging && result == RESULT_OK) {
+			if (!messages.empty()) {
+				StagedEntry& entry = stage();
+				entry.m_messages = messages;
+				entry.m_row.assign(restart, end);
+				entry.m_lastError = m_lastError;
+			}
+			continue;
+		}
 		for (auto& message : messages) {
 			if (result == RESULT_OK) {
 				result = add(message);
@@ -1543,7 +1872,169 @@ result_t MessageMap::addFromFile(vector<string>::iterator& begin, const vector<s
 	return result;
 }
 
-shared_ptr<Message> MessageMap::getScanMessage(const libebus::Address &dstAddress)
+MessageMap::StagedEntry& MessageMap::stage()
+{
+	flushStagedOutput();
+	m_staged.emplace_back();
+	StagedEntry& entry = m_staged.back();
+	entry.m_lineNo = m_stagedLineNo;
+	entry.m_instruction = false;
+	return entry;
+}
+
+void MessageMap::flushStagedOutput()
+{
+	if (m_stagedOutput.tellp() <= 0)
+		return;
+	m_staged.emplace_back();
+	StagedEntry& entry = m_staged.back();
+	entry.m_lineNo = m_stagedLineNo;
+	entry.m_instruction = false;
+	entry.m_output = m_stagedOutput.str();
+	m_stagedOutput.str("");
+}
+
+ostream& MessageMap::getVerboseOutput()
+{
+	if (m_staging)
+		return m_stagedOutput;
+	return FileReader::getVerboseOutput();
+}
+
+result_t MessageMap::readFromFile(const string filename, bool verbose,
+	string defaultDest, string defaultCircuit, string defaultSuffix)
+{
+	ConfigArena::Scope scope(m_arena);
+	return FileReader::readFromFile(filename, verbose, defaultDest, defaultCircuit, defaultSuffix);
+}
+
+result_t MessageMap::readFromFiles(const vector<string>& filenames, bool verbose, unsigned int threads,
+	void (*readFunc)(const string& filename))
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads > filenames.size())
+		threads = (unsigned int)filenames.size();
+	if (threads <= 1) {
+		for (const auto& filename : filenames) {
+			if (readFunc)
+				readFunc(filename);
+			result_t result = readFromFile(filename, verbose);
+			if (result != RESULT_OK)
+				return result;
+		}
+		return RESULT_OK;
+	}
+	// the staging instances are created here as the scan message needs the ident fields
+	size_t count = filenames.size();
+	vector<std::unique_ptr<MessageMap>> staged;
+	for (size_t index = 0; index < count; index++) {
+		staged.emplace_back(new MessageMap(m_addAll));
+		staged.back()->m_staging = true;
+		staged.back()->m_arena->release(); // allocate from the arena of this generation
+		staged.back()->m_arena = m_arena;
+		m_arena->retain();
+		staged.back()->setRowCache(m_rowCache);
+	}
+	vector<result_t> results(count, RESULT_OK);
+	vector<bool> done(count, false);
+	std::mutex doneMutex;
+	std::condition_variable doneCond;
+	std::atomic<size_t> next(0);
+	std::atomic<bool> stop(false);
+	vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; i++) {
+		workers.emplace_back([&]() {
+			size_t index;
+			while (!stop && (index = next++) < count) {
+				MessageMap* messages = staged[index].get();
+				results[index] = messages->readFromFile(filenames[index], verbose);
+				messages->flushStagedOutput();
+				{
+					std::lock_guard<std::mutex> lock(doneMutex);
+					done[index] = true;
+				}
+				doneCond.notify_all();
+			}
+		});
+	}
+	result_t result = RESULT_OK;
+	for (size_t index = 0; index < count && result == RESULT_OK; index++) {
+		{
+			std::unique_lock<std::mutex> lock(doneMutex);
+			doneCond.wait(lock, [&done, index]{ return done[index]; });
+		}
+		if (readFunc)
+			readFunc(filenames[index]);
+		result = addStaged(*staged[index], filenames[index], verbose, results[index]);
+		staged[index].reset();
+	}
+	stop = true;
+	for (auto& worker : workers)
+		worker.join();
+	return result;
+}
+
+result_t MessageMap::addStaged(MessageMap& staged, const string& filename, bool verbose, result_t readResult)
+{
+	unsigned int failedLineNo = 0;
+	for (auto& entry : staged.m_staged) {
+		if (failedLineNo > 0 && entry.m_lineNo == failedLineNo)
+			continue; // skip the remainder of a failed row
+		failedLineNo = 0;
+		if (!entry.m_condition.empty()) {
+			auto it = staged.m_conditions.find(entry.m_condition);
+			if (it != staged.m_conditions.end()) {
+				m_conditions[entry.m_condition] = it->second;
+				staged.m_conditions.erase(it);
+			}
+			continue;
+		}
+		if (entry.m_instruction) {
+			auto& instructions = staged.m_instructions[filename];
+			m_instructions[filename].push_back(instructions.front());
+			instructions.erase(instructions.begin());
+			continue;
+		}
+		if (!entry.m_output.empty()) {
+			cout << entry.m_output;
+			continue;
+		}
+		result_t result = RESULT_OK;
+		for (auto& message : entry.m_messages) {
+			result = add(message);
+			if (result != RESULT_OK)
+				break;
+		}
+		if (result == RESULT_OK)
+			continue;
+		vector<string>::iterator pos = entry.m_row.begin();
+		if (result==RESULT_ERR_DUPLICATE_NAME)
+			pos += std::min((size_t)3, entry.m_row.size()-1); // mark name as invalid
+		else if (result==RESULT_ERR_DUPLICATE)
+			pos += std::min((size_t)8, entry.m_row.size()-1); // mark ID as invalid
+		string lastError = entry.m_lastError.empty() ? m_lastError : entry.m_lastError;
+		if (!verbose) {
+			ostringstream error;
+			error << filename << ":" << static_cast<unsigned>(entry.m_lineNo);
+			if (lastError.length()>0) {
+				error << ": " << lastError;
+			}
+			m_lastError = error.str();
+			return result;
+		}
+		if (lastError.length()>0) {
+			cout << lastError << endl;
+		}
+		printErrorPos(cout, entry.m_row.begin(), entry.m_row.end(), pos, filename, entry.m_lineNo, result);
+		failedLineNo = entry.m_lineNo;
+	}
+	if (!verbose || !staged.m_lastError.empty())
+		m_lastError = staged.m_lastError;
+	return readResult;
+}
+
+shared_ptr<Message> MessageMap::getScanMessage(const libebus::Address &dstAddress, const bool derive)
 {
 	if (dstAddress==SYN)
 		return m_scanMessage;
@@ -1553,7 +2044,9 @@ shared_ptr<Message> MessageMap::getScanMessage(const libebus::Address &dstAddres
 	auto msgs = getByKey(key);
 	if (msgs!=NULL)
 		return msgs->front();
-	shared_ptr<Message> message = m_scanMessage->derive(dstAddress, true);
+	if (!derive)
+		return NULL;
+	shared_ptr<Message> message = m_scanMessage->derive(dstAddress.binAddr(), true);
 	add(message);
 	return message;
 }
@@ -1662,10 +2155,45 @@ string MessageMap::getLoadedFiles(const libebus::Address &address)
 	return m_loadedFiles[address.binAddr()];
 }
 
+size_t MessageMap::takeLastData(MessageMap& previous)
+{
+	size_t count = 0;
+	for (auto& it : m_messagesByKey) {
+		auto previousMessages = previous.getByKey(it.first);
+		if (previousMessages == NULL)
+			continue;
+		for (auto& message : it.second) {
+			for (auto& previousMessage : *previousMessages) {
+				if (previousMessage->m_circuit.getLowerId() != message->m_circuit.getLowerId()
+				|| previousMessage->m_definition->m_name.getLowerId() != message->m_definition->m_name.getLowerId())
+					continue;
+				if (message->takeLastData(*previousMessage))
+					count++;
+				break;
+			}
+		}
+	}
+	return count;
+}
+
+size_t MessageMap::deriveFrom(const shared_ptr<MessageMap>& source)
+{
+	size_t count = 0;
+	m_derivedSource = source;
+	ConfigArena::Scope scope(m_arena);
+	for (auto& it : source->m_messagesByKey) {
+		for (auto& message : it.second) {
+			if (add(message->derive(message->getDstAddress())) == RESULT_OK)
+				count++;
+		}
+	}
+	return count;
+}
+
 vector<shared_ptr<Message>>* MessageMap::getByKey(const unsigned long long key) {
-	auto it = m_messagesByKey.find(key);
-	if (it != m_messagesByKey.end())
-		return &it->second;
+	auto messages = m_messagesByKeyIndex.find(key);
+	if (messages)
+		return *messages;
 	return NULL;
 }
 
@@ -1694,6 +2222,29 @@ shared_ptr<Message> MessageMap::find(const string& circuit, const string& name,
 	return NULL;
 }
 
+void MessageMap::buildNameIndex()
+{
+	if (m_nameIndexValid)
+		return;
+	m_nameIndex.clear();
+	m_nameIndexByCircuit.clear();
+	m_nameIndexByName.clear();
+	for (auto it = m_messagesByName.begin(); it != m_messagesByName.end(); it++) {
+		if (it->first[0] == '-' || it->second.empty()) // avoid duplicates: instances stored multiple times have a key starting with "-"
+			continue;
+		NameIndexEntry entry;
+		entry.m_circuit = it->second.front()->m_circuit.lower();
+		entry.m_name = it->second.front()->m_definition->m_name.lower();
+		entry.m_type = it->first[0];
+		entry.m_messages = &it->second;
+		size_t pos = m_nameIndex.size();
+		m_nameIndexByCircuit[entry.m_circuit].push_back(pos);
+		m_nameIndexByName[entry.m_name].push_back(pos);
+		m_nameIndex.push_back(entry);
+	}
+	m_nameIndexValid = true;
+}
+
 deque<shared_ptr<Message>> MessageMap::findAll(const string& circuit, const string& name, const bool completeMatch,
 	const bool withRead, const bool withWrite, const bool withPassive)
 {
@@ -1704,29 +2255,36 @@ deque<shared_ptr<Message>> MessageMap::findAll(const string& circuit, const stri
 	FileReader::tolower(lname);
 	bool checkCircuit = lcircuit.length() > 0;
 	bool checkName = name.length() > 0;
-	for (auto it = m_messagesByName.begin(); it != m_messagesByName.end(); it++) {
-		if (it->first[0] == '-') // avoid duplicates: instances stored multiple times have a key starting with "-"
-			continue;
-		auto message = getFirstAvailable(it->second);
-		if (!message)
-			continue;
-		if (checkCircuit) {
-			string check = message->getCircuit();
-			FileReader::tolower(check);
-			if (completeMatch ? (check != lcircuit) : (check.find(lcircuit) == check.npos))
-				continue;
-		}
-		if (checkName) {
-			string check = message->getName();
-			FileReader::tolower(check);
-			if (completeMatch ? (check != lname) : (check.find(lname) == check.npos))
-				continue;
-		}
-		if (message->isPassive()) {
+	// for a complete match, the names compare by interned identity and unknown names cannot match at all
+	InternedString icircuit, iname;
+	if (completeMatch && ((checkCircuit && !InternedString::find(lcircuit, icircuit))
+	|| (checkName && !InternedString::find(lname, iname))))
+		return ret;
+	std::lock_guard<std::mutex> lock(m_nameIndexMutex);
+	buildNameIndex();
+	// for a complete match, only walk the entries with the circuit or name
+	const vector<size_t>* positions = NULL;
+	if (completeMatch && checkCircuit) {
+		auto it = m_nameIndexByCircuit.find(icircuit);
+		if (it == m_nameIndexByCircuit.end())
+			return ret;
+		positions = &it->second;
+	}
+	if (completeMatch && checkName) {
+		auto it = m_nameIndexByName.find(iname);
+		if (it == m_nameIndexByName.end())
+			return ret;
+		if (positions == NULL || it->second.size() < positions->size())
+			positions = &it->second;
+	}
+	size_t count = positions ? positions->size() : m_nameIndex.size();
+	for (size_t i = 0; i < count; i++) {
+		NameIndexEntry& entry = m_nameIndex[positions ? (*positions)[i] : i];
+		if (entry.m_type == 'P') {
 			if (!withPassive)
 				continue;
 		}
-		else if (message->isWrite()) {
+		else if (entry.m_type == 'W') {
 			if (!withWrite)
 				continue;
 		}
@@ -1734,7 +2292,13 @@ deque<shared_ptr<Message>> MessageMap::findAll(const string& circuit, const stri
 			if (!withRead)
 				continue;
 		}
-		ret.push_back(message);
+		if (checkCircuit && (completeMatch ? (entry.m_circuit != icircuit) : (entry.m_circuit.str().find(lcircuit) == string::npos)))
+			continue;
+		if (checkName && (completeMatch ? (entry.m_name != iname) : (entry.m_name.str().find(lname) == string::npos)))
+			continue;
+		auto message = getFirstAvailable(*entry.m_messages);
+		if (message)
+			ret.push_back(message);
 	}
 
 	return ret;
@@ -1752,13 +2316,94 @@ shared_ptr<Message> MessageMap::find(SymbolString& master, bool anyDestination,
 		return NULL;
 	if (maxIdLength == 0 && anyDestination && master[2] == 0x07 && master[3] == 0x04)
 		return m_scanMessage;
+	// check for master data already known to be unknown (only for IDs fitting into the integer key)
+	bool useUnknown = maxIdLength <= UNKNOWN_CACHE_MAX_ID_LENGTH;
+	UnknownKey unknownKey = {0, 0};
+	unsigned int generation = 0;
+	if (useUnknown) {
+		unknownKey.m_head = (unsigned long long)((anyDestination ? 1 : 0) | (withRead ? 2 : 0) | (withWrite ? 4 : 0)
+			| (withPassive ? 8 : 0)) << (8 * 5);
+		for (size_t i = 0; i < 4; i++) // QQ ZZ PB SB
+			unknownKey.m_head |= (unsigned long long)master[i] << (8 * (4 - i));
+		unknownKey.m_head |= maxIdLength;
+		for (unsigned char i = 0; i < maxIdLength; i++)
+			unknownKey.m_id |= (unsigned long long)master[5 + i] << (8 * i);
+		if (isUnknown(unknownKey, generation)) {
+			m_unknownCacheHits.fetch_add(1, std::memory_order_relaxed);
+			return NULL;
+		}
+	}
+	bool anyKey;
+	auto message = findByKey(master, maxIdLength, anyDestination, withRead, withWrite, withPassive, anyKey);
+	if (message)
+		return *message;
+	if (!anyKey && useUnknown) {
+		// remember master data without any matching key
+		m_unknownCacheMisses.fetch_add(1, std::memory_order_relaxed);
+		rememberUnknown(unknownKey, generation);
+	}
+
+	return NULL;
+}
+
+Message* MessageMap::findUncached(SymbolString& master, bool anyDestination,
+	const bool withRead, const bool withWrite, const bool withPassive)
+{
+	if (master.size() < 5)
+		return NULL;
+	unsigned char maxIdLength = master[4];
+	if (maxIdLength > m_maxIdLength)
+		maxIdLength = m_maxIdLength;
+	if (master.size() < 5+maxIdLength)
+		return NULL;
+	if (maxIdLength == 0 && anyDestination && master[2] == 0x07 && master[3] == 0x04)
+		return m_scanMessage.get();
+	bool anyKey;
+	auto message = findByKey(master, maxIdLength, anyDestination, withRead, withWrite, withPassive, anyKey);
+	return message ? message->get() : NULL;
+}
+
+shared_ptr<Message>* MessageMap::findByKey(SymbolString& master, const unsigned char maxIdLength, bool anyDestination,
+	const bool withRead, const bool withWrite, const bool withPassive, bool& anyKey)
+{
 	unsigned long long baseKey = (unsigned long long)libebus::Address(master[0]).getMasterNumber() << (8 * 7); // QQ address for passive message
 	baseKey |= (unsigned long long)(anyDestination ? SYN : master[1]) << (8 * 6); // ZZ address
 	baseKey |= (unsigned long long)master[2] << (8 * 5); // PB
 	baseKey |= (unsigned long long)master[3] << (8 * 4); // SB
+	// determine the ID lengths available for each possible source in order to probe only existing keys
+	unsigned char passiveLengths = 0, anyPassiveLengths = 0, readLengths = 0, writeLengths = 0;
+	unsigned char* lengths;
+	if (withPassive) {
+		lengths = m_idLengthsByKeyPrefix.find(ID_KEY_PREFIX(baseKey));
+		if (lengths)
+			passiveLengths = *lengths;
+		if ((baseKey & ID_SOURCE_MASK) != 0) {
+			lengths = m_idLengthsByKeyPrefix.find(ID_KEY_PREFIX(baseKey & ~ID_SOURCE_MASK));
+			if (lengths)
+				anyPassiveLengths = *lengths;
+		}
+	}
+	baseKey &= ~ID_SOURCE_MASK;
+	if (withRead) {
+		lengths = m_idLengthsByKeyPrefix.find(ID_KEY_PREFIX(baseKey | ID_SOURCE_ACTIVE_READ));
+		if (lengths)
+			readLengths = *lengths;
+	}
+	if (withWrite) {
+		lengths = m_idLengthsByKeyPrefix.find(ID_KEY_PREFIX(baseKey | ID_SOURCE_ACTIVE_WRITE));
+		if (lengths)
+			writeLengths = *lengths;
+	}
+	anyKey = false;
+	unsigned long long sourceKey = baseKey | (withPassive ? (unsigned long long)libebus::Address(master[0]).getMasterNumber() << (8 * 7) : 0);
 	for (unsigned char idLength = maxIdLength; true; idLength--) {
-		unsigned long long key = (unsigned long long)idLength << (8 * 7 + 5);
-		key |= baseKey;
+		unsigned long long key = (unsigned long long)idLength << ID_LENGTH_SHIFT;
+		unsigned char lengthBit = ID_LENGTH_BIT(key);
+		if (((passiveLengths | anyPassiveLengths | readLengths | writeLengths) & lengthBit) == 0) {
+			if (idLength == 0)
+				break;
+			continue;
+		}
 		int exp = 3;
 		for (unsigned char i = 0; i < idLength; i++) {
 			key |= (unsigned long long)master[5 + i] << (8 * exp--);
@@ -1766,38 +2411,40 @@ shared_ptr<Message> MessageMap::find(SymbolString& master, bool anyDestination,
 				exp = 3;
 		}
 
-		map<unsigned long long , vector<shared_ptr<Message>> >::iterator it;
-		if (withPassive) {
-			it = m_messagesByKey.find(key);
-			if (it != m_messagesByKey.end()) {
-				auto message = getFirstAvailable(it->second, idLength, &master);
+		vector<shared_ptr<Message>>** messages;
+		if ((passiveLengths & lengthBit) != 0) {
+			messages = m_messagesByKeyIndex.find(key | sourceKey);
+			if (messages) {
+				anyKey = true;
+				auto message = getFirstAvailableEntry(**messages, master);
 				if (message)
 					return message;
 			}
-			if ((key & ID_SOURCE_MASK) != 0) {
-				key &= ~ID_SOURCE_MASK;
-				it = m_messagesByKey.find(key & ~ID_SOURCE_MASK); // try again without specific source master
-				if (it != m_messagesByKey.end()) {
-					auto message = getFirstAvailable(it->second, idLength, &master);
-					if (message)
-						return message;
-				}
+		}
+		key |= baseKey;
+		if ((anyPassiveLengths & lengthBit) != 0) {
+			messages = m_messagesByKeyIndex.find(key); // try again without specific source master
+			if (messages) {
+				anyKey = true;
+				auto message = getFirstAvailableEntry(**messages, master);
+				if (message)
+					return message;
 			}
-		} else {
-			key &= ~ID_SOURCE_MASK;
 		}
-		if (withRead) {
-			it = m_messagesByKey.find(key | ID_SOURCE_ACTIVE_READ); // try again with special value for active read
-			if (it != m_messagesByKey.end()) {
-				auto message = getFirstAvailable(it->second, idLength, &master);
+		if ((readLengths & lengthBit) != 0) {
+			messages = m_messagesByKeyIndex.find(key | ID_SOURCE_ACTIVE_READ); // try again with special value for active read
+			if (messages) {
+				anyKey = true;
+				auto message = getFirstAvailableEntry(**messages, master);
 				if (message)
 					return message;
 			}
 		}
-		if (withWrite) {
-			it = m_messagesByKey.find(key | ID_SOURCE_ACTIVE_WRITE); // try again with special value for active write
-			if (it != m_messagesByKey.end()) {
-				auto message = getFirstAvailable(it->second, idLength, &master);
+		if ((writeLengths & lengthBit) != 0) {
+			messages = m_messagesByKeyIndex.find(key | ID_SOURCE_ACTIVE_WRITE); // try again with special value for active write
+			if (messages) {
+				anyKey = true;
+				auto message = getFirstAvailableEntry(**messages, master);
 				if (message)
 					return message;
 			}
@@ -1805,32 +2452,68 @@ shared_ptr<Message> MessageMap::find(SymbolString& master, bool anyDestination,
 		if (idLength == 0)
 			break;
 	}
-
 	return NULL;
 }
 
+void MessageMap::invalidateUnknownCache()
+{
+	m_unknownGeneration.fetch_add(1, std::memory_order_release);
+}
+
+bool MessageMap::isUnknown(const UnknownKey& key, unsigned int& generation)
+{
+	// the generation is taken before looking up the key, so that a key remembered afterwards is dropped with
+	// any message added in between
+	generation = m_unknownGeneration.load(std::memory_order_acquire);
+	const UnknownSlot& slot = m_unknownSlots[key.getSlot()];
+	unsigned int sequence = slot.m_sequence.load(std::memory_order_acquire);
+	if (sequence & 1)
+		return false; // being written
+	bool found = slot.m_generation.load(std::memory_order_relaxed) == generation
+		&& slot.m_head.load(std::memory_order_relaxed) == key.m_head
+		&& slot.m_id.load(std::memory_order_relaxed) == key.m_id;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return found && slot.m_sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+void MessageMap::rememberUnknown(const UnknownKey& key, const unsigned int generation)
+{
+	UnknownSlot& slot = m_unknownSlots[key.getSlot()];
+	unsigned int sequence = slot.m_sequence.load(std::memory_order_relaxed);
+	if ((sequence & 1) || !slot.m_sequence.compare_exchange_strong(sequence, sequence+1, std::memory_order_relaxed))
+		return; // written by another thread
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.m_generation.store(generation, std::memory_order_relaxed);
+	slot.m_head.store(key.m_head, std::memory_order_relaxed);
+	slot.m_id.store(key.m_id, std::memory_order_relaxed);
+	slot.m_sequence.store(sequence+2, std::memory_order_release);
+}
+
 void MessageMap::invalidateCache(shared_ptr<Message> message)
 {
-	if (message->m_data==DataFieldSet::getIdentFields())
+	if (message->m_definition->m_data==DataFieldSet::getIdentFields())
 		return;
 	message->m_lastUpdateTime = 0;
-	string circuit = message->getCircuit();
-	size_t pos = circuit.find('#');
-	if (pos!=string::npos)
-		circuit.resize(pos);
-	string name = message->getName();
-	auto messages = findAll(circuit, name, false, true, true, true);
-	for (auto it = messages.begin(); it != messages.end(); it++) {
-		auto checkMessage = *it;
-		if (checkMessage==message
-		|| name!=checkMessage->getName())
+	const string& circuit = message->getCircuit();
+	size_t circuitLength = circuit.find('#');
+	if (circuitLength==string::npos)
+		circuitLength = circuit.length();
+	std::lock_guard<std::mutex> lock(m_nameIndexMutex);
+	buildNameIndex();
+	auto it = m_nameIndexByName.find(message->m_definition->m_name.lower());
+	if (it == m_nameIndexByName.end())
+		return;
+	for (auto pos : it->second) {
+		auto checkMessage = getFirstAvailable(*m_nameIndex[pos].m_messages);
+		if (!checkMessage || checkMessage==message
+		|| checkMessage->m_definition->m_name!=message->m_definition->m_name)
 			continue; // check exact name
-		string check = checkMessage->getCircuit();
-		if (check!=circuit) {
-			size_t pos = check.find('#');
-			if (pos!=string::npos)
-				check.resize(pos);
-			if (check!=circuit)
+		if (checkMessage->m_circuit!=message->m_circuit) {
+			const string& check = checkMessage->getCircuit();
+			size_t checkLength = check.find('#');
+			if (checkLength==string::npos)
+				checkLength = check.length();
+			if (checkLength!=circuitLength || check.compare(0, checkLength, circuit, 0, circuitLength)!=0)
 				continue;
 		}
 		checkMessage->m_lastUpdateTime = 0;
@@ -1839,19 +2522,36 @@ void MessageMap::invalidateCache(shared_ptr<Message> message)
 
 void MessageMap::addPollMessage(shared_ptr<Message> message, bool toFront)
 {
-	if (message != NULL && message->getPollPriority() > 0) {
-		message->m_lastPollTime = toFront ? 0 : m_pollMessages.size();
-		m_pollMessages.push(message);
+	if (message == NULL || message->getPollPriority() == 0)
+		return;
+	time_t due = 0;
+	if (!toFront)
+		time(&due);
+	std::lock_guard<std::mutex> lock(m_pollMutex);
+	if (message->m_pollScheduled) {
+		if (due >= message->m_nextPollTime)
+			return; // already due earlier
+	} else {
+		message->m_pollScheduled = true;
+		m_pollMessageCount++;
 	}
+	message->m_nextPollTime = due;
+	m_pollMessages.add(message, due);
 }
 
 void MessageMap::clear()
 {
 	m_loadedFiles.clear();
+	m_changeJournal.clear();
 	// clear poll messages
-	while (!m_pollMessages.empty()) {
-		m_pollMessages.top();
-		m_pollMessages.pop();
+	{
+		std::lock_guard<std::mutex> lock(m_pollMutex);
+		m_pollMessages.clear();
+		m_pollMessageCount = 0;
+		for (auto& message : m_refreshMessages)
+			message->m_refreshScheduled = false;
+		m_refreshMessages.clear();
+		m_refreshMessageCount = 0;
 	}
 	// free message instances by name
 	for (auto it = m_messagesByName.begin(); it != m_messagesByName.end(); it++) {
@@ -1896,24 +2596,79 @@ void MessageMap::clear()
 	m_messageCount = 0;
 	m_conditionalMessageCount = 0;
 	m_passiveMessageCount = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_nameIndexMutex);
+		m_nameIndexValid = false;
+		m_nameIndex.clear();
+		m_nameIndexByCircuit.clear();
+		m_nameIndexByName.clear();
+	}
 	m_messagesByName.clear();
 	// clear messages by key
 	m_messagesByKey.clear();
+	m_messagesByKeyIndex.clear();
+	m_idLengthsByKeyPrefix.clear();
+	invalidateUnknownCache();
 	m_conditions.clear();
 	m_instructions.clear();
 	m_maxIdLength = 0;
+	// the source is only needed while the derived instances are in use
+	m_derivedSource.reset();
+	// start a new generation: the chunks of the previous one are freed with its last remaining instance
+	m_arena->release();
+	m_arena = ConfigArena::create();
+}
+
+shared_ptr<Message> MessageMap::getNextPoll(time_t now)
+{
+	std::lock_guard<std::mutex> lock(m_pollMutex);
+	shared_ptr<Message> message;
+	time_t due;
+	while (m_pollMessages.take(now, message, due)) {
+		if (!message->m_pollScheduled || due != message->m_nextPollTime)
+			continue; // outdated entry
+		if (message->getPollPriority() == 0) {
+			message->m_pollScheduled = false; // polling disabled
+			m_pollMessageCount--;
+			continue;
+		}
+		message->m_pollCount++;
+		message->m_lastPollTime = now;
+		time_t interval = (time_t)message->getPollInterval();
+		message->m_nextPollTime = due + interval; // keep the rate if polled late
+		if (message->m_nextPollTime <= now)
+			message->m_nextPollTime = now + interval; // too late already: avoid catching up
+		m_pollMessages.add(message, message->m_nextPollTime); // schedule at new due time
+		return message;
+	}
+	return NULL;
 }
 
-shared_ptr<Message> MessageMap::getNextPoll()
+bool MessageMap::addRefreshMessage(shared_ptr<Message> message)
 {
-	if (m_pollMessages.empty())
+	if (message == NULL || message->isPassive() || message->isWrite() || message->getDstAddress() == SYN)
+		return false;
+	std::lock_guard<std::mutex> lock(m_pollMutex);
+	if (message->m_refreshScheduled)
+		return false;
+	message->m_refreshScheduled = true;
+	m_refreshMessages.push_back(message);
+	m_refreshMessageCount++;
+	return true;
+}
+
+shared_ptr<Message> MessageMap::getNextRefresh()
+{
+	if (m_refreshMessageCount == 0)
 		return NULL;
-	auto ret = m_pollMessages.top();
-	m_pollMessages.pop();
-	ret->m_pollCount++;
-	time(&(ret->m_lastPollTime));
-	m_pollMessages.push(ret); // re-insert at new position
-	return ret;
+	std::lock_guard<std::mutex> lock(m_pollMutex);
+	if (m_refreshMessages.empty())
+		return NULL;
+	auto message = m_refreshMessages.front();
+	m_refreshMessages.pop_front();
+	m_refreshMessageCount--;
+	message->m_refreshScheduled = false;
+	return message;
 }
 
 void MessageMap::dump(ostream& output, bool withConditions)
@@ -23,10 +23,16 @@
 #include "result.h"
 #include "symbol.h"
 #include "Address.h"
+#include "flatindex.h"
+#include "timingwheel.h"
+#include "history.h"
 #include <string>
 #include <vector>
 #include <deque>
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
 
 /** @file message.h
  * Classes and functions for decoding and encoding of complete messages on the
@@ -45,20 +51,176 @@
  * In order to make a @a Message available (see Message#isAvailable()) under
  * certain conditions only, it may have assigned a @a Condition instance.
  *
+ * The immutable parts of a @a Message (name, comment, ID, fields, and
+ * @a Condition) are kept in a @a MessageDefinition that is shared by all
+ * instances derived from it for other addresses (see Message#derive()), so
+ * that each derived instance only carries its own addresses, circuit, last
+ * seen data, and polling state.
+ *
  * A @a Condition is either a @a SimpleCondition referencing another
  * @a Message, numeric field, and field value, or a @a CombinedCondition
  * applying a logical AND on two or more other @a Condition instances.
  *
  * The @a MessageMap stores all @a Message and @a Condition instances by their
- * unique keys, and also keeps track of messages with polling enabled. It reads
+ * unique keys, and also keeps track of messages with polling enabled in a
+ * @a TimingWheel by the time they are due to be polled again. It reads
  * the instances from configuration files by inheriting the @a FileReader
- * template class.
+ * template class. Each change of the data of one of its messages is recorded
+ * in a @a ChangeJournal.
  */
 
+/** the number of entries kept in a @a ChangeJournal (power of 2). */
+#define CHANGE_JOURNAL_SIZE 1024
+
+/** the poll interval in seconds per poll priority of a @a Message without an explicit poll interval. */
+#define POLL_PRIORITY_INTERVAL 30
+
+/** the weight of the previous estimate when learning the change interval of a @a Message (moving average). */
+#define CHANGE_INTERVAL_WEIGHT 4
+
+/** the share of the learned change interval of a @a Message that its last data is considered fresh for. */
+#define ADAPTIVE_MAX_AGE_DIVISOR 2
+
+/** the minimum adaptive maximum age in seconds of the last data of a @a Message. */
+#define ADAPTIVE_MAX_AGE_MIN 5
+
+/** the maximum adaptive maximum age in seconds of the last data of a @a Message. */
+#define ADAPTIVE_MAX_AGE_MAX (60*60)
+
+/** the maximum number of prepared master telegrams cached per @a Message. */
+#define PREPARED_MASTER_CACHE_SIZE 4
+
+
 class Condition;
 class SimpleCondition;
 class CombinedCondition;
 class MessageMap;
+class ChangeJournal;
+
+/**
+ * The immutable definition of a @a Message shared by all instances derived from it.
+ */
+struct MessageDefinition
+{
+	/**
+	 * Construct a new instance.
+	 * @param name the message name (unique within the same circuit and type).
+	 * @param isWrite whether this is a write message.
+	 * @param isPassive true if message can only be initiated by a participant other than us,
+	 * false if message can be initiated by any participant.
+	 * @param comment the comment.
+	 * @param id the primary, secondary, and optional further ID bytes.
+	 * @param data the @a DataField for encoding/decoding the message.
+	 * @param condition the @a Condition for this message, or NULL.
+	 */
+	MessageDefinition(const InternedString& name, const bool isWrite, const bool isPassive,
+		const InternedString& comment, const vector<unsigned char>& id, shared_ptr<DataField> data,
+		Condition* condition)
+		: m_name(name), m_isWrite(isWrite), m_isPassive(isPassive), m_comment(comment),
+		  m_id(id), m_data(data), m_condition(condition) {}
+
+	/** the message name (unique within the same circuit and type). */
+	const InternedString m_name;
+
+	/** whether this is a write message. */
+	const bool m_isWrite;
+
+	/** true if message can only be initiated by a participant other than us,
+	 * false if message can be initiated by any participant. */
+	const bool m_isPassive;
+
+	/** the comment. */
+	const InternedString m_comment;
+
+	/** the primary, secondary, and optionally further command ID bytes. */
+	const vector<unsigned char> m_id;
+
+	/** the @a DataField for encoding/decoding the message. */
+	const shared_ptr<DataField> m_data;
+
+	/** the @a Condition for this message, or NULL. */
+	Condition* const m_condition;
+};
+
+/**
+ * The immutable definition of a @a ChainedMessage shared by all instances derived from it.
+ */
+struct ChainedMessageDefinition : public MessageDefinition
+{
+	/**
+	 * Construct a new instance.
+	 * @param name the message name (unique within the same circuit and type).
+	 * @param isWrite whether this is a write message.
+	 * @param comment the comment.
+	 * @param id the primary, secondary, and optional further ID bytes common to each part of the chain.
+	 * @param ids the primary, secondary, and optional further ID bytes for each part of the chain.
+	 * @param lengths the data length for each part of the chain.
+	 * @param data the @a DataField for encoding/decoding the chained message.
+	 * @param condition the @a Condition for this message, or NULL.
+	 */
+	ChainedMessageDefinition(const InternedString& name, const bool isWrite, const InternedString& comment,
+		const vector<unsigned char>& id, const vector<vector<unsigned char>>& ids,
+		const vector<unsigned char>& lengths, shared_ptr<DataField> data, Condition* condition)
+		: MessageDefinition(name, isWrite, false, comment, id, data, condition),
+		  m_ids(ids), m_lengths(lengths), m_maxTimeDiff(ids.size()*15) {} // 15 seconds per message
+
+	/** the primary, secondary, and optional further ID bytes for each part of the chain. */
+	const vector< vector<unsigned char> > m_ids;
+
+	/** the data length for each part of the chain. */
+	const vector<unsigned char> m_lengths;
+
+	/** the maximum allowed time difference of any data pair. */
+	const time_t m_maxTimeDiff;
+};
+
+/**
+ * A master telegram prepared by @a Message::prepareMaster() for reuse with identical arguments.
+ */
+struct PreparedMaster
+{
+	/** the source address. */
+	unsigned char m_srcAddress;
+
+	/** the effective destination address. */
+	unsigned char m_dstAddress;
+
+	/** the index of the part. */
+	unsigned char m_index;
+
+	/** the separator character between multiple fields. */
+	char m_separator;
+
+	/** the hash of @a m_input. */
+	size_t m_inputHash;
+
+	/** the formatted input value(s). */
+	string m_input;
+
+	/** the unescaped master data. */
+	SymbolString m_master = SymbolString(false);
+
+	/** the escaped master data including the CRC. */
+	SymbolString m_escaped = SymbolString(true);
+};
+
+/**
+ * The recently prepared master telegrams of a @a Message (only allocated once a telegram was prepared).
+ */
+struct PreparedMasters
+{
+	/** the mutex for all members. */
+	std::mutex m_mutex;
+
+	/** the recently prepared master telegrams (definitions are immutable, so these stay valid for the instance). */
+	vector<PreparedMaster> m_entries;
+
+	/** the position in @a m_entries to replace next when full. */
+	size_t m_next = 0;
+
+	/** the number of master telegrams taken from @a m_entries. */
+	unsigned int m_hits = 0;
+};
 
 /**
  * Defines parameters of a message sent or received on the bus.
@@ -84,8 +246,8 @@ public:
 	 * @param pollPriority the priority for polling, or 0 for no polling at all.
 	 * @param condition the @a Condition for this message, or NULL.
 	 */
-	Message(const string& circuit, const string& name,
-			const bool isWrite, const bool isPassive, const string comment,
+	Message(const InternedString& circuit, const InternedString& name,
+			const bool isWrite, const bool isPassive, const InternedString& comment,
 			const libebus::Address& srcAddress, const libebus::Address& dstAddress,
 			const vector<unsigned char> id,
 			shared_ptr<DataField> data,
@@ -103,15 +265,27 @@ public:
 	 * @param sb the secondary ID byte.
 	 * @param data the @a DataField for encoding/decoding the message.
 	 */
-	Message(const string& circuit, const string& name,
+	Message(const InternedString& circuit, const InternedString& name,
 			const bool isWrite, const bool isPassive,
 			const unsigned char pb, const unsigned char sb,
 			shared_ptr<DataField> data);
 
+	/**
+	 * Construct a new instance sharing an existing definition (e.g. for deriving).
+	 * @param definition the shared @a MessageDefinition.
+	 * @param circuit the optional circuit name.
+	 * @param srcAddress the source address, or @a SYN for any (only relevant if passive).
+	 * @param dstAddress the destination address, or @a SYN for any (set later).
+	 * @param pollPriority the priority for polling, or 0 for no polling at all.
+	 */
+	Message(const shared_ptr<const MessageDefinition>& definition, const InternedString& circuit,
+			const libebus::Address& srcAddress, const libebus::Address& dstAddress,
+			const unsigned char pollPriority);
+
 	/**
 	 * Destructor.
 	 */
-	virtual ~Message() { }
+	virtual ~Message() { delete m_preparedMasters.load(); }
 
 	/**
 	 * Parse an ID part from the input @a string.
@@ -159,32 +333,32 @@ public:
 	 * Get the optional circuit name.
 	 * @return the optional circuit name.
 	 */
-	string getCircuit() const { return m_circuit; }
+	const string& getCircuit() const { return m_circuit; }
 
 	/**
 	 * Get the message name (unique within the same circuit and type).
 	 * @return the message name (unique within the same circuit and type).
 	 */
-	string getName() const { return m_name; }
+	const string& getName() const { return m_definition->m_name; }
 
 	/**
 	 * Get whether this is a write message.
 	 * @return whether this is a write message.
 	 */
-	bool isWrite() const { return m_isWrite; }
+	bool isWrite() const { return m_definition->m_isWrite; }
 
 	/**
 	 * Get whether message can be initiated only by a participant other than us.
 	 * @return true if message can only be initiated by a participant other than us,
 	 * false if message can be initiated by any participant.
 	 */
-	bool isPassive() const { return m_isPassive; }
+	bool isPassive() const { return m_definition->m_isPassive; }
 
 	/**
 	 * Get the comment.
 	 * @return the comment.
 	 */
-	string getComment() const { return m_comment; }
+	const string& getComment() const { return m_definition->m_comment; }
 
 	/**
 	 * Get the source address.
@@ -202,26 +376,32 @@ public:
 	 * Get the primary command byte.
 	 * @return the primary command byte.
 	 */
-	unsigned char getPrimaryCommand() const { return m_id[0]; }
+	unsigned char getPrimaryCommand() const { return m_definition->m_id[0]; }
 
 	/**
 	 * Get the secondary command byte.
 	 * @return the secondary command byte.
 	 */
-	unsigned char getSecondaryCommand() const { return m_id[1]; }
+	unsigned char getSecondaryCommand() const { return m_definition->m_id[1]; }
 
 	/**
 	 * Get the length of the ID bytes (without primary and secondary command bytes).
 	 * @return the length of the ID bytes (without primary and secondary command bytes).
 	 */
-	virtual unsigned char getIdLength() const { return (unsigned char)(m_id.size() - 2); }
+	virtual unsigned char getIdLength() const { return (unsigned char)(m_definition->m_id.size() - 2); }
+
+	/**
+	 * Get the primary and secondary command byte followed by the ID bytes (only the first part of a chained message).
+	 * @return the primary and secondary command byte followed by the ID bytes.
+	 */
+	const vector<unsigned char>& getId() const { return m_definition->m_id; }
 
 	/**
 	 * Check if the full command ID starts with the given value.
 	 * @param id the ID bytes to check against.
 	 * @return true if the full command ID starts with the given value.
 	 */
-	bool checkIdPrefix(vector<unsigned char>& id);
+	bool checkIdPrefix(const vector<unsigned char>& id);
 
 	/**
 	 * Check the ID against the master @a SymbolString data.
@@ -264,6 +444,18 @@ public:
 	 */
 	bool setPollPriority(unsigned char priority);
 
+	/**
+	 * Get the interval in which this message is to be polled.
+	 * @return the explicitly set poll interval in seconds, or the one derived from the poll priority.
+	 */
+	unsigned int getPollInterval() const { return m_pollInterval > 0 ? m_pollInterval : m_pollPriority * POLL_PRIORITY_INTERVAL; }
+
+	/**
+	 * Set the interval in which this message is to be polled (effective after the next poll).
+	 * @param interval the poll interval in seconds, or 0 to derive it from the poll priority.
+	 */
+	void setPollInterval(unsigned int interval) { m_pollInterval = interval; }
+
 	/**
 	 * Set the poll priority suitable for resolving a @a Condition.
 	 */
@@ -273,7 +465,7 @@ public:
 	 * Return whether this @a Message depends on a @a Condition.
 	 * @return true when this @a Message depends on a @a Condition.
 	 */
-	bool isConditional() const { return m_condition!=NULL; }
+	bool isConditional() const { return m_definition->m_condition!=NULL; }
 
 	/**
 	 * Return whether this @a Message is available (optionally depending on a @a Condition evaluation).
@@ -281,6 +473,18 @@ public:
 	 */
 	bool isAvailable();
 
+	/**
+	 * Add a @a Condition to re-evaluate whenever the data of this @a Message changes.
+	 * @param condition the dependent @a Condition.
+	 */
+	void addDependentCondition(Condition* condition);
+
+	/**
+	 * Remove a @a Condition previously added by @a addDependentCondition().
+	 * @param condition the dependent @a Condition.
+	 */
+	void removeDependentCondition(Condition* condition);
+
 	/**
 	 * Return whether the field is available.
 	 * @param fieldName the name of the field to find, or NULL for any.
@@ -320,8 +524,34 @@ protected:
 	 */
 	virtual result_t prepareMasterPart(SymbolString& master, istringstream& input, char separator, unsigned char index);
 
+	/**
+	 * Get the @a PreparedMasters of this instance and allocate them if necessary.
+	 * @return the @a PreparedMasters of this instance.
+	 */
+	PreparedMasters* getPreparedMasters();
+
+	/**
+	 * Called with the index of a part when its master data was prepared (freshly or from the cache) and is about
+	 * to be stored.
+	 */
+	virtual void preparedMasterPart(unsigned char) {}
+
 public:
 
+	/**
+	 * Get the number of master telegrams that were taken from the cache by @a prepareMaster().
+	 * @return the number of master telegrams taken from the cache.
+	 */
+	unsigned int getPreparedHits() const;
+
+	/**
+	 * Encode the formatted value(s) to the unescaped slave data without updating the last seen data.
+	 * @param input the @a istringstream to parse the formatted value(s) from.
+	 * @param slave the empty unescaped slave data @a SymbolString for writing symbols to (including the length).
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	result_t encodeSlave(istringstream& input, SymbolString& slave) const;
+
 	/**
 	 * Prepare the slave @a SymbolString for sending an answer to the bus.
 	 * @param input the @a istringstream to parse the formatted value(s) from.
@@ -347,10 +577,18 @@ public:
 	 */
 	virtual result_t storeLastData(const PartType partType, SymbolString& data, unsigned char index);
 
+	/**
+	 * Take over the last seen data from the same @a Message of a previous configuration generation.
+	 * @param previous the @a Message of the previous generation.
+	 * @return true if the last seen data was taken over, false if the previous @a Message has no data or a different
+	 * number of parts.
+	 */
+	virtual bool takeLastData(Message& previous);
+
 	/**
 	 * Decode the value from the last stored data.
 	 * @param partType the @a PartType of the data.
-	 * @param output the @a ostringstream to append the formatted value to.
+	 * @param output the @a ostream to append the formatted value to.
 	 * @param outputFormat the @a OutputFormat options to use.
 	 * @param leadingSeparator whether to prepend a separator before the formatted value.
 	 * @param fieldName the optional name of a field to limit the output to.
@@ -358,19 +596,33 @@ public:
 	 * @return @a RESULT_OK on success, or an error code.
 	 */
 	virtual result_t decodeLastData(const PartType partType,
-			ostringstream& output, OutputFormat outputFormat=0,
+			ostream& output, OutputFormat outputFormat=0,
 			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1);
 
 	/**
 	 * Decode the value from the last stored data.
-	 * @param output the @a ostringstream to append the formatted value to.
+	 * @param output the @a ostream to append the formatted value to.
+	 * @param outputFormat the @a OutputFormat options to use.
+	 * @param leadingSeparator whether to prepend a separator before the formatted value.
+	 * @param fieldName the optional name of a field to limit the output to.
+	 * @param fieldIndex the optional index of the named field to limit the output to, or -1.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	virtual result_t decodeLastData(ostream& output, OutputFormat outputFormat=0,
+			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1);
+
+	/**
+	 * Decode the value from the specified data (e.g. from the @a DataHistory).
+	 * @param master the unescaped master @a SymbolString in the form stored as last data.
+	 * @param slave the unescaped slave @a SymbolString in the form stored as last data.
+	 * @param output the @a ostream to append the formatted value to.
 	 * @param outputFormat the @a OutputFormat options to use.
 	 * @param leadingSeparator whether to prepend a separator before the formatted value.
 	 * @param fieldName the optional name of a field to limit the output to.
 	 * @param fieldIndex the optional index of the named field to limit the output to, or -1.
 	 * @return @a RESULT_OK on success, or an error code.
 	 */
-	virtual result_t decodeLastData(ostringstream& output, OutputFormat outputFormat=0,
+	result_t decodeData(SymbolString& master, SymbolString& slave, ostream& output, OutputFormat outputFormat=0,
 			bool leadingSeparator=false, const char* fieldName=NULL, signed char fieldIndex=-1);
 
 	/**
@@ -406,6 +658,12 @@ public:
 	 */
 	time_t getLastChangeTime() { return m_lastChangeTime; }
 
+	/**
+	 * Get the number of times @a m_lastValue was changed so far.
+	 * @return the number of times @a m_lastValue was changed so far.
+	 */
+	unsigned int getChangeCount() const { return m_changeCount; }
+
 	/**
 	 * Get the time when this message was last polled for.
 	 * @return the time when this message was last polled for, or 0 for never.
@@ -413,11 +671,35 @@ public:
 	time_t getLastPollTime() { return m_lastPollTime; }
 
 	/**
-	 * Return whether this @a Message needs to be polled after the other one.
-	 * @param other the other @a Message to compare with.
-	 * @return true if this @a Message needs to be polled after the other one.
+	 * Get the number of times this message was already polled for.
+	 * @return the number of times this message was already polled for.
+	 */
+	unsigned int getPollCount() { return m_pollCount; }
+
+	/**
+	 * Get the learned average interval in seconds between two changes of the last data.
+	 * @return the learned average interval in seconds between two changes, or 0 if not known yet.
+	 */
+	time_t getChangeInterval() const { return m_changeInterval; }
+
+	/**
+	 * Get the maximum age of the last data derived from how often it changed so far.
+	 * @param defaultMaxAge the maximum age in seconds to use while the change interval is not known yet.
+	 * @return the maximum age in seconds for which the last data is considered up to date.
+	 */
+	time_t getAdaptiveMaxAge(const time_t defaultMaxAge) const;
+
+	/**
+	 * Keep a @a DataHistory of the changes of the last data from now on.
+	 * @param maxSegments the maximum number of @a HISTORY_SEGMENT_SIZE segments to keep.
+	 */
+	void enableHistory(const size_t maxSegments);
+
+	/**
+	 * Get the @a DataHistory of the changes of the last data.
+	 * @return the @a DataHistory, or NULL if not enabled.
 	 */
-	bool isLessPollWeight(const Message* other);
+	const DataHistory* getHistory() const { return m_history.get(); }
 
 	/**
 	 * Write the message definition or parts of it to the @a ostream.
@@ -437,21 +719,36 @@ protected:
 	 */
 	virtual void dumpColumn(ostream& output, size_t column, bool withConditions);
 
-	/** the optional circuit name. */
-	const string m_circuit;
+	/**
+	 * Re-evaluate all dependent @a Condition instances after the data changed.
+	 */
+	void updateDependentConditions();
 
-	/** the message name (unique within the same circuit and type). */
-	const string m_name;
+	/**
+	 * Record a change of the last data at @a m_lastUpdateTime and learn the change interval from it.
+	 */
+	void markChanged();
 
-	/** whether this is a write message. */
-	const bool m_isWrite;
+	/**
+	 * Add the last data to the @a DataHistory if it was changed since it was added last.
+	 */
+	void recordHistory();
 
-	/** true if message can only be initiated by a participant other than us,
-	 * false if message can be initiated by any participant. */
-	const bool m_isPassive;
+	/**
+	 * Calculate the key for storing in @a MessageMap (see @a m_key).
+	 * @param definition the @a MessageDefinition.
+	 * @param srcAddress the source address, or @a SYN for any (only relevant if passive).
+	 * @param dstAddress the destination address, or @a SYN for any.
+	 * @return the key.
+	 */
+	static unsigned long long calcKey(const MessageDefinition& definition,
+			const libebus::Address& srcAddress, const libebus::Address& dstAddress);
 
-	/** the comment. */
-	const string m_comment;
+	/** the immutable definition shared with all derived instances. */
+	const shared_ptr<const MessageDefinition> m_definition;
+
+	/** the optional circuit name. */
+	const InternedString m_circuit;
 
 	/** the source address, or @a SYN for any (only relevant if passive). */
 	const libebus::Address m_srcAddress;
@@ -459,9 +756,6 @@ protected:
 	/** the destination address, or @a SYN for any (only for temporary scan messages). */
 	const libebus::Address m_dstAddress;
 
-	/** the primary, secondary, and optionally further command ID bytes. */
-	vector<unsigned char> m_id;
-
 	/**
 	 * the key for storing in @a MessageMap.
 	 * <ul>
@@ -485,17 +779,17 @@ protected:
 	 */
 	unsigned long long m_key;
 
-	/** the @a DataField for encoding/decoding the message. */
-	shared_ptr<DataField> m_data;
-
 	/** the priority for polling, or 0 for no polling at all. */
 	unsigned char m_pollPriority = 0;
 
+	/** the explicitly set poll interval in seconds, or 0 to derive it from @a m_pollPriority. */
+	unsigned int m_pollInterval = 0;
+
 	/** whether this message is used by a @a Condition. */
 	bool m_usedByCondition = false;
 
-	/** the @a Condition for this message, or NULL. */
-	Condition* m_condition = nullptr;
+	/** the @a Condition instances to re-evaluate when the data of this message changes (in order of dependency). */
+	vector<Condition*> m_dependentConditions;
 
 	/** the last seen master data. */
 	SymbolString m_lastMasterData;
@@ -509,12 +803,39 @@ protected:
 	/** the system time when the message content was last changed, 0 for never. */
 	time_t m_lastChangeTime = 0;
 
+	/** the number of times the message content was changed so far. */
+	unsigned int m_changeCount = 0;
+
+	/** the moving average of the seconds between two changes of the message content, 0 if not known yet. */
+	time_t m_changeInterval = 0;
+
+	/** the @a DataHistory of the changes of the last data, or NULL. */
+	std::unique_ptr<DataHistory> m_history;
+
+	/** whether the last data was changed since it was last added to @a m_history. */
+	bool m_historyPending = false;
+
 	/** the number of times this messages was already polled for. */
 	unsigned int m_pollCount = 0;
 
 	/** the system time when this message was last polled for, 0 for never. */
 	time_t m_lastPollTime = 0;
 
+	/** whether this message is scheduled for polling in a @a MessageMap. */
+	bool m_pollScheduled = false;
+
+	/** the system time when this message is due to be polled next (only valid if @a m_pollScheduled). */
+	time_t m_nextPollTime = 0;
+
+	/** whether this message is queued for a single refresh in a @a MessageMap. */
+	bool m_refreshScheduled = false;
+
+	/** the @a ChangeJournal to record changes of the last data in, or NULL. */
+	ChangeJournal* m_changeJournal = nullptr;
+
+	/** the recently prepared master telegrams (owned), or NULL if none was prepared yet. */
+	std::atomic<PreparedMasters*> m_preparedMasters{nullptr};
+
 };
 
 
@@ -540,8 +861,8 @@ public:
 	 * @param pollPriority the priority for polling, or 0 for no polling at all.
 	 * @param condition the @a Condition for this message, or NULL.
 	 */
-	ChainedMessage(const string &circuit, const string &name,
-				   const bool isWrite, const string comment,
+	ChainedMessage(const InternedString& circuit, const InternedString& name,
+				   const bool isWrite, const InternedString& comment,
 				   const libebus::Address& srcAddress, const libebus::Address& dstAddress,
 				   const vector<unsigned char> &id,
 				   const vector<vector<unsigned char>> &ids, const vector<unsigned char> &lengths,
@@ -549,6 +870,18 @@ public:
 				   const unsigned char pollPriority,
 				   Condition *condition = NULL);
 
+	/**
+	 * Construct a new instance sharing an existing definition (e.g. for deriving).
+	 * @param definition the shared @a ChainedMessageDefinition.
+	 * @param circuit the optional circuit name.
+	 * @param srcAddress the source address, or @a SYN for any (only relevant if passive).
+	 * @param dstAddress the destination address, or @a SYN for any (set later).
+	 * @param pollPriority the priority for polling, or 0 for no polling at all.
+	 */
+	ChainedMessage(const shared_ptr<const ChainedMessageDefinition>& definition, const InternedString& circuit,
+				   const libebus::Address& srcAddress, const libebus::Address& dstAddress,
+				   const unsigned char pollPriority);
+
 	virtual ~ChainedMessage();
 
 	// @copydoc
@@ -556,7 +889,7 @@ public:
 									   const string circuit = "");
 
 	// @copydoc
-	virtual unsigned char getIdLength() const { return (unsigned char)(m_ids[0].size() - 2); }
+	virtual unsigned char getIdLength() const { return (unsigned char)(chain().m_ids[0].size() - 2); }
 
 	// @copydoc
 	virtual bool checkId(SymbolString& master, unsigned char* index=NULL);
@@ -565,13 +898,16 @@ public:
 	virtual bool checkId(Message& other);
 
 	// @copydoc
-	virtual unsigned char getCount() { return (unsigned char)m_ids.size(); }
+	virtual unsigned char getCount() { return (unsigned char)chain().m_ids.size(); }
 
 protected:
 
 	// @copydoc
 	virtual result_t prepareMasterPart(SymbolString& master, istringstream& input, char separator, unsigned char index);
 
+	// @copydoc
+	virtual void preparedMasterPart(unsigned char index);
+
 public:
 
 	// @copydoc
@@ -580,6 +916,9 @@ public:
 	// @copydoc
 	virtual result_t storeLastData(const PartType partType, SymbolString& data, unsigned char index);
 
+	// @copydoc
+	virtual bool takeLastData(Message& previous);
+
 protected:
 
 	// @copydoc
@@ -587,14 +926,19 @@ protected:
 
 private:
 
-	/** the primary, secondary, and optional further ID bytes for each part of the chain. */
-	const vector< vector<unsigned char> > m_ids;
-
-	/** the data length for each part of the chain. */
-	const vector<unsigned char> m_lengths;
+	/**
+	 * Get the shared @a ChainedMessageDefinition.
+	 * @return the shared @a ChainedMessageDefinition.
+	 */
+	const ChainedMessageDefinition& chain() const
+	{
+		return static_cast<const ChainedMessageDefinition&>(*m_definition);
+	}
 
-	/** the maximum allowed time difference of any data pair. */
-	const time_t m_maxTimeDiff;
+	/**
+	 * Allocate the per-instance data of each part of the chain.
+	 */
+	void initParts();
 
 	/** array of the last seen master datas. */
 	vector<shared_ptr<SymbolString>> m_lastMasterDatas;
@@ -612,47 +956,85 @@ private:
 
 
 /**
- * A function that compares the weighted poll priority of two @a Message instances.
+ * An append-only journal of changed @a Message instances.
+ *
+ * Each change of the last seen data of a @a Message is recorded with an
+ * increasing sequence number in a ring of @a CHANGE_JOURNAL_SIZE entries. A
+ * reader keeps the sequence number as cursor and only needs to look at the
+ * entries recorded since then.
  */
-struct compareMessagePriority : binary_function <shared_ptr<Message>,shared_ptr<Message>,bool> {
+class ChangeJournal
+{
+public:
+
 	/**
-	 * Compare the weighted poll priority of the two @a Message instances.
-	 * @param x the first @a Message.
-	 * @param y the second @a Message.
-	 * @return whether @a x is smaller than @a y with regard to their weighted poll priority.
+	 * Construct a new instance.
 	 */
-	bool operator() (shared_ptr<Message> x, shared_ptr<Message> y) const { return x->isLessPollWeight(y.get()); };
-};
+	ChangeJournal() {}
 
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	ChangeJournal(const ChangeJournal& src);
 
-/**
- * Helper class extending @a priority_queue to hold distinct values only.
- */
-class MessagePriorityQueue
-	: public priority_queue<shared_ptr<Message>, vector<shared_ptr<Message>>, compareMessagePriority>
-{
 public:
+
 	/**
-	 * Add data to the queue and ensure it is contained only once.
-	 * @param __x the element to add.
+	 * Record a change of the @a Message.
+	 * @param message the changed @a Message.
 	 */
-	void push(const value_type& __x)
-	{
-		for (auto it = c.begin(); it != c.end(); it++) {
-			if (*it==__x) {
-				c.erase(it);
-				break;
-			}
-		}
-		priority_queue<shared_ptr<Message>, vector<shared_ptr<Message>>, compareMessagePriority>::push(__x);
-	}
+	void add(Message* message);
+
+	/**
+	 * Get the cursor for reading changes recorded from now on.
+	 * @return the cursor for reading changes recorded from now on.
+	 */
+	unsigned long long getCursor();
+
+	/**
+	 * Get the @a Message instances changed since the cursor (each only once) and advance the cursor.
+	 * @param cursor the cursor from @a getCursor() or the previous call, updated to the cursor for the next call.
+	 * @param messages the @a vector to add the changed @a Message instances to.
+	 * @return true on success, false if changes since the cursor were already dropped from the ring.
+	 */
+	bool getChanges(unsigned long long& cursor, vector<Message*>& messages);
+
+	/**
+	 * Remove all entries (e.g. before the recorded @a Message instances get deleted).
+	 */
+	void clear();
+
+	/**
+	 * Continue the sequence numbers after those of the journal of a previous configuration generation,
+	 * so that all cursors of the previous journal are reported as dropped.
+	 * @param previous the @a ChangeJournal of the previous generation.
+	 */
+	void continueAfter(ChangeJournal& previous);
+
+private:
+
+	/** mutex for exclusive access to the entries. */
+	std::mutex m_mutex;
+
+	/** the ring of changed @a Message instances, indexed by sequence number. */
+	Message* m_entries[CHANGE_JOURNAL_SIZE];
+
+	/** the sequence number of the next entry. */
+	unsigned long long m_nextSequence = 0;
+
+	/** the sequence number of the oldest entry still available. */
+	unsigned long long m_firstSequence = 0;
+
 };
 
 
 /**
  * An abstract condition based on the value of one or more @a Message instances.
  */
-class Condition
+class Condition : public ArenaObject
 {
 public:
 	/**
@@ -701,18 +1083,26 @@ public:
 	virtual result_t resolve(MessageMap* messages, ostringstream& errorMessage) = 0;
 
 	/**
-	 * Check and return whether this condition is fulfilled.
+	 * Return whether this condition is fulfilled (as determined by the last @a update()).
 	 * @return whether this condition is fulfilled.
 	 */
-	virtual bool isTrue() = 0;
+	bool isTrue() const { return m_isTrue.load(std::memory_order_relaxed); }
 
-protected:
+	/**
+	 * Re-evaluate the condition (called whenever the data of a referred @a Message changed).
+	 */
+	virtual void update() = 0;
 
-	/** the system time when the condition was last checked, 0 for never. */
-	time_t m_lastCheckTime = 0;
+	/**
+	 * Add the referred @a Message instances (once each).
+	 * @param messages the vector to add the referred @a Message instances to.
+	 */
+	virtual void addMessages(vector<shared_ptr<Message>>& messages) = 0;
+
+protected:
 
-	/** whether the condition was @a true during the last check. */
-	bool m_isTrue = false;
+	/** whether the condition was @a true during the last @a update(). */
+	std::atomic<bool> m_isTrue{false};
 
 };
 
@@ -741,7 +1131,7 @@ public:
 	/**
 	 * Destructor.
 	 */
-	virtual ~SimpleCondition() {}
+	virtual ~SimpleCondition();
 
 	// @copydoc
 	virtual SimpleCondition* derive(string valueList);
@@ -761,7 +1151,10 @@ public:
 	virtual result_t resolve(MessageMap* messages, ostringstream& errorMessage);
 
 	// @copydoc
-	virtual bool isTrue();
+	virtual void update();
+
+	// @copydoc
+	virtual void addMessages(vector<shared_ptr<Message>>& messages);
 
 	/**
 	 * Return whether the condition is based on a numeric value.
@@ -903,7 +1296,7 @@ public:
 	/**
 	 * Destructor.
 	 */
-	virtual ~CombinedCondition() {}
+	virtual ~CombinedCondition();
 
 	// @copydoc
 	virtual void dump(ostream& output);
@@ -915,20 +1308,26 @@ public:
 	virtual result_t resolve(MessageMap* messages, ostringstream& errorMessage);
 
 	// @copydoc
-	virtual bool isTrue();
+	virtual void update();
+
+	// @copydoc
+	virtual void addMessages(vector<shared_ptr<Message>>& messages);
 
 private:
 
 	/** the @a Condition instances used. */
 	vector<Condition*> m_conditions;
 
+	/** the @a Message instances referred by @a m_conditions this instance was added to as dependent @a Condition. */
+	vector<shared_ptr<Message>> m_messages;
+
 };
 
 
 /**
  * An abstract instruction based on the value of one or more @a Message instances.
  */
-class Instruction
+class Instruction : public ArenaObject
 {
 public:
 
@@ -1048,6 +1447,52 @@ private:
 };
 
 
+/** the number of slots for unknown master data keys remembered by @a MessageMap (power of 2). */
+#define UNKNOWN_CACHE_SIZE 256
+
+/** the maximum number of ID bytes of master data remembered as unknown by @a MessageMap::find(). */
+#define UNKNOWN_CACHE_MAX_ID_LENGTH 8
+
+/**
+ * The integer key of master data remembered as unknown by @a MessageMap::find().
+ */
+struct UnknownKey
+{
+	/** the lookup flags, QQ, ZZ, PB, SB, and the ID length. */
+	unsigned long long m_head;
+
+	/** the ID bytes. */
+	unsigned long long m_id;
+
+	/**
+	 * Return the index of the @a UnknownSlot for this key.
+	 * @return the index of the @a UnknownSlot for this key.
+	 */
+	size_t getSlot() const
+	{
+		return static_cast<size_t>(((m_head * 0x9e3779b97f4a7c15ULL) ^ (m_id * 0xc2b2ae3d27d4eb4fULL)) >> 32)
+			& (UNKNOWN_CACHE_SIZE-1);
+	}
+};
+
+/**
+ * A slot of the direct mapped cache of unknown master data, read without locking.
+ */
+struct UnknownSlot
+{
+	/** the sequence number, odd while the slot is being written. */
+	std::atomic<unsigned int> m_sequence{0};
+
+	/** the cache generation the key was stored in (0 for never). */
+	std::atomic<unsigned int> m_generation{0};
+
+	/** the @a UnknownKey#m_head of the stored key. */
+	std::atomic<unsigned long long> m_head{0};
+
+	/** the @a UnknownKey#m_id of the stored key. */
+	std::atomic<unsigned long long> m_id{0};
+};
+
 /**
  * Holds a map of all known @a Message instances.
  */
@@ -1060,7 +1505,7 @@ public:
 	 * @param addAll whether to add all messages, even if duplicate.
 	 */
 	MessageMap(const bool addAll=false) : FileReader::FileReader(true),
-		m_addAll(addAll)
+		m_addAll(addAll), m_arena(ConfigArena::create())
 	{
 		m_scanMessage = make_shared<Message>("scan", "ident", false, false, 0x07, 0x04, DataFieldSet::getIdentFields());
 	}
@@ -1070,6 +1515,7 @@ public:
 	 */
 	virtual ~MessageMap() {
 		clear();
+		m_arena->release();
 	}
 
 	/**
@@ -1082,8 +1528,8 @@ public:
 	result_t add(shared_ptr<Message> message, bool storeByName=true);
 
 	// @copydoc
-	virtual result_t addDefaultFromFile(vector< vector<string> >& defaults, vector<string>& row,
-		vector<string>::iterator& begin, string defaultDest, string defaultCircuit, string defaultSuffix,
+	virtual result_t addDefaultFromFile(vector< vector<string> >& defaults, const vector<StringRef>& row,
+		size_t& column, string defaultDest, string defaultCircuit, string defaultSuffix,
 		const string& filename, unsigned int lineNo);
 
 	/**
@@ -1100,12 +1546,43 @@ public:
 		vector< vector<string> >* defaults, const string& defaultDest, const string& defaultCircuit, const string& defaultSuffix,
 		const string& filename, unsigned int lineNo);
 
+	/**
+	 * Read the definitions from a file.
+	 * All definitions are allocated from the @a ConfigArena of the current configuration generation.
+	 * @param filename the name of the file being read.
+	 * @param verbose whether to verbosely log problems.
+	 * @param defaultDest the default destination address (may be overwritten by file name), or empty.
+	 * @param defaultCircuit the default circuit name (may be overwritten by file name), or empty.
+	 * @param defaultSuffix the default circuit name suffix (starting with a ".", may be overwritten by file name, or empty.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	virtual result_t readFromFile(const string filename, bool verbose=false,
+		string defaultDest = "", string defaultCircuit = "", string defaultSuffix = "");
+
+	/**
+	 * Read the definitions from several files in parallel.
+	 * Each file is read by one of the worker threads into a separate staging instance and the staged definitions
+	 * are then added to this instance in the order of the files, so that problems are reported and duplicates are
+	 * rejected the same way as when calling @a readFromFile() for each file one after another.
+	 * @param filenames the names of the files to read.
+	 * @param verbose whether to verbosely log problems.
+	 * @param threads the maximum number of worker threads, or 0 for the number of available CPU cores.
+	 * @param readFunc the function to call right before the definitions of a file are added, or NULL.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	result_t readFromFiles(const vector<string>& filenames, bool verbose=false, unsigned int threads=0,
+		void (*readFunc)(const string& filename)=NULL);
+
+	// @copydoc
+	virtual ostream& getVerboseOutput();
+
 	/**
 	 * Get the scan @a Message instance for the specified address.
 	 * @param dstAddress the destination address, or @a SYN for the base scan @a Message.
-	 * @return the scan @a Message instance, or NULL if the dstAddress is no slave.
+	 * @param derive whether to derive and add the scan @a Message for the address if not yet available.
+	 * @return the scan @a Message instance, or NULL if the dstAddress is no slave or it was not derived yet.
 	 */
-	shared_ptr<Message> getScanMessage(const libebus::Address &dstAddress = SYN);
+	shared_ptr<Message> getScanMessage(const libebus::Address &dstAddress = SYN, const bool derive = true);
 
 	/**
 	 * Resolve all @a Condition instances.
@@ -1185,10 +1662,78 @@ public:
 	 * @param withPassive true to include passive messages (default true).
 	 * @return the @a Message instance, or NULL.
 	 * Note: the caller may not free the returned instance.
+	 * Note: master data without any matching key is remembered and answered directly on the next call.
 	 */
 	shared_ptr<Message> find(SymbolString& master, bool anyDestination=false,
 		const bool withRead=true, const bool withWrite=true, const bool withPassive=true);
 
+	/**
+	 * Find the @a Message instance for the specified master data like @a find(), but only reading the shared tables
+	 * (neither the cache of unknown master data nor any reference count is touched, e.g. for decoding in several threads).
+	 * @param master the master @a SymbolString for identifying the @a Message.
+	 * @param anyDestination true to only return messages without a particular destination.
+	 * @param withRead true to include read messages (default true).
+	 * @param withWrite true to include write messages (default true).
+	 * @param withPassive true to include passive messages (default true).
+	 * @return the @a Message instance, or NULL.
+	 * Note: the returned instance is only valid as long as this @a MessageMap is not modified.
+	 */
+	Message* findUncached(SymbolString& master, bool anyDestination=false,
+		const bool withRead=true, const bool withWrite=true, const bool withPassive=true);
+
+	/**
+	 * Forget all master data remembered as unknown by @a find().
+	 */
+	void invalidateUnknownCache();
+
+	/**
+	 * Get the number of @a find() calls answered from the cache of unknown master data.
+	 * @return the number of @a find() calls answered from the cache of unknown master data.
+	 */
+	unsigned long getUnknownCacheHits() { return m_unknownCacheHits.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the number of @a find() calls for master data without any matching key not answered from the cache.
+	 * @return the number of @a find() calls for master data without any matching key not answered from the cache.
+	 */
+	unsigned long getUnknownCacheMisses() { return m_unknownCacheMisses.load(std::memory_order_relaxed); }
+
+	/**
+	 * Set the number of @a DataHistory segments to keep for each @a Message added afterwards.
+	 * @param maxSegments the maximum number of @a HISTORY_SEGMENT_SIZE segments per @a Message, or 0 to disable.
+	 */
+	void setHistorySegments(const size_t maxSegments) { m_historySegments = maxSegments; }
+
+	/**
+	 * Get the number of @a DataHistory segments kept for each added @a Message.
+	 * @return the maximum number of @a HISTORY_SEGMENT_SIZE segments per @a Message, or 0 if disabled.
+	 */
+	size_t getHistorySegments() const { return m_historySegments; }
+
+	/**
+	 * Get the @a ChangeJournal recording changes of the @a Message instances stored by name.
+	 * @return the @a ChangeJournal.
+	 */
+	ChangeJournal& getChangeJournal() { return m_changeJournal; }
+
+	/**
+	 * Take over the last seen data of all @a Message instances with the same key, circuit, and name from a
+	 * previous configuration generation.
+	 * @param previous the @a MessageMap of the previous generation.
+	 * @return the number of @a Message instances that took over the last seen data.
+	 */
+	size_t takeLastData(MessageMap& previous);
+
+	/**
+	 * Add a derived @a Message instance for each @a Message of another instance, e.g. for another bus.
+	 * The derived instances share the immutable @a MessageDefinition (including the @a Condition, which is
+	 * therefore still evaluated on the source instances), but carry their own last seen data and polling state.
+	 * The source is kept alive for as long as the derived instances are in use here (until @a clear()).
+	 * @param source the @a MessageMap to derive the @a Message instances from.
+	 * @return the number of added @a Message instances.
+	 */
+	size_t deriveFrom(const shared_ptr<MessageMap>& source);
+
 	/**
 	 * Invalidate cached data of the @a Message and all other instances with a matching name key.
 	 * @param message the @a Message to invalidate.
@@ -1198,7 +1743,7 @@ public:
 	/**
 	 * Add a @a Message to the list of instances to poll.
 	 * @param message the @a Message to poll.
-	 * @param toFront whether to add the @a Message to the very front of the poll queue.
+	 * @param toFront whether to poll the @a Message before all others already due.
 	 */
 	void addPollMessage(shared_ptr<Message> message, bool toFront=false);
 
@@ -1225,18 +1770,45 @@ public:
 	 */
 	size_t sizePassive() { return m_passiveMessageCount; }
 
+	/**
+	 * Get the memory used by the definitions of the current configuration generation.
+	 * @param reserved true for the bytes reserved in chunks, false for the bytes allocated.
+	 * @return the number of bytes.
+	 */
+	size_t sizeArena(const bool reserved) { return reserved ? m_arena->getReservedSize() : m_arena->getAllocatedSize(); }
+
 	/**
 	 * Get the number of stored @a Message instances with a poll priority.
 	 * @return the the number of stored @a Message instances with a poll priority.
 	 */
-	size_t sizePoll() { return m_pollMessages.size(); }
+	size_t sizePoll() { return m_pollMessageCount; }
 
 	/**
-	 * Get the next @a Message to poll.
-	 * @return the next @a Message to poll, or NULL.
+	 * Get the next @a Message due to be polled and schedule it again after its poll interval.
+	 * @param now the current system time.
+	 * @return the next @a Message due to be polled, or NULL if none is due yet.
 	 * Note: the caller may not free the returned instance.
 	 */
-	shared_ptr<Message> getNextPoll();
+	shared_ptr<Message> getNextPoll(time_t now);
+
+	/**
+	 * Queue a @a Message for being read once in the background, e.g. after outdated data was returned.
+	 * @param message the @a Message to refresh.
+	 * @return true when queued, false when already queued or not readable.
+	 */
+	bool addRefreshMessage(shared_ptr<Message> message);
+
+	/**
+	 * Get the next @a Message queued for being refreshed.
+	 * @return the next @a Message queued for being refreshed, or NULL if none.
+	 */
+	shared_ptr<Message> getNextRefresh();
+
+	/**
+	 * Get the number of @a Message instances queued for being refreshed.
+	 * @return the number of @a Message instances queued for being refreshed.
+	 */
+	size_t sizeRefresh() { return m_refreshMessageCount; }
 
 	/**
 	 * Get the number of stored @a Condition instances.
@@ -1259,9 +1831,41 @@ public:
 
 private:
 
+	/**
+	 * Return whether the master data key was remembered as unknown in the current generation (without locking).
+	 * @param key the @a UnknownKey of the master data.
+	 * @param generation set to the current generation for passing to @a rememberUnknown().
+	 * @return whether the master data key was remembered as unknown.
+	 */
+	bool isUnknown(const UnknownKey& key, unsigned int& generation);
+
+	/**
+	 * Remember the master data key as unknown, replacing the key stored in the same slot.
+	 * @param key the @a UnknownKey of the master data.
+	 * @param generation the generation returned by @a isUnknown() before looking up the key.
+	 */
+	void rememberUnknown(const UnknownKey& key, const unsigned int generation);
+
+	/**
+	 * Find the entry of the @a Message instance for the specified master data in the key index.
+	 * @param master the master @a SymbolString for identifying the @a Message.
+	 * @param maxIdLength the maximum ID length to check.
+	 * @param anyDestination true to only return messages without a particular destination.
+	 * @param withRead true to include read messages.
+	 * @param withWrite true to include write messages.
+	 * @param withPassive true to include passive messages.
+	 * @param anyKey set to whether any key matched the master data (even if no @a Message was available).
+	 * @return the entry of the @a Message instance, or NULL.
+	 */
+	shared_ptr<Message>* findByKey(SymbolString& master, const unsigned char maxIdLength, bool anyDestination,
+		const bool withRead, const bool withWrite, const bool withPassive, bool& anyKey);
+
 	/** whether to add all messages, even if duplicate. */
 	const bool m_addAll;
 
+	/** the maximum number of @a DataHistory segments per added @a Message, or 0 to disable. */
+	size_t m_historySegments = 0;
+
 	/** the @a Message instance used for scanning. */
 	shared_ptr<Message> m_scanMessage;
 
@@ -1283,11 +1887,83 @@ private:
 	/** the known @a Message instances by lowercase circuit and name. */
 	map<string, vector<shared_ptr<Message>> > m_messagesByName;
 
+	/**
+	 * An entry of @a m_nameIndex.
+	 */
+	struct NameIndexEntry
+	{
+		/** the interned lowercase circuit name. */
+		InternedString m_circuit;
+
+		/** the interned lowercase message name. */
+		InternedString m_name;
+
+		/** the message type from the key in @a m_messagesByName ('P' for passive, 'W' for write, 'R' for read). */
+		char m_type;
+
+		/** the @a Message instances stored in @a m_messagesByName under this circuit and name. */
+		vector<shared_ptr<Message>>* m_messages;
+	};
+
+	/** mutex for building @a m_nameIndex. */
+	std::mutex m_nameIndexMutex;
+
+	/** whether @a m_nameIndex and the derived indexes reflect @a m_messagesByName. */
+	bool m_nameIndexValid = false;
+
+	/** the entries of @a m_messagesByName not starting with "-" in the same order. */
+	vector<NameIndexEntry> m_nameIndex;
+
+	/** the positions in @a m_nameIndex by interned lowercase circuit name (in ascending order). */
+	unordered_map<InternedString, vector<size_t>> m_nameIndexByCircuit;
+
+	/** the positions in @a m_nameIndex by interned lowercase message name (in ascending order). */
+	unordered_map<InternedString, vector<size_t>> m_nameIndexByName;
+
+	/**
+	 * Rebuild @a m_nameIndex and the derived indexes from @a m_messagesByName if necessary.
+	 * Note: @a m_nameIndexMutex has to be locked by the caller.
+	 */
+	void buildNameIndex();
+
 	/** the known @a Message instances by key. */
 	map<unsigned long long, vector<shared_ptr<Message>> > m_messagesByKey;
 
-	/** the known @a Message instances to poll, by priority. */
-	MessagePriorityQueue m_pollMessages;
+	/** the hash index of the entries in @a m_messagesByKey by key (for fast lookup of received telegrams). */
+	FlatIndex<vector<shared_ptr<Message>>*> m_messagesByKeyIndex;
+
+	/** the bit mask of available ID lengths by key prefix (source, ZZ, PB, SB) of the @a Message instances. */
+	FlatIndex<unsigned char> m_idLengthsByKeyPrefix;
+
+	/** the direct mapped cache of master data without any matching key (see @a find()). */
+	UnknownSlot m_unknownSlots[UNKNOWN_CACHE_SIZE];
+
+	/** the current generation of @a m_unknownSlots (incremented by @a invalidateUnknownCache()). */
+	std::atomic<unsigned int> m_unknownGeneration{1};
+
+	/** the number of @a find() calls answered from @a m_unknownSlots. */
+	std::atomic<unsigned long> m_unknownCacheHits{0};
+
+	/** the number of @a find() calls for master data without any matching key not answered from @a m_unknownSlots. */
+	std::atomic<unsigned long> m_unknownCacheMisses{0};
+
+	/** the @a ChangeJournal recording changes of the @a Message instances stored by name. */
+	ChangeJournal m_changeJournal;
+
+	/** the mutex for @a m_pollMessages and the poll schedule of the @a Message instances. */
+	std::mutex m_pollMutex;
+
+	/** the known @a Message instances to poll, by the time they are due (may contain outdated entries). */
+	TimingWheel<shared_ptr<Message>> m_pollMessages;
+
+	/** the number of distinct @a Message instances scheduled in @a m_pollMessages. */
+	std::atomic<size_t> m_pollMessageCount{0};
+
+	/** the @a Message instances queued for a single refresh (guarded by @a m_pollMutex). */
+	deque<shared_ptr<Message>> m_refreshMessages;
+
+	/** the number of @a Message instances in @a m_refreshMessages. */
+	std::atomic<size_t> m_refreshMessageCount{0};
 
 	/** the @a Condition instances by filename and condition name. */
 	map<string, Condition*> m_conditions;
@@ -1295,6 +1971,150 @@ private:
 	/** the list of @a Instruction instances by filename. */
 	map<string, vector<Instruction*> > m_instructions;
 
+	/**
+	 * An entry recorded by a staging instance (see @a readFromFiles()).
+	 */
+	struct StagedEntry
+	{
+		/** the line number in the file being read. */
+		unsigned int m_lineNo;
+
+		/** the verbose output to report, or empty. */
+		string m_output;
+
+		/** the key of the @a Condition added to @a m_conditions, or empty. */
+		string m_condition;
+
+		/** whether an @a Instruction was added to @a m_instructions. */
+		bool m_instruction;
+
+		/** the @a Message instances to add (created from the same type of the same row). */
+		vector<shared_ptr<Message>> m_messages;
+
+		/** the row the @a Message instances were created from (for reporting problems). */
+		vector<string> m_row;
+
+		/** the last error message at the time the @a Message instances were created. */
+		string m_lastError;
+	};
+
+	/** the @a ConfigArena holding the definitions of the current configuration generation (replaced by @a clear()). */
+	ConfigArena* m_arena;
+
+	/** the @a MessageMap the @a Message instances were derived from and whose @a Condition instances they use, or empty. */
+	shared_ptr<MessageMap> m_derivedSource;
+
+	/** whether to record the read definitions in @a m_staged instead of adding the @a Message instances directly. */
+	bool m_staging = false;
+
+	/** the line number of the row currently read while staging. */
+	unsigned int m_stagedLineNo = 0;
+
+	/** the verbose output not yet recorded in @a m_staged. */
+	ostringstream m_stagedOutput;
+
+	/** the entries recorded while staging in the order they were read. */
+	vector<StagedEntry> m_staged;
+
+	/**
+	 * Record a new entry in @a m_staged for the current row (after recording pending verbose output).
+	 * @return the new @a StagedEntry.
+	 */
+	StagedEntry& stage();
+
+	/**
+	 * Record the pending verbose output in @a m_staged.
+	 */
+	void flushStagedOutput();
+
+	/**
+	 * Add the entries recorded by a staging instance.
+	 * @param staged the staging instance (the transferred @a Condition and @a Instruction instances are removed from it).
+	 * @param filename the name of the file read by the staging instance.
+	 * @param verbose whether to verbosely log problems.
+	 * @param readResult the result of reading the file by the staging instance.
+	 * @return @a RESULT_OK on success, or an error code.
+	 */
+	result_t addStaged(MessageMap& staged, const string& filename, bool verbose, result_t readResult);
+
+};
+
+
+/**
+ * Holder of the current generation of a @a MessageMap for concurrent readers (read-copy-update).
+ *
+ * A new generation is completely built by the writer before it is published
+ * with an atomic pointer swap. Each reader keeps a snapshot of the generation
+ * it works on alive and only has to check the generation number for picking
+ * up a newly published one, so that a reload never blocks the readers.
+ */
+class MessageMapHolder
+{
+public:
+
+	/**
+	 * Constructor.
+	 * @param messages the initial @a MessageMap generation.
+	 */
+	explicit MessageMapHolder(shared_ptr<MessageMap> messages) : m_current(messages) {}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	MessageMapHolder(const MessageMapHolder& src);
+
+public:
+
+	/**
+	 * Get the current generation.
+	 * @return the current @a MessageMap generation.
+	 */
+	shared_ptr<MessageMap> get() const { return std::atomic_load(&m_current); }
+
+	/**
+	 * Get the number of the current generation.
+	 * @return the number of the current generation (starting with 0).
+	 */
+	unsigned int getGeneration() const { return m_generation.load(std::memory_order_acquire); }
+
+	/**
+	 * Update the snapshot of a reader if a new generation was published since.
+	 * @param snapshot the @a MessageMap snapshot of the reader to update.
+	 * @param generation the generation number of the snapshot to update.
+	 * @return true if the snapshot was updated, false if it is still current.
+	 */
+	bool refresh(shared_ptr<MessageMap>& snapshot, unsigned int& generation) const
+	{
+		unsigned int current = getGeneration();
+		if (snapshot && current == generation)
+			return false;
+		generation = current;
+		snapshot = get();
+		return true;
+	}
+
+	/**
+	 * Publish a new generation.
+	 * @param messages the completely built @a MessageMap generation to publish.
+	 * @return the number of the published generation.
+	 */
+	unsigned int publish(shared_ptr<MessageMap> messages)
+	{
+		std::atomic_store(&m_current, messages);
+		return m_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+	}
+
+private:
+
+	/** the current @a MessageMap generation (only accessed atomically). */
+	shared_ptr<MessageMap> m_current;
+
+	/** the number of the current generation. */
+	std::atomic<unsigned int> m_generation{0};
+
 };
 
 #endif // LIBEBUS_MESSAGE_H_
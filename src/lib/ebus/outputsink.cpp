@@ -0,0 +1,123 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "outputsink.h"
+#include <cstring>
+
+char* formatUnsigned(char* end, unsigned long long value)
+{
+	do {
+		*--end = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+	return end;
+}
+
+char* formatSigned(char* end, long long value)
+{
+	if (value >= 0)
+		return formatUnsigned(end, (unsigned long long)value);
+	end = formatUnsigned(end, 0ULL - (unsigned long long)value);
+	*--end = '-';
+	return end;
+}
+
+void writeUnsigned(ostream& output, unsigned long long value)
+{
+	char buffer[FORMAT_NUMBER_MAX];
+	char* end = buffer + sizeof(buffer);
+	char* begin = formatUnsigned(end, value);
+	output.write(begin, end - begin);
+}
+
+void writeSigned(ostream& output, long long value)
+{
+	char buffer[FORMAT_NUMBER_MAX];
+	char* end = buffer + sizeof(buffer);
+	char* begin = formatSigned(end, value);
+	output.write(begin, end - begin);
+}
+
+
+OutputBuffer::OutputBuffer()
+	: m_data(OUTPUTBUFFER_INITIAL_SIZE)
+{
+	clear();
+}
+
+void OutputBuffer::truncate(const size_t size)
+{
+	if (size >= this->size())
+		return;
+	setp(m_data.data(), m_data.data() + m_data.size());
+	pbump((int)size);
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type ch)
+{
+	if (traits_type::eq_int_type(ch, traits_type::eof()))
+		return traits_type::not_eof(ch);
+	grow(1);
+	*pptr() = traits_type::to_char_type(ch);
+	pbump(1);
+	return ch;
+}
+
+std::streamsize OutputBuffer::xsputn(const char* str, std::streamsize count)
+{
+	if (count <= 0)
+		return 0;
+	if (epptr() - pptr() < count)
+		grow((size_t)count);
+	memcpy(pptr(), str, (size_t)count);
+	pbump((int)count);
+	return count;
+}
+
+OutputBuffer::pos_type OutputBuffer::seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+	if (offset != 0 || dir != std::ios_base::cur || (which & std::ios_base::out) == 0)
+		return pos_type(off_type(-1));
+	return pos_type((off_type)size());
+}
+
+void OutputBuffer::grow(const size_t count)
+{
+	size_t used = size();
+	size_t capacity = m_data.size();
+	while (capacity - used < count)
+		capacity *= 2;
+	m_data.resize(capacity);
+	setp(m_data.data(), m_data.data() + capacity);
+	pbump((int)used);
+}
+
+
+void OutputSink::reset()
+{
+	m_buffer.clear();
+	clear();
+	flags(std::ios_base::skipws | std::ios_base::dec);
+	width(0);
+	precision(6);
+	fill(' ');
+}
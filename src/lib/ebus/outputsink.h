@@ -0,0 +1,221 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBEBUS_OUTPUTSINK_H_
+#define LIBEBUS_OUTPUTSINK_H_
+
+#include <streambuf>
+#include <ostream>
+#include <vector>
+#include "cppconfig.h"
+
+/** @file outputsink.h
+ * Classes for formatting output into a single reusable buffer.
+ *
+ * An @a OutputSink is an @a ostream that appends to a growable @a OutputBuffer
+ * instead of an internal string, so that the formatted text can be inspected
+ * (@a data(), @a size()), truncated, and reused for the next request without
+ * copying and without giving back the allocated memory.
+ *
+ * The @a formatUnsigned() and @a formatSigned() functions are used for
+ * writing plain integers without going through the locale aware number
+ * formatting of the stream.
+ */
+
+/** the initial capacity of an @a OutputBuffer in bytes. */
+#define OUTPUTBUFFER_INITIAL_SIZE 1024
+
+/** the maximum number of characters produced by @a formatSigned(). */
+#define FORMAT_NUMBER_MAX 21
+
+/**
+ * Format an unsigned integer in decimal.
+ * @param end the pointer to the end of the buffer to fill backwards.
+ * @param value the value to format.
+ * @return the pointer to the first character written.
+ */
+char* formatUnsigned(char* end, unsigned long long value);
+
+/**
+ * Format a signed integer in decimal.
+ * @param end the pointer to the end of the buffer to fill backwards (with room for @a FORMAT_NUMBER_MAX characters).
+ * @param value the value to format.
+ * @return the pointer to the first character written.
+ */
+char* formatSigned(char* end, long long value);
+
+/**
+ * Write an unsigned integer in decimal to the @a ostream (ignoring width, fill, and base).
+ * @param output the @a ostream to write to.
+ * @param value the value to write.
+ */
+void writeUnsigned(ostream& output, unsigned long long value);
+
+/**
+ * Write a signed integer in decimal to the @a ostream (ignoring width, fill, and base).
+ * @param output the @a ostream to write to.
+ * @param value the value to write.
+ */
+void writeSigned(ostream& output, long long value);
+
+
+/**
+ * A growable @a streambuf keeping its memory when cleared.
+ */
+class OutputBuffer : public std::streambuf
+{
+public:
+
+	/**
+	 * Construct a new instance.
+	 */
+	OutputBuffer();
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~OutputBuffer() {}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	OutputBuffer(const OutputBuffer& src);
+
+public:
+
+	/**
+	 * Get the written characters (not null terminated).
+	 * @return the pointer to the written characters.
+	 */
+	const char* data() const { return pbase(); }
+
+	/**
+	 * Get the number of written characters.
+	 * @return the number of written characters.
+	 */
+	size_t size() const { return (size_t)(pptr() - pbase()); }
+
+	/**
+	 * Remove all written characters while keeping the allocated memory.
+	 */
+	void clear() { setp(m_data.data(), m_data.data() + m_data.size()); }
+
+	/**
+	 * Remove the written characters after the specified size.
+	 * @param size the number of written characters to keep.
+	 */
+	void truncate(const size_t size);
+
+protected:
+
+	// @copydoc
+	virtual int_type overflow(int_type ch);
+
+	// @copydoc
+	virtual std::streamsize xsputn(const char* str, std::streamsize count);
+
+	// @copydoc
+	virtual pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which);
+
+private:
+
+	/**
+	 * Grow the allocated memory to hold at least the specified additional number of characters.
+	 * @param count the number of additional characters.
+	 */
+	void grow(const size_t count);
+
+	/** the allocated memory. */
+	vector<char> m_data;
+
+};
+
+
+/**
+ * An @a ostream writing to an @a OutputBuffer.
+ */
+class OutputSink : public ostream
+{
+public:
+
+	/**
+	 * Construct a new instance.
+	 */
+	OutputSink() : ostream(NULL) { rdbuf(&m_buffer); }
+
+	/**
+	 * Destructor.
+	 */
+	virtual ~OutputSink() {}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	OutputSink(const OutputSink& src);
+
+public:
+
+	/**
+	 * Remove all written characters and reset the stream state and format flags.
+	 */
+	void reset();
+
+	/**
+	 * Get the written characters (not null terminated).
+	 * @return the pointer to the written characters.
+	 */
+	const char* data() const { return m_buffer.data(); }
+
+	/**
+	 * Get the number of written characters.
+	 * @return the number of written characters.
+	 */
+	size_t size() const { return m_buffer.size(); }
+
+	/**
+	 * Remove the written characters after the specified size.
+	 * @param size the number of written characters to keep.
+	 */
+	void truncate(const size_t size) { m_buffer.truncate(size); }
+
+	/**
+	 * Get a copy of the written characters.
+	 * @return the written characters as string.
+	 */
+	string str() const { return string(data(), size()); }
+
+	/**
+	 * Append the written characters to a string.
+	 * @param str the string to append to.
+	 */
+	void appendTo(string& str) const { str.append(data(), size()); }
+
+private:
+
+	/** the @a OutputBuffer to write to. */
+	OutputBuffer m_buffer;
+
+};
+
+#endif // LIBEBUS_OUTPUTSINK_H_
@@ -0,0 +1,252 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "stringpool.h"
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+
+const string InternedString::s_empty;
+
+/**
+ * The process wide pool of @a InternedString entries.
+ */
+class StringPool
+{
+public:
+
+	/** the entry type. */
+	typedef InternedString::Entry Entry;
+
+	/**
+	 * Get the pool (intentionally never destroyed as static definitions may outlive it otherwise).
+	 * @return the pool.
+	 */
+	static StringPool* getPool()
+	{
+		static StringPool* pool = new StringPool();
+		return pool;
+	}
+
+	/**
+	 * Find or add the entry for a string.
+	 * @param value the non-empty string.
+	 * @return the retained entry.
+	 */
+	Entry* intern(const string& value)
+	{
+		size_t hash = std::hash<string>()(value);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return internLocked(value, hash, true);
+	}
+
+	/**
+	 * Find the entry for a string without adding it.
+	 * @param value the non-empty string.
+	 * @return the retained entry, or NULL if not found.
+	 */
+	Entry* find(const string& value)
+	{
+		size_t hash = std::hash<string>()(value);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return internLocked(value, hash, false);
+	}
+
+	/**
+	 * Remove a reference from the entry (possibly the last one).
+	 * @param entry the entry.
+	 */
+	void release(Entry* entry)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		releaseLocked(entry);
+	}
+
+	/**
+	 * Get the statistics of the pool.
+	 * @param stats the @a StringPoolStats to fill.
+	 */
+	void getStats(StringPoolStats& stats)
+	{
+		static const size_t localCapacity = string().capacity();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		stats.m_strings = m_entries.size();
+		stats.m_references = 0;
+		stats.m_bytes = 0;
+		size_t separate = 0;
+		for (const auto& it : m_entries) {
+			const Entry* entry = it.second;
+			size_t refs = entry->m_refs.load(std::memory_order_relaxed) - entry->m_links;
+			size_t heap = entry->m_value.capacity() > localCapacity ? entry->m_value.capacity() + 1 : 0;
+			stats.m_references += refs;
+			stats.m_bytes += sizeof(Entry) + heap + sizeof(Key) + 2 * sizeof(void*);
+			separate += refs * (sizeof(string) + heap - sizeof(InternedString));
+		}
+		stats.m_bytes += m_entries.bucket_count() * sizeof(void*);
+		stats.m_savedBytes = separate > stats.m_bytes ? separate - stats.m_bytes : 0;
+	}
+
+private:
+
+	/**
+	 * The key of an entry in the pool referring to the string of the entry.
+	 */
+	struct Key
+	{
+		/** the string. */
+		const string* m_value;
+
+		/** the precomputed hash of the string. */
+		size_t m_hash;
+	};
+
+	/**
+	 * The hash function for a @a Key.
+	 */
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const { return key.m_hash; }
+	};
+
+	/**
+	 * The equality function for a @a Key.
+	 */
+	struct KeyEqual
+	{
+		bool operator()(const Key& left, const Key& right) const { return *left.m_value == *right.m_value; }
+	};
+
+	/**
+	 * Construct the pool.
+	 */
+	StringPool() {}
+
+	/**
+	 * Find or add the entry for a string.
+	 * Note: @a m_mutex has to be locked by the caller.
+	 * @param value the non-empty string.
+	 * @param hash the hash of the string.
+	 * @param add whether to add the string if it is not in the pool yet.
+	 * @return the retained entry, or NULL if not found and not added.
+	 */
+	Entry* internLocked(const string& value, const size_t hash, const bool add)
+	{
+		auto it = m_entries.find(Key{&value, hash});
+		if (it != m_entries.end()) {
+			it->second->m_refs.fetch_add(1, std::memory_order_relaxed);
+			return it->second;
+		}
+		if (!add)
+			return NULL;
+		Entry* entry = new Entry(value, hash);
+		m_entries[Key{&entry->m_value, hash}] = entry;
+		string lower = value;
+		std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+		if (lower != value) {
+			entry->m_lower = internLocked(lower, std::hash<string>()(lower), true);
+			entry->m_lower->m_links++;
+		}
+		return entry;
+	}
+
+	/**
+	 * Remove a reference from the entry and delete it when it was the last one.
+	 * Note: @a m_mutex has to be locked by the caller.
+	 * @param entry the entry.
+	 */
+	void releaseLocked(Entry* entry)
+	{
+		if (entry->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+		m_entries.erase(Key{&entry->m_value, entry->m_hash});
+		Entry* lower = entry->m_lower;
+		delete entry;
+		if (lower != entry) {
+			lower->m_links--;
+			releaseLocked(lower);
+		}
+	}
+
+	/** the mutex for accessing @a m_entries and for removing the last reference to an entry. */
+	std::mutex m_mutex;
+
+	/** the entries by string. */
+	unordered_map<Key, Entry*, KeyHash, KeyEqual> m_entries;
+};
+
+
+InternedString::InternedString(const string& value)
+	: m_entry(value.empty() ? NULL : StringPool::getPool()->intern(value))
+{
+}
+
+InternedString::InternedString(const char* value)
+	: InternedString(string(value))
+{
+}
+
+InternedString& InternedString::operator=(const InternedString& src)
+{
+	if (src.m_entry != m_entry) {
+		retain(src.m_entry);
+		release(m_entry);
+		m_entry = src.m_entry;
+	}
+	return *this;
+}
+
+InternedString& InternedString::operator=(InternedString&& src) noexcept
+{
+	if (this != &src) {
+		release(m_entry);
+		m_entry = src.m_entry;
+		src.m_entry = NULL;
+	}
+	return *this;
+}
+
+bool InternedString::find(const string& value, InternedString& result)
+{
+	Entry* entry = value.empty() ? NULL : StringPool::getPool()->find(value);
+	if (entry == NULL && !value.empty())
+		return false;
+	release(result.m_entry);
+	result.m_entry = entry;
+	return true;
+}
+
+void InternedString::getStats(StringPoolStats& stats)
+{
+	StringPool::getPool()->getStats(stats);
+}
+
+void InternedString::release(Entry* entry)
+{
+	if (entry == NULL)
+		return;
+	// only the last reference needs the pool lock, as it races with finding the entry
+	size_t refs = entry->m_refs.load(std::memory_order_relaxed);
+	while (refs > 1) {
+		if (entry->m_refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel))
+			return;
+	}
+	StringPool::getPool()->release(entry);
+}
@@ -0,0 +1,313 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBEBUS_STRINGPOOL_H_
+#define LIBEBUS_STRINGPOOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include "cppconfig.h"
+
+/** @file stringpool.h
+ * Interned strings for the definitions read from the configuration files.
+ *
+ * The circuit, name, comment and unit of the message and field definitions
+ * repeat a lot, especially for the per-address instances derived from a
+ * single definition. An @a InternedString is a single pointer to a shared
+ * immutable entry in a process wide pool that carries the string with its
+ * precomputed hash and the interned lowercase form, so that equal strings
+ * share their storage and comparing them (case sensitive or not) only needs
+ * to compare the entry pointers.
+ */
+
+/**
+ * The statistics of the string pool.
+ */
+struct StringPoolStats
+{
+	/** the number of distinct strings in the pool. */
+	size_t m_strings;
+
+	/** the number of references to the strings (excluding the pool internal ones). */
+	size_t m_references;
+
+	/** the number of bytes used by the pool. */
+	size_t m_bytes;
+
+	/** the number of bytes saved compared to a separate @a string per reference. */
+	size_t m_savedBytes;
+};
+
+/**
+ * A reference counted handle to an immutable string in the pool.
+ */
+class InternedString
+{
+public:
+
+	/**
+	 * Construct a new instance for the empty string.
+	 */
+	InternedString() : m_entry(NULL) {}
+
+	/**
+	 * Construct a new instance.
+	 * @param value the string to intern.
+	 */
+	InternedString(const string& value); // NOLINT(runtime/explicit)
+
+	/**
+	 * Construct a new instance.
+	 * @param value the string to intern.
+	 */
+	InternedString(const char* value); // NOLINT(runtime/explicit)
+
+	/**
+	 * Copy constructor.
+	 * @param src the object to copy from.
+	 */
+	InternedString(const InternedString& src) : m_entry(src.m_entry) { retain(m_entry); }
+
+	/**
+	 * Move constructor.
+	 * @param src the object to move from.
+	 */
+	InternedString(InternedString&& src) noexcept : m_entry(src.m_entry) { src.m_entry = NULL; }
+
+	/**
+	 * Destructor.
+	 */
+	~InternedString() { release(m_entry); }
+
+	/**
+	 * Assignment operator.
+	 * @param src the object to copy from.
+	 * @return this object.
+	 */
+	InternedString& operator=(const InternedString& src);
+
+	/**
+	 * Move assignment operator.
+	 * @param src the object to move from.
+	 * @return this object.
+	 */
+	InternedString& operator=(InternedString&& src) noexcept;
+
+	/**
+	 * Get the interned string.
+	 * @return the interned string.
+	 */
+	const string& str() const { return m_entry ? m_entry->m_value : s_empty; }
+
+	/**
+	 * Get the interned string.
+	 * @return the interned string.
+	 */
+	operator const string&() const { return str(); }
+
+	/**
+	 * Get the interned lowercase form of the string.
+	 * @return the interned lowercase form of the string.
+	 */
+	InternedString lower() const { return m_entry ? InternedString(m_entry->m_lower) : InternedString(); }
+
+	/**
+	 * Get the identifier of the lowercase form of the string for fast case insensitive comparisons.
+	 * @return the identifier of the lowercase form of the string (equal for strings only differing in case).
+	 */
+	const void* getLowerId() const { return m_entry ? m_entry->m_lower : NULL; }
+
+	/**
+	 * Get the precomputed hash of the string.
+	 * @return the precomputed hash of the string.
+	 */
+	size_t getHash() const { return m_entry ? m_entry->m_hash : 0; }
+
+	/**
+	 * Return whether the string is empty.
+	 * @return whether the string is empty.
+	 */
+	bool empty() const { return m_entry == NULL; }
+
+	/**
+	 * Get the length of the string.
+	 * @return the length of the string.
+	 */
+	size_t length() const { return str().length(); }
+
+	/**
+	 * Compare two interned strings.
+	 * @param other the other interned string.
+	 * @return whether both strings are equal.
+	 */
+	bool operator==(const InternedString& other) const { return m_entry == other.m_entry; }
+
+	/**
+	 * Compare two interned strings.
+	 * @param other the other interned string.
+	 * @return whether both strings differ.
+	 */
+	bool operator!=(const InternedString& other) const { return m_entry != other.m_entry; }
+
+	/**
+	 * Find an already interned string without adding it to the pool.
+	 * @param value the string to find.
+	 * @param result the variable in which to store the interned string.
+	 * @return true when the string was found (or is empty), false otherwise.
+	 */
+	static bool find(const string& value, InternedString& result);
+
+	/**
+	 * Get the statistics of the string pool.
+	 * @param stats the @a StringPoolStats to fill.
+	 */
+	static void getStats(StringPoolStats& stats);
+
+private:
+
+	/**
+	 * An interned string in the pool.
+	 */
+	struct Entry
+	{
+		/** the string value. */
+		const string m_value;
+
+		/** the precomputed hash of @a m_value. */
+		const size_t m_hash;
+
+		/** the entry of the lowercase form of @a m_value (this entry if it is lowercase already). */
+		Entry* m_lower;
+
+		/** the number of references to this entry. */
+		std::atomic<size_t> m_refs;
+
+		/** the number of references from other entries (@a m_lower). */
+		size_t m_links;
+
+		/**
+		 * Construct a new entry.
+		 * @param value the string value.
+		 * @param hash the precomputed hash of the value.
+		 */
+		Entry(const string& value, const size_t hash)
+			: m_value(value), m_hash(hash), m_lower(this), m_refs(1), m_links(0) {}
+	};
+
+	/**
+	 * Construct a new instance from an entry that was already retained.
+	 * @param entry the retained entry.
+	 */
+	explicit InternedString(Entry* entry) : m_entry(entry) { retain(m_entry); }
+
+	/**
+	 * Add a reference to the entry.
+	 * @param entry the entry, or NULL.
+	 */
+	static void retain(Entry* entry)
+	{
+		if (entry)
+			entry->m_refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Remove a reference from the entry and remove it from the pool when it was the last one.
+	 * @param entry the entry, or NULL.
+	 */
+	static void release(Entry* entry);
+
+	/** the empty string. */
+	static const string s_empty;
+
+	/** the entry in the pool, or NULL for the empty string. */
+	Entry* m_entry;
+
+	friend class StringPool;
+};
+
+/**
+ * Compare an interned string with a string.
+ * @param left the interned string.
+ * @param right the string.
+ * @return whether both strings are equal.
+ */
+inline bool operator==(const InternedString& left, const string& right) { return left.str() == right; }
+
+/**
+ * Compare an interned string with a string.
+ * @param left the interned string.
+ * @param right the string.
+ * @return whether both strings differ.
+ */
+inline bool operator!=(const InternedString& left, const string& right) { return left.str() != right; }
+
+/**
+ * Compare a string with an interned string.
+ * @param left the string.
+ * @param right the interned string.
+ * @return whether both strings are equal.
+ */
+inline bool operator==(const string& left, const InternedString& right) { return left == right.str(); }
+
+/**
+ * Compare a string with an interned string.
+ * @param left the string.
+ * @param right the interned string.
+ * @return whether both strings differ.
+ */
+inline bool operator!=(const string& left, const InternedString& right) { return left != right.str(); }
+
+/**
+ * Compare an interned string with a C string.
+ * @param left the interned string.
+ * @param right the C string.
+ * @return whether both strings are equal.
+ */
+inline bool operator==(const InternedString& left, const char* right) { return left.str() == right; }
+
+/**
+ * Compare an interned string with a C string.
+ * @param left the interned string.
+ * @param right the C string.
+ * @return whether both strings differ.
+ */
+inline bool operator!=(const InternedString& left, const char* right) { return left.str() != right; }
+
+/**
+ * Write an interned string to an @a ostream.
+ * @param stream the @a ostream to write to.
+ * @param value the interned string.
+ * @return the @a ostream.
+ */
+inline ostream& operator<<(ostream& stream, const InternedString& value) { return stream << value.str(); }
+
+namespace std {
+
+/**
+ * The hash of an @a InternedString using the precomputed hash.
+ */
+template <>
+struct hash<InternedString>
+{
+	size_t operator()(const InternedString& value) const { return value.getHash(); }
+};
+
+}  // namespace std
+
+#endif // LIBEBUS_STRINGPOOL_H_
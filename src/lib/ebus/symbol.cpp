@@ -18,7 +18,6 @@
 
 #include "symbol.h"
 
-using std::stringstream;
 
 /**
  * CRC8 lookup table for the polynom 0x9b = x^8 + x^7 + x^4 + x^3 + x^1 + 1.
@@ -44,91 +43,233 @@ static const unsigned char CRC_LOOKUP_TABLE[] =
 };
 
 
+/**
+ * The CRC8 lookup tables for processing multiple symbols at once (slicing).
+ * Since the CRC is linear, the CRC after N symbols is the XOR of the initial CRC
+ * shifted N times and each symbol shifted by its distance to the end.
+ */
+static const struct CrcSliceTables
+{
+	/**
+	 * Construct the tables from @a CRC_LOOKUP_TABLE.
+	 */
+	CrcSliceTables()
+	{
+		for (int value = 0; value < 256; value++) {
+			m_tables[0][value] = CRC_LOOKUP_TABLE[value];
+			for (int n = 1; n < 4; n++)
+				m_tables[n][value] = CRC_LOOKUP_TABLE[m_tables[n-1][value]];
+		}
+	}
+
+	/** the lookup table for applying the CRC shift 1 to 4 times (index 0 to 3). */
+	unsigned char m_tables[4][256];
+} CRC_SLICE_TABLES;
+
+SymbolString& SymbolString::operator=(const SymbolString& str)
+{
+	if (this == &str)
+		return *this;
+	if (str.m_size > m_capacity)
+		reserve(str.m_size);
+	memcpy(data(), str.data(), str.m_size);
+	m_size = str.m_size;
+	m_unescapeState = str.m_unescapeState;
+	m_crc = str.m_crc;
+	return *this;
+}
+
+SymbolString& SymbolString::operator=(SymbolString&& str)
+{
+	if (this == &str)
+		return *this;
+	if (str.m_heapData) {
+		delete[] m_heapData;
+		m_heapData = str.m_heapData;
+		m_capacity = str.m_capacity;
+		str.m_heapData = NULL;
+		str.m_capacity = SYMBOL_INLINE_SIZE;
+	} else {
+		memcpy(data(), str.m_inlineData, str.m_size); // fits in any capacity
+	}
+	m_size = str.m_size;
+	m_unescapeState = str.m_unescapeState;
+	m_crc = str.m_crc;
+	str.m_size = 0;
+	str.m_crc = 0;
+	return *this;
+}
+
+void SymbolString::reserve(const size_t capacity)
+{
+	if (capacity <= m_capacity)
+		return;
+	unsigned char* heapData = new unsigned char[capacity];
+	memcpy(heapData, data(), m_size);
+	delete[] m_heapData;
+	m_heapData = heapData;
+	m_capacity = capacity;
+}
+
+void SymbolString::resize(const size_t size)
+{
+	if (size > m_capacity)
+		reserve(size > m_capacity*2 ? size : m_capacity*2);
+	if (size > m_size)
+		memset(data()+m_size, 0, size-m_size);
+	m_size = size;
+}
+
 void SymbolString::addAll(const SymbolString& str)
 {
 	bool addCrc = (m_unescapeState == 0);
 	bool isEscaped = (str.m_unescapeState == 0);
 
-	for (auto& d : str.m_data) {
-		push_back(d, isEscaped, addCrc);
+	const unsigned char* data = str.data();
+	for (size_t i = 0; i < str.m_size; i++) {
+		push_back(data[i], isEscaped, addCrc);
 	}
 
 	if (addCrc)
 		push_back(m_crc, false, false); // add CRC
 }
 
+/**
+ * Parse a single hex digit.
+ * @param ch the hex digit character.
+ * @return the value of the hex digit, or -1 if invalid.
+ */
+static int parseHexDigit(const char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
 result_t SymbolString::parseHex(const string& str, const bool isEscaped)
 {
 	bool addCrc = m_unescapeState == 0;
-	try {
-
-		for (size_t i = 0; i < str.size(); i += 2) {
-			auto value = std::stoul(str.substr(i, 2), 0, 16);
-			push_back((unsigned char) value, isEscaped, addCrc);
+	unsigned char values[32];
+	const char* hex = str.c_str();
+	size_t remain = str.size();
+	while (remain > 0) {
+		// parse the next chunk of values
+		size_t count = 0;
+		for (; remain > 0 && count < sizeof(values); count++) {
+			int high = parseHexDigit(*hex++);
+			int low = 0;
+			if (remain == 1) { // single trailing digit
+				low = high;
+				high = 0;
+				remain--;
+			} else {
+				low = parseHexDigit(*hex++);
+				remain -= 2;
+			}
+			if (high < 0 || low < 0)
+				return RESULT_ERR_INVALID_NUM;
+			values[count] = (unsigned char)((high << 4) | low);
 		}
-
-		if (addCrc)
-			push_back(m_crc, false, false); // add CRC
-	}
-	catch(const std::exception& e)
-	{
-		return RESULT_ERR_INVALID_NUM;
+		if (!addCrc) {
+			for (size_t i = 0; i < count; i++)
+				push_back(values[i], isEscaped, false);
+			continue;
+		}
+		// escaped instance: store the symbols and update the CRC in bulk
+		reserve(m_size + (isEscaped ? count : count*2));
+		if (isEscaped) {
+			memcpy(data()+m_size, values, count);
+			m_size += count;
+		} else {
+			for (size_t i = 0; i < count; i++) {
+				auto value = values[i];
+				if (value == ESC || value == SYN) {
+					append(ESC);
+					append(value == ESC ? 0x00 : 0x01);
+				} else
+					append(value);
+			}
+		}
+		addCRC(values, count, !isEscaped);
 	}
+	if (addCrc)
+		push_back(m_crc, false, false); // add CRC
 
 	return RESULT_OK;
 }
 
-string SymbolString::getDataStr(const bool unescape, const bool skipLastSymbol)
+/** the lowercase hex digits. */
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+string SymbolString::getDataStr(const bool unescape, const bool skipLastSymbol) const
 {
-	stringstream sstr;
-	bool previousEscape = false;
+	string str(m_size*2+1, '\0');
+	size_t length = getDataStr(&str[0], str.size(), unescape, skipLastSymbol);
+	str.resize(length);
+	return str;
+}
 
-	for (size_t i = 0; i < m_data.size(); i++) {
-		auto value = m_data[i];
+size_t SymbolString::getDataStr(char* buffer, const size_t bufferSize, const bool unescape, const bool skipLastSymbol) const
+{
+	if (bufferSize == 0)
+		return 0;
+	size_t pos = 0;
+	bool previousEscape = false;
+	const unsigned char* data = this->data();
+	for (size_t i = 0; i < m_size && pos+2 < bufferSize; i++) {
+		auto value = data[i];
 		if (m_unescapeState == 0 && unescape && previousEscape) {
-			if (!skipLastSymbol || i+1 < m_data.size()) {
-				if (value == 0x00)
-					sstr << "a9"; // ESC
-				else if (value == 0x01)
-					sstr << "aa"; // SYN
-				else
-					sstr << "XX"; // invalid escape sequence
+			if (!skipLastSymbol || i+1 < m_size) {
+				if (value == 0x00) {
+					buffer[pos++] = 'a'; // ESC
+					buffer[pos++] = '9';
+				} else if (value == 0x01) {
+					buffer[pos++] = 'a'; // SYN
+					buffer[pos++] = 'a';
+				} else {
+					buffer[pos++] = 'X'; // invalid escape sequence
+					buffer[pos++] = 'X';
+				}
 			}
 			previousEscape = false;
 		}
 		else if (m_unescapeState == 0 && unescape && value == ESC) {
 			previousEscape = true; // escape sequence not yet finished
 		}
-		else if (!skipLastSymbol || i+1 < m_data.size()) {
-			sstr << nouppercase << setw(2) << hex
-					<< setfill('0') << static_cast<unsigned>(value);
+		else if (!skipLastSymbol || i+1 < m_size) {
+			buffer[pos++] = HEX_DIGITS[value >> 4];
+			buffer[pos++] = HEX_DIGITS[value & 0x0f];
 		}
 	}
-
-	return sstr.str();
+	buffer[pos] = 0;
+	return pos;
 }
 
 result_t SymbolString::push_back(const unsigned char value, const bool isEscaped, const bool updateCRC)
 {
 	if (m_unescapeState == 0) { // store escaped data
 		if (!isEscaped && value == ESC) {
-			m_data.push_back(ESC);
-			m_data.push_back(0x00);
+			append(ESC);
+			append(0x00);
 			if (updateCRC) {
 				addCRC(ESC);
 				addCRC(0x00);
 			}
 		}
 		else if (!isEscaped && value == SYN) {
-			m_data.push_back(ESC);
-			m_data.push_back(0x01);
+			append(ESC);
+			append(0x01);
 			if (updateCRC) {
 				addCRC(ESC);
 				addCRC(0x01);
 			}
 		}
 		else {
-			m_data.push_back(value);
+			append(value);
 			if (updateCRC)
 				addCRC(value);
 
@@ -138,7 +279,7 @@ result_t SymbolString::push_back(const unsigned char value, const bool isEscaped
 	else if (!isEscaped) {
 		if (m_unescapeState != 1)
 			return RESULT_ERR_ESC; // invalid unescape state
-		m_data.push_back(value);
+		append(value);
 		if (updateCRC) {
 			if (value == ESC) {
 				addCRC(ESC);
@@ -159,12 +300,12 @@ result_t SymbolString::push_back(const unsigned char value, const bool isEscaped
 			addCRC(value);
 
 		if (value == 0x00) {
-			m_data.push_back(ESC);
+			append(ESC);
 			m_unescapeState = 1;
 			return RESULT_OK;
 		}
 		if (value == 0x01) {
-			m_data.push_back(SYN);
+			append(SYN);
 			m_unescapeState = 1;
 			return RESULT_OK;
 		}
@@ -180,7 +321,7 @@ result_t SymbolString::push_back(const unsigned char value, const bool isEscaped
 	if (updateCRC)
 		addCRC(value);
 
-	m_data.push_back(value);
+	append(value);
 	return RESULT_OK;
 }
 
@@ -188,3 +329,54 @@ void SymbolString::addCRC(const unsigned char value) {
 	m_crc = CRC_LOOKUP_TABLE[m_crc]^value;
 }
 
+void SymbolString::addCRC(const unsigned char* data, const size_t len, const bool escape) {
+	m_crc = calcCRC(data, len, escape, m_crc);
+}
+
+unsigned char SymbolString::calcCRC(const unsigned char* data, const size_t len, const bool escape, unsigned char crc)
+{
+	const unsigned char* end = data+len;
+	// process four symbols at once while no escaping is needed
+	while (end-data >= 4) {
+		if (escape && (needsEscape(data[0]) || needsEscape(data[1]) || needsEscape(data[2]) || needsEscape(data[3]))) {
+			for (int i = 0; i < 4; i++, data++) {
+				if (needsEscape(*data)) {
+					crc = CRC_LOOKUP_TABLE[crc]^ESC;
+					crc = CRC_LOOKUP_TABLE[crc]^(*data == ESC ? 0x00 : 0x01);
+				} else
+					crc = CRC_LOOKUP_TABLE[crc]^*data;
+			}
+			continue;
+		}
+		crc = CRC_SLICE_TABLES.m_tables[3][crc]
+			^ CRC_SLICE_TABLES.m_tables[2][data[0]]
+			^ CRC_SLICE_TABLES.m_tables[1][data[1]]
+			^ CRC_LOOKUP_TABLE[data[2]]
+			^ data[3];
+		data += 4;
+	}
+	for (; data < end; data++) {
+		if (escape && needsEscape(*data)) {
+			crc = CRC_LOOKUP_TABLE[crc]^ESC;
+			crc = CRC_LOOKUP_TABLE[crc]^(*data == ESC ? 0x00 : 0x01);
+		} else
+			crc = CRC_LOOKUP_TABLE[crc]^*data;
+	}
+	return crc;
+}
+
+bool SymbolString::checkCRC(const unsigned char* data, const size_t len, const bool isEscaped)
+{
+	if (len < 2)
+		return false;
+	size_t dataLen = len-1;
+	unsigned char expectCrc = data[dataLen];
+	if (isEscaped && len >= 3 && data[len-2] == ESC) {
+		if (expectCrc > 0x01)
+			return false; // invalid escape sequence
+		expectCrc = expectCrc == 0x00 ? ESC : SYN;
+		dataLen--;
+	}
+	return calcCRC(data, dataLen, !isEscaped) == expectCrc;
+}
+
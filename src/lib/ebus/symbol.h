@@ -68,6 +68,12 @@ static const unsigned char ACK = 0x00;       //!< positive acknowledge
 static const unsigned char NAK = 0xFF;       //!< negative acknowledge
 static const unsigned char BROADCAST = 0xFE; //!< the broadcast destination address
 
+/** the buffer size sufficient for the hex string of any @a SymbolString (two characters per symbol plus null character). */
+#define MAX_DATA_STR_SIZE (2*256+1)
+
+/** the number of symbols a @a SymbolString stores inline without allocating (sufficient for any escaped telegram part). */
+#define SYMBOL_INLINE_SIZE 64
+
 
 /**
  * A string of escaped or unescaped bus symbols.
@@ -82,6 +88,31 @@ public:
 	 */
 	explicit SymbolString(const bool escaped=true) : m_unescapeState(escaped ? 0 : 1) {}
 
+	/**
+	 * Move constructor.
+	 * @param str the @a SymbolString to move from (left empty).
+	 */
+	SymbolString(SymbolString&& str) { *this = std::move(str); }
+
+	/**
+	 * Destructor.
+	 */
+	~SymbolString() { delete[] m_heapData; }
+
+	/**
+	 * Copy the symbols, escape mode, and CRC from the other instance (allocates only if exceeding the capacity).
+	 * @param str the @a SymbolString to copy from.
+	 * @return this instance.
+	 */
+	SymbolString& operator=(const SymbolString& str);
+
+	/**
+	 * Move the symbols, escape mode, and CRC from the other instance.
+	 * @param str the @a SymbolString to move from (left empty).
+	 * @return this instance.
+	 */
+	SymbolString& operator=(SymbolString&& str);
+
 	/**
 	 * Add all symbols from the other @a SymbolString and the calculated CRC if escaped.
 	 * @param str the @a SymbolString to copy from.
@@ -96,34 +127,63 @@ public:
 	 */
 	result_t parseHex(const string& str, const bool isEscaped=false);
 
+	/**
+	 * Calculate the CRC of multiple symbols.
+	 * @param data the symbols to calculate the CRC for.
+	 * @param len the number of symbols.
+	 * @param escape whether the symbols are unescaped and need to be escaped for the calculation.
+	 * @param crc the CRC to start with (e.g. from a previous call).
+	 * @return the calculated CRC.
+	 */
+	static unsigned char calcCRC(const unsigned char* data, const size_t len, const bool escape=false, unsigned char crc=0);
+
+	/**
+	 * Verify the CRC of a complete message part.
+	 * @param data the symbols of the message part ending with the CRC.
+	 * @param len the number of symbols including the CRC.
+	 * @param isEscaped whether the symbols are escaped (including the CRC).
+	 * @return true if the message part ends with the correct CRC.
+	 */
+	static bool checkCRC(const unsigned char* data, const size_t len, const bool isEscaped=true);
+
 	/**
 	 * Returns the symbols as hex string.
 	 * @param unescape whether to unescape an escaped instance.
 	 * @param skipLastSymbol whether to skip the last symbol (probably the CRC).
 	 * @return the symbols as hex string.
 	 */
-	string getDataStr(const bool unescape=true, const bool skipLastSymbol=true);
+	string getDataStr(const bool unescape=true, const bool skipLastSymbol=true) const;
+
+	/**
+	 * Write the symbols as hex string to the buffer without allocating memory.
+	 * @param buffer the buffer to write the null terminated hex string to.
+	 * @param bufferSize the size of the buffer (at most (@a bufferSize - 1) / 2 symbols are written, see @a MAX_DATA_STR_SIZE).
+	 * @param unescape whether to unescape an escaped instance.
+	 * @param skipLastSymbol whether to skip the last symbol (probably the CRC).
+	 * @return the length of the hex string written to the buffer (excluding the terminating null character).
+	 */
+	size_t getDataStr(char* buffer, const size_t bufferSize, const bool unescape=true, const bool skipLastSymbol=true) const;
 
 	/**
 	 * Returns a reference to the symbol at the specified index.
 	 * @param index the index of the symbol to return.
 	 * @return the reference to the symbol at the specified index.
 	 */
-	unsigned char& operator[](const size_t index) { if (index >= m_data.size()) m_data.resize(index+1, 0); return m_data[index]; }
+	unsigned char& operator[](const size_t index) { if (index >= m_size) resize(index+1); return data()[index]; }
 
 	/**
 	 * Returns whether this instance is equal to the other instance.
 	 * @param other the other instance.
 	 * @return true if this instance is equal to the other instance (i.e. both escaped or both unescaped and same symbols).
 	 */
-	bool operator==(SymbolString& other) { return m_unescapeState==other.m_unescapeState && m_data==other.m_data; }
+	bool operator==(SymbolString& other) { return m_unescapeState==other.m_unescapeState && equalData(other); }
 
 	/**
 	 * Returns whether this instance is different from the other instance.
 	 * @param other the other instance.
 	 * @return true if this instance is different from the other instance.
 	 */
-	bool operator!=(SymbolString& other) { return m_unescapeState!=other.m_unescapeState || m_data!=other.m_data; }
+	bool operator!=(SymbolString& other) { return m_unescapeState!=other.m_unescapeState || !equalData(other); }
 
 	/**
 	 * Compares this instance to the other instance while treating both as master data (i.e. starting with the master address and ending with the CRC).
@@ -133,10 +193,10 @@ public:
 	 * 2 if this instance only differs from the other instance in the first byte (the master address).
 	 */
 	int compareMaster(SymbolString& other) {
-		if (m_unescapeState!=other.m_unescapeState || m_data.size()!=other.m_data.size()) return 1;
-		if (m_data==other.m_data) return 0;
-		if (m_data.size()==1) return 2;
-		if (equal(m_data.begin()+1, m_data.end()-1, other.m_data.begin()+1)) return 2;
+		if (m_unescapeState!=other.m_unescapeState || m_size!=other.m_size) return 1;
+		if (equalData(other)) return 0;
+		if (m_size==1) return 2;
+		if (memcmp(data()+1, other.data()+1, m_size-2)==0) return 2;
 		return 1;
 	}
 
@@ -155,7 +215,7 @@ public:
 	 * Returns the number of symbols in this symbol string.
 	 * @return the number of available symbols.
 	 */
-	unsigned char size() const { return (unsigned char)m_data.size(); }
+	unsigned char size() const { return (unsigned char)m_size; }
 
 	/**
 	 * Returns the calculated CRC.
@@ -163,16 +223,22 @@ public:
 	 */
 	unsigned char getCRC() const { return m_crc; }
 
+	/**
+	 * Return whether this instance is in escaped mode (including the CRC).
+	 * @return whether this instance is in escaped mode.
+	 */
+	bool isEscaped() const { return m_unescapeState == 0; }
+
 	/**
 	 * Clear the symbols.
 	 */
-	void clear() { m_data.clear(); m_unescapeState = m_unescapeState==0 ? 0 : 1; m_crc = 0; }
+	void clear() { m_size = 0; m_unescapeState = m_unescapeState==0 ? 0 : 1; m_crc = 0; }
 
 	/**
 	 * Clear the symbols and adjust the escape mode.
 	 * @param escape true to set to an escaped instance, false to set to an unescaped instance.
 	 */
-	void clear(const bool escape) { m_data.clear(); m_unescapeState = escape ? 0 : 1; m_crc = 0; }
+	void clear(const bool escape) { m_size = 0; m_unescapeState = escape ? 0 : 1; m_crc = 0; }
 
 private:
 
@@ -180,8 +246,7 @@ private:
 	 * Hidden copy constructor.
 	 * @param str the @a SymbolString to copy from.
 	 */
-	SymbolString(const SymbolString& str)
-		: m_data(str.m_data), m_unescapeState(str.m_unescapeState), m_crc(str.m_crc) {}
+	SymbolString(const SymbolString& str) { *this = str; }
 
 	/**
 	 * Update the calculated CRC in @a m_crc by adding a value.
@@ -189,15 +254,76 @@ private:
 	 */
 	void addCRC(const unsigned char value);
 
-	/** the string of bus symbols. */
-	vector<unsigned char> m_data;
+	/**
+	 * Update the calculated CRC in @a m_crc by adding multiple values.
+	 * @param data the values to add to the calculated CRC in @a m_crc.
+	 * @param len the number of values.
+	 * @param escape whether the values are unescaped and need to be escaped for the calculation.
+	 */
+	void addCRC(const unsigned char* data, const size_t len, const bool escape);
+
+	/**
+	 * Return whether the unescaped value needs to be escaped.
+	 * @param value the unescaped value.
+	 * @return true if the value is @a ESC or @a SYN.
+	 */
+	static bool needsEscape(const unsigned char value) { return value == ESC || value == SYN; }
+
+	/**
+	 * Get the storage of the symbols.
+	 * @return the storage of the symbols (either inline or on the heap).
+	 */
+	unsigned char* data() { return m_heapData ? m_heapData : m_inlineData; }
+
+	/**
+	 * Get the storage of the symbols.
+	 * @return the storage of the symbols (either inline or on the heap).
+	 */
+	const unsigned char* data() const { return m_heapData ? m_heapData : m_inlineData; }
+
+	/**
+	 * Return whether the symbols of this instance are equal to the symbols of the other instance.
+	 * @param other the other instance.
+	 * @return true if both have the same symbols.
+	 */
+	bool equalData(const SymbolString& other) const { return m_size==other.m_size && memcmp(data(), other.data(), m_size)==0; }
+
+	/**
+	 * Make sure the storage is able to hold the specified number of symbols.
+	 * @param capacity the number of symbols to hold.
+	 */
+	void reserve(const size_t capacity);
+
+	/**
+	 * Change the number of symbols filling new symbols with zero.
+	 * @param size the new number of symbols.
+	 */
+	void resize(const size_t size);
+
+	/**
+	 * Append a single raw symbol to the storage.
+	 * @param value the symbol to append.
+	 */
+	void append(const unsigned char value) { if (m_size >= m_capacity) reserve(m_capacity*2); data()[m_size++] = value; }
+
+	/** the inline storage of the symbols (used as long as @a m_heapData is NULL). */
+	unsigned char m_inlineData[SYMBOL_INLINE_SIZE];
+
+	/** the heap storage of the symbols when exceeding @a SYMBOL_INLINE_SIZE, or NULL. */
+	unsigned char* m_heapData = NULL;
+
+	/** the number of symbols stored. */
+	size_t m_size = 0;
+
+	/** the number of symbols that can be stored without allocating. */
+	size_t m_capacity = SYMBOL_INLINE_SIZE;
 
 	/**
-	 * 0 if the symbols in @a m_data are escaped,
-	 * 1 if the symbols in @a m_data are unescaped and the last symbol passed to @a push_back was a normal symbol,
-	 * 2 if the symbols in @a m_data are unescaped and the last symbol passed to @a push_back was the escape symbol.
+	 * 0 if the stored symbols are escaped,
+	 * 1 if the stored symbols are unescaped and the last symbol passed to @a push_back was a normal symbol,
+	 * 2 if the stored symbols are unescaped and the last symbol passed to @a push_back was the escape symbol.
 	 */
-	int m_unescapeState;
+	int m_unescapeState = 0;
 
 	/** the calculated CRC. */
 	unsigned char m_crc = 0;
@@ -496,6 +496,20 @@ int main()
 			bool match = strcasecmp(output.str().c_str(), expectStr.c_str()) == 0;
 			verify(failedReadMatch, "read", check[2], match, expectStr, output.str());
 		}
+		shared_ptr<DataFieldSet> set = dynamic_pointer_cast<DataFieldSet>(fields);
+		if (set && set->hasPlan()) {
+			// the compiled decode plan has to match the virtual field path
+			OutputFormat format = (verbose?OF_VERBOSE:0)|(numeric?OF_NUMERIC:0)|(json?OF_JSON:0);
+			ostringstream reference;
+			result_t planResult = set->readFields(PartType::masterData, mstr, 0, reference, format, -1, false);
+			if (planResult >= RESULT_OK)
+				planResult = set->readFields(PartType::slaveData, sstr, 0, reference, format, -1, !reference.str().empty());
+			if ((planResult >= RESULT_OK) != (result >= RESULT_OK) || (result >= RESULT_OK && reference.str() != output.str())) {
+				cout << "  plan read " << fields->getName() << " >" << output.str() << "< error: differs from >"
+				     << reference.str() << "<" << endl;
+				error = true;
+			}
+		}
 
 		if (!verbose && !json) {
 			istringstream input(expectStr);
@@ -219,13 +219,16 @@ int main()
 		}
 		if (isDefaults) {
 			// store defaults or condition
-			vector<string>::iterator it = entries.begin();
+			vector<StringRef> fields;
+			for (const auto& entry : entries)
+				fields.emplace_back(entry.data(), entry.length());
+			size_t column = 0;
 			size_t oldSize = conditions.size();
-			result = messages->addDefaultFromFile(defaultsRows, entries, it, "", "", "", "no file", 1);
+			result = messages->addDefaultFromFile(defaultsRows, fields, column, "", "", "", "no file", 1);
 			if (result != RESULT_OK)
 				cout << "\"" << check[0] << "\": defaults read error: " << getResultCode(result) << endl;
-			else if (it != entries.end())
-				cout << "\"" << check[0] << "\": defaults read error: trailing input " << static_cast<unsigned>(entries.end()-it) << endl;
+			else if (column != fields.size())
+				cout << "\"" << check[0] << "\": defaults read error: trailing input " << static_cast<unsigned>(fields.size()-column) << endl;
 			else {
 				cout << "\"" << check[0] << "\": read defaults OK" << endl;
 				if (isCondition) {
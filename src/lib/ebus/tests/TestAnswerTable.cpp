@@ -0,0 +1,80 @@
+#include "gtest/gtest.h"
+#include "answertable.h"
+#include <thread>
+
+static void parseSlave(const string& hex, SymbolString& slave)
+{
+    slave.clear(true);
+    ASSERT_EQ(slave.parseHex(hex, false), RESULT_OK);
+}
+
+TEST(TestAnswerTable, findById)
+{
+    AnswerTable table;
+    SymbolString master(false), slave, answer, other;
+    ASSERT_EQ(master.parseHex("1015b509030d28001a", false), RESULT_OK);
+    ASSERT_FALSE(table.find(master, answer));
+
+    parseSlave("02a90111", slave);
+    ASSERT_TRUE(table.set({0xb5, 0x09, 0x0d, 0x28}, slave));
+    parseSlave("0101", other);
+    ASSERT_TRUE(table.set({0xb5, 0x09}, other));
+    ASSERT_EQ(table.size(), 2u);
+
+    // the longest matching ID wins and the answer is copied escaped with CRC
+    ASSERT_TRUE(table.find(master, answer));
+    ASSERT_EQ(answer.getDataStr(false, false), slave.getDataStr(false, false));
+    ASSERT_EQ(answer.getDataStr(true, false).substr(0, 8), "02a90111");
+
+    SymbolString shortMaster(false);
+    ASSERT_EQ(shortMaster.parseHex("1015b509020d29", false), RESULT_OK);
+    ASSERT_TRUE(table.find(shortMaster, answer));
+    ASSERT_EQ(answer.getDataStr(false, false), other.getDataStr(false, false));
+
+    SymbolString unknown(false);
+    ASSERT_EQ(unknown.parseHex("1015b510020d28", false), RESULT_OK);
+    ASSERT_FALSE(table.find(unknown, answer));
+
+    // replace and remove
+    parseSlave("0102", other);
+    ASSERT_TRUE(table.set({0xb5, 0x09}, other));
+    ASSERT_EQ(table.size(), 2u);
+    ASSERT_TRUE(table.find(shortMaster, answer));
+    ASSERT_EQ(answer.getDataStr(true, true), "0102");
+    ASSERT_TRUE(table.remove({0xb5, 0x09}));
+    ASSERT_FALSE(table.remove({0xb5, 0x09}));
+    ASSERT_FALSE(table.find(shortMaster, answer));
+    ASSERT_TRUE(table.find(master, answer));
+
+    ASSERT_FALSE(table.set({0xb5}, slave));
+    ASSERT_FALSE(table.set({0xb5, 0x09, 1, 2, 3, 4, 5, 6}, slave));
+    table.clear();
+    ASSERT_EQ(table.size(), 0u);
+    ASSERT_FALSE(table.find(master, answer));
+}
+
+TEST(TestAnswerTable, concurrentUpdate)
+{
+    AnswerTable table;
+    SymbolString master(false);
+    ASSERT_EQ(master.parseHex("1015b509010d", false), RESULT_OK);
+    std::thread writer([&table]() {
+        SymbolString slave;
+        for (int value = 0; value < 2000; value++) {
+            slave.clear(true);
+            slave.parseHex(value % 2 == 0 ? "020102" : "020304", false);
+            table.set({0xb5, 0x09, 0x0d}, slave);
+            table.set({0x07, 0x04}, slave);
+        }
+    });
+    SymbolString answer;
+    for (int count = 0; count < 20000; count++) {
+        if (!table.find(master, answer))
+            continue;
+        string data = answer.getDataStr(true, true);
+        ASSERT_TRUE(data == "020102" || data == "020304") << data;
+    }
+    writer.join();
+    ASSERT_TRUE(table.find(master, answer));
+    ASSERT_EQ(answer.getDataStr(true, true), "020304");
+}
@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+#include "configcache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+class RowCollector : public FileReader
+{
+public:
+    RowCollector() : FileReader(true) {}
+
+    virtual result_t addFromFile(vector<string>::iterator& begin, const vector<string>::iterator end,
+        vector< vector<string> >* defaults, const string& defaultDest, const string& defaultCircuit, const string& defaultSuffix,
+        const string& filename, unsigned int lineNo)
+    {
+        m_output << filename << ":" << lineNo << ":" << defaults->size() << ":" << defaultDest;
+        for (auto it = begin; it != end; it++)
+            m_output << "|" << *it;
+        m_output << std::endl;
+        begin = end;
+        return RESULT_OK;
+    }
+
+    std::ostringstream m_output;
+};
+
+static string collect(const vector<string>& files, FileRowCache* cache)
+{
+    RowCollector reader;
+    reader.setRowCache(cache);
+    for (const auto& file : files)
+        reader.readFromFile(file);
+    return reader.m_output.str();
+}
+
+TEST(TestConfigCache, rowsMatchSource)
+{
+    char dir[] = "/tmp/ebusdcacheXXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    vector<string> files = { string(dir) + "/08.ehp.csv", string(dir) + "/other.csv" };
+    {
+        std::ofstream file(files[0]);
+        file << "# comment\n*r,,,,,,b509\n\nr,ehp,\"quoted, text\",comment,,,0d2800,,,UCH\nw,ehp,name,,,,0d2900\n";
+        std::ofstream file2(files[1]);
+        file2 << "r,,single,,,15,b509,0d01\n";
+    }
+    string cacheFile = string(dir) + "/cache.bin";
+    string expect = collect(files, NULL);
+    ASSERT_NE(expect.find("quoted, text"), string::npos);
+
+    ConfigCache cache;
+    ASSERT_EQ(cache.open(cacheFile), RESULT_ERR_NOTFOUND);
+    ASSERT_EQ(collect(files, &cache), expect);
+    ASSERT_EQ(cache.getHits(), 0u);
+    ASSERT_EQ(cache.getMisses(), 2u);
+    ASSERT_TRUE(cache.isModified());
+    ASSERT_EQ(cache.write(cacheFile), RESULT_OK);
+    ASSERT_FALSE(cache.isModified());
+
+    ConfigCache reopened;
+    ASSERT_EQ(reopened.open(cacheFile), RESULT_OK);
+    ASSERT_EQ(collect(files, &reopened), expect);
+    ASSERT_EQ(reopened.getHits(), 2u);
+    ASSERT_EQ(reopened.getMisses(), 0u);
+    ASSERT_FALSE(reopened.isModified());
+
+    {
+        std::ofstream file(files[1], std::ios::app);
+        file << "r,,added,,,15,b509,0d02\n";
+    }
+    expect = collect(files, NULL);
+    ASSERT_EQ(reopened.open(cacheFile), RESULT_OK);
+    ASSERT_EQ(collect(files, &reopened), expect);
+    ASSERT_EQ(reopened.getHits(), 1u);
+    ASSERT_EQ(reopened.getMisses(), 1u);
+    ASSERT_TRUE(reopened.isModified());
+    ASSERT_EQ(reopened.write(cacheFile), RESULT_OK);
+    ASSERT_EQ(reopened.open(cacheFile), RESULT_OK);
+    ASSERT_EQ(collect(files, &reopened), expect);
+    ASSERT_EQ(reopened.getHits(), 2u);
+
+    {
+        std::fstream file(cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('X');
+    }
+    ASSERT_EQ(reopened.open(cacheFile), RESULT_ERR_INVALID_ARG);
+    ASSERT_EQ(collect(files, &reopened), expect);
+    ASSERT_EQ(reopened.getMisses(), 2u);
+
+    for (const auto& file : files)
+        unlink(file.c_str());
+    unlink(cacheFile.c_str());
+    rmdir(dir);
+}
@@ -0,0 +1,83 @@
+#include "gtest/gtest.h"
+#include "filereader.h"
+#include "message.h"
+#include <cstdlib>
+#include <sstream>
+
+// all rows with their line numbers as split by the stream based reference
+static string splitStream(const string& data)
+{
+    std::ostringstream result;
+    std::istringstream ifs(data);
+    vector<string> row;
+    unsigned int lineNo = 0;
+    while (FileReader::splitFields(ifs, row, lineNo)) {
+        if (row.empty())
+            continue;
+        result << lineNo;
+        for (const auto& field : row)
+            result << "|" << field;
+        result << "\n";
+    }
+    return result.str();
+}
+
+static string splitTokenizer(const string& data)
+{
+    std::ostringstream result;
+    CsvTokenizer tokenizer(data.data(), data.length());
+    vector<StringRef> row;
+    unsigned int lineNo = 0;
+    while (tokenizer.next(row, lineNo)) {
+        if (row.empty())
+            continue;
+        result << lineNo;
+        for (const auto& field : row)
+            result << "|" << field.str();
+        result << "\n";
+    }
+    return result.str();
+}
+
+TEST(TestCsvTokenizer, sameAsStream)
+{
+    ASSERT_EQ(splitTokenizer("# x\nr,bai, temp ,,\"a, b\"\n\n"), "2|r|bai|temp||a, b\n");
+    const char* inputs[] = {
+        "", "\n", "a", "a\n", " a , b \n", "a,b\r\nc,d\r\n", "#c\n//c\n/x\n", "   \n\t\n", " , ,", ",",
+        "\"a,b\",c", "\"a\"\"b\",c", "a\"b\"c,d", "\"a\"b,c", "\"\",x", "\"\"\"\",x", "\"a\nb\",c", "\"a;\nb\"",
+        "\"a\n,b\"\n", "\"a\n\"b\"\n", "\"a\n \n#b\"", "\"open\n", "x,\"a \" ,y", "\"a\r\",b", "a\r\rb,c",
+        "*r,,,,,,b509\nr,ehp,\"quoted, text\",comment,,,0d2800,,,UCH\n", "\t\"a\"x\"y\",\"\"z",
+    };
+    for (auto input : inputs)
+        ASSERT_EQ(splitTokenizer(input), splitStream(input)) << "input: " << input;
+    const char alphabet[] = "ab ,\"\n\r#/;\t";
+    srand(42);
+    for (int run = 0; run < 20000; run++) {
+        string input;
+        size_t length = rand() % 24;
+        for (size_t pos = 0; pos < length; pos++)
+            input += alphabet[rand() % (sizeof(alphabet)-1)];
+        ASSERT_EQ(splitTokenizer(input), splitStream(input)) << "input: " << input;
+    }
+}
+
+TEST(TestCsvTokenizer, readFromContent)
+{
+    MessageMap messages;
+    string content = "*r,,,,,,\"B509\",\"0D\"\n"
+        "*[code],,code,,,,4\n"
+        "r,,code,,,,,4301,,,UCH,\n"
+        "[code]r,,status,,,,,4302,,,UCH,\n";
+    ASSERT_EQ(messages.readFromContent(StringRef(content.data(), content.length()), "/tmp/08.ehp.csv"), RESULT_OK);
+    ASSERT_EQ(messages.resolveConditions(), RESULT_OK);
+    auto code = messages.find("ehp", "code", false);
+    ASSERT_NE(code, nullptr);
+    ASSERT_EQ(code->getDstAddress(), 0x08);
+    ASSERT_EQ(messages.find("ehp", "status", true), nullptr);
+    ASSERT_EQ(messages.size(), 2u);
+
+    content = "# invalid condition\n*[bad],,,,,,value\n";
+    messages.clear();
+    ASSERT_NE(messages.readFromContent(StringRef(content.data(), content.length()), "/tmp/08.ehp.csv"), RESULT_OK);
+    ASSERT_EQ(messages.getLastError(), "/tmp/08.ehp.csv:2: invalid condition");
+}
@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+#include "history.h"
+#include <string>
+#include <vector>
+
+static void parse(const std::string& hex, SymbolString& data)
+{
+    data.clear(false);
+    ASSERT_EQ(data.parseHex(hex, false), RESULT_OK);
+}
+
+TEST(TestDataHistory, addAndGet)
+{
+    DataHistory history(2);
+    SymbolString master(false), slave(false);
+    parse("1008b509010d", master);
+    for (int value = 0; value < 100; value++) {
+        char hex[8];
+        snprintf(hex, sizeof(hex), "02%02x01", value);
+        parse(hex, slave);
+        history.add(1000 + value * 10, master, slave);
+    }
+    // only changed bytes are stored, so that a segment holds many entries
+    ASSERT_LE(history.getEncodedSize(), (size_t)2*HISTORY_SEGMENT_SIZE);
+    size_t stored = history.size();
+    ASSERT_GT(stored, 50u);
+    ASSERT_LT(stored, 100u); // the oldest segments were dropped
+
+    std::vector<time_t> times;
+    std::vector<std::string> slaves;
+    size_t count = history.get(0, [&](time_t time, SymbolString& entryMaster, SymbolString& entrySlave) {
+        EXPECT_EQ(entryMaster.getDataStr(true, false), "1008b509010d");
+        times.push_back(time);
+        slaves.push_back(entrySlave.getDataStr(true, false));
+        return true;
+    });
+    ASSERT_EQ(count, stored);
+    ASSERT_EQ(times.back(), 1990);
+    ASSERT_EQ(slaves.back(), "026301");
+    for (size_t pos = 0; pos < times.size(); pos++) {
+        int value = (int)(times[pos] - 1000) / 10;
+        char hex[8];
+        snprintf(hex, sizeof(hex), "02%02x01", value);
+        ASSERT_EQ(slaves[pos], hex);
+    }
+
+    // entries after a certain time only and stopping early
+    count = history.get(1950, [](time_t time, SymbolString&, SymbolString&) {
+        EXPECT_GT(time, 1950);
+        return true;
+    });
+    ASSERT_EQ(count, 4u);
+    count = history.get(0, [](time_t, SymbolString&, SymbolString&) { return false; });
+    ASSERT_EQ(count, 1u);
+
+    // different lengths and a copy
+    parse("0401020304", slave);
+    history.add(2000, master, slave);
+    parse("01ff", slave);
+    history.add(2000, master, slave);
+    DataHistory copy(1);
+    copy.assign(history);
+    slaves.clear();
+    copy.get(1990, [&](time_t time, SymbolString&, SymbolString& entrySlave) {
+        EXPECT_EQ(time, 2000);
+        slaves.push_back(entrySlave.getDataStr(true, false));
+        return true;
+    });
+    ASSERT_EQ(slaves.size(), 2u);
+    ASSERT_EQ(slaves[0], "0401020304");
+    ASSERT_EQ(slaves[1], "01ff");
+
+    history.clear();
+    ASSERT_EQ(history.size(), 0u);
+    ASSERT_EQ(history.get(0, [](time_t, SymbolString&, SymbolString&) { return true; }), 0u);
+}
@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+#include "data.h"
+#include <cstdlib>
+
+static shared_ptr<DataFieldSet> createSet(const string& definition)
+{
+    DataFieldTemplates templates;
+    vector<string> entries;
+    istringstream input(definition);
+    string item;
+    while (getline(input, item, FIELD_SEPARATOR))
+        entries.push_back(item);
+    auto it = entries.begin();
+    shared_ptr<DataField> fields;
+    result_t result = DataField::create(it, entries.end(), &templates, fields, false, false, false);
+    if (result != RESULT_OK)
+        return NULL;
+    return std::dynamic_pointer_cast<DataFieldSet>(fields);
+}
+
+static const char* s_definitions[] = {
+    "temp,m,D2C,,°C,comment,pressure,m,UCH,10,bar,,status,s,UCH,0=off;1=on;2=auto,,,hours,s,UIN,,h,",
+    "a,s,BI0:3,,,,b,s,BI3:2,,,,c,s,BI5,0=no;1=yes,,,d,s,SCH,-10,,,e,s,D1B,,,",
+    "x,s,IGN:2,,,,y,s,BCD:2,,,,z,s,HCD:4,,,,w,s,PIN,,,,v,s,ULR,,,",
+    "f,s,EXP,,,,g,s,SIR,,,,h,s,FLT,,,,i,s,HEX:3,,,,j,s,HDA:3,,,",
+    "k,s,STR:3,,,,l,s,TTM,,,,m,s,ULG,100,,,n,s,SLG,-3,,,o,m,UCH,,,",
+    ",s,UCH,,,,,s,UCH,,,,,s,UIN,,,",
+};
+
+TEST(TestDecodePlan, matchesFieldPath)
+{
+    srand(42);
+    const OutputFormat formats[] = { 0, OF_VERBOSE, OF_NUMERIC, OF_JSON, OF_JSON|OF_VERBOSE };
+    vector<string> definitions(s_definitions, s_definitions + sizeof(s_definitions) / sizeof(s_definitions[0]));
+    definitions.push_back("");
+    size_t decoded = 0;
+    for (auto definition : definitions) {
+        auto set = definition.empty() ? DataFieldSet::getIdentFields() : createSet(definition);
+        ASSERT_NE(set, nullptr) << definition;
+        ASSERT_TRUE(set->hasPlan()) << definition;
+        for (int round = 0; round < 500; round++) {
+            SymbolString master(false), slave(false);
+            master.push_back(0x10, false, false);
+            master.push_back(0x08, false, false);
+            master.push_back(0xb5, false, false);
+            master.push_back(0x09, false, false);
+            size_t masterLength = (size_t)(rand() % 5), slaveLength = (size_t)(rand() % 24);
+            master.push_back((unsigned char)masterLength, false, false);
+            for (size_t i = 0; i < masterLength; i++)
+                master.push_back((unsigned char)(round < 50 ? 0xff : rand()), false, false);
+            slave.push_back((unsigned char)slaveLength, false, false);
+            for (size_t i = 0; i < slaveLength; i++)
+                slave.push_back((unsigned char)(round < 50 ? 0xff : rand()), false, false);
+            for (auto format : formats) {
+                for (int part = 0; part < 2; part++) {
+                    PartType partType = part == 0 ? PartType::masterData : PartType::slaveData;
+                    SymbolString& data = part == 0 ? master : slave;
+                    ostringstream planOutput, fieldOutput;
+                    planOutput << "x";
+                    fieldOutput << "x";
+                    result_t planResult = set->read(partType, data, 0, planOutput, format, -1, true);
+                    result_t fieldResult = set->readFields(partType, data, 0, fieldOutput, format, -1, true);
+                    ASSERT_EQ(planResult, fieldResult) << definition << " " << data.getDataStr();
+                    ASSERT_EQ(planOutput.str(), fieldOutput.str()) << definition << " " << data.getDataStr();
+                    if (planResult == RESULT_OK)
+                        decoded++;
+                }
+            }
+        }
+    }
+    ASSERT_GT(decoded, 1000u);
+}
+
+TEST(TestDecodePlan, variableLayoutNotCompiled)
+{
+    auto set = createSet("a,s,UCH,,,,b,s,STR:*,,,");
+    ASSERT_NE(set, nullptr);
+    ASSERT_FALSE(set->hasPlan());
+}
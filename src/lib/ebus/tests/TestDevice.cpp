@@ -0,0 +1,41 @@
+#include "gtest/gtest.h"
+#include "device.h"
+#include <fcntl.h>
+#include <stdlib.h>
+
+static unsigned int rawCount = 0;
+
+static void logRaw(const unsigned char byte, bool received)
+{
+    if (received)
+        rawCount++;
+}
+
+TEST(TestDevice, recvBuffered)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_GE(master, 0);
+    ASSERT_EQ(grantpt(master), 0);
+    ASSERT_EQ(unlockpt(master), 0);
+
+    auto device = Device::create(ptsname(master), false, false, false, logRaw);
+    ASSERT_NE(device, nullptr);
+    ASSERT_EQ(device->open(), RESULT_OK);
+    device->setLogRaw(true);
+
+    unsigned char value = 0;
+    ASSERT_EQ(device->recv(10000, value), RESULT_ERR_TIMEOUT);
+
+    const unsigned char burst[] = {0xaa, 0x10, 0x08, 0xb5, 0x09, 0x00, 0xaa};
+    ASSERT_EQ(write(master, burst, sizeof(burst)), (ssize_t)sizeof(burst));
+    for (auto expect : burst) {
+        ASSERT_EQ(device->recv(100000, value), RESULT_OK);
+        ASSERT_EQ(value, expect);
+    }
+    ASSERT_EQ(rawCount, sizeof(burst));
+    ASSERT_EQ(device->recv(10000, value), RESULT_ERR_TIMEOUT);
+
+    device->close();
+    ASSERT_FALSE(device->isValid());
+    close(master);
+}
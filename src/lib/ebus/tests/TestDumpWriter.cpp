@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include "dumpwriter.h"
+#include <cstdio>
+#include <unistd.h>
+
+static string readFile(const string& name)
+{
+    std::ifstream stream(name.c_str(), std::ios::in | std::ios::binary);
+    return string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+}
+
+TEST(TestDumpWriter, plain)
+{
+    string file = "/tmp/test_dumpwriter_" + std::to_string(getpid()) + ".bin";
+    remove(file.c_str());
+
+    DumpWriter writer;
+    writer.setFile(file);
+    ASSERT_TRUE(writer.start());
+    ASSERT_TRUE(writer.isRunning());
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(writer.push((unsigned char)i));
+    }
+    writer.stop();
+    ASSERT_FALSE(writer.isRunning());
+
+    string data = readFile(file);
+    ASSERT_EQ(data.size(), 1000u);
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ((unsigned char)data[i], (unsigned char)i);
+    }
+    ASSERT_EQ(writer.getDropped(), 0u);
+    remove(file.c_str());
+}
+
+TEST(TestDumpWriter, timestampsAndRotation)
+{
+    string file = "/tmp/test_dumpwriter_ts_" + std::to_string(getpid()) + ".bin";
+    string oldFile = file + ".old";
+    remove(file.c_str());
+    remove(oldFile.c_str());
+
+    DumpWriter writer;
+    writer.setFile(file);
+    writer.setMaxSize(1);
+    writer.setTimestamps(true);
+    ASSERT_TRUE(writer.start());
+    for (int i = 0; i < 200; i++) {
+        ASSERT_TRUE(writer.push((unsigned char)i));
+    }
+    writer.stop();
+
+    string rotated = readFile(oldFile);
+    string data = readFile(file);
+    ASSERT_GE(rotated.size(), 1024u);
+    ASSERT_EQ(rotated.size() % DUMP_RECORD_SIZE, 0u);
+    ASSERT_EQ((rotated.size() + data.size()) / DUMP_RECORD_SIZE, 200u);
+    data = rotated + data;
+    unsigned long long previous = 0;
+    for (size_t i = 0; i < 200; i++) {
+        unsigned long long time = 0;
+        for (int j = 7; j >= 0; j--) {
+            time = (time << 8) | (unsigned char)data[i * DUMP_RECORD_SIZE + j];
+        }
+        ASSERT_GE(time, previous);
+        ASSERT_GT(time, 1400000000000000ULL);
+        previous = time;
+        ASSERT_EQ((unsigned char)data[i * DUMP_RECORD_SIZE + 8], (unsigned char)i);
+    }
+    remove(file.c_str());
+    remove(oldFile.c_str());
+}
+
+TEST(TestDumpWriter, restart)
+{
+    string file = "/tmp/test_dumpwriter_re_" + std::to_string(getpid()) + ".bin";
+    remove(file.c_str());
+
+    DumpWriter writer;
+    ASSERT_FALSE(writer.push(0x01));
+    writer.setFile(file);
+    for (int run = 0; run < 3; run++) {
+        ASSERT_TRUE(writer.start());
+        for (int i = 0; i < DUMP_RING_SIZE; i++) {
+            ASSERT_TRUE(writer.push((unsigned char)run)) << i;
+            if ((i % 1024) == 1023)
+                usleep(20000);
+        }
+        writer.stop();
+        ASSERT_FALSE(writer.isRunning());
+        ASSERT_FALSE(writer.push(0x01));
+    }
+    string data = readFile(file);
+    ASSERT_EQ(data.size(), 3u*DUMP_RING_SIZE);
+    ASSERT_EQ((unsigned char)data[2*DUMP_RING_SIZE], 2);
+    ASSERT_EQ(writer.getDropped(), 0u);
+    remove(file.c_str());
+}
@@ -0,0 +1,710 @@
+#include "gtest/gtest.h"
+#include "message.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+
+static DataFieldTemplates templates;
+
+DataFieldTemplates* getTemplates(const string filename)
+{
+    return &templates;
+}
+
+TEST(TestMessageMap, unknownCache)
+{
+    MessageMap messages;
+    SymbolString master(false);
+
+    auto result = master.parseHex("1008b50900");
+    ASSERT_EQ(result, RESULT_OK);
+
+    ASSERT_EQ(messages.find(master, true), nullptr);
+    ASSERT_EQ(messages.getUnknownCacheHits(), 0u);
+    ASSERT_EQ(messages.getUnknownCacheMisses(), 1u);
+
+    ASSERT_EQ(messages.find(master, true), nullptr);
+    ASSERT_EQ(messages.getUnknownCacheHits(), 1u);
+
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    result = messages.add(message);
+    ASSERT_EQ(result, RESULT_OK);
+
+    ASSERT_EQ(messages.find(master, true), message);
+    ASSERT_EQ(messages.getUnknownCacheHits(), 1u);
+    ASSERT_EQ(messages.getUnknownCacheMisses(), 1u); // known master data is not counted
+
+    messages.clear();
+    ASSERT_EQ(messages.find(master, true), nullptr);
+    ASSERT_EQ(messages.getUnknownCacheMisses(), 2u);
+    ASSERT_EQ(messages.find(master, true), nullptr);
+    ASSERT_EQ(messages.getUnknownCacheHits(), 2u);
+}
+
+static SymbolString unknownMaster(unsigned int index)
+{
+    SymbolString master(false);
+    master.push_back(0x10, false);
+    master.push_back(0x08, false);
+    master.push_back((unsigned char)(index >> 8), false);
+    master.push_back((unsigned char)(index & 0xff), false);
+    master.push_back(0x00, false);
+    return master;
+}
+
+TEST(TestMessageMap, unknownCacheBounded)
+{
+    MessageMap messages;
+
+    const unsigned int count = 2*UNKNOWN_CACHE_SIZE;
+    for (unsigned int i = 0; i < count; i++) {
+        SymbolString master = unknownMaster(i);
+        ASSERT_EQ(messages.find(master), nullptr);
+    }
+    ASSERT_EQ(messages.getUnknownCacheHits(), 0u);
+
+    // the most recent key is always kept
+    SymbolString last = unknownMaster(count-1);
+    ASSERT_EQ(messages.find(last), nullptr);
+    ASSERT_EQ(messages.getUnknownCacheHits(), 1u);
+
+    // at most one key per slot is kept
+    for (unsigned int i = 0; i < count; i++) {
+        SymbolString master = unknownMaster(i);
+        ASSERT_EQ(messages.find(master), nullptr);
+    }
+    ASSERT_GT(messages.getUnknownCacheHits(), 1u);
+    ASSERT_LE(messages.getUnknownCacheHits(), 1u+UNKNOWN_CACHE_SIZE);
+
+    // adding a message drops all remembered keys
+    auto message = make_shared<Message>("circuit", "name", false, false, 0x07, 0x00, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages.add(message), RESULT_OK);
+    unsigned long hits = messages.getUnknownCacheHits();
+    ASSERT_EQ(messages.find(last), nullptr);
+    ASSERT_EQ(messages.getUnknownCacheHits(), hits);
+}
+
+TEST(TestMessageMap, changeJournal)
+{
+    MessageMap messages;
+    ChangeJournal& journal = messages.getChangeJournal();
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages.add(message), RESULT_OK);
+
+    unsigned long long cursor = journal.getCursor();
+    vector<Message*> changed;
+    ASSERT_TRUE(journal.getChanges(cursor, changed));
+    ASSERT_TRUE(changed.empty());
+
+    SymbolString master(false), slave(false);
+    ASSERT_EQ(master.parseHex("1015b5090124"), RESULT_OK);
+    ASSERT_EQ(slave.parseHex("0102"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK); // unchanged
+    ASSERT_EQ(slave.parseHex("0103"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+
+    ASSERT_TRUE(journal.getChanges(cursor, changed));
+    ASSERT_EQ(changed.size(), 1u); // reported only once
+    ASSERT_EQ(changed[0], message.get());
+
+    changed.clear();
+    ASSERT_TRUE(journal.getChanges(cursor, changed));
+    ASSERT_TRUE(changed.empty());
+
+    // overflow
+    unsigned long long oldCursor = cursor;
+    for (unsigned int i = 0; i <= CHANGE_JOURNAL_SIZE; i++) {
+        slave[1] = (unsigned char)i;
+        ASSERT_EQ(message->storeLastData(PartType::slaveData, slave, 0), RESULT_OK);
+    }
+    ASSERT_FALSE(journal.getChanges(oldCursor, changed));
+    ASSERT_EQ(changed.size(), 1u);
+
+    messages.clear();
+    changed.clear();
+    ASSERT_FALSE(journal.getChanges(cursor, changed));
+    ASSERT_TRUE(changed.empty());
+}
+
+TEST(TestMessageMap, findAll)
+{
+    MessageMap messages;
+    const char* circuits[] = {"Heating", "hwc", "heatingZone"};
+    const char* names[] = {"FlowTemp", "Status", "flowTempDesired"};
+    unsigned char sb = 0;
+    for (auto circuit : circuits) {
+        for (auto name : names) {
+            auto message = make_shared<Message>(circuit, name, false, false, 0xb5, sb++, DataFieldSet::getIdentFields());
+            ASSERT_EQ(messages.add(message), RESULT_OK);
+        }
+    }
+
+    auto found = messages.findAll("heating", "flowtemp");
+    ASSERT_EQ(found.size(), 1u);
+    ASSERT_EQ(found.front()->getCircuit(), "Heating");
+    ASSERT_EQ(found.front()->getName(), "FlowTemp");
+
+    found = messages.findAll("HWC", "");
+    ASSERT_EQ(found.size(), 3u);
+    ASSERT_EQ(found[0]->getName(), "FlowTemp");
+    ASSERT_EQ(found[1]->getName(), "flowTempDesired");
+    ASSERT_EQ(found[2]->getName(), "Status");
+
+    found = messages.findAll("", "FLOWTEMP");
+    ASSERT_EQ(found.size(), 3u);
+    ASSERT_EQ(found[0]->getCircuit(), "Heating");
+    ASSERT_EQ(found[1]->getCircuit(), "heatingZone");
+    ASSERT_EQ(found[2]->getCircuit(), "hwc");
+
+    found = messages.findAll("heat", "flowtemp", false);
+    ASSERT_EQ(found.size(), 4u);
+
+    ASSERT_EQ(messages.findAll("unknown", "").size(), 0u);
+    ASSERT_EQ(messages.findAll("", "", false).size(), 9u);
+    ASSERT_EQ(messages.findAll("", "", false, false).size(), 0u);
+
+    auto message = make_shared<Message>("hwc", "Extra", false, false, 0xb5, sb++, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages.add(message), RESULT_OK);
+    ASSERT_EQ(messages.findAll("hwc", "").size(), 4u);
+}
+
+static string readConfig(const vector<string>& files, bool verbose, unsigned int threads, result_t& result, string& error)
+{
+    MessageMap messages;
+    std::ostringstream output;
+    std::streambuf* stdout = std::cout.rdbuf(output.rdbuf());
+    if (threads == 0) {
+        result = RESULT_OK;
+        for (const auto& file : files) {
+            result = messages.readFromFile(file, verbose);
+            if (result != RESULT_OK)
+                break;
+        }
+    } else {
+        result = messages.readFromFiles(files, verbose, threads);
+    }
+    std::cout.rdbuf(stdout);
+    error = messages.getLastError();
+    output << "messages: " << messages.size() << ", conditions: " << messages.sizeConditions() << std::endl;
+    messages.dump(output, true);
+    return output.str();
+}
+
+TEST(TestMessageMap, readFromFilesInOrder)
+{
+    char dir[] = "/tmp/ebusdcfgXXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    const char* contents[] = {
+        "*[code],ehp,ApplianceCode,,,08,4;6\n"
+        "r,ehp,ApplianceCode,,,08,b509,0d4301,,,UCH,\n"
+        "[code]r,ehp,status,,,08,b509,0d4302,,,UCH,\n"
+        "[code=8]r;w,ehp,derived,,,08,b509,0d4303,,,UCH,\n"
+        "r,ehp,ApplianceCode,,,08,b509,0d4304,,,UCH,\n"
+        "r,ehp,bad,,,08,b509,0d4305,,,XYZ,\n"
+        "r,ehp,dupid,,,08,b509,0d4301,,,UCH,\n"
+        "[unknown]r,ehp,nocond,,,08,b509,0d4306,,,UCH,\n",
+        "r,other,first,,,15,b509,0d0001,,,UCH,\n"
+        "w;r,ehp,ApplianceCode,,,08,b509,0d4310,,,UCH,\n"
+        "r,other,second,,,15,b509,0d0002,,,UCH,\n",
+        "",
+    };
+    vector<string> files;
+    for (size_t index = 0; index < sizeof(contents) / sizeof(contents[0]); index++) {
+        string name = string(dir) + "/file" + std::to_string(index) + ".csv";
+        std::ofstream file(name);
+        file << contents[index];
+        if (index == 2) {
+            for (int i = 0; i < 200; i++)
+                file << "r,bulk,msg" << i << ",,,25,b509," << std::hex << std::setw(4) << std::setfill('0') << (0x1000 + i) << std::dec << ",,,UIN,\n";
+        }
+        files.push_back(name);
+    }
+    files.push_back(string(dir) + "/missing.csv");
+
+    for (int mode = 0; mode < 2; mode++) {
+        bool verbose = mode == 1;
+        for (size_t last = 1; last <= files.size(); last++) {
+            vector<string> subset(files.begin(), files.begin() + last);
+            result_t expectResult, result;
+            string expectError, error;
+            string expect = readConfig(subset, verbose, 0, expectResult, expectError);
+            for (unsigned int threads = 2; threads <= 4; threads++) {
+                string output = readConfig(subset, verbose, threads, result, error);
+                ASSERT_EQ(result, expectResult) << "verbose " << verbose << ", files " << last;
+                ASSERT_EQ(error, expectError) << "verbose " << verbose << ", files " << last;
+                ASSERT_EQ(output, expect) << "verbose " << verbose << ", files " << last;
+            }
+        }
+    }
+    string expectError;
+    result_t expectResult;
+    string expect = readConfig(files, true, 0, expectResult, expectError);
+    ASSERT_NE(expect.find("messages: 207"), string::npos) << expect;
+    ASSERT_NE(expect.find("Erroneous item"), string::npos) << expect;
+
+    for (const auto& file : files)
+        unlink(file.c_str());
+    rmdir(dir);
+}
+
+TEST(TestMessageMap, pollSchedule)
+{
+    MessageMap messages;
+    time_t now;
+    time(&now);
+    auto first = make_shared<Message>("circuit", "first", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    auto second = make_shared<Message>("circuit", "second", false, false, 0xb5, 0x0a, DataFieldSet::getIdentFields());
+    auto third = make_shared<Message>("circuit", "third", false, false, 0xb5, 0x0b, DataFieldSet::getIdentFields());
+    ASSERT_TRUE(first->setPollPriority(1));
+    ASSERT_TRUE(second->setPollPriority(2));
+    ASSERT_EQ(messages.add(first), RESULT_OK);
+    ASSERT_EQ(messages.add(second), RESULT_OK);
+    ASSERT_EQ(messages.add(third), RESULT_OK);
+    ASSERT_EQ(messages.sizePoll(), 2u);
+    ASSERT_EQ(first->getPollInterval(), (unsigned int)POLL_PRIORITY_INTERVAL);
+    ASSERT_EQ(second->getPollInterval(), 2u * POLL_PRIORITY_INTERVAL);
+
+    ASSERT_TRUE(third->setPollPriority(3));
+    third->setPollInterval(5);
+    messages.addPollMessage(third, true);
+    messages.addPollMessage(third, true); // scheduled only once
+    ASSERT_EQ(messages.sizePoll(), 3u);
+
+    ASSERT_EQ(messages.getNextPoll(now), third);
+    ASSERT_EQ(messages.getNextPoll(now), first);
+    ASSERT_EQ(messages.getNextPoll(now), second);
+    ASSERT_EQ(messages.getNextPoll(now), nullptr);
+    ASSERT_EQ(first->getPollCount(), 1u);
+    ASSERT_EQ(first->getLastPollTime(), now);
+
+    // count the polls within 10 minutes with one poll opportunity per second (plus time for the last collisions)
+    std::map<string, int> polls;
+    for (time_t time = now + 1; time <= now + 602; time++) {
+        auto message = messages.getNextPoll(time);
+        if (message != nullptr)
+            polls[message->getName()]++;
+    }
+    ASSERT_EQ(polls["third"], 120);
+    ASSERT_EQ(polls["first"], 600 / POLL_PRIORITY_INTERVAL);
+    ASSERT_EQ(polls["second"], 600 / (2 * POLL_PRIORITY_INTERVAL));
+
+    second->setPollPriority(0);
+    for (time_t time = now + 603; time <= now + 1200; time++)
+        messages.getNextPoll(time);
+    ASSERT_EQ(messages.sizePoll(), 2u);
+}
+
+static void storeData(shared_ptr<Message> message, const char* masterHex, const char* slaveHex)
+{
+    SymbolString master(false), slave(false);
+    ASSERT_EQ(master.parseHex(masterHex), RESULT_OK);
+    ASSERT_EQ(slave.parseHex(slaveHex), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+}
+
+TEST(TestMessageMap, conditionsPushed)
+{
+    char dir[] = "/tmp/ebusdcondXXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    string name = string(dir) + "/08.csv";
+    {
+        std::ofstream file(name);
+        file << "*[code],ehp,code,,,08,4\n"
+            "*[seen],ehp,other,,,08\n"
+            "r,ehp,code,,,08,b509,0d4301,,,UCH,\n"
+            "r,ehp,other,,,08,b509,0d4307,,,UCH,\n"
+            "[code]r,ehp,status,,,08,b509,0d4302,,,UCH,\n"
+            "[code][seen]r,ehp,both,,,08,b509,0d4303,,,UCH,\n";
+    }
+    MessageMap messages;
+    ASSERT_EQ(messages.readFromFile(name), RESULT_OK);
+    ASSERT_EQ(messages.resolveConditions(), RESULT_OK);
+    auto code = messages.find("ehp", "code", false);
+    auto other = messages.find("ehp", "other", false);
+    ASSERT_NE(code, nullptr);
+    ASSERT_NE(other, nullptr);
+    ASSERT_EQ(messages.find("ehp", "status", false), nullptr);
+    ASSERT_EQ(messages.find("ehp", "both", false), nullptr);
+
+    storeData(code, "1008b509030d4301", "0104");
+    ASSERT_NE(messages.find("ehp", "status", false), nullptr);
+    ASSERT_EQ(messages.find("ehp", "both", false), nullptr);
+
+    storeData(other, "1008b509030d4307", "0100");
+    ASSERT_NE(messages.find("ehp", "both", false), nullptr);
+
+    // changes within the same second are evaluated as well
+    storeData(code, "1008b509030d4301", "0105");
+    ASSERT_EQ(messages.find("ehp", "status", false), nullptr);
+    ASSERT_EQ(messages.find("ehp", "both", false), nullptr);
+    storeData(code, "1008b509030d4301", "0104");
+    ASSERT_NE(messages.find("ehp", "status", false), nullptr);
+    ASSERT_NE(messages.find("ehp", "both", false), nullptr);
+
+    messages.clear();
+    ASSERT_EQ(messages.size(), 0u);
+    storeData(code, "1008b509030d4301", "0105"); // no longer referring to the deleted conditions
+    unlink(name.c_str());
+    rmdir(dir);
+}
+
+TEST(TestMessageMap, derivedSharesDefinition)
+{
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    auto derived = message->derive(0x15, true);
+    ASSERT_EQ(derived->getCircuit(), "circuit.15");
+    ASSERT_EQ(derived->getDstAddress().binAddr(), 0x15);
+    ASSERT_EQ(&derived->getId(), &message->getId()); // shared definition
+    ASSERT_EQ(&derived->getName(), &message->getName());
+    ASSERT_EQ(derived->getKey(), message->getDerivedKey(0x15));
+
+    // the last data is kept per instance
+    storeData(derived, "1015b50900", "00");
+    ASSERT_NE(derived->getLastUpdateTime(), 0);
+    ASSERT_EQ(message->getLastUpdateTime(), 0);
+
+    auto chained = make_shared<ChainedMessage>("circuit", "chained", false, "", SYN, 0x08,
+        vector<unsigned char>{0xb5, 0x09, 0x0d}, vector<vector<unsigned char>>{{0xb5, 0x09, 0x0d, 0x01}, {0xb5, 0x09, 0x0d, 0x02}},
+        vector<unsigned char>{1, 1}, DataFieldSet::getIdentFields(), 0);
+    auto derivedChained = chained->derive(0x15);
+    ASSERT_EQ(derivedChained->getCount(), 2);
+    ASSERT_EQ(derivedChained->getIdLength(), 2);
+    ASSERT_EQ(&derivedChained->getId(), &chained->getId());
+    ASSERT_EQ(derivedChained->getKey(), chained->getDerivedKey(0x15));
+}
+
+TEST(TestMessageMap, scanMessagePerAddress)
+{
+    MessageMap messages;
+    auto first = messages.getScanMessage(0x08);
+    auto second = messages.getScanMessage(0x15);
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    ASSERT_NE(first, second);
+    ASSERT_EQ(first->getCircuit(), "scan.08");
+    ASSERT_EQ(second->getCircuit(), "scan.15");
+    ASSERT_EQ(first->getSrcAddress(), messages.getScanMessage()->getSrcAddress());
+
+    // each derived scan message is kept for its own address
+    ASSERT_EQ(messages.getScanMessage(0x08), first);
+    ASSERT_EQ(messages.getScanMessage(0x15), second);
+    ASSERT_EQ(messages.getScanMessage(0x10), nullptr);
+}
+
+TEST(TestMessageMap, publishGeneration)
+{
+    auto previous = make_shared<MessageMap>();
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    ASSERT_EQ(previous->add(message), RESULT_OK);
+    SymbolString master(false), slave(false);
+    ASSERT_EQ(master.parseHex("1015b5090124"), RESULT_OK);
+    ASSERT_EQ(slave.parseHex("0102"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+
+    MessageMapHolder holder(previous);
+    shared_ptr<MessageMap> snapshot;
+    unsigned int generation = 0;
+    ASSERT_TRUE(holder.refresh(snapshot, generation));
+    ASSERT_EQ(snapshot, previous);
+    ASSERT_FALSE(holder.refresh(snapshot, generation));
+
+    // the new generation takes over the last data of the same message only
+    auto messages = make_shared<MessageMap>();
+    auto same = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    auto other = make_shared<Message>("circuit", "other", false, false, 0xb5, 0x0a, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages->add(same), RESULT_OK);
+    ASSERT_EQ(messages->add(other), RESULT_OK);
+    messages->getChangeJournal().continueAfter(previous->getChangeJournal());
+    unsigned long long cursor = previous->getChangeJournal().getCursor();
+    ASSERT_EQ(holder.publish(messages), 1u);
+    ASSERT_EQ(holder.getGeneration(), 1u);
+    ASSERT_EQ(snapshot, previous); // still the old snapshot until refreshed
+    ASSERT_TRUE(holder.refresh(snapshot, generation));
+    ASSERT_EQ(snapshot, messages);
+    ASSERT_EQ(generation, 1u);
+
+    ASSERT_EQ(messages->takeLastData(*previous), 1u);
+    ASSERT_EQ(same->getLastSlaveData().getDataStr(), slave.getDataStr());
+    ASSERT_EQ(same->getLastUpdateTime(), message->getLastUpdateTime());
+    ASSERT_EQ(other->getLastUpdateTime(), 0);
+
+    // a cursor of the previous generation is no longer valid
+    vector<Message*> changed;
+    ASSERT_FALSE(messages->getChangeJournal().getChanges(cursor, changed));
+}
+
+TEST(TestMessageMap, adaptiveMaxAgeAndRefresh)
+{
+    MessageMap messages;
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages.add(message), RESULT_OK);
+    ASSERT_EQ(message->getAdaptiveMaxAge(300), 300);
+
+    SymbolString master(false), slave(false);
+    ASSERT_EQ(master.parseHex("1015b5090124"), RESULT_OK);
+    ASSERT_EQ(slave.parseHex("0102"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+    ASSERT_EQ(message->getChangeInterval(), 0);
+    ASSERT_EQ(message->getAdaptiveMaxAge(300), 300); // not known yet
+    unsigned int changes = message->getChangeCount();
+    ASSERT_GT(changes, 0u);
+
+    // changes within the same second do not teach an interval
+    SymbolString other(false);
+    ASSERT_EQ(other.parseHex("0103"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(PartType::slaveData, other, 0), RESULT_OK);
+    time_t maxAge = message->getAdaptiveMaxAge(300);
+    ASSERT_TRUE(maxAge == 300 || maxAge == ADAPTIVE_MAX_AGE_MIN) << maxAge; // unless crossing a second boundary
+    ASSERT_EQ(message->getChangeCount(), changes+1);
+    ASSERT_EQ(message->storeLastData(PartType::slaveData, other, 0), RESULT_OK);
+    ASSERT_EQ(message->getChangeCount(), changes+1); // unchanged data
+
+    // passive messages and duplicates are not queued for a refresh
+    auto passive = make_shared<Message>("circuit", "passive", false, true, 0xb5, 0x0a, DataFieldSet::getIdentFields());
+    ASSERT_FALSE(messages.addRefreshMessage(passive));
+    ASSERT_FALSE(messages.addRefreshMessage(message)); // no destination address
+    auto derived = message->derive(0x08, true);
+    ASSERT_TRUE(messages.addRefreshMessage(derived));
+    ASSERT_FALSE(messages.addRefreshMessage(derived));
+    ASSERT_EQ(messages.sizeRefresh(), 1u);
+    ASSERT_EQ(messages.getNextRefresh(), derived);
+    ASSERT_EQ(messages.getNextRefresh(), nullptr);
+    ASSERT_TRUE(messages.addRefreshMessage(derived));
+    messages.clear();
+    ASSERT_EQ(messages.sizeRefresh(), 0u);
+    ASSERT_TRUE(messages.addRefreshMessage(derived));
+}
+
+/** a @a Message with changes at given times. */
+class TimedMessage : public Message
+{
+public:
+    using Message::Message;
+
+    void changeAt(time_t now)
+    {
+        m_lastUpdateTime = now;
+        markChanged();
+    }
+
+    void updateAt(time_t now) { m_lastUpdateTime = now; }
+};
+
+TEST(TestMessageMap, adaptiveMaxAgeLearned)
+{
+    TimedMessage message("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    message.changeAt(1000);
+    ASSERT_EQ(message.getChangeInterval(), 0);
+    ASSERT_EQ(message.getAdaptiveMaxAge(300), 300);
+
+    message.changeAt(1100);
+    ASSERT_EQ(message.getChangeInterval(), 100);
+    ASSERT_EQ(message.getAdaptiveMaxAge(300), 100/ADAPTIVE_MAX_AGE_DIVISOR);
+
+    // moving average
+    message.changeAt(1140);
+    time_t interval = (100*(CHANGE_INTERVAL_WEIGHT-1)+40)/CHANGE_INTERVAL_WEIGHT;
+    ASSERT_EQ(message.getChangeInterval(), interval);
+    ASSERT_EQ(message.getAdaptiveMaxAge(300), interval/ADAPTIVE_MAX_AGE_DIVISOR);
+
+    // unchanged for longer than the learned interval
+    message.updateAt(1140+400);
+    ASSERT_EQ(message.getChangeInterval(), interval);
+    ASSERT_EQ(message.getAdaptiveMaxAge(300), 400/ADAPTIVE_MAX_AGE_DIVISOR);
+
+    // clamped to the bounds
+    TimedMessage fast("circuit", "fast", false, false, 0xb5, 0x0a, DataFieldSet::getIdentFields());
+    fast.changeAt(2000);
+    fast.changeAt(2002);
+    ASSERT_EQ(fast.getChangeInterval(), 2);
+    ASSERT_EQ(fast.getAdaptiveMaxAge(300), ADAPTIVE_MAX_AGE_MIN);
+    TimedMessage slow("circuit", "slow", false, false, 0xb5, 0x0b, DataFieldSet::getIdentFields());
+    slow.changeAt(10000);
+    slow.changeAt(10000+3*ADAPTIVE_MAX_AGE_MAX);
+    ASSERT_EQ(slow.getChangeInterval(), 3*ADAPTIVE_MAX_AGE_MAX);
+    ASSERT_EQ(slow.getAdaptiveMaxAge(300), ADAPTIVE_MAX_AGE_MAX);
+}
+
+TEST(TestMessageMap, historyOfChanges)
+{
+    MessageMap messages;
+    messages.setHistorySegments(1);
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    ASSERT_EQ(message->getHistory(), nullptr);
+    ASSERT_EQ(messages.add(message), RESULT_OK);
+    ASSERT_NE(message->getHistory(), nullptr);
+
+    SymbolString master(false), slave(false);
+    ASSERT_EQ(master.parseHex("1015b50900"), RESULT_OK);
+    ASSERT_EQ(slave.parseHex("0ab5454850303003277201"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK); // unchanged
+    slave.clear();
+    ASSERT_EQ(slave.parseHex("0ab5454850303003287201"), RESULT_OK);
+    ASSERT_EQ(message->storeLastData(master, slave), RESULT_OK);
+    ASSERT_EQ(message->getHistory()->size(), 2u);
+
+    std::vector<std::string> values;
+    message->getHistory()->get(0, [&](time_t, SymbolString& entryMaster, SymbolString& entrySlave) {
+        std::ostringstream output;
+        EXPECT_EQ(message->decodeData(entryMaster, entrySlave, output), RESULT_OK);
+        values.push_back(output.str());
+        return true;
+    });
+    ASSERT_EQ(values.size(), 2u);
+    ASSERT_EQ(values[0], "Vaillant;EHP00;0327;7201");
+    ASSERT_EQ(values[1], "Vaillant;EHP00;0328;7201");
+}
+
+TEST(TestMessageMap, deriveForOtherBus)
+{
+    auto source = make_shared<MessageMap>();
+    MessageMap& messages = *source;
+    MessageMap other;
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    auto passive = make_shared<Message>("circuit", "seen", false, true, 0xb5, 0x10, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages.add(message), RESULT_OK);
+    ASSERT_EQ(messages.add(passive), RESULT_OK);
+
+    ASSERT_EQ(other.deriveFrom(source), 2u);
+    ASSERT_EQ(other.size(), messages.size());
+    ASSERT_EQ(other.sizePassive(), 1u);
+    auto derived = other.find("circuit", "name", false);
+    ASSERT_NE(derived, nullptr);
+    ASSERT_NE(derived, message);
+    ASSERT_EQ(derived->getKey(), message->getKey());
+
+    // the last data is kept per bus
+    SymbolString master(false), slave(false);
+    ASSERT_EQ(master.parseHex("1008b50900"), RESULT_OK);
+    ASSERT_EQ(slave.parseHex("0ab5454850303003277201"), RESULT_OK);
+    ASSERT_EQ(other.find(master, true), derived);
+    ASSERT_EQ(derived->storeLastData(master, slave), RESULT_OK);
+    ASSERT_NE(derived->getLastUpdateTime(), 0);
+    ASSERT_EQ(message->getLastUpdateTime(), 0);
+    ASSERT_EQ(messages.find(master, true), message);
+}
+
+TEST(TestMessageMap, reloadWithTwoBuses)
+{
+    string content = "*[code],ehp,code,,,08,4\n"
+        "r,ehp,code,,,08,b509,0d4301,,,UCH,\n"
+        "[code]r,ehp,status,,,08,b509,0d4302,,,UCH,\n";
+    auto primary = make_shared<MessageMap>();
+    ASSERT_EQ(primary->readFromContent(StringRef(content.data(), content.length()), "08.csv"), RESULT_OK);
+    ASSERT_EQ(primary->resolveConditions(), RESULT_OK);
+    auto other = make_shared<MessageMap>();
+    ASSERT_EQ(other->deriveFrom(primary), 2u);
+
+    // reload: the primary bus switches to the new generation while the other bus still uses the old one
+    auto reloaded = make_shared<MessageMap>();
+    ASSERT_EQ(reloaded->readFromContent(StringRef(content.data(), content.length()), "08.csv"), RESULT_OK);
+    ASSERT_EQ(reloaded->resolveConditions(), RESULT_OK);
+    std::weak_ptr<MessageMap> retired = primary;
+    primary = reloaded;
+    ASSERT_FALSE(retired.expired());
+    ASSERT_EQ(other->find("ehp", "status", false), nullptr);
+    storeData(retired.lock()->find("ehp", "code", false), "1008b509030d4301", "0104");
+    auto status = other->find("ehp", "status", false);
+    ASSERT_NE(status, nullptr);
+    ASSERT_TRUE(status->isConditional());
+
+    // the old generation is released together with the last map derived from it
+    auto derived = make_shared<MessageMap>();
+    ASSERT_EQ(derived->deriveFrom(primary), 2u);
+    status.reset();
+    other = derived;
+    ASSERT_TRUE(retired.expired());
+}
+
+TEST(TestMessageMap, preparedMasterCache)
+{
+    vector<string> entries = {"value", "m", "UCH", "", "", ""};
+    auto it = entries.begin();
+    shared_ptr<DataField> fields;
+    ASSERT_EQ(DataField::create(it, entries.end(), &templates, fields, true, false, false), RESULT_OK);
+    auto message = make_shared<Message>("circuit", "name", true, false, 0xb5, 0x09, fields)->derive(0x08);
+    auto reference = make_shared<Message>("circuit", "name", true, false, 0xb5, 0x09, fields)->derive(0x08);
+
+    SymbolString master(true), expected(true);
+    for (int run = 0; run < 3; run++) {
+        istringstream input("169"), refInput("169");
+        ASSERT_EQ(message->prepareMaster(0x10, master, input), RESULT_OK);
+        ASSERT_EQ(reference->prepareMaster(0x10, expected, refInput), RESULT_OK);
+        ASSERT_EQ(master.getDataStr(false, false), expected.getDataStr(false, false));
+        ASSERT_EQ(master.getDataStr(false, false).substr(0, 14), "1008b50901a900"); // escaped value
+        ASSERT_EQ(master.getDataStr(false, false).length(), 16u); // followed by the CRC
+    }
+    ASSERT_EQ(message->getPreparedHits(), 2u);
+    ASSERT_EQ(message->getLastMasterData().getDataStr(true, false), "1008b50901a9");
+
+    // a different source, destination, or input is prepared again
+    istringstream input("170");
+    ASSERT_EQ(message->prepareMaster(0x10, master, input), RESULT_OK);
+    input.str("169");
+    ASSERT_EQ(message->prepareMaster(0x31, master, input), RESULT_OK);
+    input.str("169");
+    ASSERT_EQ(message->prepareMaster(0x10, master, input, UI_FIELD_SEPARATOR, 0x15), RESULT_OK);
+    ASSERT_EQ(message->getPreparedHits(), 2u);
+    input.str("170");
+    ASSERT_EQ(message->prepareMaster(0x10, master, input), RESULT_OK);
+    ASSERT_EQ(message->getPreparedHits(), 3u);
+    SymbolString unescaped(false);
+    input.str("170");
+    ASSERT_EQ(message->prepareMaster(0x10, unescaped, input), RESULT_OK);
+    ASSERT_EQ(unescaped.getDataStr(true, false), "1008b50901aa");
+    ASSERT_EQ(message->getPreparedHits(), 4u);
+
+    // invalid input is not cached
+    input.str("x");
+    ASSERT_NE(message->prepareMaster(0x10, master, input), RESULT_OK);
+    input.str("x");
+    ASSERT_NE(message->prepareMaster(0x10, master, input), RESULT_OK);
+    ASSERT_EQ(message->getPreparedHits(), 4u);
+}
+
+TEST(TestMessageMap, findUncached)
+{
+    MessageMap messages;
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    ASSERT_EQ(messages.add(message->derive(0x08)), RESULT_OK);
+    SymbolString master(false), unknown(false);
+    ASSERT_EQ(master.parseHex("1008b50900"), RESULT_OK);
+    ASSERT_EQ(unknown.parseHex("1008b51000"), RESULT_OK);
+
+    auto found = messages.find(master);
+    ASSERT_NE(found, nullptr);
+    ASSERT_EQ(messages.findUncached(master), found.get());
+    long useCount = found.use_count();
+    ASSERT_EQ(messages.findUncached(unknown), nullptr);
+    ASSERT_EQ(messages.findUncached(unknown), nullptr);
+    ASSERT_EQ(messages.findUncached(master), found.get());
+    ASSERT_EQ(found.use_count(), useCount);
+    ASSERT_EQ(messages.getUnknownCacheHits(), 0u);
+    ASSERT_EQ(messages.getUnknownCacheMisses(), 0u); // neither from find() of known nor from findUncached()
+    ASSERT_EQ(messages.find(unknown), nullptr); // not remembered by findUncached()
+    ASSERT_EQ(messages.getUnknownCacheHits(), 0u);
+    ASSERT_EQ(messages.getUnknownCacheMisses(), 1u);
+}
+
+TEST(TestMessageMap, encodeSlaveKeepsState)
+{
+    auto message = make_shared<Message>("circuit", "name", false, false, 0xb5, 0x09, DataFieldSet::getIdentFields());
+    istringstream input("21;ABCDE;0102;0304");
+    SymbolString encoded(false);
+    ASSERT_EQ(message->encodeSlave(input, encoded), RESULT_OK);
+    ASSERT_EQ(encoded.getDataStr(true, false), "0a15414243444501020304");
+    ASSERT_EQ(message->getChangeCount(), 0u);
+    ASSERT_EQ(message->getLastUpdateTime(), 0);
+    ASSERT_EQ(message->getLastSlaveData().size(), 0u);
+
+    input.clear();
+    input.str("21;ABCDE;0102;0304");
+    SymbolString prepared;
+    ASSERT_EQ(message->prepareSlave(input, prepared), RESULT_OK);
+    ASSERT_EQ(message->getChangeCount(), 1u);
+    ASSERT_TRUE(message->getLastSlaveData() == encoded);
+}
@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+#include "outputsink.h"
+#include "data.h"
+#include <climits>
+#include <iomanip>
+#include <sstream>
+
+TEST(TestOutputSink, writeAndReuse)
+{
+    OutputSink sink;
+    ASSERT_EQ(sink.size(), 0u);
+
+    sink << "value=" << std::setw(3) << std::setfill('0') << 7 << ";" << std::hex << 255;
+    ASSERT_EQ(sink.str(), "value=007;ff");
+    ASSERT_EQ((size_t)sink.tellp(), sink.size());
+
+    size_t pos = sink.size();
+    sink << ";removed";
+    sink.truncate(pos);
+    sink << ";kept";
+    ASSERT_EQ(sink.str(), "value=007;ff;kept");
+
+    sink.reset();
+    ASSERT_EQ(sink.size(), 0u);
+    sink << 255;
+    ASSERT_EQ(sink.str(), "255");
+
+    string large(5000, 'x');
+    sink << large;
+    ASSERT_EQ(sink.size(), 5003u);
+    ASSERT_EQ(sink.str().substr(0, 4), "255x");
+
+    string appended = "head:";
+    sink.appendTo(appended);
+    ASSERT_EQ(appended.length(), 5008u);
+}
+
+TEST(TestOutputSink, numbers)
+{
+    const long long values[] = { 0, 1, -1, 9, 10, 99, 100, -128, 32767, -32768, INT_MAX, INT_MIN, LLONG_MAX, LLONG_MIN };
+    for (auto value : values) {
+        OutputSink sink;
+        std::ostringstream expect;
+        writeSigned(sink, value);
+        expect << value;
+        ASSERT_EQ(sink.str(), expect.str());
+    }
+    OutputSink sink;
+    writeUnsigned(sink, 0xffffffffffffffffULL);
+    ASSERT_EQ(sink.str(), "18446744073709551615");
+}
+
+TEST(TestOutputSink, decodeMatchesStringStream)
+{
+    auto fields = DataFieldSet::getIdentFields();
+    SymbolString slave(false);
+    ASSERT_EQ(slave.parseHex("0ab5454243443101020304"), RESULT_OK);
+    const OutputFormat formats[] = { 0, OF_VERBOSE, OF_NUMERIC, OF_JSON, OF_JSON|OF_VERBOSE };
+    OutputSink sink;
+    for (auto format : formats) {
+        std::ostringstream expect;
+        sink.reset();
+        ASSERT_EQ(fields->read(PartType::slaveData, slave, 0, expect, format), RESULT_OK);
+        ASSERT_EQ(fields->read(PartType::slaveData, slave, 0, sink, format), RESULT_OK);
+        ASSERT_EQ(sink.str(), expect.str());
+    }
+}
@@ -0,0 +1,86 @@
+#include "gtest/gtest.h"
+#include "stringpool.h"
+#include <thread>
+#include <vector>
+
+TEST(TestStringPool, internAndCompare)
+{
+    InternedString empty, alsoEmpty("");
+    ASSERT_TRUE(empty.empty());
+    ASSERT_EQ(empty, alsoEmpty);
+    ASSERT_EQ(empty.str(), "");
+
+    string value = "OutsideTemp";
+    InternedString first(value), second(string("Outside") + "Temp"), other("outsidetemp");
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(&first.str(), &second.str()); // shared storage
+    ASSERT_NE(first, other);
+    ASSERT_EQ(first, value);
+    ASSERT_EQ(first.getHash(), std::hash<string>()(value));
+
+    // the lowercase form is interned as well
+    ASSERT_EQ(first.lower(), other);
+    ASSERT_EQ(first.getLowerId(), other.getLowerId());
+    ASSERT_EQ(other.lower(), other);
+    ASSERT_EQ(first.lower().str(), "outsidetemp");
+
+    InternedString found;
+    ASSERT_TRUE(InternedString::find("OutsideTemp", found));
+    ASSERT_EQ(found, first);
+    ASSERT_FALSE(InternedString::find("UnknownName", found));
+    ASSERT_EQ(found, first);
+    ASSERT_TRUE(InternedString::find("", found));
+    ASSERT_TRUE(found.empty());
+}
+
+TEST(TestStringPool, releaseAndStats)
+{
+    StringPoolStats before, stats;
+    InternedString::getStats(before);
+    {
+        vector<InternedString> names;
+        for (int i = 0; i < 100; i++)
+            names.push_back(InternedString("a rather long comment that does not fit into a string"));
+        InternedString::getStats(stats);
+        ASSERT_EQ(stats.m_strings, before.m_strings + 1);
+        ASSERT_EQ(stats.m_references, before.m_references + 100);
+        ASSERT_GT(stats.m_savedBytes, before.m_savedBytes);
+        InternedString moved(std::move(names.back()));
+        ASSERT_TRUE(names.back().empty());
+        names.back() = moved;
+        ASSERT_EQ(names.back(), moved);
+    }
+    InternedString::getStats(stats);
+    ASSERT_EQ(stats.m_strings, before.m_strings);
+    ASSERT_EQ(stats.m_references, before.m_references);
+    InternedString found;
+    ASSERT_FALSE(InternedString::find("a rather long comment that does not fit into a string", found));
+
+    // mixed case entries keep their lowercase form alive
+    InternedString upper("MixedCase");
+    InternedString::getStats(stats);
+    ASSERT_EQ(stats.m_strings, before.m_strings + 2);
+    ASSERT_EQ(stats.m_references, before.m_references + 1);
+    upper = InternedString();
+    InternedString::getStats(stats);
+    ASSERT_EQ(stats.m_strings, before.m_strings);
+}
+
+TEST(TestStringPool, concurrentInternAndRelease)
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([]() {
+            for (int i = 0; i < 5000; i++) {
+                InternedString value(i % 2 == 0 ? "Shared" : "shared");
+                InternedString copy = value;
+                ASSERT_EQ(copy.lower().str(), "shared");
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    InternedString found;
+    ASSERT_FALSE(InternedString::find("Shared", found));
+    ASSERT_FALSE(InternedString::find("shared", found));
+}
@@ -24,4 +24,58 @@ TEST(TestSymbolString, testUnescaped)
     ASSERT_EQ(result, RESULT_OK);
 
     ASSERT_EQ(sstr.getDataStr(true, false),"10feb5050427a915aa77");
-}
\ No newline at end of file
+}
+TEST(TestSymbolString, testDataStrBuffer)
+{
+    SymbolString sstr(true);
+
+    auto result = sstr.parseHex("10feb5050427a915aa", false);
+    ASSERT_EQ(result, RESULT_OK);
+
+    char buffer[MAX_DATA_STR_SIZE];
+    ASSERT_EQ(sstr.getDataStr(buffer, sizeof(buffer), true, false), 20u);
+    ASSERT_STREQ(buffer, "10feb5050427a915aa77");
+
+    ASSERT_EQ(sstr.getDataStr(buffer, sizeof(buffer)), 18u);
+    ASSERT_STREQ(buffer, "10feb5050427a915aa");
+
+    ASSERT_EQ(sstr.getDataStr(buffer, sizeof(buffer), false, false), 24u);
+    ASSERT_STREQ(buffer, "10feb5050427a90015a90177");
+
+    ASSERT_EQ(sstr.getDataStr(buffer, 6), 4u); // truncated
+    ASSERT_STREQ(buffer, "10fe");
+}
+
+TEST(TestSymbolString, testCalcCRC)
+{
+    const unsigned char data[] = {0x10, 0xfe, 0xb5, 0x05, 0x04, 0x27, 0xa9, 0x15, 0xaa};
+    ASSERT_EQ(SymbolString::calcCRC(data, sizeof(data), true), 0x77);
+
+    const unsigned char escaped[] = {0x10, 0xfe, 0xb5, 0x05, 0x04, 0x27, 0xa9, 0x00, 0x15, 0xa9, 0x01, 0x77};
+    ASSERT_EQ(SymbolString::calcCRC(escaped, sizeof(escaped)-1), 0x77);
+    ASSERT_TRUE(SymbolString::checkCRC(escaped, sizeof(escaped)));
+    ASSERT_FALSE(SymbolString::checkCRC(escaped, sizeof(escaped)-1));
+
+    const unsigned char unescaped[] = {0x10, 0xfe, 0xb5, 0x05, 0x04, 0x27, 0xa9, 0x15, 0xaa, 0x77};
+    ASSERT_TRUE(SymbolString::checkCRC(unescaped, sizeof(unescaped), false));
+
+    // bulk calculation has to match the calculation symbol by symbol
+    unsigned char values[257];
+    for (unsigned int i = 0; i < sizeof(values); i++) {
+        values[i] = (unsigned char)(i * 37 + 11);
+    }
+    for (size_t len = 0; len < sizeof(values); len += 13) {
+        SymbolString sstr(true);
+        for (size_t i = 0; i < len; i++) {
+            sstr.push_back(values[i], false);
+        }
+        ASSERT_EQ(SymbolString::calcCRC(values, len, true), sstr.getCRC());
+    }
+}
+
+TEST(TestSymbolString, testParseHexInvalid)
+{
+    SymbolString sstr(true);
+
+    ASSERT_EQ(sstr.parseHex("10fe0g"), RESULT_ERR_INVALID_NUM);
+}
@@ -0,0 +1,73 @@
+#include "gtest/gtest.h"
+#include "symbol.h"
+#include <atomic>
+#include <new>
+
+static std::atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* ptr = malloc(size);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+static const unsigned char TELEGRAM[] = {0x10, 0x08, 0xb5, 0x09, 0x03, 0x0d, 0x29, 0x00, 0xaa, 0x07};
+static const unsigned char RESPONSE[] = {0x04, 0x12, 0x34, 0xa9, 0x78};
+
+TEST(TestSymbolStringAlloc, allocationsPerTelegram)
+{
+    const unsigned long telegrams = 1000;
+
+    // telegrams fitting into the inline storage do not allocate
+    SymbolString lastMaster(false), lastSlave(false);
+    unsigned long start = allocations;
+    for (unsigned long i = 0; i < telegrams; i++) {
+        SymbolString master(true), slave(true);
+        for (auto value : TELEGRAM) {
+            master.push_back(value, false);
+        }
+        master.push_back(master.getCRC(), false, false);
+        for (auto value : RESPONSE) {
+            slave.push_back(value, false);
+        }
+        slave.push_back(slave.getCRC(), false, false);
+        lastMaster = master;
+        lastSlave = slave;
+        SymbolString moved(std::move(master));
+        ASSERT_EQ(moved.size(), lastMaster.size());
+    }
+    ASSERT_EQ(allocations - start, 0u);
+}
+
+TEST(TestSymbolStringAlloc, exceedInline)
+{
+    SymbolString sstr(false);
+    for (unsigned int i = 0; i < 2*SYMBOL_INLINE_SIZE; i++) {
+        sstr.push_back((unsigned char)i, false);
+    }
+    ASSERT_EQ(sstr.size(), 2*SYMBOL_INLINE_SIZE);
+    ASSERT_EQ(sstr[2*SYMBOL_INLINE_SIZE-1], 2*SYMBOL_INLINE_SIZE-1);
+
+    SymbolString copy(false);
+    copy = sstr;
+    ASSERT_TRUE(copy == sstr);
+
+    SymbolString moved(std::move(sstr));
+    ASSERT_TRUE(moved == copy);
+    ASSERT_EQ(sstr.size(), 0);
+    sstr.push_back(0x01, false);
+    ASSERT_EQ(sstr.size(), 1);
+}
@@ -0,0 +1,49 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "arena.h"
+
+void* ArenaObject::operator new(size_t size)
+{
+	ConfigArena* arena = ConfigArena::getCurrent();
+	char* base;
+	if (arena) {
+		base = static_cast<char*>(arena->allocate(ARENA_HEADER_SIZE + size));
+		arena->retain();
+	} else {
+		base = static_cast<char*>(::operator new(ARENA_HEADER_SIZE + size));
+	}
+	*reinterpret_cast<ConfigArena**>(base) = arena;
+	return base + ARENA_HEADER_SIZE;
+}
+
+void ArenaObject::operator delete(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+	char* base = static_cast<char*>(ptr) - ARENA_HEADER_SIZE;
+	ConfigArena* arena = *reinterpret_cast<ConfigArena**>(base);
+	if (arena)
+		arena->release();
+	else
+		::operator delete(base);
+}
@@ -0,0 +1,343 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_ARENA_H_
+#define LIBUTILS_ARENA_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "cppconfig.h"
+
+/** \file arena.h
+ * A chunked memory arena for objects sharing the same lifetime.
+ *
+ * A @a ConfigArena hands out memory from large chunks without any per object
+ * bookkeeping, so that a whole generation of objects (e.g. all definitions of
+ * a loaded configuration) is packed densely and released in a single step.
+ * Each object allocated from an arena keeps a reference on it, so the chunks
+ * are freed as soon as the last object of the generation was destroyed and
+ * the owner released its own reference.
+ *
+ * The arena to allocate from is selected per thread with a
+ * @a ConfigArena::Scope. Outside of a scope, all allocations go to the heap.
+ *
+ * The arena only replaces the allocator: the objects are still owned through
+ * shared_ptr (with the control block placed in the arena as well) and
+ * destructed one by one, and lookups hand out owning references rather than
+ * non-owning views. References held across a reload (e.g. by the MQTT
+ * publisher or a pending request) therefore keep their objects valid.
+ */
+
+/** the size of a regular chunk of a @a ConfigArena in bytes. */
+#define ARENA_CHUNK_SIZE (64*1024)
+
+/** the size of the header in front of each object allocated by @a ArenaObject (keeps the maximum alignment). */
+#define ARENA_HEADER_SIZE alignof(std::max_align_t)
+
+/**
+ * A reference counted chunked memory arena.
+ */
+class ConfigArena
+{
+public:
+
+	/**
+	 * Create a new arena with a single reference held by the caller.
+	 * @return the new @a ConfigArena.
+	 */
+	static ConfigArena* create() { return new ConfigArena(); }
+
+private:
+
+	/**
+	 * Construct a new instance.
+	 */
+	ConfigArena() {}
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	ConfigArena(const ConfigArena& src);
+
+	/**
+	 * Destructor (frees all chunks).
+	 */
+	~ConfigArena()
+	{
+		for (auto chunk : m_chunks)
+			delete[] chunk;
+	}
+
+public:
+
+	/**
+	 * Add a reference.
+	 */
+	void retain() { m_references.fetch_add(1, std::memory_order_relaxed); }
+
+	/**
+	 * Remove a reference and free the arena with all chunks when it was the last one.
+	 */
+	void release()
+	{
+		if (m_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete this;
+	}
+
+	/**
+	 * Allocate memory from the arena (thread safe).
+	 * @param size the number of bytes to allocate.
+	 * @param alignment the alignment of the memory (a power of 2 not larger than the maximum alignment).
+	 * @return the allocated memory (only released together with the arena).
+	 */
+	void* allocate(size_t size, size_t alignment=alignof(std::max_align_t))
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_allocatedSize.fetch_add(size, std::memory_order_relaxed);
+		if (size > ARENA_CHUNK_SIZE/4) {
+			// large object: use a dedicated chunk and keep filling the current one
+			char* chunk = new char[size];
+			m_chunks.push_back(chunk);
+			m_reservedSize.fetch_add(size, std::memory_order_relaxed);
+			return chunk;
+		}
+		uintptr_t pos = ((uintptr_t)m_next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		if (m_next == NULL || pos + size > (uintptr_t)m_end) {
+			char* chunk = new char[ARENA_CHUNK_SIZE];
+			m_chunks.push_back(chunk);
+			m_reservedSize.fetch_add(ARENA_CHUNK_SIZE, std::memory_order_relaxed);
+			m_next = chunk;
+			m_end = chunk + ARENA_CHUNK_SIZE;
+			pos = ((uintptr_t)m_next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		}
+		m_next = reinterpret_cast<char*>(pos + size);
+		return reinterpret_cast<void*>(pos);
+	}
+
+	/**
+	 * Get the number of bytes allocated from the arena.
+	 * @return the number of bytes allocated from the arena.
+	 */
+	size_t getAllocatedSize() const { return m_allocatedSize.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the number of bytes reserved in chunks.
+	 * @return the number of bytes reserved in chunks.
+	 */
+	size_t getReservedSize() const { return m_reservedSize.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the arena selected for the current thread.
+	 * @return the @a ConfigArena selected for the current thread, or NULL to allocate from the heap.
+	 */
+	static ConfigArena* getCurrent() { return current(); }
+
+	/**
+	 * Selects the arena to allocate from in the current thread while in scope.
+	 */
+	class Scope
+	{
+	public:
+
+		/**
+		 * Select the arena for the current thread.
+		 * @param arena the @a ConfigArena to allocate from, or NULL to allocate from the heap.
+		 */
+		explicit Scope(ConfigArena* arena) : m_previous(current()) { current() = arena; }
+
+		/**
+		 * Restore the previously selected arena.
+		 */
+		~Scope() { current() = m_previous; }
+
+	private:
+
+		/**
+		 * Hidden copy constructor.
+		 * @param src the object to copy from.
+		 */
+		Scope(const Scope& src);
+
+		/** the previously selected arena. */
+		ConfigArena* m_previous;
+
+	};
+
+private:
+
+	/**
+	 * Get the arena selected for the current thread.
+	 * @return the reference to the variable holding the arena selected for the current thread.
+	 */
+	static ConfigArena*& current()
+	{
+		static thread_local ConfigArena* arena = NULL;
+		return arena;
+	}
+
+	/** the mutex for allocating. */
+	std::mutex m_mutex;
+
+	/** the allocated chunks. */
+	vector<char*> m_chunks;
+
+	/** the next free position in the current chunk. */
+	char* m_next = NULL;
+
+	/** the end of the current chunk. */
+	char* m_end = NULL;
+
+	/** the number of references. */
+	std::atomic<unsigned long> m_references{1};
+
+	/** the number of bytes allocated. */
+	std::atomic<size_t> m_allocatedSize{0};
+
+	/** the number of bytes reserved in chunks. */
+	std::atomic<size_t> m_reservedSize{0};
+
+};
+
+
+/**
+ * Allocator for use with std::allocate_shared() taking memory from a @a ConfigArena.
+ * Memory is never freed individually, each copy of the allocator keeps a
+ * reference on the arena instead.
+ * @param T the type of the allocated objects.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+
+	/** the type of the allocated objects. */
+	typedef T value_type;
+
+	/**
+	 * Construct a new instance.
+	 * @param arena the @a ConfigArena to allocate from.
+	 */
+	explicit ArenaAllocator(ConfigArena* arena) : m_arena(arena) { m_arena->retain(); }
+
+	/**
+	 * Copy constructor.
+	 * @param other the allocator to copy from.
+	 */
+	ArenaAllocator(const ArenaAllocator& other) : m_arena(other.m_arena) { m_arena->retain(); }
+
+	/**
+	 * Converting copy constructor.
+	 * @param other the allocator to copy from.
+	 */
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.getArena()) { m_arena->retain(); }
+
+	/**
+	 * Destructor.
+	 */
+	~ArenaAllocator() { m_arena->release(); }
+
+	/**
+	 * Allocate memory for objects.
+	 * @param count the number of objects.
+	 * @return the allocated memory.
+	 */
+	T* allocate(size_t count) { return static_cast<T*>(m_arena->allocate(count*sizeof(T), alignof(T))); }
+
+	/**
+	 * Deallocate memory (only freed together with the arena).
+	 */
+	void deallocate(T*, size_t) {}
+
+	/**
+	 * Get the @a ConfigArena to allocate from.
+	 * @return the @a ConfigArena to allocate from.
+	 */
+	ConfigArena* getArena() const { return m_arena; }
+
+	/**
+	 * Return whether both allocators use the same arena.
+	 * @param other the other allocator.
+	 * @return whether both allocators use the same arena.
+	 */
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.getArena(); }
+
+	/**
+	 * Return whether the allocators use different arenas.
+	 * @param other the other allocator.
+	 * @return whether the allocators use different arenas.
+	 */
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.getArena(); }
+
+private:
+
+	/** the @a ConfigArena to allocate from. */
+	ConfigArena* m_arena;
+
+};
+
+
+/**
+ * Create a shared object in the arena selected for the current thread (object and control block in one allocation).
+ * @param T the type of the object.
+ * @param args the arguments for the constructor.
+ * @return the new shared object.
+ */
+template <typename T, typename... Args>
+shared_ptr<T> allocateShared(Args&&... args)
+{
+	ConfigArena* arena = ConfigArena::getCurrent();
+	if (arena == NULL)
+		return make_shared<T>(std::forward<Args>(args)...);
+	return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+}
+
+
+/**
+ * Base class for objects created with new that shall be placed in the arena selected for the current thread.
+ * The object is still destroyed with delete, its memory is then released
+ * together with the arena (or freed individually if it came from the heap).
+ */
+class ArenaObject
+{
+public:
+
+	/**
+	 * Allocate memory for an object.
+	 * @param size the size of the object.
+	 * @return the allocated memory.
+	 */
+	static void* operator new(size_t size);
+
+	/**
+	 * Free the memory of an object.
+	 * @param ptr the memory of the object.
+	 */
+	static void operator delete(void* ptr);
+
+};
+
+#endif // LIBUTILS_ARENA_H_
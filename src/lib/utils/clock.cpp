@@ -25,6 +25,8 @@
 #ifdef __MACH__
 static bool clockInitialized = false;
 static clock_serv_t clockServ;
+static bool monotonicInitialized = false;
+static clock_serv_t monotonicServ;
 #endif
 
 void clockGettime(struct timespec* t)
@@ -42,3 +44,26 @@ void clockGettime(struct timespec* t)
 	clock_gettime(CLOCK_REALTIME, t);
 #endif
 }
+
+void clockGettimeMonotonic(struct timespec* t)
+{
+#ifdef __MACH__
+	if (!monotonicInitialized) {
+		monotonicInitialized = true;
+		host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &monotonicServ);
+	}
+	mach_timespec_t mts;
+	clock_get_time(monotonicServ, &mts);
+	t->tv_sec = mts.tv_sec;
+	t->tv_nsec = mts.tv_nsec;
+#else
+	clock_gettime(CLOCK_MONOTONIC, t);
+#endif
+}
+
+unsigned long long clockGetMicros()
+{
+	struct timespec t;
+	clockGettimeMonotonic(&t);
+	return (unsigned long long)t.tv_sec*1000000ULL + (unsigned long long)(t.tv_nsec/1000);
+}
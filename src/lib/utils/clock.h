@@ -29,4 +29,16 @@
  */
 void clockGettime(struct timespec* t);
 
+/**
+ * Get the monotonic system clock (not affected by changes of the real time).
+ * @param t the @a timespec in which to store the time.
+ */
+void clockGettimeMonotonic(struct timespec* t);
+
+/**
+ * Get the monotonic system clock in microseconds.
+ * @return the monotonic system clock in microseconds.
+ */
+unsigned long long clockGetMicros();
+
 #endif // LIBUTILS_CLOCK_H_
@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <iostream>
 #include <iomanip>
@@ -12,9 +14,12 @@
 using std::string;
 using std::vector;
 using std::map;
+using std::unordered_map;
+using std::unordered_set;
 using std::deque;
 using std::list;
 using std::shared_ptr;
+using std::weak_ptr;
 using std::make_shared;
 
 using std::ofstream;
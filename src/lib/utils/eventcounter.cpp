@@ -0,0 +1,77 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "eventcounter.h"
+#include <chrono>
+#include <climits>
+#include <errno.h>
+#include <time.h>
+
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool EventCounter::wait(const int key, const long timeout)
+{
+	bool signaled = true;
+#ifdef HAVE_LINUX_FUTEX_H
+	struct timespec tdiff, *tptr = NULL;
+	if (timeout > 0) {
+		tdiff.tv_sec = timeout/1000;
+		tdiff.tv_nsec = (timeout%1000)*1000000;
+		tptr = &tdiff;
+	}
+	while (m_count.load() == key) {
+		// the futex word is the plain int value of the atomic
+		int ret = (int)syscall(SYS_futex, reinterpret_cast<int*>(&m_count), FUTEX_WAIT_PRIVATE, key, tptr, NULL, 0);
+		if (ret == -1 && errno == ETIMEDOUT) {
+			signaled = m_count.load() != key;
+			break;
+		}
+		// EAGAIN (value already changed) and EINTR (retry with full timeout) are handled by the loop
+	}
+#else
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (timeout > 0)
+		signaled = m_cond.wait_for(lock, std::chrono::milliseconds(timeout), [this, key]{ return m_count.load() != key; });
+	else
+		m_cond.wait(lock, [this, key]{ return m_count.load() != key; });
+#endif
+	return signaled;
+}
+
+void EventCounter::notify()
+{
+	m_count++;
+	if (!m_waiting.exchange(false))
+		return;
+#ifdef HAVE_LINUX_FUTEX_H
+	syscall(SYS_futex, reinterpret_cast<int*>(&m_count), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_cond.notify_all();
+#endif
+}
@@ -0,0 +1,99 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_EVENTCOUNTER_H_
+#define LIBUTILS_EVENTCOUNTER_H_
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/** \file eventcounter.h */
+
+/**
+ * An event counter for blocking until another thread signals an event.
+ *
+ * A waiting thread takes a key with @a prepareWait(), checks its own
+ * (lock-free) condition, and then calls @a wait() with the key. A signal sent
+ * via @a notify() in between is not lost. The notifying side does not need a
+ * system call as long as nobody is waiting, and wakes up all waiting threads
+ * with a single system call until one of them prepares to wait again. On Linux the wait is built on the
+ * futex system call, on other systems a mutex and condition variable are used
+ * for the waiting part only.
+ */
+class EventCounter
+{
+public:
+	EventCounter() : m_count(0), m_waiting(false) {}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	EventCounter(const EventCounter& src);
+
+public:
+
+	/**
+	 * Register as waiting thread and get the key for @a wait().
+	 * @return the key to pass to @a wait().
+	 * Note: each call has to be followed by either @a wait() or @a cancelWait().
+	 */
+	int prepareWait()
+	{
+		m_waiting.store(true);
+		return m_count.load();
+	}
+
+	/**
+	 * Unregister as waiting thread without waiting.
+	 * Note: the pending wakeup is kept, as other threads might still be waiting.
+	 */
+	void cancelWait() {}
+
+	/**
+	 * Wait for an event signaled after @a prepareWait().
+	 * @param key the key returned by @a prepareWait().
+	 * @param timeout the maximum time in milliseconds to wait, or 0 for infinite.
+	 * @return true if an event was signaled, false on timeout.
+	 */
+	bool wait(const int key, const long timeout=0);
+
+	/**
+	 * Signal an event to all waiting threads.
+	 */
+	void notify();
+
+private:
+	/** the number of signaled events (also used as futex word). */
+	std::atomic<int> m_count;
+
+	/** whether a thread prepared to wait since the last wakeup. */
+	std::atomic<bool> m_waiting;
+
+	/** mutex variable for waiting without futex support. */
+	std::mutex m_mutex;
+
+	/** condition variable for waiting without futex support. */
+	std::condition_variable m_cond;
+
+};
+
+#endif // LIBUTILS_EVENTCOUNTER_H_
@@ -0,0 +1,172 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_FLATINDEX_H_
+#define LIBUTILS_FLATINDEX_H_
+
+#include <vector>
+#include <cstddef>
+#include "cppconfig.h"
+
+/** \file flatindex.h */
+
+/** the initial number of slots of a non-empty @a FlatIndex (power of 2). */
+#define FLATINDEX_MIN_CAPACITY 16
+
+/**
+ * Template class for an open addressing hash index with 64 bit keys.
+ *
+ * All entries are kept in a single contiguous slot array using linear probing,
+ * so that a lookup usually touches only one or two cache lines. Entries can
+ * only be added or all removed at once, which is the typical usage for
+ * lookup tables built while loading the configuration.
+ * @param V the value type (should be cheap to copy, e.g. a pointer or number).
+ */
+template <typename V>
+class FlatIndex
+{
+public:
+	FlatIndex() = default;
+
+	/**
+	 * Find the value stored for the key.
+	 * @param key the key to find.
+	 * @return the pointer to the stored value, or NULL if the key is not stored.
+	 */
+	V* find(const unsigned long long key)
+	{
+		if (m_size == 0)
+			return NULL;
+		size_t mask = m_slots.size() - 1;
+		for (size_t pos = hash(key) & mask; m_slots[pos].m_used; pos = (pos + 1) & mask) {
+			if (m_slots[pos].m_key == key)
+				return &m_slots[pos].m_value;
+		}
+		return NULL;
+	}
+
+	/**
+	 * Find the value stored for the key.
+	 * @param key the key to find.
+	 * @return the pointer to the stored value, or NULL if the key is not stored.
+	 */
+	const V* find(const unsigned long long key) const
+	{
+		return const_cast<FlatIndex*>(this)->find(key);
+	}
+
+	/**
+	 * Get the value stored for the key, adding a default value if the key is not stored yet.
+	 * @param key the key to get.
+	 * @return the reference to the stored value (only valid until the next addition).
+	 */
+	V& operator[](const unsigned long long key)
+	{
+		if ((m_size + 1) * 2 > m_slots.size())
+			rehash(m_slots.empty() ? FLATINDEX_MIN_CAPACITY : m_slots.size() * 2);
+		size_t mask = m_slots.size() - 1;
+		size_t pos = hash(key) & mask;
+		for (; m_slots[pos].m_used; pos = (pos + 1) & mask) {
+			if (m_slots[pos].m_key == key)
+				return m_slots[pos].m_value;
+		}
+		m_slots[pos].m_used = true;
+		m_slots[pos].m_key = key;
+		m_slots[pos].m_value = V();
+		m_size++;
+		return m_slots[pos].m_value;
+	}
+
+	/**
+	 * Remove all entries and free the slot memory.
+	 */
+	void clear()
+	{
+		m_slots.clear();
+		m_slots.shrink_to_fit();
+		m_size = 0;
+	}
+
+	/**
+	 * Get the number of stored entries.
+	 * @return the number of stored entries.
+	 */
+	size_t size() const { return m_size; }
+
+	/**
+	 * Get whether no entry is stored.
+	 * @return whether no entry is stored.
+	 */
+	bool empty() const { return m_size == 0; }
+
+private:
+
+	/**
+	 * A single slot of the index.
+	 */
+	struct Slot
+	{
+		/** the stored key. */
+		unsigned long long m_key = 0;
+
+		/** whether this slot is in use. */
+		bool m_used = false;
+
+		/** the stored value. */
+		V m_value = V();
+	};
+
+	/**
+	 * Calculate the hash of a key (fibonacci hashing with the upper bits folded in).
+	 * @param key the key to calculate the hash for.
+	 * @return the hash value.
+	 */
+	static size_t hash(const unsigned long long key)
+	{
+		unsigned long long value = key * 0x9e3779b97f4a7c15ULL;
+		return (size_t)(value ^ (value >> 32));
+	}
+
+	/**
+	 * Move all entries to a new slot array.
+	 * @param capacity the new number of slots (power of 2).
+	 */
+	void rehash(const size_t capacity)
+	{
+		vector<Slot> old(capacity);
+		old.swap(m_slots);
+		size_t mask = capacity - 1;
+		for (auto& slot : old) {
+			if (!slot.m_used)
+				continue;
+			size_t pos = hash(slot.m_key) & mask;
+			while (m_slots[pos].m_used)
+				pos = (pos + 1) & mask;
+			m_slots[pos] = slot;
+		}
+	}
+
+	/** the slot array (size is a power of 2 or zero). */
+	vector<Slot> m_slots;
+
+	/** the number of used slots. */
+	size_t m_size = 0;
+
+};
+
+#endif // LIBUTILS_FLATINDEX_H_
@@ -0,0 +1,207 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_HISTOGRAM_H_
+#define LIBUTILS_HISTOGRAM_H_
+
+#include <atomic>
+#include <sstream>
+
+/** \file histogram.h */
+
+/** the number of buckets of a @a Histogram. */
+#define HISTOGRAM_BUCKETS 32
+
+/**
+ * A lock-free histogram of unsigned values with logarithmic buckets.
+ *
+ * Bucket 0 counts the value 0, each further bucket n counts the values from
+ * 2^(n-1) up to 2^n-1, and the last bucket counts all larger values as well.
+ * Values are added by a single thread (or several) without any lock, while
+ * other threads may format or reset the histogram at the same time. A
+ * concurrent reset may lose single values, which is acceptable for
+ * statistics.
+ */
+class Histogram
+{
+public:
+	Histogram() { reset(); }
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	Histogram(const Histogram& src);
+
+public:
+
+	/**
+	 * Add a value.
+	 * @param value the value to add.
+	 */
+	void add(const unsigned long long value)
+	{
+		m_buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(value, std::memory_order_relaxed);
+		unsigned long long max = m_max.load(std::memory_order_relaxed);
+		while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+			// retry with the updated max
+		}
+	}
+
+	/**
+	 * Remove all values.
+	 */
+	void reset()
+	{
+		for (auto& bucket : m_buckets)
+			bucket.store(0, std::memory_order_relaxed);
+		m_count.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Get the number of added values.
+	 * @return the number of added values.
+	 */
+	unsigned long long getCount() const { return m_count.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the sum of all added values.
+	 * @return the sum of all added values.
+	 */
+	unsigned long long getSum() const { return m_sum.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the maximum added value.
+	 * @return the maximum added value, or 0 if empty.
+	 */
+	unsigned long long getMax() const { return m_max.load(std::memory_order_relaxed); }
+
+	/**
+	 * Get the number of values counted in a bucket.
+	 * @param bucket the index of the bucket.
+	 * @return the number of values counted in the bucket.
+	 */
+	unsigned long long getBucketCount(const unsigned int bucket) const
+	{
+		return bucket < HISTOGRAM_BUCKETS ? m_buckets[bucket].load(std::memory_order_relaxed) : 0;
+	}
+
+	/**
+	 * Get the upper limit of a bucket.
+	 * @param bucket the index of the bucket.
+	 * @return the largest value counted in the bucket (except for the last bucket).
+	 */
+	static unsigned long long getBucketLimit(const unsigned int bucket)
+	{
+		return bucket == 0 ? 0 : (1ULL << bucket) - 1;
+	}
+
+	/**
+	 * Get the index of the bucket counting a value.
+	 * @param value the value.
+	 * @return the index of the bucket.
+	 */
+	static unsigned int getBucket(unsigned long long value)
+	{
+		unsigned int bucket = 0;
+		while (value > 0 && bucket < HISTOGRAM_BUCKETS-1) {
+			value >>= 1;
+			bucket++;
+		}
+		return bucket;
+	}
+
+	/**
+	 * Get the upper limit of the bucket in which the specified percentage of the values is reached.
+	 * @param percent the percentage (0-100).
+	 * @return the upper limit of the bucket (see @a getBucketLimit()) limited to the maximum value, or 0 if empty.
+	 */
+	unsigned long long getPercentile(const unsigned int percent) const
+	{
+		unsigned long long count = 0, total = 0;
+		for (const auto& bucket : m_buckets)
+			total += bucket.load(std::memory_order_relaxed);
+		if (total == 0)
+			return 0;
+		unsigned long long limit = (total*percent+99)/100;
+		for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+			count += m_buckets[bucket].load(std::memory_order_relaxed);
+			if (count >= limit && count > 0) {
+				unsigned long long max = getMax();
+				return getBucketLimit(bucket) < max ? getBucketLimit(bucket) : max;
+			}
+		}
+		return getMax();
+	}
+
+	/**
+	 * Format the histogram to the @a ostream.
+	 * @param output the @a ostream to format to.
+	 * @param unit the unit of the values to append to each value.
+	 * @param buckets whether to add the count of each non-empty bucket.
+	 */
+	void format(std::ostream& output, const char* unit, const bool buckets=true) const
+	{
+		unsigned long long count = getCount();
+		output << "count " << count;
+		if (count == 0)
+			return;
+		output << ", avg " << (getSum()/count) << unit
+			<< ", p50 <" << (getPercentile(50)+1) << unit
+			<< ", p99 <" << (getPercentile(99)+1) << unit
+			<< ", max " << getMax() << unit;
+		if (!buckets)
+			return;
+		const char* separator = "\n ";
+		for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+			unsigned long long value = m_buckets[bucket].load(std::memory_order_relaxed);
+			if (value == 0)
+				continue;
+			output << separator;
+			if (bucket == HISTOGRAM_BUCKETS-1)
+				output << ">=" << (getBucketLimit(bucket-1)+1);
+			else
+				output << "<" << (getBucketLimit(bucket)+1);
+			output << ":" << value;
+			separator = " ";
+		}
+	}
+
+private:
+
+	/** the number of values per bucket. */
+	std::atomic<unsigned long long> m_buckets[HISTOGRAM_BUCKETS];
+
+	/** the number of added values. */
+	std::atomic<unsigned long long> m_count;
+
+	/** the sum of all added values. */
+	std::atomic<unsigned long long> m_sum;
+
+	/** the maximum added value. */
+	std::atomic<unsigned long long> m_max;
+
+};
+
+#endif // LIBUTILS_HISTOGRAM_H_
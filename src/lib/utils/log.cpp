@@ -23,6 +23,11 @@
 #include <sys/time.h>
 #include <stdarg.h>
 #include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
 #include "clock.h"
 #include "cppconfig.h"
 
@@ -52,8 +57,71 @@ static int logFacilites = LF_ALL;
 /** the current log level. */
 static LogLevel logLevel = ll_notice;
 
-/** the current log FILE. */
-static FILE* logFile = stdout;
+/** the current log FILE (written to without holding @a logFileMutex). */
+static std::atomic<FILE*> logFile(stdout);
+
+/** the log FILE replaced by the last reopen, kept open until the next one for writers still using it, or NULL. */
+static FILE* logFileReplaced = NULL;
+
+/** the name of the current log file, or NULL for stdout. */
+static char* logFileName = NULL;
+
+/** the mutex for replacing @a logFile and for the background thread writing to it. */
+static std::mutex logFileMutex;
+
+/**
+ * A message queued for the background thread.
+ */
+struct LogRecord
+{
+	/** the sequence number for synchronizing producers and consumer. */
+	std::atomic<size_t> m_sequence;
+
+	/** the time of the message. */
+	struct timespec m_time;
+
+	/** the @a LogFacility of the message. */
+	LogFacility m_facility;
+
+	/** the @a LogLevel of the message. */
+	LogLevel m_level;
+
+	/** the formatted message. */
+	char m_message[LOG_MESSAGE_SIZE];
+};
+
+/** the ring buffer of @a LOG_RING_SIZE records, or NULL. */
+static LogRecord* logRing = NULL;
+
+/** the position of the next record to be written by any producer. */
+static std::atomic<size_t> logRingHead(0);
+
+/** the position of the next record to be read by the background thread. */
+static size_t logRingTail = 0;
+
+/** whether messages are currently queued for the background thread. */
+static std::atomic<bool> logAsync(false);
+
+/** whether the background thread shall stop after writing all queued messages. */
+static std::atomic<bool> logThreadStop(false);
+
+/** whether the background thread is waiting for new messages. */
+static std::atomic<bool> logThreadWaiting(false);
+
+/** whether the log file shall be reopened before writing the next messages. */
+static std::atomic<bool> logFileReopen(false);
+
+/** the number of messages dropped because the ring buffer was full. */
+static std::atomic<unsigned long> logDroppedCount(0);
+
+/** the background thread. */
+static std::thread logThread;
+
+/** the mutex for waiting on @a logThreadCond. */
+static std::mutex logThreadMutex;
+
+/** the condition for waking up the background thread. */
+static std::condition_variable logThreadCond;
 
 bool setLogFacilities(const char* facilities)
 {
@@ -118,18 +186,54 @@ bool setLogFile(const char* filename)
 	if (newFile == NULL)
 		return false;
 
-	closeLogFile();
-	logFile = newFile;
+	std::lock_guard<std::mutex> lock(logFileMutex);
+	FILE* oldFile = logFile.exchange(newFile);
+	if (oldFile != NULL && oldFile != stdout)
+		fclose(oldFile);
+	if (logFileReplaced != NULL) {
+		fclose(logFileReplaced);
+		logFileReplaced = NULL;
+	}
+	free(logFileName);
+	logFileName = strdup(filename);
 	return true;
 }
 
+/**
+ * Reopen the log file while holding @a logFileMutex.
+ */
+static void doReopenLogFile()
+{
+	if (logFileName == NULL)
+		return;
+	FILE* newFile = fopen(logFileName, "a");
+	if (newFile == NULL)
+		return; // keep writing to the previous file
+	FILE* oldFile = logFile.exchange(newFile);
+	// a synchronous writer might still use the previous file, so close it only with the next reopen
+	if (logFileReplaced != NULL)
+		fclose(logFileReplaced);
+	logFileReplaced = oldFile != stdout ? oldFile : NULL;
+}
+
+void reopenLogFile()
+{
+	logFileReopen = true;
+}
+
 void closeLogFile()
 {
-	if (logFile != NULL) {
-		if (logFile != stdout)
-			fclose(logFile);
-		logFile = NULL;
+	stopLogThread();
+	std::lock_guard<std::mutex> lock(logFileMutex);
+	FILE* oldFile = logFile.exchange(NULL);
+	if (oldFile != NULL && oldFile != stdout)
+		fclose(oldFile);
+	if (logFileReplaced != NULL) {
+		fclose(logFileReplaced);
+		logFileReplaced = NULL;
 	}
+	free(logFileName);
+	logFileName = NULL;
 }
 
 bool needsLog(const LogFacility facility, const LogLevel level)
@@ -138,24 +242,195 @@ bool needsLog(const LogFacility facility, const LogLevel level)
 		&& (logLevel >= level);
 }
 
+/**
+ * Write a single log line (without flushing).
+ * @param file the FILE to write to.
+ * @param ts the time of the message.
+ * @param tm the broken down local time of the message.
+ * @param facility the @a LogFacility of the message.
+ * @param level the @a LogLevel of the message.
+ * @param message the formatted message.
+ */
+static void writeLine(FILE* file, const struct timespec& ts, const struct tm& tm, const LogFacility facility,
+	const LogLevel level, const char* message)
+{
+	fprintf(file, "%04d-%02d-%02d %02d:%02d:%02d.%03ld [%s %s] %s\n",
+		tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday,
+		tm.tm_hour, tm.tm_min, tm.tm_sec, ts.tv_nsec/1000000,
+		facilityNames[facility], levelNames[level], message);
+}
+
+/**
+ * Write all queued records to @a logFile while holding @a logFileMutex.
+ * @param reportedDrops the number of dropped messages already reported (updated).
+ * @return true when anything was written.
+ */
+static bool writeQueued(unsigned long& reportedDrops)
+{
+	static time_t lastSecond = -1;
+	static struct tm lastTm;
+	bool written = false;
+	FILE* file = logFile;
+	while (true) {
+		LogRecord& record = logRing[logRingTail & (LOG_RING_SIZE-1)];
+		if (record.m_sequence.load(std::memory_order_acquire) != logRingTail+1)
+			break;
+		if (file != NULL) {
+			if (record.m_time.tv_sec != lastSecond) {
+				localtime_r(&record.m_time.tv_sec, &lastTm);
+				lastSecond = record.m_time.tv_sec;
+			}
+			writeLine(file, record.m_time, lastTm, record.m_facility, record.m_level, record.m_message);
+			written = true;
+		}
+		record.m_sequence.store(logRingTail+LOG_RING_SIZE, std::memory_order_release);
+		logRingTail++;
+	}
+	unsigned long dropped = logDroppedCount.load(std::memory_order_relaxed);
+	if (dropped != reportedDrops && file != NULL) {
+		struct timespec ts;
+		struct tm tm;
+		clockGettime(&ts);
+		localtime_r(&ts.tv_sec, &tm);
+		char message[64];
+		snprintf(message, sizeof(message), "%lu log messages dropped", dropped-reportedDrops);
+		writeLine(file, ts, tm, lf_main, ll_error, message);
+		reportedDrops = dropped;
+		written = true;
+	}
+	return written;
+}
+
+/**
+ * The main function of the background thread.
+ */
+static void runLogThread()
+{
+	unsigned long reportedDrops = logDroppedCount.load();
+	while (true) {
+		bool stop = logThreadStop;
+		{
+			std::lock_guard<std::mutex> lock(logFileMutex);
+			if (logFileReopen.exchange(false))
+				doReopenLogFile();
+			if (writeQueued(reportedDrops))
+				fflush(logFile);
+		}
+		if (stop)
+			break;
+		std::unique_lock<std::mutex> lock(logThreadMutex);
+		logThreadWaiting = true;
+		LogRecord& record = logRing[logRingTail & (LOG_RING_SIZE-1)];
+		if (!logThreadStop && record.m_sequence.load(std::memory_order_acquire) != logRingTail+1)
+			logThreadCond.wait_for(lock, std::chrono::milliseconds(100)); // timeout covers a missed wakeup
+		logThreadWaiting = false;
+	}
+}
+
+bool startLogThread()
+{
+	if (logAsync)
+		return true;
+	if (logRing == NULL) {
+		logRing = new LogRecord[LOG_RING_SIZE];
+		for (size_t pos = 0; pos < LOG_RING_SIZE; pos++)
+			logRing[pos].m_sequence.store(pos, std::memory_order_relaxed);
+		logRingHead = 0;
+		logRingTail = 0;
+	}
+	logThreadStop = false;
+	try {
+		logThread = std::thread(runLogThread);
+	} catch (const std::system_error&) {
+		return false;
+	}
+	logAsync = true;
+	return true;
+}
+
+void stopLogThread()
+{
+	if (!logAsync)
+		return;
+	logAsync = false;
+	{
+		std::lock_guard<std::mutex> lock(logThreadMutex);
+		logThreadStop = true;
+	}
+	logThreadCond.notify_one();
+	logThread.join();
+}
+
+unsigned long getLogDroppedCount()
+{
+	return logDroppedCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * Queue a message for the background thread.
+ * @param ts the time of the message.
+ * @param facility the @a LogFacility of the message.
+ * @param level the @a LogLevel of the message.
+ * @param message the formatted message.
+ * @param length the length of the message.
+ */
+static void queueMessage(const struct timespec& ts, const LogFacility facility, const LogLevel level,
+	const char* message, size_t length)
+{
+	size_t pos = logRingHead.load(std::memory_order_relaxed);
+	LogRecord* record;
+	while (true) {
+		record = &logRing[pos & (LOG_RING_SIZE-1)];
+		size_t sequence = record->m_sequence.load(std::memory_order_acquire);
+		if (sequence == pos) {
+			if (logRingHead.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+				break;
+		} else if ((long)(sequence-pos) < 0) {
+			logDroppedCount.fetch_add(1, std::memory_order_relaxed); // ring buffer is full
+			return;
+		} else {
+			pos = logRingHead.load(std::memory_order_relaxed);
+		}
+	}
+	record->m_time = ts;
+	record->m_facility = facility;
+	record->m_level = level;
+	memcpy(record->m_message, message, length+1);
+	record->m_sequence.store(pos+1, std::memory_order_release);
+	if (logThreadWaiting)
+		logThreadCond.notify_one();
+}
+
 void logWrite(const LogFacility facility, const LogLevel level, const char* message, ...)
 {
 	struct timespec ts;
-	struct tm* tm;
-
 	clockGettime(&ts);
-	tm = localtime(&ts.tv_sec);
-
-	char* buf;
 	va_list ap;
 	va_start(ap, message);
+	if (logAsync) {
+		static thread_local char buffer[LOG_MESSAGE_SIZE];
+		int length = vsnprintf(buffer, sizeof(buffer), message, ap);
+		va_end(ap);
+		if (length >= 0)
+			queueMessage(ts, facility, level, buffer, length < LOG_MESSAGE_SIZE ? (size_t)length : LOG_MESSAGE_SIZE-1);
+		return;
+	}
 
+	char* buf = NULL;
 	if (vasprintf(&buf, message, ap) >= 0 && buf) {
-		fprintf(logFile, "%04d-%02d-%02d %02d:%02d:%02d.%03ld [%s %s] %s\n",
-			tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday,
-			tm->tm_hour, tm->tm_min, tm->tm_sec, ts.tv_nsec/1000000,
-			facilityNames[facility], levelNames[level], buf);
-		fflush(logFile);
+		struct tm tm;
+		localtime_r(&ts.tv_sec, &tm);
+		// only lock for a pending reopen, the writing itself is serialized by the FILE
+		if (logFileReopen.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(logFileMutex);
+			if (logFileReopen.exchange(false))
+				doReopenLogFile();
+		}
+		FILE* file = logFile;
+		if (file != NULL) {
+			writeLine(file, ts, tm, facility, level, buf);
+			fflush(file);
+		}
 	}
 
 	va_end(ap);
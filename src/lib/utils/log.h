@@ -33,6 +33,12 @@ enum LogFacility {
 /** macro for enabling all log facilities. */
 #define LF_ALL ((1<<lf_main) | (1<<lf_network) | (1<<lf_bus) | (1<<lf_update))
 
+/** the number of records in the ring buffer of the background log thread (power of 2). */
+#define LOG_RING_SIZE 256
+
+/** the maximum length of a message queued for the background log thread (including the terminating zero). */
+#define LOG_MESSAGE_SIZE 480
+
 /** the available log levels. */
 enum LogLevel {
 	ll_none=0, //!< no level at all
@@ -78,10 +84,37 @@ const char* getLogLevel();
 bool setLogFile(const char* filename);
 
 /**
- * Close the log file if necessary.
+ * Request reopening the log file previously set with @a setLogFile() (e.g. after rotation).
+ * The file is reopened by the thread writing the next messages, so this only sets a flag and
+ * is safe to be called from a signal handler.
+ */
+void reopenLogFile();
+
+/**
+ * Close the log file if necessary (after stopping the background thread).
  */
 void closeLogFile();
 
+/**
+ * Start writing the log from a background thread.
+ * Afterwards, @a logWrite() only formats the message and queues it in a ring
+ * buffer of @a LOG_RING_SIZE records. Messages are truncated to
+ * @a LOG_MESSAGE_SIZE characters and dropped when the ring buffer is full.
+ * @return true when the thread was started or is already running, false on error.
+ */
+bool startLogThread();
+
+/**
+ * Stop the background thread after writing all queued messages.
+ */
+void stopLogThread();
+
+/**
+ * Get the number of messages dropped because the ring buffer was full.
+ * @return the number of dropped messages.
+ */
+unsigned long getLogDroppedCount();
+
 /**
  * Return whether logging is needed for the specified facility and level.
  * @param facility the @a LogFacility of the message to check.
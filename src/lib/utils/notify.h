@@ -34,7 +34,7 @@ public:
 	/**
 	 * constructs a new instance and do notifying.
 	 */
-	Notify()
+	Notify() : m_recvfd(-1), m_sendfd(-1)
 	{
 		int pipefd[2];
 		int ret = pipe(pipefd);
@@ -0,0 +1,175 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "poller.h"
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+
+/**
+ * Convert poll flags to epoll flags.
+ * @param events the poll flags.
+ * @return the epoll flags.
+ */
+static uint32_t toEpoll(const short events)
+{
+	uint32_t ret = 0;
+	if (events & POLLIN)
+		ret |= EPOLLIN;
+	if (events & POLLOUT)
+		ret |= EPOLLOUT;
+	return ret;
+}
+
+/**
+ * Convert epoll flags to poll flags.
+ * @param events the epoll flags.
+ * @return the poll flags.
+ */
+static short fromEpoll(const uint32_t events)
+{
+	short ret = 0;
+	if (events & EPOLLIN)
+		ret |= POLLIN;
+	if (events & EPOLLOUT)
+		ret |= POLLOUT;
+	if (events & EPOLLERR)
+		ret |= POLLERR;
+	if (events & EPOLLHUP)
+		ret |= POLLHUP;
+	return ret;
+}
+
+Poller::Poller()
+{
+	m_epollFD = epoll_create1(EPOLL_CLOEXEC);
+}
+
+Poller::~Poller()
+{
+	if (m_epollFD >= 0)
+		close(m_epollFD);
+}
+
+bool Poller::isValid() const
+{
+	return m_epollFD >= 0;
+}
+
+bool Poller::add(const int fd, const short events)
+{
+	struct epoll_event event;
+	event.events = toEpoll(events);
+	event.data.fd = fd;
+	return epoll_ctl(m_epollFD, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool Poller::modify(const int fd, const short events)
+{
+	struct epoll_event event;
+	event.events = toEpoll(events);
+	event.data.fd = fd;
+	return epoll_ctl(m_epollFD, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void Poller::remove(const int fd)
+{
+	struct epoll_event event; // required by old kernels
+	epoll_ctl(m_epollFD, EPOLL_CTL_DEL, fd, &event);
+}
+
+int Poller::wait(const int timeout, vector<Event>& events)
+{
+	struct epoll_event occurred[POLLER_MAX_EVENTS];
+	events.clear();
+	int ret = epoll_wait(m_epollFD, occurred, POLLER_MAX_EVENTS, timeout);
+	for (int i = 0; i < ret; i++)
+		events.push_back({occurred[i].data.fd, fromEpoll(occurred[i].events)});
+	return ret;
+}
+
+#else
+
+Poller::Poller()
+{
+}
+
+Poller::~Poller()
+{
+}
+
+bool Poller::isValid() const
+{
+	return true;
+}
+
+bool Poller::add(const int fd, const short events)
+{
+	if (m_index.find(fd) != m_index.end())
+		return false;
+	m_index[fd] = m_fds.size();
+	m_fds.push_back({fd, events, 0});
+	return true;
+}
+
+bool Poller::modify(const int fd, const short events)
+{
+	auto it = m_index.find(fd);
+	if (it == m_index.end())
+		return false;
+	m_fds[it->second].events = events;
+	return true;
+}
+
+void Poller::remove(const int fd)
+{
+	auto it = m_index.find(fd);
+	if (it == m_index.end())
+		return;
+	// move the last entry into the gap
+	size_t pos = it->second;
+	m_index.erase(it);
+	if (pos + 1 < m_fds.size()) {
+		m_fds[pos] = m_fds.back();
+		m_index[m_fds[pos].fd] = pos;
+	}
+	m_fds.pop_back();
+}
+
+int Poller::wait(const int timeout, vector<Event>& events)
+{
+	events.clear();
+	int ret = poll(m_fds.data(), (nfds_t)m_fds.size(), timeout);
+	if (ret <= 0)
+		return ret;
+	for (auto& pfd : m_fds) {
+		if (pfd.revents == 0)
+			continue;
+		events.push_back({pfd.fd, (short)(pfd.revents & (POLLIN | POLLOUT | POLLERR | POLLHUP))});
+		if (events.size() >= POLLER_MAX_EVENTS)
+			break;
+	}
+	return (int)events.size();
+}
+
+#endif
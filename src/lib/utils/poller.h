@@ -0,0 +1,124 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_POLLER_H_
+#define LIBUTILS_POLLER_H_
+
+#include <poll.h>
+#include <unordered_map>
+#include <vector>
+#include "cppconfig.h"
+
+/** \file poller.h */
+
+/** the maximum number of events returned by a single @a Poller::wait(). */
+#define POLLER_MAX_EVENTS 64
+
+/**
+ * Class for waiting on events of many file descriptors at once.
+ *
+ * Uses epoll where available and poll otherwise. Events are always specified
+ * and reported with the poll flags (POLLIN, POLLOUT, POLLERR, POLLHUP), where
+ * POLLERR and POLLHUP are reported even if not requested.
+ */
+class Poller
+{
+public:
+	/**
+	 * Construct a new instance.
+	 */
+	Poller();
+
+	/**
+	 * Destructor.
+	 */
+	~Poller();
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	Poller(const Poller& src);
+
+public:
+
+	/**
+	 * A single event reported by @a wait().
+	 */
+	struct Event
+	{
+		/** the file descriptor. */
+		int m_fd;
+
+		/** the occurred poll flags. */
+		short m_events;
+	};
+
+	/**
+	 * Return whether the instance was set up successfully.
+	 * @return whether the instance was set up successfully.
+	 */
+	bool isValid() const;
+
+	/**
+	 * Start watching a file descriptor.
+	 * @param fd the file descriptor to watch.
+	 * @param events the poll flags to watch for.
+	 * @return true on success.
+	 */
+	bool add(const int fd, const short events);
+
+	/**
+	 * Change the events to watch for on a file descriptor.
+	 * @param fd the watched file descriptor.
+	 * @param events the poll flags to watch for (0 for only errors and hangup).
+	 * @return true on success.
+	 */
+	bool modify(const int fd, const short events);
+
+	/**
+	 * Stop watching a file descriptor (has to be called before closing it).
+	 * @param fd the watched file descriptor.
+	 */
+	void remove(const int fd);
+
+	/**
+	 * Wait for events on the watched file descriptors.
+	 * @param timeout the maximum time in milliseconds to wait, or -1 for infinite.
+	 * @param events the @a vector to fill with the occurred @a Event instances.
+	 * @return the number of occurred events, 0 on timeout, or -1 on error.
+	 */
+	int wait(const int timeout, vector<Event>& events);
+
+private:
+#ifdef HAVE_SYS_EPOLL_H
+	/** the epoll file descriptor. */
+	int m_epollFD;
+#else
+	/** the watched file descriptors. */
+	vector<struct pollfd> m_fds;
+
+	/** the index in @a m_fds by file descriptor. */
+	std::unordered_map<int, size_t> m_index;
+#endif
+
+};
+
+#endif // LIBUTILS_POLLER_H_
@@ -22,6 +22,7 @@
 #include <list>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <errno.h>
 #include "clock.h"
@@ -59,7 +60,10 @@ public:
 		std::lock_guard<std::mutex> lock(m_mutex);
 
 		m_queue.push_back(item);
-		m_cond.notify_all();
+		m_size.store(m_queue.size(), std::memory_order_relaxed);
+		m_pushCount++;
+		if (m_waiters > 0)
+			m_cond.notify_all();
 	}
 
 	/**
@@ -72,17 +76,17 @@ public:
 		T item;
 		std::unique_lock<std::mutex> lock(m_mutex);
 
-		if (timeout>0) {
-			while (m_queue.empty()) {
-				if (m_cond.wait_for(lock, std::chrono::seconds(timeout)) == std::cv_status::timeout)
-					break;
-			}
+		if (timeout>0 && m_queue.empty()) {
+			m_waiters++;
+			m_cond.wait_for(lock, std::chrono::seconds(timeout), [this]{ return !m_queue.empty(); });
+			m_waiters--;
 		}
 		if (m_queue.empty())
 			item = NULL;
 		else {
 			item = m_queue.front();
 			m_queue.pop_front();
+			m_size.store(m_queue.size(), std::memory_order_relaxed);
 		}
 
 		return item;
@@ -96,21 +100,29 @@ public:
 	 */
 	bool remove(T item, bool wait=false)
 	{
-		bool ret = false;
 		std::unique_lock<std::mutex> lock(m_mutex);
-		do {
-			size_t oldSize = m_queue.size();
-			if (oldSize > 0) {
-				m_queue.remove(item);
-				if (m_queue.size() != oldSize) {
-					ret = true;
-					break;
+		// first check all items, afterwards only the ones pushed in the meantime
+		size_t check = m_queue.size();
+		while (true) {
+			if (check > m_queue.size())
+				check = m_queue.size();
+			auto it = m_queue.end();
+			for (; check > 0; check--) {
+				--it;
+				if (*it == item) {
+					m_queue.erase(it);
+					m_size.store(m_queue.size(), std::memory_order_relaxed);
+					return true;
 				}
 			}
-			m_cond.wait(lock);
-
-		} while (wait);
-		return ret;
+			if (!wait)
+				return false;
+			unsigned long pushCount = m_pushCount;
+			m_waiters++;
+			m_cond.wait(lock, [this, pushCount]{ return m_pushCount != pushCount; });
+			m_waiters--;
+			check = (size_t)(m_pushCount - pushCount);
+		}
 	}
 
 	/**
@@ -128,6 +140,12 @@ public:
 		return item;
 	}
 
+	/**
+	 * Return the number of items in the queue without locking.
+	 * @return the number of items in the queue.
+	 */
+	size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
 private:
 	/** the queue itself */
 	list<T> m_queue;
@@ -138,6 +156,15 @@ private:
 	/** condition variable for exclusive lock */
 	std::condition_variable m_cond;
 
+	/** the number of threads waiting on @a m_cond. */
+	size_t m_waiters = 0;
+
+	/** the number of items pushed so far (for detecting new items while waiting). */
+	unsigned long m_pushCount = 0;
+
+	/** the number of items in @a m_queue (readable without locking). */
+	std::atomic<size_t> m_size{0};
+
 };
 
 #endif // LIBUTILS_QUEUE_H_
@@ -0,0 +1,223 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2014-2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_RINGQUEUE_H_
+#define LIBUTILS_RINGQUEUE_H_
+
+#include <atomic>
+#include <thread>
+#include <cstddef>
+#include "eventcounter.h"
+#include "cppconfig.h"
+
+/** \file ringqueue.h */
+
+/** the number of slots freed by the consumer before waking up waiting producers of a @a RingQueue. */
+#define RINGQUEUE_BATCH(size) ((size) >= 16 ? (size)/4 : 1)
+
+/**
+ * Thread safe template class for queuing items in a bounded lock-free ring.
+ *
+ * This is a drop-in replacement for @a Queue for the typical producer/consumer
+ * pattern of multiple threads pushing and a single thread popping items, where
+ * no item needs to be removed from the middle of the queue. Each slot carries
+ * its own sequence number, so that producers only contend on a single atomic
+ * index and neither side ever takes a lock. A consumer waiting for an item and
+ * a producer waiting for a free slot block on an @a EventCounter that is only
+ * signaled with a system call when someone actually waits.
+ * @param T the item type (a pointer).
+ * @param N the number of slots (power of 2). A producer blocks while all slots are in use.
+ */
+template <typename T, size_t N=256>
+class RingQueue
+{
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size has to be a power of 2");
+
+public:
+	RingQueue() : m_head(0), m_tail(0)
+	{
+		for (size_t pos = 0; pos < N; pos++)
+			m_slots[pos].m_sequence.store(pos, std::memory_order_relaxed);
+	}
+
+private:
+
+	/**
+	 * Hidden copy constructor.
+	 * @param src the object to copy from.
+	 */
+	RingQueue(const RingQueue& src);
+
+public:
+
+	/**
+	 * Add an item to the end of queue.
+	 * @param item the item to add.
+	 */
+	void push(T item)
+	{
+		while (!tryPush(item)) {
+			int key = m_spaceEvent.prepareWait();
+			if (tryPush(item)) {
+				m_spaceEvent.cancelWait();
+				break;
+			}
+			m_spaceEvent.wait(key);
+		}
+		m_itemEvent.notify();
+	}
+
+	/**
+	 * Remove the first item from the queue optionally waiting for the queue being non-empty.
+	 * @param timeout the maximum time in seconds to wait for the queue being filled, or 0 for no wait.
+	 * @return the item, or NULL if no item is available within the specified time.
+	 */
+	T pop(int timeout=0)
+	{
+		T item;
+		if (tryPop(item))
+			return item;
+		if (timeout > 0) {
+			while (true) {
+				int key = m_itemEvent.prepareWait();
+				if (tryPop(item)) {
+					m_itemEvent.cancelWait();
+					return item;
+				}
+				if (!m_itemEvent.wait(key, timeout*1000L))
+					break;
+			}
+			if (tryPop(item))
+				return item;
+		}
+		return NULL;
+	}
+
+	/**
+	 * Return the approximate number of items in the queue (may be outdated when returned).
+	 * @return the approximate number of items in the queue.
+	 */
+	size_t size() const
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t head = m_head.load(std::memory_order_relaxed);
+		return head > tail ? head - tail : 0;
+	}
+
+	/**
+	 * Return the first item in the queue without removing it (only to be called from the consuming thread).
+	 * @return the item, or NULL if no item is available.
+	 */
+	T peek()
+	{
+		size_t pos = m_tail.load(std::memory_order_relaxed);
+		Slot& slot = m_slots[pos & (N - 1)];
+		if (slot.m_sequence.load(std::memory_order_acquire) != pos + 1)
+			return NULL;
+		return slot.m_item;
+	}
+
+private:
+
+	/**
+	 * Try to add an item to the end of the queue without waiting.
+	 * @param item the item to add.
+	 * @return true if the item was added, false if the ring is full.
+	 */
+	bool tryPush(T item)
+	{
+		size_t pos = m_head.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = m_slots[pos & (N - 1)];
+			size_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+			if (diff == 0) {
+				if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					slot.m_item = item;
+					slot.m_sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+				// pos was updated by the failed exchange
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Try to remove the first item from the queue without waiting.
+	 * @param item the variable in which to store the removed item.
+	 * @return true if an item was removed, false if the ring is empty.
+	 */
+	bool tryPop(T& item)
+	{
+		size_t pos = m_tail.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = m_slots[pos & (N - 1)];
+			size_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+			if (diff == 0) {
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					item = slot.m_item;
+					slot.m_sequence.store(pos + N, std::memory_order_release);
+					// let waiting producers refill a whole batch of slots instead of waking them for each slot
+					if (((pos + 1) & (RINGQUEUE_BATCH(N) - 1)) == 0
+					|| m_slots[(pos + 1) & (N - 1)].m_sequence.load(std::memory_order_acquire) != pos + 2)
+						m_spaceEvent.notify();
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * A single slot of the ring.
+	 */
+	struct Slot
+	{
+		/** the sequence number telling whether the slot is free or filled for a certain round. */
+		std::atomic<size_t> m_sequence;
+
+		/** the stored item. */
+		T m_item;
+	};
+
+	/** the slots of the ring. */
+	Slot m_slots[N];
+
+	/** the position of the next slot to fill. */
+	alignas(64) std::atomic<size_t> m_head;
+
+	/** the position of the next slot to empty. */
+	alignas(64) std::atomic<size_t> m_tail;
+
+	/** the @a EventCounter for waiting on the queue being filled. */
+	EventCounter m_itemEvent;
+
+	/** the @a EventCounter for waiting on a free slot. */
+	EventCounter m_spaceEvent;
+
+};
+
+#endif // LIBUTILS_RINGQUEUE_H_
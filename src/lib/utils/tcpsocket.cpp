@@ -39,6 +39,14 @@ bool TCPSocket::isValid()
 		return true;
 }
 
+bool TCPSocket::setNonBlocking()
+{
+	int flags = fcntl(m_sfd, F_GETFL);
+	if (flags == -1)
+		return false;
+	return fcntl(m_sfd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
 
 TCPSocket* TCPClient::connect(const string& server, const uint16_t& port)
 {
@@ -70,8 +78,10 @@ TCPSocket* TCPClient::connect(const string& server, const uint16_t& port)
 		return NULL;
 
 	ret = ::connect(sfd, (struct sockaddr*) &address, sizeof(address));
-	if (ret < 0)
+	if (ret < 0) {
+		close(sfd);
 		return NULL;
+	}
 
 	return new TCPSocket(sfd, &address);
 }
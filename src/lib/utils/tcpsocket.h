@@ -91,6 +91,12 @@ public:
 	 */
 	bool isValid();
 
+	/**
+	 * switch the file descriptor to non-blocking mode.
+	 * @return true on success.
+	 */
+	bool setNonBlocking();
+
 private:
 	/** file descriptor from tcp socket */
 	int m_sfd;
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "arena.h"
+#include <cstdint>
+#include <string>
+#include <thread>
+
+static int s_alive = 0;
+
+class Counted : public ArenaObject
+{
+public:
+    explicit Counted(const std::string& name) : m_name(name) { s_alive++; }
+    virtual ~Counted() { s_alive--; }
+    std::string m_name;
+    double m_value = 1.5;
+};
+
+TEST(TestArena, allocateAligned)
+{
+    ConfigArena* arena = ConfigArena::create();
+    for (size_t size = 1; size < 100; size += 7) {
+        void* ptr = arena->allocate(size, 8);
+        ASSERT_EQ((uintptr_t)ptr % 8, 0u);
+        memset(ptr, 0xff, size);
+    }
+    ASSERT_EQ(arena->getReservedSize(), (size_t)ARENA_CHUNK_SIZE);
+    void* large = arena->allocate(ARENA_CHUNK_SIZE);
+    memset(large, 0, ARENA_CHUNK_SIZE);
+    ASSERT_EQ(arena->getReservedSize(), (size_t)2*ARENA_CHUNK_SIZE);
+    for (int i = 0; i < 2000; i++)
+        arena->allocate(48);
+    ASSERT_GT(arena->getReservedSize(), (size_t)2*ARENA_CHUNK_SIZE);
+    arena->release();
+}
+
+TEST(TestArena, scopeAndLifetime)
+{
+    ASSERT_EQ(ConfigArena::getCurrent(), nullptr);
+    ConfigArena* arena = ConfigArena::create();
+    Counted* raw;
+    shared_ptr<Counted> shared;
+    {
+        ConfigArena::Scope scope(arena);
+        ASSERT_EQ(ConfigArena::getCurrent(), arena);
+        raw = new Counted("raw");
+        shared = allocateShared<Counted>("shared");
+        {
+            ConfigArena::Scope heap(NULL);
+            ASSERT_EQ(ConfigArena::getCurrent(), nullptr);
+            delete new Counted("heap");
+        }
+        ASSERT_EQ(ConfigArena::getCurrent(), arena);
+        std::thread other([]() { ASSERT_EQ(ConfigArena::getCurrent(), nullptr); });
+        other.join();
+    }
+    ASSERT_EQ(ConfigArena::getCurrent(), nullptr);
+    ASSERT_EQ(s_alive, 2);
+    ASSERT_GE(arena->getAllocatedSize(), 2*sizeof(Counted));
+
+    // the owner releases the generation while objects are still alive
+    arena->release();
+    ASSERT_EQ(raw->m_name, "raw");
+    ASSERT_EQ(shared->m_name, "shared");
+    ASSERT_EQ(shared->m_value, 1.5);
+    delete raw;
+    ASSERT_EQ(s_alive, 1);
+    shared.reset();
+    ASSERT_EQ(s_alive, 0);
+
+    // heap fallback outside of any scope
+    shared = allocateShared<Counted>("plain");
+    raw = new Counted("plain");
+    ASSERT_EQ(s_alive, 2);
+    delete raw;
+    shared.reset();
+    ASSERT_EQ(s_alive, 0);
+}
@@ -0,0 +1,43 @@
+#include "gtest/gtest.h"
+#include "flatindex.h"
+
+TEST(TestFlatIndex, findAndAdd)
+{
+    FlatIndex<int> index;
+
+    ASSERT_TRUE(index.empty());
+    ASSERT_EQ(index.find(0), nullptr);
+
+    index[0] = 1;
+    index[0x1f07040000000000ULL] = 2;
+
+    ASSERT_EQ(index.size(), 2u);
+    ASSERT_NE(index.find(0), nullptr);
+    ASSERT_EQ(*index.find(0), 1);
+    ASSERT_EQ(*index.find(0x1f07040000000000ULL), 2);
+    ASSERT_EQ(index.find(0x1e07040000000000ULL), nullptr);
+
+    index[0] |= 4;
+    ASSERT_EQ(*index.find(0), 5);
+    ASSERT_EQ(index.size(), 2u);
+
+    index.clear();
+    ASSERT_TRUE(index.empty());
+    ASSERT_EQ(index.find(0), nullptr);
+}
+
+TEST(TestFlatIndex, rehash)
+{
+    FlatIndex<unsigned long long> index;
+
+    for (unsigned long long i = 0; i < 10000; i++) {
+        index[i << 24] = i;
+    }
+    ASSERT_EQ(index.size(), 10000u);
+    for (unsigned long long i = 0; i < 10000; i++) {
+        auto value = index.find(i << 24);
+        ASSERT_NE(value, nullptr);
+        ASSERT_EQ(*value, i);
+        ASSERT_EQ(index.find((i << 24) | 1), nullptr);
+    }
+}
@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "histogram.h"
+#include "clock.h"
+#include <thread>
+#include <vector>
+
+TEST(TestHistogram, buckets)
+{
+    Histogram histogram;
+    ASSERT_EQ(histogram.getCount(), 0u);
+    ASSERT_EQ(histogram.getPercentile(50), 0u);
+    std::ostringstream empty;
+    histogram.format(empty, "us");
+    ASSERT_EQ(empty.str(), "count 0");
+
+    ASSERT_EQ(Histogram::getBucket(0), 0u);
+    ASSERT_EQ(Histogram::getBucket(1), 1u);
+    ASSERT_EQ(Histogram::getBucket(2), 2u);
+    ASSERT_EQ(Histogram::getBucket(3), 2u);
+    ASSERT_EQ(Histogram::getBucket(4), 3u);
+    ASSERT_EQ(Histogram::getBucket(~0ULL), (unsigned int)HISTOGRAM_BUCKETS-1);
+
+    histogram.add(0);
+    histogram.add(3);
+    histogram.add(3);
+    histogram.add(100);
+    ASSERT_EQ(histogram.getCount(), 4u);
+    ASSERT_EQ(histogram.getSum(), 106u);
+    ASSERT_EQ(histogram.getMax(), 100u);
+    ASSERT_EQ(histogram.getBucketCount(2), 2u);
+    ASSERT_EQ(histogram.getBucketCount(7), 1u);
+    ASSERT_EQ(histogram.getPercentile(50), 3u);
+    ASSERT_EQ(histogram.getPercentile(99), 100u);
+
+    std::ostringstream output;
+    histogram.format(output, "us");
+    ASSERT_EQ(output.str(), "count 4, avg 26us, p50 <4us, p99 <101us, max 100us\n <1:1 <4:2 <128:1");
+
+    histogram.reset();
+    ASSERT_EQ(histogram.getCount(), 0u);
+    ASSERT_EQ(histogram.getMax(), 0u);
+    ASSERT_EQ(histogram.getBucketCount(2), 0u);
+}
+
+TEST(TestHistogram, concurrentAdd)
+{
+    Histogram histogram;
+    std::vector<std::thread> threads;
+    for (int index = 0; index < 4; index++) {
+        threads.emplace_back([&histogram, index]() {
+            for (unsigned long long value = 0; value < 10000; value++)
+                histogram.add(value + (unsigned long long)index);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    ASSERT_EQ(histogram.getCount(), 40000u);
+    ASSERT_EQ(histogram.getMax(), 10002u);
+    unsigned long long total = 0;
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+        total += histogram.getBucketCount(bucket);
+    ASSERT_EQ(total, 40000u);
+}
+
+TEST(TestHistogram, monotonicClock)
+{
+    unsigned long long start = clockGetMicros();
+    unsigned long long end = clockGetMicros();
+    ASSERT_LE(start, end);
+    ASSERT_GT(start, 0u);
+}
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "log.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static std::vector<std::string> readLines(const std::string& name)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(name);
+    std::string line;
+    while (std::getline(file, line))
+        lines.push_back(line);
+    return lines;
+}
+
+TEST(TestLog, asyncWritesAllOrCountsDropped)
+{
+    char dir[] = "/tmp/ebusdlogXXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string name = std::string(dir) + "/ebusd.log";
+    std::string rotated = name + ".1";
+    ASSERT_TRUE(setLogFile(name.c_str()));
+    ASSERT_TRUE(startLogThread());
+    ASSERT_TRUE(startLogThread());
+    unsigned long droppedBefore = getLogDroppedCount();
+
+    const int threadCount = 4, messageCount = 300;
+    std::vector<std::thread> threads;
+    for (int index = 0; index < threadCount; index++) {
+        threads.emplace_back([index]() {
+            for (int count = 0; count < messageCount; count++)
+                logWrite(lf_bus, ll_info, "thread %d message %d", index, count);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    stopLogThread();
+    unsigned long dropped = getLogDroppedCount() - droppedBefore;
+    ASSERT_TRUE(startLogThread());
+    std::string longMessage(LOG_MESSAGE_SIZE * 2, 'x');
+    logWrite(lf_main, ll_notice, "%s", longMessage.c_str());
+    stopLogThread();
+
+    std::vector<std::string> lines = readLines(name);
+    size_t messages = 0, dropLines = 0;
+    for (const auto& line : lines) {
+        if (line.find("[bus info] thread ") != std::string::npos)
+            messages++;
+        else if (line.find("log messages dropped") != std::string::npos)
+            dropLines++;
+    }
+    ASSERT_EQ(messages + dropped, (size_t)(threadCount * messageCount));
+    ASSERT_EQ(dropLines > 0, dropped > 0);
+    ASSERT_FALSE(lines.empty());
+    std::string last = lines.back();
+    ASSERT_NE(last.find("[main notice] xxx"), std::string::npos);
+    ASSERT_EQ(last.length(), last.find("] xxx") + 2 + LOG_MESSAGE_SIZE - 1);
+
+    // reopen after rotation
+    ASSERT_TRUE(startLogThread());
+    ASSERT_EQ(rename(name.c_str(), rotated.c_str()), 0);
+    reopenLogFile();
+    logWrite(lf_main, ll_notice, "after rotation");
+    stopLogThread();
+    lines = readLines(name);
+    ASSERT_EQ(lines.size(), 1u);
+    ASSERT_NE(lines[0].find("[main notice] after rotation"), std::string::npos);
+
+    // synchronous again
+    logWrite(lf_main, ll_error, "sync %d", 1);
+    lines = readLines(name);
+    ASSERT_EQ(lines.size(), 2u);
+    ASSERT_NE(lines[1].find("[main error] sync 1"), std::string::npos);
+
+    // reopen requested without the background thread
+    ASSERT_EQ(rename(name.c_str(), rotated.c_str()), 0);
+    reopenLogFile();
+    logWrite(lf_main, ll_error, "sync %d", 2);
+    lines = readLines(name);
+    ASSERT_EQ(lines.size(), 1u);
+    ASSERT_NE(lines[0].find("[main error] sync 2"), std::string::npos);
+
+    closeLogFile();
+    setLogFile("/dev/stdout");
+    unlink(name.c_str());
+    unlink(rotated.c_str());
+    rmdir(dir);
+}
@@ -0,0 +1,36 @@
+#include "gtest/gtest.h"
+#include "poller.h"
+#include <unistd.h>
+
+TEST(TestPoller, readWrite)
+{
+    Poller poller;
+    ASSERT_TRUE(poller.isValid());
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_TRUE(poller.add(fds[0], POLLIN));
+    ASSERT_TRUE(poller.add(fds[1], 0));
+
+    vector<Poller::Event> events;
+    ASSERT_EQ(poller.wait(10, events), 0);
+    ASSERT_TRUE(events.empty());
+
+    ASSERT_TRUE(poller.modify(fds[1], POLLOUT));
+    ASSERT_EQ(poller.wait(10, events), 1);
+    ASSERT_EQ(events[0].m_fd, fds[1]);
+    ASSERT_TRUE(events[0].m_events & POLLOUT);
+
+    ASSERT_TRUE(poller.modify(fds[1], 0));
+    ASSERT_EQ(write(fds[1], "1", 1), 1);
+    ASSERT_EQ(poller.wait(10, events), 1);
+    ASSERT_EQ(events[0].m_fd, fds[0]);
+    ASSERT_EQ(events[0].m_events, POLLIN);
+
+    poller.remove(fds[0]);
+    ASSERT_EQ(poller.wait(10, events), 0);
+
+    poller.remove(fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -1,5 +1,10 @@
 #include "gtest/gtest.h"
 #include "queue.h"
+#include "ringqueue.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 TEST(TestQueue, pushPop)
 {
@@ -17,3 +22,119 @@ TEST(TestQueue, pushPop)
 
     ASSERT_EQ(x, &d);
 }
+
+TEST(TestQueue, removeNoWait)
+{
+    Queue<char*> q;
+    char d[3] = {'1', '2', '3'};
+
+    ASSERT_FALSE(q.remove(&d[0]));  // must not block
+
+    q.push(&d[0]);
+    q.push(&d[1]);
+    q.push(&d[2]);
+
+    ASSERT_EQ(q.size(), 3u);
+    ASSERT_FALSE(q.remove(&d[0] + 3));
+    ASSERT_TRUE(q.remove(&d[1]));
+    ASSERT_FALSE(q.remove(&d[1]));
+    ASSERT_EQ(q.size(), 2u);
+    ASSERT_EQ(q.pop(), &d[0]);
+    ASSERT_EQ(q.pop(), &d[2]);
+    ASSERT_EQ(q.pop(), nullptr);
+    ASSERT_EQ(q.size(), 0u);
+}
+
+TEST(TestQueue, removeWait)
+{
+    Queue<int*> q;
+    int values[100];
+
+    std::thread producer([&q, &values]{
+        for (int i = 0; i < 100; i++) {
+            q.push(&values[i]);
+            if (i % 10 == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    ASSERT_TRUE(q.remove(&values[99], true));
+    producer.join();
+    ASSERT_FALSE(q.remove(&values[99]));
+    ASSERT_TRUE(q.remove(&values[50], true));
+    ASSERT_EQ(q.pop(), &values[0]);
+}
+
+TEST(TestQueue, popTimeout)
+{
+    Queue<char*> q;
+    RingQueue<char*> r;
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(q.pop(1), nullptr);
+    ASSERT_EQ(r.pop(1), nullptr);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 1900);
+}
+
+TEST(TestRingQueue, pushPop)
+{
+    RingQueue<char*, 4> q;
+
+    ASSERT_EQ(q.peek(), nullptr);
+    ASSERT_EQ(q.pop(), nullptr);
+
+    char d[10];
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++)
+            q.push(&d[i]);
+        ASSERT_EQ(q.size(), 4u);
+        ASSERT_EQ(q.peek(), &d[0]);
+        for (int i = 0; i < 4; i++)
+            ASSERT_EQ(q.pop(), &d[i]);
+        ASSERT_EQ(q.size(), 0u);
+        ASSERT_EQ(q.peek(), nullptr);
+        ASSERT_EQ(q.pop(), nullptr);
+    }
+}
+
+TEST(TestRingQueue, wakeup)
+{
+    RingQueue<char*> q;
+    char d = '1';
+
+    std::thread producer([&q, &d]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        q.push(&d);
+    });
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(q.pop(5), &d);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    producer.join();
+    ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 2000);
+}
+
+TEST(TestRingQueue, multipleProducers)
+{
+    const int producers = 4, count = 20000;
+    RingQueue<int*> q;
+    std::vector<int> values((size_t)count);
+    for (int i = 0; i < count; i++)
+        values[(size_t)i] = i;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&q, &values, p, producers, count]{
+            for (int i = p; i < count; i += producers)
+                q.push(&values[(size_t)i]);
+        });
+    }
+    long long sum = 0;
+    for (int received = 0; received < count; received++) {
+        int* value = q.pop(5);
+        ASSERT_NE(value, nullptr);
+        sum += *value;
+    }
+    for (auto& thread : threads)
+        thread.join();
+    ASSERT_EQ(sum, (long long)count * (count - 1) / 2);
+    ASSERT_EQ(q.pop(), nullptr);
+}
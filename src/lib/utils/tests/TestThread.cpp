@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+#include "thread.h"
+#include <sched.h>
+
+class Sleeper : public Thread
+{
+protected:
+    virtual void run() override { while (isRunning()) usleep(1000); }
+};
+
+TEST(TestThread, parseSettings)
+{
+    ThreadSettings settings;
+    ASSERT_TRUE(settings.isDefault());
+    ASSERT_EQ(settings.str(), "");
+    ASSERT_TRUE(settings.parse("fifo:50@1"));
+    ASSERT_EQ(settings.m_policy, SCHED_FIFO);
+    ASSERT_EQ(settings.m_priority, 50);
+    ASSERT_EQ(settings.m_cpus, 2u);
+    ASSERT_EQ(settings.str(), "fifo:50@1");
+    ASSERT_TRUE(settings.parse("RR"));
+    ASSERT_EQ(settings.str(), "rr:1");
+    ASSERT_TRUE(settings.parse("@0,2-4,6,7"));
+    ASSERT_EQ(settings.m_policy, -1);
+    ASSERT_EQ(settings.str(), "@0,2-4,6-7");
+    ASSERT_TRUE(settings.parse("other@63"));
+    ASSERT_EQ(settings.str(), "other@63");
+    const char* invalid[] = {"", "@", "fast", "fifo:", "fifo:100", "other:1", "fifo:1x", "@1,", "@3-2", "@64", "@-1", "@1x"};
+    for (auto input : invalid) {
+        ASSERT_FALSE(settings.parse(input)) << "input: " << input;
+        ASSERT_EQ(settings.str(), "other@63") << "input: " << input;
+    }
+}
+
+TEST(TestThread, effectiveSettings)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(cpus), &cpus), 0);
+    int cpu = 0;
+    while (cpu < 64 && !CPU_ISSET(cpu, &cpus))
+        cpu++;
+    if (cpu >= 64)
+        return;  // no CPU usable by this process can be expressed in the settings
+    const string expected = "other@" + std::to_string(cpu);
+    Sleeper thread;
+    ThreadSettings settings;
+    ASSERT_TRUE(settings.parse(expected.c_str()));
+    thread.setSettings(settings);
+    ASSERT_EQ(thread.getEffectiveSettings(), "");
+    ASSERT_TRUE(thread.start("sleeper"));
+    ASSERT_EQ(thread.getName(), "sleeper");
+    for (int i = 0; i < 100 && !thread.isRunning(); i++)
+        usleep(1000);
+    ASSERT_EQ(thread.getEffectiveSettings(), expected);
+    thread.join();
+}
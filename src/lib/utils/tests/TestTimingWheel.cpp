@@ -0,0 +1,70 @@
+#include "gtest/gtest.h"
+#include "timingwheel.h"
+#include <cstdlib>
+#include <map>
+
+TEST(TestTimingWheel, dueOrder)
+{
+    TimingWheel<int> wheel;
+    time_t start = 1480000000;
+    int item;
+    time_t due;
+
+    ASSERT_TRUE(wheel.empty());
+    ASSERT_FALSE(wheel.take(start, item, due));
+
+    wheel.add(1, start + 10);
+    wheel.add(2, start);
+    wheel.add(3, start);
+    wheel.add(4, 0);
+    ASSERT_EQ(wheel.size(), 4u);
+
+    ASSERT_TRUE(wheel.take(start, item, due));
+    ASSERT_EQ(item, 4);
+    ASSERT_EQ(due, 0);
+    ASSERT_TRUE(wheel.take(start, item, due));
+    ASSERT_EQ(item, 2);
+    ASSERT_TRUE(wheel.take(start, item, due));
+    ASSERT_EQ(item, 3);
+    ASSERT_FALSE(wheel.take(start + 9, item, due));
+    ASSERT_TRUE(wheel.take(start + 10, item, due));
+    ASSERT_EQ(item, 1);
+    ASSERT_EQ(due, start + 10);
+    ASSERT_TRUE(wheel.empty());
+
+    wheel.add(5, start + 100);
+    wheel.clear();
+    ASSERT_TRUE(wheel.empty());
+    ASSERT_FALSE(wheel.take(start + 200, item, due));
+}
+
+TEST(TestTimingWheel, matchesSortedOrder)
+{
+    srand(7);
+    TimingWheel<int> wheel;
+    std::multimap<time_t, int> expect;
+    time_t now = 1480000000;
+    int item;
+    time_t due;
+    ASSERT_FALSE(wheel.take(now, item, due)); // initialize the current time
+    int next = 0;
+    for (int step = 0; step < 20000; step++) {
+        if (rand() % 3 == 0) {
+            time_t delta = rand() % 4 == 0 ? (time_t)(rand() % 400000) : (time_t)(rand() % 300);
+            wheel.add(next, now + delta);
+            expect.insert(std::make_pair(now + delta, next));
+            next++;
+        }
+        now += rand() % 8 == 0 ? rand() % 5000 : rand() % 3;
+        while (wheel.take(now, item, due)) {
+            ASSERT_FALSE(expect.empty());
+            auto it = expect.begin();
+            ASSERT_EQ(due, it->first);
+            ASSERT_EQ(item, it->second);
+            ASSERT_LE(due, now);
+            expect.erase(it);
+        }
+        ASSERT_TRUE(expect.empty() || expect.begin()->first > now);
+        ASSERT_EQ(wheel.size(), expect.size());
+    }
+}
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "tokenizer.h"
+#include "flatindex.h"
+#include <sstream>
+
+// the previous stream based splitting of commands as reference
+static void splitStream(const string& data, const bool isHttp, vector<string>& args)
+{
+    string token, previous;
+    istringstream stream(data);
+    bool escaped = false;
+    char delim = ' ';
+    while (getline(stream, token, delim)) {
+        if (!isHttp) {
+            if (escaped) {
+                args.pop_back();
+                if (token.length() > 0 && token[token.length()-1] == '"') {
+                    token.erase(token.length() - 1, 1);
+                    escaped = false;
+                }
+                token = previous + " " + token;
+            } else if (token.length() == 0) {
+                continue;
+            } else if (token[0] == '"') {
+                token.erase(0, 1);
+                if (token.length() > 0 && token[token.length()-1] == '"')
+                    token.erase(token.length() - 1, 1);
+                else
+                    escaped = true;
+            }
+        }
+        args.push_back(token);
+        previous = token;
+        if (isHttp)
+            delim = (args.size() == 1) ? '?' : '\n';
+    }
+}
+
+static vector<string> split(const string& data, const bool isHttp)
+{
+    vector<StringRef> tokens;
+    if (isHttp)
+        splitHttpRequest(data.data(), data.length(), tokens);
+    else
+        splitCommand(data.data(), data.length(), tokens);
+    vector<string> args;
+    for (const auto& token : tokens)
+        args.push_back(token.str());
+    return args;
+}
+
+TEST(TestTokenizer, splitCommand)
+{
+    ASSERT_EQ(split("read -f  outsidetemp ", false), vector<string>({"read", "-f", "outsidetemp"}));
+    ASSERT_EQ(split("write -c bai \"value with  spaces\" x", false),
+        vector<string>({"write", "-c", "bai", "value with  spaces", "x"}));
+    ASSERT_EQ(split("", false), vector<string>());
+    const char* inputs[] = {
+        "", " ", "  ", "r", " r  x ", "\"", "\"\"", "a \"\" b", "\"a", "\"a b", "\"a b ", "\"a b  ", "\"a  b\"",
+        "x \"a\" \"b c\" d\"", "a\"b c\"", "\" \"", "\"a \" b", "w -c \"x\" \"1 2\" 3 \"", "r -m 10 \"a\"b\" c\"",
+    };
+    for (auto input : inputs) {
+        vector<string> expected;
+        splitStream(input, false, expected);
+        ASSERT_EQ(split(input, false), expected) << "input: " << input;
+    }
+}
+
+TEST(TestTokenizer, splitHttpRequest)
+{
+    ASSERT_EQ(split("GET /data/bai?since=1&required", true),
+        vector<string>({"GET", "/data/bai", "since=1&required"}));
+    const char* inputs[] = {
+        "", "GET", "GET ", "GET /", "GET /a?", "GET /a?b?c", "GET  /a", "GET /a b?c d",
+    };
+    for (auto input : inputs) {
+        vector<string> expected;
+        splitStream(input, true, expected);
+        ASSERT_EQ(split(input, true), expected) << "input: " << input;
+    }
+}
+
+TEST(TestTokenizer, packName)
+{
+    ASSERT_EQ(packName("read", 4), packName("READ", 4));
+    ASSERT_NE(packName("read", 4), packName("r", 1));
+    ASSERT_NE(packName("reload", 6), packName("reloa", 5));
+    ASSERT_EQ(packName("", 0), 0u);
+    ASSERT_EQ(packName("toolongname", 11), 0u);
+    StringRef ref("Help me", 4);
+    ASSERT_TRUE(ref.equalsIgnoreCase("HELP"));
+    ASSERT_FALSE(ref.equalsIgnoreCase("HEL"));
+    ASSERT_FALSE(ref.equalsIgnoreCase("HELPS"));
+}
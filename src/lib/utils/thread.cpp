@@ -21,6 +21,153 @@
 #endif
 
 #include "thread.h"
+#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#ifdef HAVE_MLOCKALL
+#include <sys/mman.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using std::ostringstream;
+
+/**
+ * Return the name of a scheduling policy as accepted by @a ThreadSettings::parse().
+ * @param policy the scheduling policy.
+ * @return the name of the policy.
+ */
+static string getPolicyName(const int policy)
+{
+	switch (policy) {
+	case SCHED_OTHER:
+		return "other";
+	case SCHED_FIFO:
+		return "fifo";
+	case SCHED_RR:
+		return "rr";
+	default:
+		return "policy" + std::to_string(policy);
+	}
+}
+
+bool ThreadSettings::parse(const char* str)
+{
+	if (str == NULL || str[0] == 0)
+		return false;
+	ThreadSettings settings;
+	const char* cpus = strchr(str, '@');
+	string policy = cpus == NULL ? string(str) : string(str, cpus-str);
+	if (!policy.empty()) {
+		size_t colon = policy.find(':');
+		string name = policy.substr(0, colon);
+		if (strcasecmp(name.c_str(), "other") == 0)
+			settings.m_policy = SCHED_OTHER;
+		else if (strcasecmp(name.c_str(), "fifo") == 0)
+			settings.m_policy = SCHED_FIFO;
+		else if (strcasecmp(name.c_str(), "rr") == 0)
+			settings.m_policy = SCHED_RR;
+		else
+			return false;
+		int minPriority = sched_get_priority_min(settings.m_policy);
+		int maxPriority = sched_get_priority_max(settings.m_policy);
+		settings.m_priority = minPriority;
+		if (colon != string::npos) {
+			const char* start = policy.c_str()+colon+1;
+			char* end = NULL;
+			long priority = strtol(start, &end, 10);
+			if (end == start || *end != 0 || priority < minPriority || priority > maxPriority)
+				return false;
+			settings.m_priority = static_cast<int>(priority);
+		}
+	}
+	if (cpus != NULL) {
+		const char* pos = cpus+1;
+		do {
+			char* end = NULL;
+			long first = strtol(pos, &end, 10);
+			if (end == pos || first < 0 || first >= THREAD_MAX_CPUS)
+				return false;
+			long last = first;
+			if (*end == '-') {
+				pos = end+1;
+				last = strtol(pos, &end, 10);
+				if (end == pos || last < first || last >= THREAD_MAX_CPUS)
+					return false;
+			}
+			for (long cpu = first; cpu <= last; cpu++)
+				settings.m_cpus |= (uint64_t)1 << cpu;
+			if (*end != 0 && *end != ',')
+				return false;
+			pos = *end == ',' ? end+1 : end;
+		} while (*pos != 0 || pos[-1] == ',');
+	}
+	*this = settings;
+	return true;
+}
+
+string ThreadSettings::str() const
+{
+	ostringstream result;
+	if (m_policy >= 0) {
+		result << getPolicyName(m_policy);
+		if (m_policy != SCHED_OTHER)
+			result << ":" << m_priority;
+	}
+	if (m_cpus != 0) {
+		result << "@";
+		bool first = true;
+		for (int cpu = 0; cpu < THREAD_MAX_CPUS; cpu++) {
+			if ((m_cpus & ((uint64_t)1 << cpu)) == 0)
+				continue;
+			int last = cpu;
+			while (last+1 < THREAD_MAX_CPUS && (m_cpus & ((uint64_t)1 << (last+1))) != 0)
+				last++;
+			result << (first ? "" : ",") << cpu;
+			if (last > cpu)
+				result << "-" << last;
+			first = false;
+			cpu = last;
+		}
+	}
+	return result.str();
+}
+
+bool lockMemory(const size_t prefaultSize, string& error)
+{
+#ifdef HAVE_MLOCKALL
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		error = strerror(errno);
+		return false;
+	}
+#else
+	error = "not supported";
+	return false;
+#endif
+#ifdef __GLIBC__
+	// keep freed memory in the heap instead of giving it back to the system
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+	if (prefaultSize > 0) {
+		volatile char* buffer = static_cast<volatile char*>(malloc(prefaultSize));
+		if (buffer == NULL) {
+			error = "unable to allocate heap";
+			return false;
+		}
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		for (size_t pos = 0; pos < prefaultSize; pos += pageSize)
+			buffer[pos] = 0;
+		free(const_cast<char*>(buffer));
+	}
+	return true;
+}
 
 
 Thread::~Thread()
@@ -43,6 +190,8 @@ void Thread::setName(const string& name)
 bool Thread::start(const char* name)
 {
 	try {
+		m_name = name;
+		m_stopped = false;
 		m_thread = std::thread(std::bind(&Thread::enter, this));
 		setName(name);
 		m_started = true;
@@ -73,7 +222,63 @@ bool Thread::join()
 	return result == 0;
 }
 
+string Thread::getEffectiveSettings()
+{
+	std::lock_guard<std::mutex> lock(m_effectiveMutex);
+	return m_effective;
+}
+
+void Thread::applySettings()
+{
+	pthread_t self = pthread_self();
+	string failed;
+	if (m_settings.m_policy >= 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = m_settings.m_priority;
+		int err = pthread_setschedparam(self, m_settings.m_policy, &param);
+		if (err != 0)
+			failed = strerror(err);
+	}
+	if (m_settings.m_cpus != 0 && failed.empty()) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int cpu = 0; cpu < THREAD_MAX_CPUS; cpu++) {
+			if ((m_settings.m_cpus & ((uint64_t)1 << cpu)) != 0)
+				CPU_SET(cpu, &cpus);
+		}
+		int err = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+		if (err != 0)
+			failed = strerror(err);
+#else
+		failed = "affinity not supported";
+#endif
+	}
+	ThreadSettings effective;
+	struct sched_param param;
+	int policy;
+	if (pthread_getschedparam(self, &policy, &param) == 0) {
+		effective.m_policy = policy;
+		effective.m_priority = param.sched_priority;
+	}
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t cpus;
+	if (pthread_getaffinity_np(self, sizeof(cpus), &cpus) == 0) {
+		for (int cpu = 0; cpu < THREAD_MAX_CPUS; cpu++) {
+			if (CPU_ISSET(cpu, &cpus))
+				effective.m_cpus |= (uint64_t)1 << cpu;
+		}
+	}
+#endif
+	std::lock_guard<std::mutex> lock(m_effectiveMutex);
+	m_effective = effective.str();
+	if (!failed.empty())
+		m_effective += " (failed to apply " + m_settings.str() + ": " + failed + ")";
+}
+
 void Thread::enter() {
+	applySettings();
 	m_running = true;
 	run();
 	m_running = false;
@@ -97,10 +302,17 @@ bool WaitThread::join()
 	return Thread::join();
 }
 
-bool WaitThread::Wait(int seconds)
+void WaitThread::wakeUp()
+{
+	m_mutex.lock();
+	m_cond.notify_one();
+	m_mutex.unlock();
+}
+
+bool WaitThread::Wait(int seconds, int milliseconds)
 {
 	std::unique_lock<std::mutex> lock(m_mutex);
-	m_cond.wait_for(lock, std::chrono::seconds(seconds));
+	m_cond.wait_for(lock, std::chrono::seconds(seconds) + std::chrono::milliseconds(milliseconds));
 
 	return isRunning();
 }
@@ -19,13 +19,62 @@
 #ifndef LIBUTILS_THREAD_H_
 #define LIBUTILS_THREAD_H_
 
+#include <functional>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <stdint.h>
 #include "cppconfig.h"
 
 /** \file thread.h */
 
+/** the maximum number of CPUs addressable by @a ThreadSettings. */
+#define THREAD_MAX_CPUS 64
+
+/**
+ * The optional scheduling settings applied by a @a Thread when entered.
+ */
+struct ThreadSettings
+{
+	/**
+	 * Parse the settings from a string in the form "[POLICY[:PRIO]][@CPU[-CPU][,CPU[-CPU]]*]" with
+	 * POLICY being one of "other", "fifo", or "rr" (e.g. "fifo:50@1").
+	 * @param str the string to parse.
+	 * @return true on success, false on invalid input (leaving the settings unchanged).
+	 */
+	bool parse(const char* str);
+
+	/**
+	 * Format the settings in the form accepted by @a parse().
+	 * @return the formatted settings, or an empty string if nothing is to be changed.
+	 */
+	string str() const;
+
+	/**
+	 * Return whether nothing is to be changed.
+	 * @return whether nothing is to be changed.
+	 */
+	bool isDefault() const { return m_policy < 0 && m_cpus == 0; }
+
+	/** the scheduling policy (SCHED_OTHER, SCHED_FIFO, or SCHED_RR), or -1 to keep the inherited one. */
+	int m_policy = -1;
+
+	/** the scheduling priority for SCHED_FIFO and SCHED_RR. */
+	int m_priority = 0;
+
+	/** the bit mask of CPUs to run on, or 0 to keep the inherited affinity. */
+	uint64_t m_cpus = 0;
+};
+
+/**
+ * Lock all current and future pages of the process into memory and pre-fault the heap, so that
+ * time critical threads do not stall on page faults.
+ * @param prefaultSize the number of heap bytes to touch once and keep with the process.
+ * @param error the string in which to store the reason on failure.
+ * @return true on success.
+ */
+bool lockMemory(const size_t prefaultSize, string& error);
+
 /**
  * wrapper class for pthread.
  */
@@ -68,6 +117,25 @@ public:
 	 */
 	void setName(const string& name);
 
+	/**
+	 * Return the thread name passed to @a start().
+	 * @return the thread name.
+	 */
+	const string& getName() const { return m_name; }
+
+	/**
+	 * Set the scheduling settings to apply when the thread is entered (only effective before @a start()).
+	 * @param settings the @a ThreadSettings to apply.
+	 */
+	void setSettings(const ThreadSettings& settings) { m_settings = settings; }
+
+	/**
+	 * Return the effective scheduling settings of the thread.
+	 * @return the effective settings formatted like @a ThreadSettings::str(), followed by the reason
+	 * for failing to apply the requested ones (if any), or an empty string if not yet entered.
+	 */
+	string getEffectiveSettings();
+
 protected:
 
 	/**
@@ -82,6 +150,11 @@ private:
 	 */
 	void enter();
 
+	/**
+	 * Apply the requested @a ThreadSettings to the calling thread and determine the effective ones.
+	 */
+	void applySettings();
+
 	/** own thread id */
 	std::thread m_thread;
 
@@ -93,6 +166,18 @@ private:
 
 	/** Whether the thread was stopped by @a stop() or @a join(). */
 	bool m_stopped = false;
+
+	/** the thread name passed to @a start(). */
+	string m_name;
+
+	/** the requested @a ThreadSettings. */
+	ThreadSettings m_settings;
+
+	/** the mutex for @a m_effective. */
+	std::mutex m_effectiveMutex;
+
+	/** the effective settings formatted by @a applySettings(). */
+	string m_effective;
 };
 
 
@@ -117,9 +202,15 @@ public:
 	/**
 	 * Wait for the specified amount of time.
 	 * @param seconds the number of seconds to wait.
+	 * @param milliseconds the additional number of milliseconds to wait.
 	 * @return true if this @a Thread is till running and not yet stopped.
 	 */
-	bool Wait(int seconds);
+	bool Wait(int seconds, int milliseconds=0);
+
+	/**
+	 * Wake up the thread from @a Wait() without stopping it.
+	 */
+	void wakeUp();
 
 private:
 	/** the mutex for waiting. */
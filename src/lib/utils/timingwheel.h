@@ -0,0 +1,237 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_TIMINGWHEEL_H_
+#define LIBUTILS_TIMINGWHEEL_H_
+
+#include <ctime>
+#include <vector>
+#include <queue>
+#include "cppconfig.h"
+
+/** \file timingwheel.h */
+
+/** the number of bits of the due time handled by a single level of a @a TimingWheel. */
+#define TIMINGWHEEL_LEVEL_BITS 6
+
+/** the number of slots in a single level of a @a TimingWheel. */
+#define TIMINGWHEEL_SLOTS (1<<TIMINGWHEEL_LEVEL_BITS)
+
+/** the number of levels of a @a TimingWheel (the last one is followed by an overflow list). */
+#define TIMINGWHEEL_LEVELS 3
+
+/**
+ * Template class for a hierarchical timing wheel with a resolution of one second.
+ *
+ * Each level divides the time in @a TIMINGWHEEL_SLOTS slots, the first level
+ * has slots of one second, each further level has slots as large as a whole
+ * turn of the level below. Items are added to the slot of the lowest level
+ * covering their due time and are moved down to the lower levels while the
+ * time advances. Items that became due are handed out in the order of their
+ * due time, and in the order they were added for the same due time.
+ * @param T the item type (should be cheap to copy, e.g. a pointer).
+ */
+template <typename T>
+class TimingWheel
+{
+public:
+	TimingWheel() = default;
+
+	/**
+	 * Add an item.
+	 * @param item the item to add.
+	 * @param due the time when the item is due.
+	 */
+	void add(const T& item, const time_t due)
+	{
+		insert(Entry{due, m_nextSequence++, item});
+	}
+
+	/**
+	 * Take the next due item.
+	 * @param now the current time.
+	 * @param item the variable in which to store the item.
+	 * @param due the variable in which to store the time when the item was due.
+	 * @return true when an item was due, false otherwise.
+	 */
+	bool take(const time_t now, T& item, time_t& due)
+	{
+		advance(now);
+		if (m_due.empty())
+			return false;
+		const Entry& entry = m_due.top();
+		item = entry.m_item;
+		due = entry.m_due;
+		m_due.pop();
+		return true;
+	}
+
+	/**
+	 * Get the number of stored items.
+	 * @return the number of stored items.
+	 */
+	size_t size() const { return m_size + m_due.size(); }
+
+	/**
+	 * Return whether no item is stored.
+	 * @return whether no item is stored.
+	 */
+	bool empty() const { return size() == 0; }
+
+	/**
+	 * Remove all items.
+	 */
+	void clear()
+	{
+		for (auto& level : m_slots) {
+			for (auto& slot : level)
+				slot.clear();
+		}
+		m_overflow.clear();
+		m_due = DueQueue();
+		m_size = 0;
+	}
+
+private:
+
+	/**
+	 * A stored item.
+	 */
+	struct Entry
+	{
+		/** the time when the item is due. */
+		time_t m_due;
+
+		/** the sequence number for keeping the order of items with the same due time. */
+		unsigned long long m_sequence;
+
+		/** the item. */
+		T m_item;
+
+		/**
+		 * Return whether this entry is due after the other one.
+		 * @param other the other @a Entry.
+		 * @return whether this entry is due after the other one.
+		 */
+		bool operator>(const Entry& other) const
+		{
+			return m_due > other.m_due || (m_due == other.m_due && m_sequence > other.m_sequence);
+		}
+	};
+
+	/** the queue of due entries, earliest first. */
+	typedef priority_queue<Entry, vector<Entry>, std::greater<Entry>> DueQueue;
+
+	/**
+	 * Put an @a Entry into the matching slot, or into the due queue if already due.
+	 * @param entry the @a Entry to put.
+	 */
+	void insert(const Entry& entry)
+	{
+		if (entry.m_due <= m_now) {
+			m_due.push(entry);
+			return;
+		}
+		time_t delta = entry.m_due - m_now;
+		for (int level = 0; level < TIMINGWHEEL_LEVELS; level++) {
+			if (delta < ((time_t)1 << (TIMINGWHEEL_LEVEL_BITS*(level+1)))) {
+				size_t slot = (size_t)(entry.m_due >> (TIMINGWHEEL_LEVEL_BITS*level)) & (TIMINGWHEEL_SLOTS-1);
+				m_slots[level][slot].push_back(entry);
+				m_size++;
+				return;
+			}
+		}
+		m_overflow.push_back(entry);
+		m_size++;
+	}
+
+	/**
+	 * Move all entries of a slot into the matching lower slots or the due queue.
+	 * @param entries the entries of the slot (cleared afterwards).
+	 */
+	void cascade(vector<Entry>& entries)
+	{
+		vector<Entry> move;
+		move.swap(entries);
+		m_size -= move.size();
+		for (const auto& entry : move)
+			insert(entry);
+	}
+
+	/**
+	 * Advance the current time and collect all entries that became due.
+	 * @param now the current time.
+	 */
+	void advance(const time_t now)
+	{
+		if (now <= m_now)
+			return;
+		if (m_size == 0) {
+			m_now = now;
+			return;
+		}
+		if (now - m_now >= ((time_t)1 << (TIMINGWHEEL_LEVEL_BITS*2))) {
+			// large step: redistribute everything instead of walking through all slots
+			m_now = now;
+			for (auto& level : m_slots) {
+				for (auto& slot : level)
+					cascade(slot);
+			}
+			cascade(m_overflow);
+			return;
+		}
+		while (m_now < now && m_size > 0) {
+			m_now++;
+			if ((m_now & (TIMINGWHEEL_SLOTS-1)) == 0) {
+				// first slot of the lowest level reached: move entries down from the higher levels
+				int top = 1;
+				while (top < TIMINGWHEEL_LEVELS
+				&& ((m_now >> (TIMINGWHEEL_LEVEL_BITS*top)) & (TIMINGWHEEL_SLOTS-1)) == 0)
+					top++;
+				if (top == TIMINGWHEEL_LEVELS)
+					cascade(m_overflow);
+				for (int level = (top < TIMINGWHEEL_LEVELS ? top : TIMINGWHEEL_LEVELS-1); level > 0; level--)
+					cascade(m_slots[level][(size_t)(m_now >> (TIMINGWHEEL_LEVEL_BITS*level)) & (TIMINGWHEEL_SLOTS-1)]);
+			}
+			cascade(m_slots[0][(size_t)m_now & (TIMINGWHEEL_SLOTS-1)]);
+		}
+		if (m_now < now)
+			m_now = now;
+	}
+
+	/** the slots of all levels. */
+	vector<Entry> m_slots[TIMINGWHEEL_LEVELS][TIMINGWHEEL_SLOTS];
+
+	/** the entries due beyond the range of the highest level. */
+	vector<Entry> m_overflow;
+
+	/** the entries already due. */
+	DueQueue m_due;
+
+	/** the current time of the wheel. */
+	time_t m_now = 0;
+
+	/** the number of entries in @a m_slots and @a m_overflow. */
+	size_t m_size = 0;
+
+	/** the sequence number for the next added entry. */
+	unsigned long long m_nextSequence = 0;
+
+};
+
+#endif // LIBUTILS_TIMINGWHEEL_H_
@@ -0,0 +1,167 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBUTILS_TOKENIZER_H_
+#define LIBUTILS_TOKENIZER_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <strings.h>
+#include "cppconfig.h"
+
+/** \file tokenizer.h
+ * Splitting of client commands into references to the received buffer.
+ *
+ * As the tree is built as C++14, @a StringRef stands in for std::string_view.
+ */
+
+/**
+ * A reference to a part of a character buffer that is not copied.
+ */
+class StringRef
+{
+public:
+	/**
+	 * Constructor.
+	 * @param data the pointer to the first character.
+	 * @param length the number of characters.
+	 */
+	StringRef(const char* data, const size_t length) : m_data(data), m_length(length) {}
+
+	/**
+	 * Return the pointer to the first character (not terminated).
+	 * @return the pointer to the first character.
+	 */
+	const char* data() const { return m_data; }
+
+	/**
+	 * Return the number of characters.
+	 * @return the number of characters.
+	 */
+	size_t length() const { return m_length; }
+
+	/**
+	 * Return whether the referenced part is empty.
+	 * @return whether the referenced part is empty.
+	 */
+	bool empty() const { return m_length == 0; }
+
+	/**
+	 * Return a copy of the referenced part.
+	 * @return a new @a string with the referenced characters.
+	 */
+	string str() const { return string(m_data, m_length); }
+
+	/**
+	 * Return whether the referenced part equals the string ignoring the case.
+	 * @param str the terminated string to compare with.
+	 * @return whether the referenced part equals the string ignoring the case.
+	 */
+	bool equalsIgnoreCase(const char* str) const
+	{
+		return strlen(str) == m_length && strncasecmp(m_data, str, m_length) == 0;
+	}
+
+private:
+	/** the pointer to the first character. */
+	const char* m_data;
+
+	/** the number of characters. */
+	size_t m_length;
+};
+
+/**
+ * Split a command line into tokens separated by one or more space characters.
+ *
+ * A token starting with a double quote extends up to the next token ending
+ * with a double quote (or to the end of the line), with the enclosing quotes
+ * removed and the enclosed space characters kept. The tokens refer to the
+ * passed buffer, which therefore has to outlive them.
+ * @param data the pointer to the command line.
+ * @param length the length of the command line.
+ * @param tokens the @a vector to append the tokens to.
+ */
+inline void splitCommand(const char* data, const size_t length, vector<StringRef>& tokens)
+{
+	size_t pos = 0, quoted = string::npos, lastEnd = 0;
+	while (pos < length) {
+		const char* found = static_cast<const char*>(memchr(data+pos, ' ', length-pos));
+		size_t end = found ? static_cast<size_t>(found-data) : length;
+		if (quoted != string::npos) {
+			if (end > pos && data[end-1] == '"') {
+				tokens.push_back(StringRef(data+quoted, end-1-quoted));
+				quoted = string::npos;
+			}
+		} else if (end == pos) {
+			// allow multiple space chars for a single delimiter
+		} else if (data[pos] == '"') {
+			if (end-pos >= 2 && data[end-1] == '"')
+				tokens.push_back(StringRef(data+pos+1, end-pos-2));
+			else
+				quoted = pos+1;
+		} else {
+			tokens.push_back(StringRef(data+pos, end-pos));
+		}
+		lastEnd = end;
+		pos = found ? end+1 : length;
+	}
+	if (quoted != string::npos)
+		tokens.push_back(StringRef(data+quoted, lastEnd >= quoted ? lastEnd-quoted : 0));
+}
+
+/**
+ * Split the first line of a HTTP request into method, path, and optional query.
+ * @param data the pointer to the request line (without the "HTTP/x.x" suffix).
+ * @param length the length of the request line.
+ * @param tokens the @a vector to append the tokens to.
+ */
+inline void splitHttpRequest(const char* data, const size_t length, vector<StringRef>& tokens)
+{
+	size_t pos = 0;
+	while (pos < length) {
+		char delim = tokens.empty() ? ' ' : tokens.size() == 1 ? '?' : '\n';
+		const char* found = static_cast<const char*>(memchr(data+pos, delim, length-pos));
+		size_t end = found ? static_cast<size_t>(found-data) : length;
+		tokens.push_back(StringRef(data+pos, end-pos));
+		pos = found ? end+1 : length;
+	}
+}
+
+/**
+ * Pack a short name into a case insensitive 64 bit key, e.g. for a hashed dispatch table.
+ * @param data the pointer to the name.
+ * @param length the length of the name.
+ * @return the packed key, or 0 if the name is empty or longer than 8 characters.
+ */
+inline unsigned long long packName(const char* data, const size_t length)
+{
+	if (length == 0 || length > 8)
+		return 0;
+	unsigned long long key = 0;
+	for (size_t pos = 0; pos < length; pos++) {
+		unsigned char ch = static_cast<unsigned char>(data[pos]);
+		if (ch >= 'A' && ch <= 'Z')
+			ch = static_cast<unsigned char>(ch - 'A' + 'a');
+		key = (key << 8) | ch;
+	}
+	return key;
+}
+
+#endif // LIBUTILS_TOKENIZER_H_
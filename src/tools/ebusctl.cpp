@@ -27,18 +27,32 @@
 #include <iostream>
 #include <cstdlib>
 #include <sstream>
-
-#ifdef HAVE_PPOLL
+#include <fstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/un.h>
 #include <poll.h>
-#endif
 
 using std::cin;
 
+/** the default maximum number of commands sent ahead in batch mode. */
+#define BATCH_WINDOW 32
+
+/** the default number of seconds after which an unused control socket is closed. */
+#define CONTROL_IDLE_TIMEOUT 300
+
 /** A structure holding all program options. */
 struct options
 {
 	const char* server; //!< ebusd server host (name or ip) [localhost]
 	uint16_t port; //!< ebusd server port [8888]
+	bool batch; //!< whether to execute commands read from stdin or @a file in batch mode
+	const char* file; //!< the file to read batch commands from, or NULL for stdin
+	bool tag; //!< whether to print batch results tagged with the request ID
+	unsigned int window; //!< the maximum number of commands sent ahead in batch mode [32]
+	const char* control; //!< the path of the persistent control socket, or NULL
+	unsigned int idle; //!< the number of seconds after which an unused control socket is closed [300]
 
 	char* const *args; //!< arguments to pass to ebusd
 	unsigned int argCount; //!< number of arguments to pass to ebusd
@@ -48,6 +62,12 @@ struct options
 static struct options opt = {
 	"localhost", // server
 	8888, // port
+	false, // batch
+	NULL, // file
+	false, // tag
+	BATCH_WINDOW, // window
+	NULL, // control
+	CONTROL_IDLE_TIMEOUT, // idle
 
 	NULL, // args
 	0 // argCount
@@ -64,7 +84,16 @@ static const char argpdoc[] =
 	"Client for acessing " PACKAGE " via TCP.\n"
 	"\v"
 	"If given, send COMMAND together with CMDOPT options to " PACKAGE ".\n"
-	"Use 'help' as COMMAND for help on available " PACKAGE " commands.";
+	"Use 'help' as COMMAND for help on available " PACKAGE " commands.\n"
+	"\n"
+	"In batch mode, the commands are read line by line from stdin or FILE and are\n"
+	"pipelined over a single connection. With '--tag', each result line is prefixed\n"
+	"with the request ID and a tab: the ID is the line number, or the text before a\n"
+	"tab in the command line.\n"
+	"\n"
+	"With '--control', a background process keeps the connection to " PACKAGE " open and\n"
+	"serves subsequent invocations via the local socket PATH until it is unused for\n"
+	"the idle time.";
 
 /** the description of the accepted arguments. */
 static char argpargsdoc[] = "\nCOMMAND [CMDOPT...]";
@@ -74,6 +103,12 @@ static const struct argp_option argpoptions[] = {
 	{NULL,       0,   NULL, 0, "Options:", 1 },
 	{"server", 's', "HOST", 0, "Connect to HOST running " PACKAGE " (name or IP) [localhost]", 0 },
 	{"port",   'p', "PORT", 0, "Connect to PORT on HOST [8888]", 0 },
+	{"batch",  'b', NULL,   0, "Execute the commands read from stdin in batch mode", 0 },
+	{"file",   'f', "FILE", 0, "Execute the commands read from FILE in batch mode", 0 },
+	{"tag",    't', NULL,   0, "Prefix each batch result line with the request ID", 0 },
+	{"window", 'w', "COUNT", 0, "Send up to COUNT batch commands ahead [32]", 0 },
+	{"control", 'c', "PATH", 0, "Use the persistent control socket PATH (started if necessary)", 0 },
+	{"idle",   'i', "SEC",  0, "Close the control socket after SEC seconds without use [300]", 0 },
 
 	{NULL,       0,   NULL, 0, NULL, 0 },
 };
@@ -106,6 +141,41 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 		}
 		opt->port = (uint16_t)port;
 		break;
+	case 'b': // --batch
+		opt->batch = true;
+		break;
+	case 'f': // --file=FILE
+		if (arg == NULL || arg[0] == 0) {
+			argp_error(state, "invalid file");
+			return EINVAL;
+		}
+		opt->file = arg;
+		opt->batch = true;
+		break;
+	case 't': // --tag
+		opt->tag = true;
+		break;
+	case 'w': // --window=32
+		opt->window = (unsigned int)strtoul(arg, &strEnd, 10);
+		if (strEnd == NULL || strEnd == arg || *strEnd != 0 || opt->window < 1 || opt->window > 10000) {
+			argp_error(state, "invalid window");
+			return EINVAL;
+		}
+		break;
+	case 'c': // --control=PATH
+		if (arg == NULL || arg[0] == 0 || strlen(arg) >= sizeof(((struct sockaddr_un*)NULL)->sun_path)) {
+			argp_error(state, "invalid control socket");
+			return EINVAL;
+		}
+		opt->control = arg;
+		break;
+	case 'i': // --idle=300
+		opt->idle = (unsigned int)strtoul(arg, &strEnd, 10);
+		if (strEnd == NULL || strEnd == arg || *strEnd != 0 || opt->idle < 1 || opt->idle > 86400) {
+			argp_error(state, "invalid idle time");
+			return EINVAL;
+		}
+		break;
 	case ARGP_KEY_ARGS:
 		opt->args = state->argv + state->next;
 		opt->argCount = state->argc - state->next;
@@ -116,7 +186,38 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	return 0;
 }
 
-string fetchData(TCPSocket* socket, bool& listening)
+/**
+ * Check whether the command line consists of the specified command only.
+ * @param line the command line.
+ * @param shortName the short name of the command.
+ * @param longName the long name of the command.
+ * @return true if the command line matches.
+ */
+static bool isCommand(const string& line, const char* shortName, const char* longName)
+{
+	return strcasecmp(line.c_str(), shortName) == 0 || strcasecmp(line.c_str(), longName) == 0;
+}
+
+/**
+ * Write all data to the socket.
+ * @param fd the socket file descriptor.
+ * @param data the data to write.
+ * @return true on success.
+ */
+static bool sendAll(int fd, const string& data)
+{
+	for (size_t pos = 0; pos < data.length(); ) {
+		ssize_t sent = ::send(fd, data.data() + pos, data.length() - pos, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		pos += sent;
+	}
+	return true;
+}
+
+string fetchData(int fd, bool& listening)
 {
 	char data[1024];
 	ssize_t datalen;
@@ -139,7 +240,7 @@ string fetchData(TCPSocket* socket, bool& listening)
 	fds[0].fd = STDIN_FILENO;
 	fds[0].events = POLLIN;
 
-	fds[1].fd = socket->getFD();
+	fds[1].fd = fd;
 	fds[1].events = POLLIN;
 #else
 #ifdef HAVE_PSELECT
@@ -148,10 +249,10 @@ string fetchData(TCPSocket* socket, bool& listening)
 
 	FD_ZERO(&checkfds);
 	FD_SET(STDIN_FILENO, &checkfds);
-	FD_SET(socket->getFD(), &checkfds);
+	FD_SET(fd, &checkfds);
 	maxfd = STDIN_FILENO;
-	if (socket->getFD()>maxfd)
-		maxfd = socket->getFD();
+	if (fd>maxfd)
+		maxfd = fd;
 #endif
 #endif
 
@@ -184,19 +285,21 @@ string fetchData(TCPSocket* socket, bool& listening)
 			newInput = FD_ISSET(STDIN_FILENO, &readfds);
 
 			// new data from socket
-			newData = FD_ISSET(socket->getFD(), &readfds);
+			newData = FD_ISSET(fd, &readfds);
 #endif
 #endif
 		}
 
 		if (newData) {
-			if (socket->isValid()) {
-				datalen = socket->recv(data, sizeof(data));
+			if (fcntl(fd, F_GETFL) != -1) {
+				datalen = ::recv(fd, data, sizeof(data), 0);
 
 				if (datalen < 0) {
 					perror("recv");
 					break;
 				}
+				if (datalen == 0)
+					break;
 
 				for (int i = 0; i < datalen; i++)
 					ostream << data[i];
@@ -213,11 +316,9 @@ string fetchData(TCPSocket* socket, bool& listening)
 		else if (newInput) {
 			getline(cin, message);
 			sendmessage = message+'\n';
-			socket->send(sendmessage.c_str(), sendmessage.size());
+			sendAll(fd, sendmessage);
 
-			if (strcasecmp(message.c_str(), "Q") == 0
-			|| strcasecmp(message.c_str(), "QUIT") == 0
-			|| strcasecmp(message.c_str(), "STOP") == 0) {
+			if (isCommand(message, "Q", "QUIT") || strcasecmp(message.c_str(), "STOP") == 0) {
 				exit(EXIT_SUCCESS);
 				return "";
 			}
@@ -229,14 +330,293 @@ string fetchData(TCPSocket* socket, bool& listening)
 	return ostream.str();
 }
 
-void connect(const char* host, uint16_t port, char* const *args, int argCount)
+/**
+ * Execute the commands read from the input in batch mode.
+ * @param fd the socket file descriptor.
+ * @param input the stream to read the commands from.
+ * @return true if all commands were answered without error.
+ */
+static bool runBatch(int fd, istream& input)
+{
+	deque<std::pair<string, string>> ids; // the IDs and local results of the commands not yet answered
+	string line, pending, received;
+	size_t lineNo = 0;
+	bool inputDone = false, success = true;
+	char data[4096];
+	while (!inputDone || !ids.empty()) {
+		while (!inputDone && ids.size() < opt.window) {
+			if (!getline(input, line)) {
+				inputDone = true;
+				break;
+			}
+			lineNo++;
+			if (!line.empty() && line[line.length()-1] == '\r')
+				line.erase(line.length()-1);
+			string id = std::to_string(lineNo);
+			size_t pos = opt.tag ? line.find('\t') : string::npos;
+			if (pos != string::npos) {
+				id = line.substr(0, pos);
+				line.erase(0, pos+1);
+			}
+			if (line.find_first_not_of(" \t") == string::npos)
+				continue; // not answered by ebusd
+			if (isCommand(line, "Q", "QUIT")) {
+				inputDone = true;
+				break;
+			}
+			if (isCommand(line, "L", "LISTEN")) {
+				ids.push_back(std::make_pair(id, "ERR: command not available in batch mode"));
+				continue;
+			}
+			pending += line + '\n';
+			ids.push_back(std::make_pair(id, ""));
+		}
+		if (!pending.empty()) {
+			if (!sendAll(fd, pending)) {
+				perror("send");
+				return false;
+			}
+			pending.clear();
+		}
+		if (ids.empty())
+			continue;
+		if (ids.front().second.empty() && received.find("\n\n") == string::npos) {
+			ssize_t datalen = ::recv(fd, data, sizeof(data), 0);
+			if (datalen < 0 && errno == EINTR)
+				continue;
+			if (datalen <= 0) {
+				cout << "connection closed with " << ids.size() << " commands unanswered" << endl;
+				return false;
+			}
+			received.append(data, datalen);
+		}
+		while (!ids.empty()) {
+			string result = ids.front().second;
+			if (result.empty()) {
+				size_t pos = received.find("\n\n");
+				if (pos == string::npos)
+					break;
+				result = received.substr(0, pos);
+				received.erase(0, pos+2);
+			}
+			if (result.compare(0, 4, "ERR:") == 0)
+				success = false;
+			if (!opt.tag)
+				cout << result << endl << endl;
+			else {
+				istringstream stream(result);
+				while (getline(stream, line))
+					cout << ids.front().first << '\t' << line << endl;
+			}
+			ids.pop_front();
+		}
+	}
+	return success;
+}
+
+/** A client connected to the control socket. */
+struct ControlClient
+{
+	unsigned long id; //!< the unique ID of the client
+	int fd; //!< the socket file descriptor
+	string input; //!< the received but not yet complete command line
+};
+
+/** A command received from a control socket client. */
+struct ControlCommand
+{
+	unsigned long clientId; //!< the ID of the requesting client
+	string localResult; //!< the result determined locally, or empty when forwarded to ebusd
+};
+
+/**
+ * Serve the clients of the control socket over the single connection to ebusd until it is unused for the idle time.
+ * @param listenFd the file descriptor of the listening control socket.
+ * @param serverFd the file descriptor of the connection to ebusd.
+ */
+static void runControlProxy(int listenFd, int serverFd)
+{
+	vector<ControlClient> clients;
+	deque<ControlCommand> commands; // the commands in order of their results
+	string received;
+	unsigned long nextId = 1;
+	time_t lastActivity = time(NULL);
+	char data[4096];
+	while (true) {
+		vector<struct pollfd> fds(2 + clients.size());
+		fds[0].fd = listenFd;
+		fds[1].fd = serverFd;
+		for (size_t i = 0; i < clients.size(); i++)
+			fds[2+i].fd = clients[i].fd;
+		for (auto& pfd : fds) {
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+		}
+		int ret = poll(fds.data(), (nfds_t)fds.size(), 1000);
+		if (ret < 0 && errno != EINTR)
+			break;
+		time_t now = time(NULL);
+		if (ret <= 0) {
+			if (clients.empty() && commands.empty() && now - lastActivity >= (time_t)opt.idle)
+				break;
+			continue;
+		}
+		if (fds[1].revents & (POLLIN|POLLHUP|POLLERR)) {
+			ssize_t datalen = ::recv(serverFd, data, sizeof(data), 0);
+			if (datalen <= 0 && !(datalen < 0 && errno == EINTR))
+				break; // connection to ebusd closed
+			if (datalen > 0)
+				received.append(data, datalen);
+		}
+		for (size_t i = clients.size(); i-- > 0; ) {
+			ControlClient& client = clients[i];
+			if (!(fds[2+i].revents & (POLLIN|POLLHUP|POLLERR)))
+				continue;
+			ssize_t datalen = ::recv(client.fd, data, sizeof(data), 0);
+			if (datalen < 0 && errno == EINTR)
+				continue;
+			if (datalen <= 0) {
+				close(client.fd);
+				clients.erase(clients.begin()+i);
+				continue;
+			}
+			lastActivity = now;
+			client.input.append(data, datalen);
+			size_t pos;
+			while ((pos = client.input.find('\n')) != string::npos) {
+				string line = client.input.substr(0, pos);
+				client.input.erase(0, pos+1);
+				if (!line.empty() && line[line.length()-1] == '\r')
+					line.erase(line.length()-1);
+				if (line.find_first_not_of(" \t") == string::npos)
+					continue;
+				ControlCommand command = { client.id, "" };
+				if (isCommand(line, "L", "LISTEN") || isCommand(line, "Q", "QUIT"))
+					command.localResult = "ERR: command not available via control socket\n\n";
+				else
+					sendAll(serverFd, line + '\n');
+				commands.push_back(command);
+			}
+		}
+		// pass the results to the requesting clients in order
+		while (!commands.empty()) {
+			string result = commands.front().localResult;
+			if (result.empty()) {
+				size_t pos = received.find("\n\n");
+				if (pos == string::npos)
+					break;
+				result = received.substr(0, pos+2);
+				received.erase(0, pos+2);
+			}
+			for (auto& client : clients) {
+				if (client.id == commands.front().clientId) {
+					sendAll(client.fd, result);
+					break;
+				}
+			}
+			commands.pop_front();
+		}
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listenFd, NULL, NULL);
+			if (fd >= 0) {
+				ControlClient client = { nextId++, fd, "" };
+				clients.push_back(client);
+				lastActivity = now;
+			}
+		}
+	}
+	for (auto& client : clients)
+		close(client.fd);
+}
+
+/**
+ * Connect to the persistent control socket and start it if necessary.
+ * @param host the host running ebusd.
+ * @param port the port of ebusd on the host.
+ * @return the connected socket file descriptor, or -1 on error.
+ */
+static int openControl(const char* host, uint16_t port)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, opt.control, sizeof(address.sun_path)-1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (::connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0)
+		return fd;
+
+	// not yet running (or stale): connect to ebusd and serve the socket in the background
+	TCPClient client;
+	TCPSocket* socket = client.connect(host, port);
+	if (socket == NULL) {
+		close(fd);
+		return -1;
+	}
+	int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(opt.control);
+	if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+		perror("control socket");
+		if (listenFd >= 0)
+			close(listenFd);
+		delete socket;
+		close(fd);
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fd);
+		setsid();
+		int null = ::open("/dev/null", O_RDWR);
+		if (null >= 0) {
+			dup2(null, STDIN_FILENO);
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+			close(null);
+		}
+		signal(SIGPIPE, SIG_IGN);
+		runControlProxy(listenFd, socket->getFD());
+		unlink(opt.control);
+		delete socket;
+		_exit(EXIT_SUCCESS);
+	}
+	close(listenFd);
+	delete socket;
+	if (pid < 0 || ::connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool connect(const char* host, uint16_t port, char* const *args, int argCount)
 {
 
-	TCPClient* client = new TCPClient();
-	TCPSocket* socket = client->connect(host, port);
+	TCPClient* client = NULL;
+	TCPSocket* socket = NULL;
+	int fd;
+	if (opt.control)
+		fd = openControl(host, port);
+	else {
+		client = new TCPClient();
+		socket = client->connect(host, port);
+		fd = socket == NULL ? -1 : socket->getFD();
+	}
 
 	bool once = args != NULL && argCount > 0;
-	if (socket != NULL) {
+	bool success = fd >= 0;
+	if (fd >= 0 && opt.batch) {
+		if (opt.file) {
+			ifstream file(opt.file);
+			if (!file.is_open()) {
+				cout << "error opening file " << opt.file << endl;
+				success = false;
+			} else
+				success = runBatch(fd, file);
+		} else
+			success = runBatch(fd, cin);
+	} else if (fd >= 0) {
 		string message, sendmessage;
 		do {
 			bool listening = false;
@@ -259,37 +639,39 @@ void connect(const char* host, uint16_t port, char* const *args, int argCount)
 			}
 
 			sendmessage = message+'\n';
-			socket->send(sendmessage.c_str(), sendmessage.size());
+			sendAll(fd, sendmessage);
 
-			if (strcasecmp(message.c_str(), "Q") == 0
-			|| strcasecmp(message.c_str(), "QUIT") == 0
-			|| strcasecmp(message.c_str(), "STOP") == 0)
+			if (isCommand(message, "Q", "QUIT") || strcasecmp(message.c_str(), "STOP") == 0)
 				break;
 
 			if (message.length() > 0) {
-				if (strcasecmp(message.c_str(), "L") == 0
-				|| strcasecmp(message.c_str(), "LISTEN") == 0) {
+				if (isCommand(message, "L", "LISTEN") && opt.control) {
+					cout << "ERR: command not available via control socket" << endl << endl;
+				} else if (isCommand(message, "L", "LISTEN")) {
 					listening = true;
 					while (listening && !cin.eof()) {
-						string result(fetchData(socket, listening));
+						string result(fetchData(fd, listening));
 						cout << result;
 						if (strcasecmp(result.c_str(), "LISTEN STOPPED") == 0)
 							break;
 					}
 				}
 				else
-					cout << fetchData(socket, listening);
+					cout << fetchData(fd, listening);
 			}
 
 		} while (!once && !cin.eof());
-
-		delete socket;
-
 	}
 	else
 		cout << "error connecting to " << host << ":" << port << endl;
 
-	delete client;
+	if (socket)
+		delete socket;
+	else if (fd >= 0)
+		close(fd);
+	if (client)
+		delete client;
+	return success;
 }
 
 int main(int argc, char* argv[])
@@ -299,8 +681,7 @@ int main(int argc, char* argv[])
 	if (argp_parse(&argp, argc, argv, ARGP_IN_ORDER, NULL, &opt) != 0)
 		return EINVAL;
 
-	connect(opt.server, opt.port, opt.args, opt.argCount);
+	bool success = connect(opt.server, opt.port, opt.args, opt.argCount);
 
-	exit(EXIT_SUCCESS);
+	exit(opt.batch && !success ? EXIT_FAILURE : EXIT_SUCCESS);
 }
-
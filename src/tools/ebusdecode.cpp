@@ -0,0 +1,635 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2016 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <argp.h>
+#include "message.h"
+#include "data.h"
+#include "dumpwriter.h"
+#include "outputsink.h"
+#include "clock.h"
+#include "log.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using std::cerr;
+using std::ios;
+
+/** the number of dump symbols decoded as one chunk. */
+#define DECODE_CHUNK_SIZE (1024*1024)
+
+/** the maximum number of decoded chunks per thread waiting to be written. */
+#define DECODE_PENDING_CHUNKS 4
+
+/** A structure holding all program options. */
+struct options
+{
+	const char* configPath; //!< the path to the CSV configuration files [/etc/ebusd]
+	bool timestamps; //!< whether the dump file contains timestamped records
+	unsigned int threads; //!< the number of decoding threads, or 0 for the number of cores
+	bool json; //!< whether to write JSON lines instead of CSV
+	bool unknown; //!< whether to also write unknown telegrams
+	OutputFormat outputFormat; //!< the @a OutputFormat options for decoding
+	const char* outputFile; //!< the file to write to, or NULL for stdout
+
+	const char* dumpFile; //!< the dump file to decode
+};
+
+/** the program options. */
+static struct options opt = {
+	"/etc/ebusd", // configPath
+	false, // timestamps
+	0, // threads
+	false, // json
+	false, // unknown
+	0, // outputFormat
+	NULL, // outputFile
+
+	"/tmp/ebus_dump.bin", // dumpFile
+};
+
+/** the version string of the program. */
+const char *argp_program_version = "ebusdecode of """ PACKAGE_STRING "";
+
+/** the report bugs to address of the program. */
+const char *argp_program_bug_address = "" PACKAGE_BUGREPORT "";
+
+/** the documentation of the program. */
+static const char argpdoc[] =
+	"Decode the telegrams in an " PACKAGE " DUMPFILE using several threads.\n"
+	"\v"
+	"With no DUMPFILE, /tmp/ebus_dump.bin is used.\n"
+	"\n"
+	"Each telegram is written as one line with the time (only for a dump written with\n"
+	"'" PACKAGE " --dumptimestamps'), the symbol offset in the dump, circuit and name of the\n"
+	"message, the master and slave data, and the decoded value.\n"
+	"Conditional messages are not available, since the decoding does not keep any state.";
+
+/** the description of the accepted arguments. */
+static char argpargsdoc[] = "[DUMPFILE]";
+
+/** the definition of the known program arguments. */
+static const struct argp_option argpoptions[] = {
+	{"configpath", 'c', "PATH", 0, "Read CSV config files from PATH [/etc/ebusd]", 0 },
+	{"timestamps", 't', NULL,   0, "DUMPFILE contains timestamped records", 0 },
+	{"threads",    'j', "COUNT", 0, "Decode with COUNT threads [number of cores]", 0 },
+	{"json",       'J', NULL,   0, "Write JSON lines instead of CSV", 0 },
+	{"unknown",    'u', NULL,   0, "Also write the telegrams of unknown messages", 0 },
+	{"verbose",    'v', NULL,   0, "Decode verbosely (with names, units, and comments)", 0 },
+	{"numeric",    'n', NULL,   0, "Keep the numeric value of value lists", 0 },
+	{"output",     'o', "FILE", 0, "Write to FILE instead of stdout", 0 },
+
+	{NULL,           0, NULL,   0, NULL, 0 },
+};
+
+/**
+ * The program argument parsing function.
+ * @param key the key from @a argpoptions.
+ * @param arg the option argument, or NULL.
+ * @param state the parsing state.
+ */
+error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+	struct options *opt = (struct options*)state->input;
+	char* strEnd = NULL;
+	switch (key) {
+	case 'c': // --configpath=/etc/ebusd
+		if (arg == NULL || arg[0] == 0 || strcmp("/", arg) == 0) {
+			argp_error(state, "invalid configpath");
+			return EINVAL;
+		}
+		opt->configPath = arg;
+		break;
+	case 't': // --timestamps
+		opt->timestamps = true;
+		break;
+	case 'j': // --threads=4
+		opt->threads = (unsigned int)strtoul(arg, &strEnd, 10);
+		if (strEnd == NULL || strEnd == arg || *strEnd != 0 || opt->threads < 1 || opt->threads > 256) {
+			argp_error(state, "invalid threads");
+			return EINVAL;
+		}
+		break;
+	case 'J': // --json
+		opt->json = true;
+		break;
+	case 'u': // --unknown
+		opt->unknown = true;
+		break;
+	case 'v': // --verbose
+		opt->outputFormat |= OF_VERBOSE;
+		break;
+	case 'n': // --numeric
+		opt->outputFormat |= OF_NUMERIC;
+		break;
+	case 'o': // --output=FILE
+		if (arg == NULL || arg[0] == 0) {
+			argp_error(state, "invalid output");
+			return EINVAL;
+		}
+		opt->outputFile = arg;
+		break;
+	case ARGP_KEY_ARG:
+		if (state->arg_num == 0) {
+			if (arg == NULL || arg[0] == 0 || strcmp("/", arg) == 0) {
+				argp_error(state, "invalid dumpfile");
+				return EINVAL;
+			}
+			opt->dumpFile = arg;
+		} else
+			return ARGP_ERR_UNKNOWN;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/** the global @a DataFieldTemplates. */
+static DataFieldTemplates globalTemplates;
+
+/** the @a DataFieldTemplates by path (may also carry a reference to @a globalTemplates). */
+static map<string, DataFieldTemplates*> templatesByPath;
+
+DataFieldTemplates* getTemplates(const string filename)
+{
+	string path;
+	size_t pos = filename.find_last_of('/');
+	if (pos != string::npos)
+		path = filename.substr(0, pos);
+	auto it = templatesByPath.find(path);
+	if (it != templatesByPath.end())
+		return it->second;
+	return &globalTemplates;
+}
+
+/**
+ * Read all configuration files in the path and its sub directories.
+ * @param path the path to read the files from.
+ * @param root whether this is the root path (using the global templates).
+ * @param messages the @a MessageMap to add the messages to.
+ * @return @a RESULT_OK on success, or an error code.
+ */
+static result_t readConfigFiles(const string& path, const bool root, MessageMap& messages)
+{
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL)
+		return RESULT_ERR_NOTFOUND;
+	vector<string> files, dirs;
+	bool hasTemplates = false;
+	dirent* d;
+	while ((d = readdir(dir)) != NULL) {
+		string name = d->d_name;
+		if (name == "." || name == "..")
+			continue;
+		const string file = path + "/" + name;
+		struct stat st;
+		if (stat(file.c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			dirs.push_back(file);
+		else if (S_ISREG(st.st_mode) && name.length() > 4 && name.substr(name.length()-4) == ".csv") {
+			if (name == "_templates.csv")
+				hasTemplates = true;
+			else
+				files.push_back(file);
+		}
+	}
+	closedir(dir);
+	DataFieldTemplates* templates = &globalTemplates;
+	if (!root && hasTemplates)
+		templates = new DataFieldTemplates(globalTemplates);
+	templatesByPath[path] = templates;
+	if (hasTemplates && templates->readFromFile(path + "/_templates.csv") != RESULT_OK)
+		cerr << "error reading templates in " << path << ": " << templates->getLastError() << endl;
+	result_t result = messages.readFromFiles(files, false);
+	if (result != RESULT_OK)
+		return result;
+	for (const auto& sub : dirs) {
+		result = readConfigFiles(sub, false, messages);
+		if (result != RESULT_OK)
+			return result;
+	}
+	return RESULT_OK;
+}
+
+/**
+ * A read-only view on the symbols of a memory mapped dump (plain or timestamped).
+ */
+class DumpView
+{
+public:
+	/**
+	 * Construct a new instance.
+	 * @param data the dump data.
+	 * @param size the size of the dump data in bytes.
+	 * @param timestamps whether the dump data consists of timestamped records.
+	 */
+	DumpView(const unsigned char* data, const size_t size, const bool timestamps)
+		: m_data(data), m_stride(timestamps ? DUMP_RECORD_SIZE : 1), m_count(size / m_stride) {}
+
+	/**
+	 * Return the number of symbols.
+	 * @return the number of symbols.
+	 */
+	size_t size() const { return m_count; }
+
+	/**
+	 * Return the symbol at the specified position.
+	 * @param pos the position of the symbol.
+	 * @return the symbol.
+	 */
+	unsigned char operator[](const size_t pos) const { return m_data[pos*m_stride + m_stride-1]; }
+
+	/**
+	 * Return whether the receive times of the symbols are available.
+	 * @return whether the receive times of the symbols are available.
+	 */
+	bool hasTimes() const { return m_stride > 1; }
+
+	/**
+	 * Return the receive time of the symbol at the specified position.
+	 * @param pos the position of the symbol.
+	 * @return the receive time in microseconds since the epoch, or 0.
+	 */
+	unsigned long long getTime(const size_t pos) const
+	{
+		if (m_stride == 1)
+			return 0;
+		unsigned long long time = 0;
+		const unsigned char* record = m_data + pos*m_stride;
+		for (int i = 0; i < 8; i++)
+			time |= (unsigned long long)record[i] << (8 * i);
+		return time;
+	}
+
+private:
+	/** the dump data. */
+	const unsigned char* m_data;
+
+	/** the number of bytes per symbol. */
+	const size_t m_stride;
+
+	/** the number of symbols. */
+	const size_t m_count;
+};
+
+/**
+ * A part of the dump decoded by a single thread.
+ */
+struct DecodeChunk
+{
+	/** the position of the first symbol. */
+	size_t m_start;
+
+	/** the position after the last symbol (always at @a SYN or the end of the dump). */
+	size_t m_end;
+
+	/** the formatted output. */
+	string m_output;
+
+	/** whether the chunk was decoded completely. */
+	bool m_done = false;
+
+	/** the number of telegrams found. */
+	unsigned long m_telegrams = 0;
+
+	/** the number of telegrams of known messages. */
+	unsigned long m_known = 0;
+
+	/** the number of telegrams that failed to decode. */
+	unsigned long m_errors = 0;
+};
+
+/**
+ * Receive a master or slave part of a telegram (accepting one repetition after @a NAK).
+ * @param data the @a DumpView.
+ * @param pos the position of the next symbol in @a data (updated).
+ * @param end the end position of the telegram in @a data.
+ * @param part the unescaped @a SymbolString to fill (including the CRC).
+ * @param headerLen the number of header bytes before the length byte.
+ * @param acknowledge whether the part has to be followed by an @a ACK.
+ * @return true when the part was completely received with valid CRC and positive acknowledge.
+ */
+static bool receivePart(const DumpView& data, size_t& pos, const size_t end, SymbolString& part,
+	const size_t headerLen, const bool acknowledge)
+{
+	for (int attempt = 0; attempt < 2; attempt++) {
+		part.clear();
+		bool complete = false;
+		while (pos < end && !complete) {
+			size_t crcPos = part.size() > headerLen ? headerLen + 1 + part[headerLen] : 0xff;
+			if (part.push_back(data[pos++], true, part.size() < crcPos) < RESULT_OK)
+				return false;
+			if (crcPos != 0xff && part.size() == crcPos + 1) {
+				if (part[crcPos] != part.getCRC())
+					return false;
+				complete = true;
+			}
+		}
+		if (!complete)
+			return false;
+		if (!acknowledge)
+			return true;
+		if (pos >= end)
+			return false;
+		unsigned char ack = data[pos++];
+		if (ack == ACK)
+			return true;
+		if (ack != NAK)
+			return false;
+	}
+	return false;
+}
+
+/**
+ * Format the receive time.
+ * @param output the @a ostream to write to.
+ * @param time the receive time in microseconds since the epoch.
+ */
+static void formatTime(ostream& output, const unsigned long long time)
+{
+	time_t secs = (time_t)(time / 1000000);
+	struct tm tm;
+	gmtime_r(&secs, &tm);
+	char buffer[40];
+	size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buffer+length, sizeof(buffer)-length, ".%06uZ", (unsigned int)(time % 1000000));
+	output << buffer;
+}
+
+/**
+ * Write a CSV column (quoted if necessary).
+ * @param output the @a ostream to write to.
+ * @param value the column value.
+ * @param length the length of the value.
+ */
+static void writeCsvColumn(ostream& output, const char* value, const size_t length)
+{
+	bool quote = false;
+	for (size_t pos = 0; pos < length && !quote; pos++)
+		quote = value[pos] == ',' || value[pos] == '"' || value[pos] == '\n';
+	if (!quote) {
+		output.write(value, length);
+		return;
+	}
+	output << '"';
+	for (size_t pos = 0; pos < length; pos++) {
+		if (value[pos] == '"')
+			output << '"';
+		output << value[pos];
+	}
+	output << '"';
+}
+
+/**
+ * Decode a chunk of the dump.
+ * @param data the @a DumpView.
+ * @param messages the @a MessageMap (only read).
+ * @param chunk the @a DecodeChunk to decode.
+ * @param master the scratch @a SymbolString for the master data.
+ * @param slave the scratch @a SymbolString for the slave data.
+ * @param value the scratch @a OutputSink for the decoded value.
+ * @param line the scratch @a OutputSink for the formatted telegrams.
+ */
+static void decodeChunk(const DumpView& data, MessageMap& messages, DecodeChunk& chunk,
+	SymbolString& master, SymbolString& slave, OutputSink& value, OutputSink& line)
+{
+	line.reset();
+	size_t pos = chunk.m_start;
+	while (pos < chunk.m_end) {
+		while (pos < chunk.m_end && data[pos] == SYN)
+			pos++;
+		size_t start = pos, end = pos;
+		while (end < chunk.m_end && data[end] != SYN)
+			end++;
+		pos = end;
+		if (end - start < 6)
+			continue; // arbitration or incomplete
+		size_t partPos = start;
+		unsigned char dstAddress = data[start+1];
+		bool broadcast = dstAddress == BROADCAST;
+		bool masterOnly = broadcast || libebus::Address(dstAddress).isMaster();
+		slave.clear();
+		if (!receivePart(data, partPos, end, master, 4, !broadcast)
+		|| (!masterOnly && !receivePart(data, partPos, end, slave, 0, true)))
+			continue;
+		chunk.m_telegrams++;
+		Message* message = messages.findUncached(master);
+		if (message && message->getCount() > 1)
+			message = NULL; // the parts of chained messages can not be decoded individually
+		if (message)
+			chunk.m_known++;
+		else if (!opt.unknown)
+			continue;
+		result_t result = RESULT_OK;
+		value.reset();
+		if (message)
+			result = message->decodeData(master, slave, value, opt.outputFormat | (opt.json ? OF_JSON : 0));
+		if (result < RESULT_OK)
+			chunk.m_errors++;
+		string masterStr = master.getDataStr(), slaveStr = slave.getDataStr(); // without CRC
+		if (opt.json) {
+			line << "{\"time\": ";
+			if (data.hasTimes()) {
+				line << '"';
+				formatTime(line, data.getTime(start));
+				line << '"';
+			} else
+				line << "null";
+			line << ", \"offset\": ";
+			writeUnsigned(line, start);
+			if (message)
+				line << ", \"circuit\": \"" << message->getCircuit() << "\", \"name\": \"" << message->getName() << '"';
+			line << ", \"master\": \"" << masterStr << "\", \"slave\": \"" << slaveStr << '"';
+			if (message && result < RESULT_OK)
+				line << ", \"decodeerror\": \"" << getResultCode(result) << '"';
+			else if (message) {
+				line << ", \"fields\": {";
+				const char* str = value.data();
+				for (size_t i = 0; i < value.size(); i++) {
+					if (str[i] != '\n') {
+						line << str[i];
+						continue;
+					}
+					while (i+1 < value.size() && str[i+1] == ' ')
+						i++; // skip the line break and indentation
+					line << ' ';
+				}
+				line << " }";
+			}
+			line << "}\n";
+		} else {
+			if (data.hasTimes())
+				formatTime(line, data.getTime(start));
+			line << ',';
+			writeUnsigned(line, start);
+			line << ',';
+			if (message) {
+				writeCsvColumn(line, message->getCircuit().c_str(), message->getCircuit().length());
+				line << ',';
+				writeCsvColumn(line, message->getName().c_str(), message->getName().length());
+			} else
+				line << ',';
+			line << ',' << masterStr << ',' << slaveStr << ',';
+			if (message && result < RESULT_OK) {
+				string error = getResultCode(result);
+				writeCsvColumn(line, error.c_str(), error.length());
+			} else if (message)
+				writeCsvColumn(line, value.data(), value.size());
+			line << '\n';
+		}
+	}
+	chunk.m_output.assign(line.data(), line.size());
+}
+
+int main(int argc, char* argv[])
+{
+	struct argp argp = { argpoptions, parse_opt, argpargsdoc, argpdoc, NULL, NULL, NULL };
+	setenv("ARGP_HELP_FMT", "no-dup-args-note", 0);
+	if (argp_parse(&argp, argc, argv, ARGP_IN_ORDER, NULL, &opt) != 0)
+		return EINVAL;
+	setLogLevel("error");
+
+	MessageMap messages;
+	result_t result = readConfigFiles(opt.configPath, true, messages);
+	if (result == RESULT_OK)
+		result = messages.resolveConditions(false);
+	if (result != RESULT_OK) {
+		cerr << "error reading config files from " << opt.configPath << ": " << getResultCode(result) << ", "
+			<< messages.getLastError() << endl;
+		return EXIT_FAILURE;
+	}
+
+	int fd = open(opt.dumpFile, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		cerr << "error opening file " << opt.dumpFile << endl;
+		return EXIT_FAILURE;
+	}
+	const unsigned char* mapped = NULL;
+	if (st.st_size > 0) {
+		void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			cerr << "error mapping file " << opt.dumpFile << endl;
+			close(fd);
+			return EXIT_FAILURE;
+		}
+		mapped = (const unsigned char*)addr;
+		madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+	}
+	DumpView data(mapped, (size_t)st.st_size, opt.timestamps);
+
+	// split at SYN symbols so that no telegram spans two chunks
+	vector<DecodeChunk> chunks;
+	for (size_t start = 0; start < data.size(); ) {
+		size_t end = start + DECODE_CHUNK_SIZE;
+		while (end < data.size() && data[end] != SYN)
+			end++;
+		if (end > data.size())
+			end = data.size();
+		DecodeChunk chunk;
+		chunk.m_start = start;
+		chunk.m_end = end;
+		chunks.push_back(chunk);
+		start = end;
+	}
+
+	ofstream file;
+	if (opt.outputFile) {
+		file.open(opt.outputFile, ios::out | ios::binary | ios::trunc);
+		if (!file.is_open()) {
+			cerr << "error opening file " << opt.outputFile << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	ostream& output = opt.outputFile ? file : cout;
+	if (!opt.json)
+		output << "time,offset,circuit,name,master,slave,value\n";
+
+	unsigned int threadCount = opt.threads ? opt.threads : std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	const size_t maxPending = DECODE_PENDING_CHUNKS * threadCount;
+	std::atomic<size_t> nextChunk(0);
+	size_t written = 0;
+	std::mutex mutex;
+	std::condition_variable decoded, consumed;
+	unsigned long long start = clockGetMicros();
+	vector<std::thread> threads;
+	for (unsigned int i = 0; i < threadCount; i++) {
+		threads.emplace_back([&]() {
+			// scratch state for this thread only, the MessageMap is shared read-only
+			SymbolString master(false), slave(false);
+			OutputSink value, line;
+			size_t index;
+			while ((index = nextChunk.fetch_add(1)) < chunks.size()) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					consumed.wait(lock, [&]() { return index < written + maxPending; });
+				}
+				decodeChunk(data, messages, chunks[index], master, slave, value, line);
+				std::lock_guard<std::mutex> lock(mutex);
+				chunks[index].m_done = true;
+				decoded.notify_all();
+			}
+		});
+	}
+	unsigned long telegrams = 0, known = 0, errors = 0;
+	while (written < chunks.size()) {
+		DecodeChunk& chunk = chunks[written];
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			decoded.wait(lock, [&]() { return chunk.m_done; });
+		}
+		output.write(chunk.m_output.data(), chunk.m_output.size());
+		string().swap(chunk.m_output);
+		telegrams += chunk.m_telegrams;
+		known += chunk.m_known;
+		errors += chunk.m_errors;
+		std::lock_guard<std::mutex> lock(mutex);
+		written++;
+		consumed.notify_all();
+	}
+	for (auto& thread : threads)
+		thread.join();
+	output.flush();
+	unsigned long long duration = clockGetMicros() - start;
+
+	if (mapped)
+		munmap((void*)mapped, (size_t)st.st_size);
+	close(fd);
+	cerr << "decoded " << telegrams << " telegrams (" << known << " known, " << errors << " errors) from "
+		<< data.size() << " symbols in " << (duration / 1000) << " ms using " << threadCount << " threads" << endl;
+	return output.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
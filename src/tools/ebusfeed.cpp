@@ -22,6 +22,8 @@
 
 #include <argp.h>
 #include "device.h"
+#include "dumpwriter.h"
+#include "clock.h"
 #include <unistd.h>
 #include <iostream>
 #include <string.h>
@@ -32,11 +34,18 @@
 using std::fstream;
 using std::ios;
 
+/** the number of bytes to read from the dump file at once. */
+#define FEED_READ_SIZE (512*DUMP_RECORD_SIZE)
+
 /** A structure holding all program options. */
 struct options
 {
 	const char* device; //!< device to write to [/dev/ttyUSB60]
 	unsigned int time; //!< delay between bytes in us [10000]
+	bool timestamps; //!< whether the dump file contains timestamped records
+	double speed; //!< speed factor for replaying timestamped records [1]
+	bool maxSpeed; //!< whether to write as fast as possible
+	unsigned int batch; //!< maximum number of bytes to write at once [4096]
 
 	const char* dumpFile; //!< dump file to read
 };
@@ -45,6 +54,10 @@ struct options
 static struct options opt = {
 	"/dev/ttyUSB60", // device
 	10000, // time
+	false, // timestamps
+	1.0, // speed
+	false, // maxSpeed
+	4096, // batch
 
 	"/tmp/ebus_dump.bin", // dumpFile
 };
@@ -61,6 +74,10 @@ static const char argpdoc[] =
 	"\v"
 	"With no DUMPFILE, /tmp/ebus_dump.bin is used.\n"
 	"\n"
+	"A dump written with '" PACKAGE " --dumptimestamps' is replayed with its original\n"
+	"timing when using '--timestamps' (optionally accelerated with '--speed'), while\n"
+	"'--max' writes the data in large batches as fast as the device accepts it.\n"
+	"\n"
 	"Example for setting up two pseudo terminals with 'socat':\n"
 	"  1. 'socat -d -d pty,raw,echo=0 pty,raw,echo=0'\n"
 	"  2. create symbol links to appropriate devices, e.g.\n"
@@ -76,6 +93,10 @@ static char argpargsdoc[] = "[DUMPFILE]";
 static const struct argp_option argpoptions[] = {
 	{"device", 'd', "DEV",  0, "Write to DEV (serial device) [/dev/ttyUSB60]", 0 },
 	{"time",   't', "USEC", 0, "Delay each byte by USEC us [10000]", 0 },
+	{"timestamps", 's', NULL, 0, "DUMPFILE contains timestamped records, replay them with their original timing", 0 },
+	{"speed",  'x', "FACTOR", 0, "Replay timestamped records FACTOR times faster than recorded [1]", 0 },
+	{"max",    'm', NULL,   0, "Write as fast as possible in large batches", 0 },
+	{"batch",  'b', "BYTES", 0, "Write at most BYTES bytes at once [4096]", 0 },
 
 	{NULL,       0, NULL,   0, NULL, 0 },
 };
@@ -106,6 +127,26 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 			return EINVAL;
 		}
 		break;
+	case 's': // --timestamps
+		opt->timestamps = true;
+		break;
+	case 'x': // --speed=1
+		opt->speed = strtod(arg, &strEnd);
+		if (strEnd == NULL || strEnd == arg || *strEnd != 0 || !(opt->speed >= 0.001 && opt->speed <= 1000000)) {
+			argp_error(state, "invalid speed");
+			return EINVAL;
+		}
+		break;
+	case 'm': // --max
+		opt->maxSpeed = true;
+		break;
+	case 'b': // --batch=4096
+		opt->batch = (unsigned int)strtoul(arg, &strEnd, 10);
+		if (strEnd == NULL || strEnd == arg || *strEnd != 0 || opt->batch < 1 || opt->batch > 1048576) {
+			argp_error(state, "invalid batch");
+			return EINVAL;
+		}
+		break;
 	case ARGP_KEY_ARG:
 		if (state->arg_num == 0) {
 			if (arg == NULL || arg[0] == 0 || strcmp("/", arg) == 0) {
@@ -123,6 +164,100 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 }
 
 
+/**
+ * Wait until the specified point in time.
+ * @param deadline the monotonic time in microseconds to wait for.
+ * @return the current monotonic time in microseconds.
+ */
+static unsigned long long waitUntil(const unsigned long long deadline)
+{
+	unsigned long long now = clockGetMicros();
+	while (now < deadline) {
+		struct timespec delay;
+		delay.tv_sec = (time_t)((deadline - now) / 1000000);
+		delay.tv_nsec = (long)(((deadline - now) % 1000000) * 1000);
+		nanosleep(&delay, NULL);
+		now = clockGetMicros();
+	}
+	return now;
+}
+
+/**
+ * Replay the dump file content to the device in batches.
+ * @param device the @a Device to write to.
+ * @param file the opened dump file.
+ * @return the @a result_t code.
+ */
+static result_t replay(Device* device, fstream& file)
+{
+	char input[FEED_READ_SIZE];
+	vector<unsigned char> batch;
+	batch.reserve(opt.batch);
+	const size_t recordSize = opt.timestamps ? DUMP_RECORD_SIZE : 1;
+	size_t inputLen = 0, sent = 0;
+	unsigned long long first = 0, maxDelay = 0;
+	bool haveFirst = false;
+	const unsigned long long start = clockGetMicros();
+	result_t result = RESULT_OK;
+	while (result == RESULT_OK) {
+		file.read(input + inputLen, FEED_READ_SIZE - inputLen);
+		inputLen += (size_t)file.gcount();
+		if (inputLen == 0)
+			break;
+		size_t pos = 0;
+		for (; pos + recordSize <= inputLen; pos += recordSize) {
+			const unsigned char* record = (const unsigned char*)input + pos;
+			if (opt.timestamps && !opt.maxSpeed) {
+				unsigned long long time = 0;
+				for (int i = 0; i < 8; i++)
+					time |= (unsigned long long)record[i] << (8 * i);
+				if (!haveFirst) {
+					first = time;
+					haveFirst = true;
+				}
+				// absolute deadlines avoid accumulating the error of each sleep
+				unsigned long long deadline = start + (time > first ? (unsigned long long)((time - first) / opt.speed) : 0);
+				unsigned long long now = clockGetMicros();
+				if (deadline > now) {
+					if (!batch.empty()) {
+						result = device->send(batch.data(), batch.size());
+						sent += batch.size();
+						batch.clear();
+					}
+					now = waitUntil(deadline);
+				}
+				if (now - deadline > maxDelay)
+					maxDelay = now - deadline;
+			}
+			batch.push_back(record[recordSize-1]);
+			if (batch.size() >= opt.batch) {
+				result = device->send(batch.data(), batch.size());
+				sent += batch.size();
+				batch.clear();
+			}
+		}
+		if (pos < inputLen)
+			memmove(input, input + pos, inputLen - pos);
+		inputLen -= pos;
+		if (file.eof())
+			break;
+	}
+	if (result == RESULT_OK && !batch.empty()) {
+		result = device->send(batch.data(), batch.size());
+		sent += batch.size();
+	}
+	unsigned long long duration = clockGetMicros() - start;
+	cout << "sent " << sent << " bytes in " << (duration / 1000) << " ms";
+	if (duration > 0)
+		cout << " (" << (unsigned long long)(sent * 1000000.0 / duration) << " bytes/s)";
+	if (opt.timestamps && !opt.maxSpeed)
+		cout << ", max delay " << maxDelay << " us";
+	cout << endl;
+	if (result != RESULT_OK)
+		cout << "error sending: " << getResultCode(result) << endl;
+	return result;
+}
+
 int main(int argc, char* argv[])
 {
 	struct argp argp = { argpoptions, parse_opt, argpargsdoc, argpdoc, NULL, NULL, NULL };
@@ -146,7 +281,10 @@ int main(int argc, char* argv[])
 
 		fstream file(opt.dumpFile, ios::in | ios::binary);
 
-		if (file.is_open()) {
+		if (file.is_open() && (opt.timestamps || opt.maxSpeed)) {
+			replay(device.get(), file);
+			file.close();
+		} else if (file.is_open()) {
 
 			while (true) {
 				unsigned char byte = (unsigned char)file.get();